@@ -0,0 +1,256 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Measures the ac mpm on the request buffers of a http transaction (uri,
+ * method, user agent, host, raw host, headers, raw headers, cookie) with
+ * 16, 128 and 512 fast patterns per buffer:
+ *
+ *  - separate: one mpm ctx per buffer, each buffer is scanned with the
+ *              patterns of its own buffer only
+ *  - combined: one mpm ctx holding the patterns of all buffers, each
+ *              buffer is scanned with it and the matches are filtered on
+ *              the buffer of the pattern, like the unified http mpm did
+ *
+ * The matcher is built into the benchmark, so the few engine functions it
+ * needs are stubbed.
+ *
+ * Build from a configured tree:
+ *
+ *   gcc -O2 -DHAVE_CONFIG_H -I.. -I../src -I../libhtp \
+ *       -ffunction-sections -Wl,--gc-sections \
+ *       http-mpm.c -o http-mpm -lpthread
+ */
+
+#include "../src/util-mpm-ac.c"
+
+#define TXS         200000
+#define BUFFERS     8
+
+MpmTableElmt mpm_table[MPM_TABLE_SIZE];
+SC_ATOMIC_DECLARE(unsigned int, engine_stage);
+SCLogLevel sc_log_global_log_level = SC_LOG_NOTSET;
+
+int SCLogDebugEnabled(void)
+{
+    return 0;
+}
+
+SCError SCLogMessage(SCLogLevel log_level, char **msg, const char *file,
+                     unsigned line, const char *function)
+{
+    return SC_OK;
+}
+
+void SCLogOutputBuffer(SCLogLevel log_level, char *msg)
+{
+}
+
+const char *SCErrorToString(SCError err)
+{
+    return "";
+}
+
+int RunmodeIsUnittests(void)
+{
+    return 0;
+}
+
+int ConfGet(char *name, char **vptr)
+{
+    return 0;
+}
+
+void MpmInitCtx(MpmCtx *mpm_ctx, uint16_t matcher, int module_handle)
+{
+    mpm_ctx->mpm_type = matcher;
+    mpm_table[matcher].InitCtx(mpm_ctx, module_handle);
+}
+
+int MpmVerifyMatch(MpmThreadCtx *thread_ctx, PatternMatcherQueue *pmq,
+                   uint32_t patid)
+{
+    if (!(pmq->pattern_id_bitarray[(patid / 8)] & (1 << (patid % 8)))) {
+        pmq->pattern_id_bitarray[(patid / 8)] |= (1 << (patid % 8));
+        pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = patid;
+    }
+    return 1;
+}
+
+static inline uint64_t Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *buffers[BUFFERS] = {
+    "/cgi-bin/search.php?q=suricata+ids&lang=en&page=2&session=8a7f6e5d4c3b2a19",
+    "GET",
+    "Mozilla/5.0 (X11; Linux x86_64; rv:24.0) Gecko/20100101 Firefox/24.0",
+    "www.example.com",
+    "www.Example.com:80",
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:24.0) Gecko/20100101 Firefox/24.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Connection: keep-alive\r\n",
+    "Host: www.Example.com:80\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:24.0) Gecko/20100101 Firefox/24.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Cookie: PHPSESSID=8a7f6e5d4c3b2a19; theme=dark; consent=yes\r\n"
+    "Connection: keep-alive\r\n\r\n",
+    "PHPSESSID=8a7f6e5d4c3b2a19; theme=dark; consent=yes",
+};
+
+/** pseudo random pattern of 4 to 12 bytes, every 8th one is taken from
+ *  the buffer itself so there are matches to filter */
+static uint16_t MakePattern(uint8_t *pat, const char *buf, uint32_t i)
+{
+    static uint32_t seed = 1;
+    uint16_t len = 4 + (i % 9);
+    uint16_t u;
+
+    if ((i % 8) == 0 && strlen(buf) > len) {
+        memcpy(pat, buf + (i * 7) % (strlen(buf) - len), len);
+        return len;
+    }
+    for (u = 0; u < len; u++) {
+        seed = seed * 1103515245 + 12345;
+        pat[u] = "abcdefghijklmnopqrstuvwxyz0123456789/.=&;:- "[(seed >> 16) % 44];
+    }
+    return len;
+}
+
+static MpmCtx *CtxNew(void)
+{
+    MpmCtx *ctx = calloc(1, sizeof(MpmCtx));
+    if (ctx == NULL)
+        exit(EXIT_FAILURE);
+    MpmInitCtx(ctx, MPM_AC, -1);
+    return ctx;
+}
+
+static double Run(int combined, uint32_t pats)
+{
+    MpmCtx *ctx[BUFFERS];
+    MpmThreadCtx mtc[BUFFERS];
+    uint8_t *sm_list = calloc(1, BUFFERS * pats);
+    PatternMatcherQueue pmq, tmp_pmq;
+    uint32_t ids = BUFFERS * pats;
+    uint32_t b, i, n, cnt = 0;
+    uint8_t pat[16];
+
+    memset(&pmq, 0x00, sizeof(pmq));
+    pmq.pattern_id_array = calloc(ids, sizeof(uint32_t));
+    pmq.pattern_id_bitarray = calloc(ids / 8 + 1, 1);
+    tmp_pmq = pmq;
+    tmp_pmq.pattern_id_array = calloc(ids, sizeof(uint32_t));
+    tmp_pmq.pattern_id_bitarray = calloc(ids / 8 + 1, 1);
+    if (sm_list == NULL || pmq.pattern_id_array == NULL ||
+        pmq.pattern_id_bitarray == NULL || tmp_pmq.pattern_id_array == NULL ||
+        tmp_pmq.pattern_id_bitarray == NULL)
+        exit(EXIT_FAILURE);
+
+    for (b = 0; b < BUFFERS; b++) {
+        ctx[b] = (combined && b > 0) ? ctx[0] : CtxNew();
+        for (i = 0; i < pats; i++) {
+            uint32_t id = b * pats + i;
+            uint16_t len = MakePattern(pat, buffers[b], i);
+            sm_list[id] = b;
+            if (i % 2)
+                SCACAddPatternCI(ctx[b], pat, len, 0, 0, id, id, 0);
+            else
+                SCACAddPatternCS(ctx[b], pat, len, 0, 0, id, id, 0);
+        }
+    }
+    for (b = 0; b < (combined ? 1 : BUFFERS); b++) {
+        SCACPreparePatterns(ctx[b]);
+        SCACInitThreadCtx(ctx[b], &mtc[b], 0);
+    }
+
+    uint64_t start = Now();
+    for (n = 0; n < TXS; n++) {
+        for (b = 0; b < BUFFERS; b++) {
+            uint8_t *buf = (uint8_t *)buffers[b];
+            uint32_t buflen = strlen(buffers[b]);
+
+            if (!combined) {
+                SCACSearchLarge(ctx[b], &mtc[b], &pmq, buf, buflen);
+                continue;
+            }
+
+            SCACSearchLarge(ctx[0], &mtc[0], &tmp_pmq, buf, buflen);
+            for (i = 0; i < tmp_pmq.pattern_id_array_cnt; i++) {
+                uint32_t id = tmp_pmq.pattern_id_array[i];
+                tmp_pmq.pattern_id_bitarray[id / 8] &= ~(1 << (id % 8));
+                if (sm_list[id] == b)
+                    MpmVerifyMatch(&mtc[0], &pmq, id);
+            }
+            tmp_pmq.pattern_id_array_cnt = 0;
+        }
+
+        cnt += pmq.pattern_id_array_cnt;
+        for (i = 0; i < pmq.pattern_id_array_cnt; i++) {
+            uint32_t id = pmq.pattern_id_array[i];
+            pmq.pattern_id_bitarray[id / 8] &= ~(1 << (id % 8));
+        }
+        pmq.pattern_id_array_cnt = 0;
+    }
+    uint64_t elapsed = Now() - start;
+
+    if (cnt == 0) {
+        printf("no matches\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (b = 0; b < (combined ? 1 : BUFFERS); b++) {
+        SCACDestroyThreadCtx(ctx[b], &mtc[b]);
+        SCACDestroyCtx(ctx[b]);
+        free(ctx[b]);
+    }
+    free(pmq.pattern_id_array);
+    free(pmq.pattern_id_bitarray);
+    free(tmp_pmq.pattern_id_array);
+    free(tmp_pmq.pattern_id_bitarray);
+    free(sm_list);
+    return (double)elapsed / TXS;
+}
+
+int main(void)
+{
+    uint32_t pats[] = { 16, 128, 512 };
+    uint32_t p;
+
+    MpmACRegister();
+
+    printf("%8s %9s %9s   (ns per tx)\n", "patterns", "separate", "combined");
+    for (p = 0; p < sizeof(pats) / sizeof(pats[0]); p++) {
+        printf("%8u", pats[p]);
+        printf(" %9.1f", Run(0, pats[p]));
+        printf(" %9.1f\n", Run(1, pats[p]));
+    }
+
+    return EXIT_SUCCESS;
+}
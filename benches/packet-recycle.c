@@ -0,0 +1,145 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Measures the cost of getting a used Packet ready for the next packet:
+ *
+ *  - memset:  clearing the Packet and its payload buffer, like
+ *             PACKET_INITIALIZE used to do
+ *  - init:    PACKET_INITIALIZE, clearing the Packet and its header area
+ *  - recycle: PACKET_RECYCLE, resetting only the fields that were set
+ *
+ * for 64 and 1500 byte packets. The cost of filling the packet is measured
+ * separately and subtracted.
+ *
+ * Build from a configured tree:
+ *
+ *   gcc -O2 -DHAVE_CONFIG_H -I.. -I../src -I../libhtp \
+ *       packet-recycle.c -o packet-recycle -lpthread
+ */
+
+#include "suricata-common.h"
+#include "decode.h"
+#include "flow.h"
+#include "host.h"
+#include "util-profiling.h"
+
+#define ITERATIONS 10000000
+
+uint32_t default_packet_size = DEFAULT_PACKET_SIZE;
+
+/* the packets we recycle never have a flow or pktvars, so we don't need
+ * to link against the engine */
+void FlowDecrUsecnt(Flow *f)
+{
+    abort();
+}
+
+void PktVarFree(PktVar *pv)
+{
+    abort();
+}
+
+static uint8_t frame[1500];
+
+/** fill the packet like the decoder would */
+static inline void Fill(Packet *p, uint16_t size)
+{
+    memcpy(GET_PKT_DATA(p), frame, size);
+    SET_PKT_LEN(p, size);
+    p->ethh = (EthernetHdr *)GET_PKT_DATA(p);
+    p->ip4h = (IPV4Hdr *)(GET_PKT_DATA(p) + ETHERNET_HEADER_LEN);
+    p->tcph = (TCPHdr *)(GET_PKT_DATA(p) + ETHERNET_HEADER_LEN + IPV4_HEADER_LEN);
+    p->payload = GET_PKT_DATA(p) + ETHERNET_HEADER_LEN + IPV4_HEADER_LEN + TCP_HEADER_LEN;
+    p->payload_len = size - (ETHERNET_HEADER_LEN + IPV4_HEADER_LEN + TCP_HEADER_LEN);
+    p->proto = IPPROTO_TCP;
+    p->sp = 1024;
+    p->dp = 80;
+}
+
+static inline uint64_t Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum { MODE_FILL, MODE_MEMSET, MODE_INIT, MODE_RECYCLE };
+
+static double Run(Packet *p, uint16_t size, int mode)
+{
+    uint64_t i;
+    uint64_t start = Now();
+
+    for (i = 0; i < ITERATIONS; i++) {
+        Fill(p, size);
+
+        switch (mode) {
+            case MODE_MEMSET:
+                SCMutexDestroy(&p->tunnel_mutex);
+                memset(p, 0x00, SIZE_OF_PACKET);
+                SCMutexInit(&p->tunnel_mutex, NULL);
+                PACKET_RESET_CHECKSUMS(p);
+                p->pkt = ((uint8_t *)p) + sizeof(Packet);
+                break;
+            case MODE_INIT:
+                SCMutexDestroy(&p->tunnel_mutex);
+                PACKET_INITIALIZE(p);
+                break;
+            case MODE_RECYCLE:
+                PACKET_RECYCLE(p);
+                break;
+        }
+        /* keep the compiler from dropping the stores */
+        __asm__ __volatile__("" : : "r"(p) : "memory");
+    }
+
+    return (double)(Now() - start) / ITERATIONS;
+}
+
+int main(void)
+{
+    uint16_t sizes[] = { 64, 1500 };
+    uint16_t s;
+
+    memset(frame, 'A', sizeof(frame));
+
+    Packet *p = malloc(SIZE_OF_PACKET);
+    if (p == NULL)
+        return EXIT_FAILURE;
+    PACKET_INITIALIZE(p);
+
+    printf("sizeof(Packet) %"PRIuMAX", payload buffer %"PRIu32"\n",
+            (uintmax_t)sizeof(Packet), default_packet_size);
+    printf("%6s %10s %10s %10s   (ns per packet)\n",
+            "size", "memset", "init", "recycle");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double fill = Run(p, sizes[s], MODE_FILL);
+        double ms = Run(p, sizes[s], MODE_MEMSET) - fill;
+        double in = Run(p, sizes[s], MODE_INIT) - fill;
+        double rc = Run(p, sizes[s], MODE_RECYCLE) - fill;
+
+        printf("%6u %10.2f %10.2f %10.2f\n", sizes[s], ms, in, rc);
+    }
+
+    PACKET_CLEANUP(p);
+    free(p);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Measures StreamTcpReassembleInsertSegment for windows of 64, 1024 and
+ * 16384 segments of 100 bytes, delivered:
+ *
+ *  - inorder: in order
+ *  - swapped: every pair of segments swapped
+ *  - hole:    the first segment delivered last
+ *  - late:    every 8th segment held back and delivered after the rest
+ *  - retrans: in order, then all segments again
+ *  - overlap: in order, then retransmits covering two segments each
+ *
+ * The reassembly code is built into the benchmark and only segment
+ * insertion is called, so the few engine functions it needs are stubbed.
+ *
+ * Build from a configured tree:
+ *
+ *   gcc -O2 -DHAVE_CONFIG_H -I.. -I../src -I../libhtp \
+ *       -ffunction-sections -Wl,--gc-sections \
+ *       stream-reassembly.c -o stream-reassembly -lpthread
+ */
+
+#include "../src/stream-tcp-reassemble.c"
+
+#define SEG_SIZE    100
+#define ISN         1000
+
+/* segments for the splits made on overlap are taken from here */
+void *PoolGet(Pool *p)
+{
+    TcpSegment *seg = calloc(1, sizeof(TcpSegment));
+    if (seg == NULL)
+        return NULL;
+    seg->payload = malloc(4 * SEG_SIZE);
+    if (seg->payload == NULL) {
+        free(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+void PoolReturn(Pool *p, void *data)
+{
+    TcpSegment *seg = (TcpSegment *)data;
+    free(seg->payload);
+    free(seg);
+}
+
+void SCPerfCounterIncr(uint16_t id, SCPerfCounterArray *pca)
+{
+}
+
+int SCLogDebugEnabled(void)
+{
+    return 0;
+}
+
+int StreamTcpInlineMode(void)
+{
+    return 0;
+}
+
+int StreamTcpInlineSegmentCompare(TcpSegment *a, TcpSegment *b)
+{
+    return 0;
+}
+
+void StreamTcpInlineSegmentReplacePacket(Packet *p, TcpSegment *seg)
+{
+}
+
+void StreamTcpSetOSPolicy(TcpStream *stream, Packet *p)
+{
+    stream->os_policy = OS_POLICY_BSD;
+}
+
+static inline uint64_t Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum { PAT_INORDER, PAT_SWAPPED, PAT_HOLE, PAT_LATE, PAT_RETRANS,
+       PAT_OVERLAP, PAT_MAX };
+
+static const char *pat_names[PAT_MAX] = { "inorder", "swapped", "hole",
+                                          "late", "retrans", "overlap" };
+
+/** fill first[] and len[] with the first segment no and the length in
+ *  segments of each delivery. Returns the no of deliveries. */
+static uint32_t Pattern(int pat, uint32_t n, uint32_t *first, uint32_t *len)
+{
+    uint32_t i, c = 0;
+
+    for (i = 0; i < 3 * n; i++)
+        len[i] = 1;
+
+    switch (pat) {
+        case PAT_INORDER:
+            for (i = 0; i < n; i++)
+                first[c++] = i;
+            break;
+        case PAT_SWAPPED:
+            for (i = 0; i < n; i++)
+                first[c++] = i ^ 1;
+            break;
+        case PAT_HOLE:
+            for (i = 1; i < n; i++)
+                first[c++] = i;
+            first[c++] = 0;
+            break;
+        case PAT_LATE:
+            for (i = 0; i < n; i++)
+                if (i % 8 != 7)
+                    first[c++] = i;
+            for (i = 7; i < n; i += 8)
+                first[c++] = i;
+            break;
+        case PAT_RETRANS:
+            for (i = 0; i < 2 * n; i++)
+                first[c++] = i % n;
+            break;
+        case PAT_OVERLAP:
+            for (i = 0; i < n; i++)
+                first[c++] = i;
+            for (i = 0; i + 1 < n; i += 2) {
+                len[c] = 2;
+                first[c++] = i;
+            }
+            break;
+    }
+    return c;
+}
+
+static double Run(int pat, uint32_t n, Packet *p)
+{
+    uint32_t *first = malloc(3 * n * sizeof(uint32_t));
+    uint32_t *len = malloc(3 * n * sizeof(uint32_t));
+    TcpSegment **segs = malloc(3 * n * sizeof(TcpSegment *));
+    uint64_t elapsed = 0;
+    uint32_t total = 0;
+    uint32_t i, c, round;
+    TcpStream stream;
+
+    if (first == NULL || len == NULL || segs == NULL)
+        exit(EXIT_FAILURE);
+
+    /* repeat the small windows so all sizes insert about the same no of
+     * segments */
+    for (round = 0; round < (1 << 18) / n; round++) {
+        memset(&stream, 0x00, sizeof(stream));
+        stream.isn = ISN;
+        stream.os_policy = OS_POLICY_BSD;
+        STREAMTCP_SET_RA_BASE_SEQ(&stream, ISN);
+
+        c = Pattern(pat, n, first, len);
+        for (i = 0; i < c; i++) {
+            segs[i] = PoolGet(NULL);
+            if (segs[i] == NULL)
+                exit(EXIT_FAILURE);
+            segs[i]->seq = ISN + 1 + first[i] * SEG_SIZE;
+            segs[i]->payload_len = len[i] * SEG_SIZE;
+            memset(segs[i]->payload, 'A' + (first[i] % 26), segs[i]->payload_len);
+        }
+
+        uint64_t start = Now();
+        for (i = 0; i < c; i++) {
+            p->tcph->th_seq = htonl(segs[i]->seq);
+            p->payload = segs[i]->payload;
+            p->payload_len = segs[i]->payload_len;
+            StreamTcpReassembleInsertSegment(NULL, NULL, &stream, segs[i], p);
+        }
+        elapsed += Now() - start;
+        total += c;
+
+        StreamTcpReturnStreamSegments(&stream);
+    }
+
+    free(first);
+    free(len);
+    free(segs);
+    return (double)elapsed / total;
+}
+
+int main(void)
+{
+    uint32_t sizes[] = { 64, 1024, 16384 };
+    uint32_t s;
+    int pat;
+    TCPHdr tcph;
+
+    Packet *p = calloc(1, SIZE_OF_PACKET);
+    if (p == NULL)
+        return EXIT_FAILURE;
+    memset(&tcph, 0x00, sizeof(tcph));
+    p->tcph = &tcph;
+
+    printf("%8s", "segments");
+    for (pat = 0; pat < PAT_MAX; pat++)
+        printf(" %9s", pat_names[pat]);
+    printf("   (ns per segment)\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf("%8u", sizes[s]);
+        for (pat = 0; pat < PAT_MAX; pat++)
+            printf(" %9.1f", Run(pat, sizes[s], p));
+        printf("\n");
+    }
+
+    free(p);
+    return EXIT_SUCCESS;
+}
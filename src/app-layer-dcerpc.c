@@ -1081,10 +1081,59 @@ static uint32_t DCERPCParseREQUEST(DCERPC *dcerpc, uint8_t *input, uint32_t inpu
     SCReturnUInt((uint32_t)(p - input));
 }
 
+/**
+ * \brief Append stub data to a stub data buffer.
+ *
+ * The buffer is kept for the lifetime of the state and reused for the next
+ * PDU, so it is only reallocated when a stub doesn't fit.  It grows by
+ * doubling, starting at DCERPC_STUB_BUFFER_MIN, up to DCERPC_STUB_BUFFER_MAX.
+ *
+ * \param buf      Pointer to the buffer.
+ * \param buf_len  Pointer to the length of the data in the buffer.
+ * \param buf_size Pointer to the allocated size of the buffer.
+ * \param data     Stub data to append.
+ * \param data_len Length of the stub data.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure, the stub would exceed the max size or we are out
+ *            of memory.  The buffer is left as it was.
+ */
+int DCERPCStubDataAppend(uint8_t **buf, uint32_t *buf_len, uint32_t *buf_size,
+                         uint8_t *data, uint32_t data_len)
+{
+    if (*buf_len > DCERPC_STUB_BUFFER_MAX ||
+        data_len > DCERPC_STUB_BUFFER_MAX - *buf_len) {
+        SCLogDebug("stub of %"PRIu32" + %"PRIu32" bytes exceeds the max of "
+                   "%u", *buf_len, data_len, DCERPC_STUB_BUFFER_MAX);
+        return -1;
+    }
+
+    if (*buf_len + data_len > *buf_size) {
+        uint32_t size = (*buf_size > 0) ? *buf_size : DCERPC_STUB_BUFFER_MIN;
+        while (size < *buf_len + data_len)
+            size *= 2;
+        if (size > DCERPC_STUB_BUFFER_MAX)
+            size = DCERPC_STUB_BUFFER_MAX;
+
+        uint8_t *ptr = SCRealloc(*buf, size);
+        if (ptr == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            return -1;
+        }
+        *buf = ptr;
+        *buf_size = size;
+    }
+
+    memcpy(*buf + *buf_len, data, data_len);
+    *buf_len += data_len;
+    return 0;
+}
+
 static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_len) {
     SCEnter();
     uint8_t **stub_data_buffer = NULL;
     uint32_t *stub_data_buffer_len = NULL;
+    uint32_t *stub_data_buffer_size = NULL;
     uint8_t *stub_data_fresh = NULL;
     uint16_t stub_len = 0;
 
@@ -1092,12 +1141,14 @@ static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_le
     if (dcerpc->dcerpchdr.type == REQUEST) {
         stub_data_buffer = &dcerpc->dcerpcrequest.stub_data_buffer;
         stub_data_buffer_len = &dcerpc->dcerpcrequest.stub_data_buffer_len;
+        stub_data_buffer_size = &dcerpc->dcerpcrequest.stub_data_buffer_size;
         stub_data_fresh = &dcerpc->dcerpcrequest.stub_data_fresh;
 
     /* response PDU.  Retrieve the response stub buffer */
     } else {
         stub_data_buffer = &dcerpc->dcerpcresponse.stub_data_buffer;
         stub_data_buffer_len = &dcerpc->dcerpcresponse.stub_data_buffer_len;
+        stub_data_buffer_size = &dcerpc->dcerpcresponse.stub_data_buffer_size;
         stub_data_fresh = &dcerpc->dcerpcresponse.stub_data_fresh;
     }
 
@@ -1133,16 +1184,12 @@ static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_le
         dcerpc->pdu_fragged = 1;
     }
 
-    *stub_data_buffer = SCRealloc(*stub_data_buffer, *stub_data_buffer_len + stub_len);
-    if (*stub_data_buffer == NULL) {
-        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
-        goto end;
+    /* if the stub doesn't fit anymore we still consume it, but the
+     * buffer isn't updated for inspection */
+    if (DCERPCStubDataAppend(stub_data_buffer, stub_data_buffer_len,
+                             stub_data_buffer_size, input, stub_len) == 0) {
+        *stub_data_fresh = 1;
     }
-    memcpy(*stub_data_buffer + *stub_data_buffer_len, input, stub_len);
-
-    *stub_data_fresh = 1;
-    /* length of the buffered stub */
-    *stub_data_buffer_len += stub_len;
     /* To see the total reassembled stubdata */
     //hexdump(*stub_data_buffer, *stub_data_buffer_len);
 
@@ -1158,7 +1205,6 @@ static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_le
     }
 #endif
 
-end:
     SCReturnUInt((uint32_t)stub_len);
 }
 
@@ -1853,11 +1899,13 @@ static void DCERPCStateFree(void *s) {
         SCFree(sstate->dcerpc.dcerpcrequest.stub_data_buffer);
         sstate->dcerpc.dcerpcrequest.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcrequest.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcrequest.stub_data_buffer_size = 0;
     }
     if (sstate->dcerpc.dcerpcresponse.stub_data_buffer != NULL) {
         SCFree(sstate->dcerpc.dcerpcresponse.stub_data_buffer);
         sstate->dcerpc.dcerpcresponse.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcresponse.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcresponse.stub_data_buffer_size = 0;
     }
 
     if (s) {
@@ -6018,6 +6066,54 @@ end:
     return result;
 }
 
+/**
+ * \test Test that the stub data buffer doesn't grow past its max size and
+ *       that a stub that doesn't fit leaves the buffer as it was.
+ */
+int DCERPCParserTest20(void)
+{
+    int result = 0;
+    uint8_t *buf = NULL;
+    uint32_t buf_len = 0;
+    uint32_t buf_size = 0;
+    uint8_t data[1024];
+
+    memset(data, 'a', sizeof(data));
+
+    while (buf_len < DCERPC_STUB_BUFFER_MAX) {
+        if (DCERPCStubDataAppend(&buf, &buf_len, &buf_size, data,
+                                 sizeof(data)) != 0) {
+            printf("append failed at %"PRIu32" bytes: ", buf_len);
+            goto end;
+        }
+    }
+    if (buf_len != DCERPC_STUB_BUFFER_MAX ||
+        buf_size != DCERPC_STUB_BUFFER_MAX) {
+        printf("buf_len %"PRIu32", buf_size %"PRIu32": ", buf_len, buf_size);
+        goto end;
+    }
+
+    if (DCERPCStubDataAppend(&buf, &buf_len, &buf_size, data, 1) != -1 ||
+        buf_len != DCERPC_STUB_BUFFER_MAX) {
+        printf("append over the max size didn't fail: ");
+        goto end;
+    }
+
+    /* a length that would wrap the size */
+    buf_len = 16;
+    if (DCERPCStubDataAppend(&buf, &buf_len, &buf_size, data,
+                             UINT32_MAX - 8) != -1 || buf_len != 16) {
+        printf("append of a wrapping length didn't fail: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (buf != NULL)
+        SCFree(buf);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DCERPCParserRegisterTests(void) {
@@ -6041,6 +6137,7 @@ void DCERPCParserRegisterTests(void) {
     UtRegisterTest("DCERPCParserTest17", DCERPCParserTest17, 1);
     UtRegisterTest("DCERPCParserTest18", DCERPCParserTest18, 1);
     UtRegisterTest("DCERPCParserTest19", DCERPCParserTest19, 1);
+    UtRegisterTest("DCERPCParserTest20", DCERPCParserTest20, 1);
 #endif /* UNITTESTS */
 
     return;
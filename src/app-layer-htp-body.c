@@ -62,10 +62,99 @@
 #include "conf.h"
 
 #include "util-memcmp.h"
+#include "util-misc.h"
+
+/** default size of the blocks body chunks are stored in, bigger chunks get
+ *  a block of their own */
+#define HTP_BODY_BLOCK_SIZE     4096
+
+/** chunk headers and data are kept 8 byte aligned in the blocks */
+#define HTP_BODY_ALIGN(x)       (((x) + 7) & ~7)
+
+#define HTP_BODY_BLOCK_DATA(blk) ((uint8_t *)(blk) + HTP_BODY_ALIGN(sizeof(HtpBodyBlock)))
+
+/** memory used by the body blocks of all bodies */
+SC_ATOMIC_DECLARE(uint64_t, htp_body_memuse);
+/** max memory the body blocks can use, 0 for no limit */
+static uint64_t htp_body_memcap = 0;
+
+/**
+ * \brief Set up the body memory accounting and read the memcap from the
+ *        config (libhtp.body-memcap).
+ */
+void HtpBodyMemcapInit(void)
+{
+    char *str = NULL;
+
+    SC_ATOMIC_INIT(htp_body_memuse);
+
+    htp_body_memcap = 0;
+    if (ConfGet("libhtp.body-memcap", &str) == 1) {
+        if (ParseSizeStringU64(str, &htp_body_memcap) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "Error parsing libhtp.body-memcap "
+                    "from conf file - %s. Killing engine", str);
+            exit(EXIT_FAILURE);
+        }
+    }
+    SCLogDebug("htp_body_memcap %"PRIu64, htp_body_memcap);
+}
+
+/**
+ * \brief Get the memory in use by the body blocks of all bodies.
+ */
+uint64_t HtpBodyMemuseGet(void)
+{
+    return SC_ATOMIC_GET(htp_body_memuse);
+}
+
+/**
+ * \brief Check if size more bytes of body memory fit in the memcap.
+ *
+ * \retval 1 it fits
+ * \retval 0 the memcap would be exceeded
+ */
+static int HtpBodyCheckMemcap(uint32_t size)
+{
+    if (htp_body_memcap > 0 &&
+            SC_ATOMIC_GET(htp_body_memuse) + size > htp_body_memcap) {
+        SCLogDebug("body memcap of %"PRIu64" reached", htp_body_memcap);
+        return 0;
+    }
+    return 1;
+}
+
+static HtpBodyBlock *HtpBodyBlockAlloc(uint32_t size)
+{
+    uint32_t total = HTP_BODY_ALIGN(sizeof(HtpBodyBlock)) + size;
+
+    if (!HtpBodyCheckMemcap(total))
+        return NULL;
+
+    HtpBodyBlock *blk = SCMalloc(total);
+    if (blk == NULL)
+        return NULL;
+
+    (void) SC_ATOMIC_ADD(htp_body_memuse, total);
+
+    blk->next = NULL;
+    blk->size = size;
+    blk->used = 0;
+    return blk;
+}
+
+static void HtpBodyBlockFree(HtpBodyBlock *blk)
+{
+    (void) SC_ATOMIC_SUB(htp_body_memuse,
+            HTP_BODY_ALIGN(sizeof(HtpBodyBlock)) + blk->size);
+    SCFree(blk);
+}
 
 /**
  * \brief Append a chunk of body to the HtpBody struct
  *
+ * The chunk and a copy of its data are stored in the body's blocks, so
+ * a new allocation is only needed when the current block is full.
+ *
  * \param body pointer to the HtpBody holding the list
  * \param data pointer to the data of the chunk
  * \param len length of the chunk pointed by data
@@ -77,63 +166,48 @@ int HtpBodyAppendChunk(HtpTxUserData *htud, HtpBody *body, uint8_t *data, uint32
 {
     SCEnter();
 
+    HtpBodyBlock *blk = NULL;
     HtpBodyChunk *bd = NULL;
 
     if (len == 0 || data == NULL) {
         SCReturnInt(0);
     }
 
-    if (body->first == NULL) {
-        /* New chunk */
-        bd = (HtpBodyChunk *)SCMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
-
-        bd->len = len;
-        bd->stream_offset = 0;
-        bd->next = NULL;
-
-        bd->data = SCMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
-        }
-        memcpy(bd->data, data, len);
+    uint32_t need = HTP_BODY_ALIGN(sizeof(HtpBodyChunk)) + HTP_BODY_ALIGN(len);
 
-        body->first = body->last = bd;
-
-        body->content_len_so_far = len;
-    } else {
-        bd = (HtpBodyChunk *)SCMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
-
-        bd->len = len;
-        bd->stream_offset = body->content_len_so_far;
-        bd->next = NULL;
+    blk = body->last_block;
+    if (blk == NULL || blk->size - blk->used < need) {
+        blk = HtpBodyBlockAlloc(need > HTP_BODY_BLOCK_SIZE ? need : HTP_BODY_BLOCK_SIZE);
+        if (blk == NULL)
+            SCReturnInt(-1);
 
-        bd->data = SCMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
+        if (body->last_block == NULL) {
+            body->first_block = blk;
+        } else {
+            body->last_block->next = blk;
         }
-        memcpy(bd->data, data, len);
+        body->last_block = blk;
+    }
+
+    bd = (HtpBodyChunk *)(HTP_BODY_BLOCK_DATA(blk) + blk->used);
+    bd->data = (uint8_t *)bd + HTP_BODY_ALIGN(sizeof(HtpBodyChunk));
+    bd->len = len;
+    bd->stream_offset = body->content_len_so_far;
+    bd->next = NULL;
+    memcpy(bd->data, data, len);
+    blk->used += need;
 
+    if (body->first == NULL) {
+        body->first = body->last = bd;
+    } else {
         body->last->next = bd;
         body->last = bd;
-
-        body->content_len_so_far += len;
     }
+    body->content_len_so_far += len;
+
     SCLogDebug("Body %p; data %p, len %"PRIu32, body, bd->data, (uint32_t)bd->len);
 
     SCReturnInt(0);
-
-error:
-    if (bd != NULL) {
-        if (bd->data != NULL) {
-            SCFree(bd->data);
-        }
-        SCFree(bd);
-    }
-    SCReturnInt(-1);
 }
 
 /**
@@ -161,6 +235,25 @@ void HtpBodyPrint(HtpBody *body)
     }
 }
 
+/**
+ * \brief Free the linear buffer of a body.
+ *
+ * The next HtpBodyLinearize starts a new buffer from the chunks that
+ * are left.
+ *
+ * \param body pointer to the HtpBody
+ */
+void HtpBodyLinearFree(HtpBody *body)
+{
+    if (body->linear != NULL) {
+        (void) SC_ATOMIC_SUB(htp_body_memuse, body->linear_size);
+        SCFree(body->linear);
+        body->linear = NULL;
+    }
+    body->linear_size = body->linear_len = 0;
+    body->linear_offset = 0;
+}
+
 /**
  * \brief Free the information held in the request body
  * \param body pointer to the HtpBody holding the list
@@ -170,24 +263,131 @@ void HtpBodyFree(HtpBody *body)
 {
     SCEnter();
 
-    if (body->first == NULL)
+    HtpBodyBlock *blk = body->first_block;
+    while (blk != NULL) {
+        HtpBodyBlock *next = blk->next;
+        HtpBodyBlockFree(blk);
+        blk = next;
+    }
+
+    body->first = body->last = NULL;
+    body->first_block = body->last_block = NULL;
+
+    HtpBodyLinearFree(body);
+}
+
+/**
+ * \internal
+ * \brief Drop the data of the pruned chunks from the linear buffer.
+ *
+ * Inspection never starts before the first chunk still in the list, so
+ * only the data from there on is kept. The buffer is freed when it's
+ * empty and shrunk when it uses less than a quarter of its size.
+ */
+static void HtpBodyLinearPrune(HtpBody *body)
+{
+    if (body->linear == NULL)
         return;
 
-    SCLogDebug("Removing chunks of Body %p; data %p, len %"PRIu32, body,
-            body->last->data, (uint32_t)body->last->len);
+    if (body->first == NULL) {
+        HtpBodyLinearFree(body);
+        return;
+    }
+
+    uint64_t keep_offset = body->first->stream_offset;
+    if (keep_offset > body->linear_offset) {
+        uint32_t drop = body->linear_len;
+        if (keep_offset - body->linear_offset < drop)
+            drop = (uint32_t)(keep_offset - body->linear_offset);
+
+        memmove(body->linear, body->linear + drop, body->linear_len - drop);
+        body->linear_len -= drop;
+        body->linear_offset += drop;
+    }
+
+    if (body->linear_len == 0) {
+        HtpBodyLinearFree(body);
+    } else if (body->linear_len < body->linear_size / 4) {
+        uint8_t *ptr = SCRealloc(body->linear, body->linear_len);
+        if (ptr != NULL) {
+            (void) SC_ATOMIC_SUB(htp_body_memuse,
+                    body->linear_size - body->linear_len);
+            body->linear = ptr;
+            body->linear_size = body->linear_len;
+        }
+    }
+}
+
+/**
+ * \brief Append the body chunks that are not in the linear buffer yet to it.
+ *
+ * Data before keep_offset is no longer needed by the caller, so it's
+ * dropped from the buffer when we need to make room.
+ *
+ * \param body pointer to the HtpBody
+ * \param keep_offset stream offset of the oldest data still needed
+ *
+ * \retval 0 ok
+ * \retval -1 error
+ */
+int HtpBodyLinearize(HtpBody *body, uint64_t keep_offset)
+{
+    SCEnter();
 
     HtpBodyChunk *cur = NULL;
-    HtpBodyChunk *prev = NULL;
 
-    prev = body->first;
-    while (prev != NULL) {
-        cur = prev->next;
-        if (prev->data != NULL)
-            SCFree(prev->data);
-        SCFree(prev);
-        prev = cur;
+    for (cur = body->first; cur != NULL; cur = cur->next) {
+        uint64_t end = body->linear_offset + body->linear_len;
+        uint8_t *data = cur->data;
+        uint32_t len = cur->len;
+
+        if (cur->stream_offset + cur->len <= end)
+            continue;
+
+        if (cur->stream_offset > end) {
+            /* chunks were pruned before we saw them, start over */
+            body->linear_offset = cur->stream_offset;
+            body->linear_len = 0;
+        } else {
+            data += (end - cur->stream_offset);
+            len -= (uint32_t)(end - cur->stream_offset);
+        }
+
+        if (body->linear_len + len > body->linear_size) {
+            /* make room by dropping what we no longer need */
+            if (keep_offset > body->linear_offset) {
+                uint32_t drop = body->linear_len;
+                if (keep_offset - body->linear_offset < drop)
+                    drop = (uint32_t)(keep_offset - body->linear_offset);
+
+                memmove(body->linear, body->linear + drop, body->linear_len - drop);
+                body->linear_len -= drop;
+                body->linear_offset += drop;
+            }
+        }
+
+        if (body->linear_len + len > body->linear_size) {
+            uint32_t size = body->linear_size * 2;
+            if (size < body->linear_len + len)
+                size = body->linear_len + len;
+
+            if (!HtpBodyCheckMemcap(size - body->linear_size))
+                SCReturnInt(-1);
+
+            uint8_t *ptr = SCRealloc(body->linear, size);
+            if (ptr == NULL)
+                SCReturnInt(-1);
+
+            (void) SC_ATOMIC_ADD(htp_body_memuse, size - body->linear_size);
+            body->linear = ptr;
+            body->linear_size = size;
+        }
+
+        memcpy(body->linear + body->linear_len, data, len);
+        body->linear_len += len;
     }
-    body->first = body->last = NULL;
+
+    SCReturnInt(0);
 }
 
 /**
@@ -201,7 +401,12 @@ void HtpBodyPrune(HtpBody *body)
 {
     SCEnter();
 
-    if (body == NULL || body->first == NULL) {
+    if (body == NULL) {
+        SCReturn;
+    }
+
+    if (body->first == NULL) {
+        HtpBodyLinearPrune(body);
         SCReturn;
     }
 
@@ -229,13 +434,35 @@ void HtpBodyPrune(HtpBody *body)
             body->last = next;
         }
 
-        if (cur->data != NULL) {
-            SCFree(cur->data);
+        cur = next;
+    }
+
+    /* release the blocks in front of the one holding the first chunk
+     * still in use. Chunks are stored in order, so those blocks only
+     * hold pruned chunks. */
+    HtpBodyBlock *blk = body->first_block;
+    while (blk != NULL) {
+        if (body->first != NULL &&
+                (uint8_t *)body->first >= HTP_BODY_BLOCK_DATA(blk) &&
+                (uint8_t *)body->first < HTP_BODY_BLOCK_DATA(blk) + blk->size) {
+            break;
+        }
+
+        /* keep an emptied default size block to append to */
+        if (blk == body->last_block && blk->size == HTP_BODY_BLOCK_SIZE) {
+            blk->used = 0;
+            break;
         }
-        SCFree(cur);
 
-        cur = next;
+        body->first_block = blk->next;
+        if (body->last_block == blk) {
+            body->last_block = NULL;
+        }
+        HtpBodyBlockFree(blk);
+        blk = body->first_block;
     }
 
+    HtpBodyLinearPrune(body);
+
     SCReturn;
 }
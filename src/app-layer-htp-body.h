@@ -32,5 +32,10 @@ int HtpBodyAppendChunk(HtpTxUserData *, HtpBody *, uint8_t *, uint32_t);
 void HtpBodyPrint(HtpBody *);
 void HtpBodyFree(HtpBody *);
 void HtpBodyPrune(HtpBody *);
+int HtpBodyLinearize(HtpBody *, uint64_t);
+void HtpBodyLinearFree(HtpBody *);
+
+void HtpBodyMemcapInit(void);
+uint64_t HtpBodyMemuseGet(void);
 
 #endif /* __APP_LAYER_HTP_BODY_H__ */
@@ -238,6 +238,36 @@ error:
     SCReturnPtr(NULL, "void");
 }
 
+/**
+ * \brief Get the user data of a tx, setting up empty user data if the tx
+ *        doesn't have any yet.
+ */
+static HtpTxUserData *HTPTxUserDataGet(htp_tx_t *tx)
+{
+    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
+    if (htud == NULL) {
+        htud = SCMalloc(sizeof(HtpTxUserData));
+        if (unlikely(htud == NULL))
+            return NULL;
+        memset(htud, 0, sizeof(HtpTxUserData));
+
+        htp_tx_set_user_data(tx, htud);
+    }
+    return htud;
+}
+
+static void HTPTxUserDataFree(htp_tx_t *tx, HtpTxUserData *htud)
+{
+    HtpBodyFree(&htud->request_body);
+    HtpBodyFree(&htud->response_body);
+    if (htud->request_headers != NULL)
+        SCFree(htud->request_headers);
+    if (htud->response_headers != NULL)
+        SCFree(htud->response_headers);
+    SCFree(htud);
+    htp_tx_set_user_data(tx, NULL);
+}
+
 /** \brief Function to frees the HTTP state memory and also frees the HTTP
  *         connection parser memory which was used by the HTP library
  */
@@ -265,10 +295,7 @@ void HTPStateFree(void *state)
                 if (tx != NULL) {
                     HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
                     if (htud != NULL) {
-                        HtpBodyFree(&htud->request_body);
-                        HtpBodyFree(&htud->response_body);
-                        SCFree(htud);
-                        htp_tx_set_user_data(tx, NULL);
+                        HTPTxUserDataFree(tx, htud);
                     }
                 }
             }
@@ -1782,13 +1809,11 @@ int HTPCallbackRequestBodyData(htp_tx_data_t *d)
     SCLogDebug("New request body data available at %p -> %p -> %p, bodylen "
                "%"PRIu32"", hstate, d, d->data, (uint32_t)d->len);
 
-    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(d->tx);
-    if (htud == NULL) {
-        htud = SCMalloc(sizeof(HtpTxUserData));
-        if (unlikely(htud == NULL)) {
-            SCReturnInt(HOOK_OK);
-        }
-        memset(htud, 0, sizeof(HtpTxUserData));
+    HtpTxUserData *htud = HTPTxUserDataGet(d->tx);
+    if (unlikely(htud == NULL)) {
+        SCReturnInt(HOOK_OK);
+    }
+    if (htud->operation == HTP_BODY_NONE) {
         htud->operation = HTP_BODY_REQUEST;
 
         if (d->tx->request_method_number == M_POST) {
@@ -1805,9 +1830,6 @@ int HTPCallbackRequestBodyData(htp_tx_data_t *d)
                 htud->request_body_type = HTP_BODY_REQUEST_PUT;
             }
         }
-
-        /* Set the user data for handling body chunks on this transaction */
-        htp_tx_set_user_data(d->tx, htud);
     }
 
     SCLogDebug("htud->request_body.content_len_so_far %"PRIu64, htud->request_body.content_len_so_far);
@@ -1899,21 +1921,16 @@ int HTPCallbackResponseBodyData(htp_tx_data_t *d)
     SCLogDebug("New response body data available at %p -> %p -> %p, bodylen "
                "%"PRIu32"", hstate, d, d->data, (uint32_t)d->len);
 
-    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(d->tx);
-    if (htud == NULL) {
-        htud = SCMalloc(sizeof(HtpTxUserData));
-        if (unlikely(htud == NULL)) {
-            SCReturnInt(HOOK_OK);
-        }
-        memset(htud, 0, sizeof(HtpTxUserData));
+    HtpTxUserData *htud = HTPTxUserDataGet(d->tx);
+    if (unlikely(htud == NULL)) {
+        SCReturnInt(HOOK_OK);
+    }
+    if (htud->operation == HTP_BODY_NONE) {
         htud->operation = HTP_BODY_RESPONSE;
 
         htp_header_t *cl = table_getc(d->tx->response_headers, "content-length");
         if (cl != NULL)
             htud->response_body.content_len = htp_parse_content_length(cl->value);
-
-        /* Set the user data for handling body chunks on this transaction */
-        htp_tx_set_user_data(d->tx, htud);
     }
 
     SCLogDebug("htud->response_body.content_len_so_far %"PRIu64, htud->response_body.content_len_so_far);
@@ -1988,6 +2005,249 @@ void HTPFreeConfig(void)
     SCReturn;
 }
 
+/**
+ * \brief Build the header buffer for http_header inspection, "name: value\r\n"
+ *        for each header except the cookie of the direction, and look up the
+ *        headers other keywords inspect. A buffer set up before is replaced,
+ *        so this is called again when chunked trailers add headers.
+ *
+ * \param htud user data of the tx to store the buffer in
+ * \param headers the request or response headers of the tx
+ * \param flags STREAM_TOSERVER or STREAM_TOCLIENT
+ */
+static void HTPTxUserDataSetHeaders(HtpTxUserData *htud, table_t *headers,
+                                    uint8_t flags)
+{
+    htp_header_t *h = NULL;
+    htp_header_t *cookie = NULL;
+    htp_header_t *ua = NULL;
+    uint8_t *buffer = NULL;
+    size_t size = 0;
+    size_t len = 0;
+
+    if (headers == NULL)
+        return;
+
+    /* first pass gets the size, so the buffer is allocated only once */
+    table_iterator_reset(headers);
+    while (table_iterator_next(headers, (void **)&h) != NULL) {
+        size_t name_len = bstr_size(h->name);
+
+        if (flags & STREAM_TOSERVER) {
+            if (name_len == 6 &&
+                SCMemcmpLowercase("cookie", bstr_ptr(h->name), 6) == 0) {
+                if (cookie == NULL)
+                    cookie = h;
+                continue;
+            }
+            if (ua == NULL && name_len == 10 &&
+                SCMemcmpLowercase("user-agent", bstr_ptr(h->name), 10) == 0) {
+                ua = h;
+            }
+        } else {
+            if (name_len == 10 &&
+                SCMemcmpLowercase("set-cookie", bstr_ptr(h->name), 10) == 0) {
+                if (cookie == NULL)
+                    cookie = h;
+                continue;
+            }
+        }
+
+        /* the extra 4 bytes are for ": " and "\r\n" */
+        size += name_len + bstr_size(h->value) + 4;
+    }
+
+    if (size > 0) {
+        buffer = SCMalloc(size);
+        if (unlikely(buffer == NULL))
+            return;
+
+        table_iterator_reset(headers);
+        while (table_iterator_next(headers, (void **)&h) != NULL) {
+            if (flags & STREAM_TOSERVER) {
+                if (bstr_size(h->name) == 6 &&
+                    SCMemcmpLowercase("cookie", bstr_ptr(h->name), 6) == 0)
+                    continue;
+            } else {
+                if (bstr_size(h->name) == 10 &&
+                    SCMemcmpLowercase("set-cookie", bstr_ptr(h->name), 10) == 0)
+                    continue;
+            }
+
+            memcpy(buffer + len, bstr_ptr(h->name), bstr_size(h->name));
+            len += bstr_size(h->name);
+            buffer[len++] = ':';
+            buffer[len++] = ' ';
+            memcpy(buffer + len, bstr_ptr(h->value), bstr_size(h->value));
+            len += bstr_size(h->value);
+            buffer[len++] = '\r';
+            buffer[len++] = '\n';
+        }
+    }
+
+    if (flags & STREAM_TOSERVER) {
+        if (htud->request_headers != NULL)
+            SCFree(htud->request_headers);
+        htud->request_headers = buffer;
+        htud->request_headers_len = len;
+        htud->request_cookie = cookie;
+        htud->request_user_agent = ua;
+        htud->tsflags |= HTP_HEADERS_SET;
+    } else {
+        if (htud->response_headers != NULL)
+            SCFree(htud->response_headers);
+        htud->response_headers = buffer;
+        htud->response_headers_len = len;
+        htud->response_cookie = cookie;
+        htud->tcflags |= HTP_HEADERS_SET;
+    }
+}
+
+/**
+ *  \brief  callback for the request headers, sets up the header buffers
+ *          for inspection now that the headers are complete
+ *  \param  connp   pointer to the current connection parser which has the htp
+ *                  state in it as user data
+ */
+static int HTPCallbackRequestHeaders(htp_connp_t *connp) {
+    SCEnter();
+
+    if (connp->in_tx == NULL)
+        SCReturnInt(HOOK_OK);
+
+    HtpTxUserData *htud = HTPTxUserDataGet(connp->in_tx);
+    if (unlikely(htud == NULL))
+        SCReturnInt(HOOK_OK);
+
+    if (!(htud->tsflags & HTP_HEADERS_SET)) {
+        HTPTxUserDataSetHeaders(htud, connp->in_tx->request_headers,
+                                STREAM_TOSERVER);
+    }
+    SCReturnInt(HOOK_OK);
+}
+
+/**
+ *  \brief  callback for the response headers, sets up the header buffers
+ *          for inspection now that the headers are complete
+ *  \param  connp   pointer to the current connection parser which has the htp
+ *                  state in it as user data
+ */
+static int HTPCallbackResponseHeaders(htp_connp_t *connp) {
+    SCEnter();
+
+    if (connp->out_tx == NULL)
+        SCReturnInt(HOOK_OK);
+
+    HtpTxUserData *htud = HTPTxUserDataGet(connp->out_tx);
+    if (unlikely(htud == NULL))
+        SCReturnInt(HOOK_OK);
+
+    if (!(htud->tcflags & HTP_HEADERS_SET)) {
+        HTPTxUserDataSetHeaders(htud, connp->out_tx->response_headers,
+                                STREAM_TOCLIENT);
+    }
+    SCReturnInt(HOOK_OK);
+}
+
+/**
+ *  \brief  callback for the request trailer, rebuilds the header buffers as
+ *          libhtp added the trailer headers to the request headers
+ *  \param  connp   pointer to the current connection parser which has the htp
+ *                  state in it as user data
+ */
+static int HTPCallbackRequestTrailer(htp_connp_t *connp) {
+    SCEnter();
+
+    if (connp->in_tx == NULL)
+        SCReturnInt(HOOK_OK);
+
+    HtpTxUserData *htud = HTPTxUserDataGet(connp->in_tx);
+    if (unlikely(htud == NULL))
+        SCReturnInt(HOOK_OK);
+
+    HTPTxUserDataSetHeaders(htud, connp->in_tx->request_headers,
+                            STREAM_TOSERVER);
+    SCReturnInt(HOOK_OK);
+}
+
+/**
+ *  \brief  callback for the response trailer, rebuilds the header buffers as
+ *          libhtp added the trailer headers to the response headers
+ *  \param  connp   pointer to the current connection parser which has the htp
+ *                  state in it as user data
+ */
+static int HTPCallbackResponseTrailer(htp_connp_t *connp) {
+    SCEnter();
+
+    if (connp->out_tx == NULL)
+        SCReturnInt(HOOK_OK);
+
+    HtpTxUserData *htud = HTPTxUserDataGet(connp->out_tx);
+    if (unlikely(htud == NULL))
+        SCReturnInt(HOOK_OK);
+
+    HTPTxUserDataSetHeaders(htud, connp->out_tx->response_headers,
+                            STREAM_TOCLIENT);
+    SCReturnInt(HOOK_OK);
+}
+
+/**
+ * \brief Get the http_header buffer of a tx for a direction.
+ *
+ * \retval 1 the buffer was set up, *buffer and *buffer_len are set
+ * \retval 0 the headers aren't complete yet
+ */
+int HTPTxGetHeaderBuffer(htp_tx_t *tx, uint8_t flags, uint8_t **buffer,
+                         uint32_t *buffer_len)
+{
+    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
+    if (htud == NULL)
+        return 0;
+
+    if (flags & STREAM_TOSERVER) {
+        if (!(htud->tsflags & HTP_HEADERS_SET))
+            return 0;
+        *buffer = htud->request_headers;
+        *buffer_len = htud->request_headers_len;
+    } else {
+        if (!(htud->tcflags & HTP_HEADERS_SET))
+            return 0;
+        *buffer = htud->response_headers;
+        *buffer_len = htud->response_headers_len;
+    }
+    return 1;
+}
+
+/**
+ * \brief Get the Cookie (to server) or Set-Cookie (to client) header of a tx.
+ */
+htp_header_t *HTPTxGetCookie(htp_tx_t *tx, uint8_t flags)
+{
+    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
+
+    if (flags & STREAM_TOSERVER) {
+        if (htud != NULL && (htud->tsflags & HTP_HEADERS_SET))
+            return htud->request_cookie;
+        return (htp_header_t *)table_getc(tx->request_headers, "Cookie");
+    } else {
+        if (htud != NULL && (htud->tcflags & HTP_HEADERS_SET))
+            return htud->response_cookie;
+        return (htp_header_t *)table_getc(tx->response_headers, "Set-Cookie");
+    }
+}
+
+/**
+ * \brief Get the User-Agent header of a tx.
+ */
+htp_header_t *HTPTxGetUserAgent(htp_tx_t *tx)
+{
+    HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
+
+    if (htud != NULL && (htud->tsflags & HTP_HEADERS_SET))
+        return htud->request_user_agent;
+    return (htp_header_t *)table_getc(tx->request_headers, "User-Agent");
+}
+
 /**
  *  \brief  callback for request to store the recent incoming request
             in to the recent_in_tx for the given htp state
@@ -2068,10 +2328,7 @@ static int HTPCallbackResponse(htp_connp_t *connp) {
         /* This will remove obsolete body chunks */
         HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
         if (htud != NULL) {
-            HtpBodyFree(&htud->request_body);
-            HtpBodyFree(&htud->response_body);
-            SCFree(htud);
-            htp_tx_set_user_data(tx, NULL);
+            HTPTxUserDataFree(tx, htud);
         }
 
         htp_tx_destroy(tx);
@@ -2093,6 +2350,10 @@ static void HTPConfigSetDefaults(HTPCfgRec *cfg_prec)
     cfg_prec->response_inspect_window = HTP_CONFIG_DEFAULT_RESPONSE_INSPECT_WINDOW;
     htp_config_register_request(cfg_prec->cfg, HTPCallbackRequest);
     htp_config_register_response(cfg_prec->cfg, HTPCallbackResponse);
+    htp_config_register_request_headers(cfg_prec->cfg, HTPCallbackRequestHeaders);
+    htp_config_register_response_headers(cfg_prec->cfg, HTPCallbackResponseHeaders);
+    htp_config_register_request_trailer(cfg_prec->cfg, HTPCallbackRequestTrailer);
+    htp_config_register_response_trailer(cfg_prec->cfg, HTPCallbackResponseTrailer);
 #ifdef HAVE_HTP_URI_NORMALIZE_HOOK
     htp_config_register_request_uri_normalize(cfg_prec->cfg, HTPCallbackRequestUriNormalizeQuery);
 #endif
@@ -2361,6 +2622,8 @@ static void HTPConfigure(void)
 
     cfglist.next = NULL;
 
+    HtpBodyMemcapInit();
+
     cfgtree = SCRadixCreateRadixTree(NULL, NULL);
     if (NULL == cfgtree)
         exit(EXIT_FAILURE);
@@ -3554,6 +3817,172 @@ end:
     return result;
 }
 
+/** \test Test the header buffer and header lookups set up when the
+ *        request headers are complete. */
+int HTPParserTest14(void) {
+    int result = 0;
+    Flow *f = NULL;
+    uint8_t httpbuf1[] = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+                         "Cookie: dummy\r\nUser-Agent: Victor/1.0\r\n\r\n";
+    uint32_t httplen1 = sizeof(httpbuf1) - 1; /* minus the \0 */
+    TcpSession ssn;
+    HtpState *htp_state =  NULL;
+    uint8_t *buffer = NULL;
+    uint32_t buffer_len = 0;
+    int r = 0;
+
+    memset(&ssn, 0, sizeof(ssn));
+
+    f = UTHBuildFlow(AF_INET, "1.2.3.4", "1.2.3.5", 1024, 80);
+    if (f == NULL)
+        goto end;
+    f->protoctx = &ssn;
+
+    StreamTcpInitConfig(TRUE);
+
+    r = AppLayerParse(NULL, f, ALPROTO_HTTP, STREAM_TOSERVER|STREAM_START,
+                      httpbuf1, httplen1);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    htp_state = f->alstate;
+    if (htp_state == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    htp_tx_t *tx = list_get(htp_state->connp->conn->transactions, 0);
+    if (tx == NULL) {
+        printf("no tx: ");
+        goto end;
+    }
+
+    if (HTPTxGetHeaderBuffer(tx, STREAM_TOSERVER, &buffer, &buffer_len) != 1) {
+        printf("no request header buffer: ");
+        goto end;
+    }
+    char expected[] = "Host: www.example.com\r\nUser-Agent: Victor/1.0\r\n";
+    if (buffer_len != strlen(expected) ||
+            memcmp(buffer, expected, buffer_len) != 0) {
+        printf("header buffer mismatch: ");
+        PrintRawDataFp(stdout, buffer, buffer_len);
+        goto end;
+    }
+
+    /* no response yet */
+    if (HTPTxGetHeaderBuffer(tx, STREAM_TOCLIENT, &buffer, &buffer_len) != 0) {
+        printf("response header buffer shouldn't be set up: ");
+        goto end;
+    }
+
+    htp_header_t *h = HTPTxGetCookie(tx, STREAM_TOSERVER);
+    if (h == NULL || bstr_cmpc(h->value, "dummy") != 0) {
+        printf("cookie lookup failed: ");
+        goto end;
+    }
+    h = HTPTxGetUserAgent(tx);
+    if (h == NULL || bstr_cmpc(h->value, "Victor/1.0") != 0) {
+        printf("user agent lookup failed: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    StreamTcpFreeConfig(TRUE);
+    if (htp_state != NULL)
+        HTPStateFree(htp_state);
+    UTHFreeFlow(f);
+    return result;
+}
+
+/** \test Test that the header buffer and header lookups are set up again
+ *        when a chunked request has trailer headers. */
+int HTPParserTest15(void) {
+    int result = 0;
+    Flow *f = NULL;
+    uint8_t httpbuf1[] = "POST / HTTP/1.1\r\nHost: www.example.com\r\n"
+                         "Transfer-Encoding: chunked\r\n\r\n"
+                         "3\r\nabc\r\n0\r\n";
+    uint32_t httplen1 = sizeof(httpbuf1) - 1; /* minus the \0 */
+    uint8_t httpbuf2[] = "User-Agent: Victor/1.0\r\n\r\n";
+    uint32_t httplen2 = sizeof(httpbuf2) - 1; /* minus the \0 */
+    TcpSession ssn;
+    HtpState *htp_state =  NULL;
+    uint8_t *buffer = NULL;
+    uint32_t buffer_len = 0;
+    int r = 0;
+
+    memset(&ssn, 0, sizeof(ssn));
+
+    f = UTHBuildFlow(AF_INET, "1.2.3.4", "1.2.3.5", 1024, 80);
+    if (f == NULL)
+        goto end;
+    f->protoctx = &ssn;
+
+    StreamTcpInitConfig(TRUE);
+
+    r = AppLayerParse(NULL, f, ALPROTO_HTTP, STREAM_TOSERVER|STREAM_START,
+                      httpbuf1, httplen1);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    htp_state = f->alstate;
+    if (htp_state == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    htp_tx_t *tx = list_get(htp_state->connp->conn->transactions, 0);
+    if (tx == NULL) {
+        printf("no tx: ");
+        goto end;
+    }
+
+    if (HTPTxGetUserAgent(tx) != NULL) {
+        printf("user agent found before the trailer: ");
+        goto end;
+    }
+
+    r = AppLayerParse(NULL, f, ALPROTO_HTTP, STREAM_TOSERVER, httpbuf2,
+                      httplen2);
+    if (r != 0) {
+        printf("toserver chunk 2 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    if (HTPTxGetHeaderBuffer(tx, STREAM_TOSERVER, &buffer, &buffer_len) != 1) {
+        printf("no request header buffer: ");
+        goto end;
+    }
+    char expected[] = "Host: www.example.com\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "User-Agent: Victor/1.0\r\n";
+    if (buffer_len != strlen(expected) ||
+            memcmp(buffer, expected, buffer_len) != 0) {
+        printf("header buffer mismatch: ");
+        PrintRawDataFp(stdout, buffer, buffer_len);
+        goto end;
+    }
+
+    htp_header_t *h = HTPTxGetUserAgent(tx);
+    if (h == NULL || bstr_cmpc(h->value, "Victor/1.0") != 0) {
+        printf("user agent lookup failed: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    StreamTcpFreeConfig(TRUE);
+    if (htp_state != NULL)
+        HTPStateFree(htp_state);
+    UTHFreeFlow(f);
+    return result;
+}
+
 /** \test Test basic config */
 int HTPParserConfigTest01(void)
 {
@@ -4710,6 +5139,148 @@ end:
     return result;
 }
 
+/** \test body chunks share blocks, pruned blocks are released and the
+ *        memory accounting goes back to where it started */
+static int HTPBodyArenaTest01(void)
+{
+    int result = 0;
+    HtpTxUserData htud;
+    memset(&htud, 0x00, sizeof(htud));
+    HtpBody *body = &htud.request_body;
+    uint8_t chunk[1000];
+    memset(chunk, 'A', sizeof(chunk));
+    uint64_t memuse = HtpBodyMemuseGet();
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        if (HtpBodyAppendChunk(&htud, body, chunk, sizeof(chunk)) != 0) {
+            printf("append %d failed: ", i);
+            goto end;
+        }
+    }
+    if (body->content_len_so_far != 10 * sizeof(chunk)) {
+        printf("content_len_so_far %"PRIu64": ", body->content_len_so_far);
+        goto end;
+    }
+    /* ~1k chunks, so a 4k block holds 3 of them */
+    if (body->first_block == NULL || body->first_block == body->last_block) {
+        printf("expected more than one block: ");
+        goto end;
+    }
+    if (body->last->stream_offset != 9 * sizeof(chunk) ||
+            memcmp(body->last->data, chunk, sizeof(chunk)) != 0) {
+        printf("last chunk wrong: ");
+        goto end;
+    }
+    if (HtpBodyMemuseGet() <= memuse) {
+        printf("memuse not updated: ");
+        goto end;
+    }
+
+    /* inspected everything but the last chunk */
+    body->body_parsed = body->body_inspected = 9 * sizeof(chunk);
+    HtpBodyPrune(body);
+    if (body->first != body->last || body->first_block != body->last_block) {
+        printf("expected one chunk in one block after prune: ");
+        goto end;
+    }
+
+    /* all inspected, the block is kept for reuse */
+    body->body_parsed = body->body_inspected = 10 * sizeof(chunk);
+    HtpBodyPrune(body);
+    if (body->first != NULL || body->last != NULL ||
+            body->last_block == NULL || body->last_block->used != 0) {
+        printf("expected an empty block after prune: ");
+        goto end;
+    }
+    if (HtpBodyAppendChunk(&htud, body, chunk, sizeof(chunk)) != 0 ||
+            body->first_block != body->last_block) {
+        printf("append after prune failed or didn't reuse the block: ");
+        goto end;
+    }
+
+    HtpBodyFree(body);
+    if (HtpBodyMemuseGet() != memuse) {
+        printf("memuse %"PRIu64", expected %"PRIu64": ", HtpBodyMemuseGet(), memuse);
+        goto end;
+    }
+
+    result = 1;
+end:
+    HtpBodyFree(body);
+    return result;
+}
+
+/** \test the linear body buffer is only appended to, keeps the data
+ *        that is still needed and is freed once the body is pruned */
+static int HTPBodyLinearizeTest01(void)
+{
+    int result = 0;
+    HtpTxUserData htud;
+    memset(&htud, 0x00, sizeof(htud));
+    HtpBody *body = &htud.request_body;
+    uint8_t chunk1[] = "abcdefgh";
+    uint8_t chunk2[] = "ijklmnop";
+    uint8_t chunk3[] = "qrstuvwx";
+    uint64_t memuse = HtpBodyMemuseGet();
+
+    if (HtpBodyAppendChunk(&htud, body, chunk1, 8) != 0 ||
+            HtpBodyAppendChunk(&htud, body, chunk2, 8) != 0)
+        goto end;
+
+    if (HtpBodyLinearize(body, 0) != 0)
+        goto end;
+    if (body->linear_offset != 0 || body->linear_len != 16 ||
+            memcmp(body->linear, "abcdefghijklmnop", 16) != 0) {
+        printf("linear buffer wrong after first linearize: ");
+        goto end;
+    }
+    uint8_t *linear = body->linear;
+
+    /* nothing new, nothing copied */
+    if (HtpBodyLinearize(body, 0) != 0 || body->linear_len != 16)
+        goto end;
+
+    /* inspected the first chunk, pruning it drops its data from the
+     * buffer, which makes room for the new chunk */
+    body->body_parsed = body->body_inspected = 8;
+    HtpBodyPrune(body);
+    if (body->linear != linear || body->linear_offset != 8 ||
+            body->linear_len != 8) {
+        printf("linear buffer wrong after prune: ");
+        goto end;
+    }
+    if (HtpBodyAppendChunk(&htud, body, chunk3, 8) != 0)
+        goto end;
+    if (HtpBodyLinearize(body, 8) != 0)
+        goto end;
+    if (body->linear != linear || body->linear_offset != 8 ||
+            body->linear_len != 16 ||
+            memcmp(body->linear, "ijklmnopqrstuvwx", 16) != 0) {
+        printf("linear buffer wrong after second linearize: ");
+        goto end;
+    }
+
+    /* all inspected and pruned, the buffer goes away */
+    body->body_parsed = body->body_inspected = 24;
+    HtpBodyPrune(body);
+    if (body->first != NULL || body->linear != NULL ||
+            body->linear_size != 0) {
+        printf("linear buffer not freed after prune: ");
+        goto end;
+    }
+    HtpBodyFree(body);
+    if (HtpBodyMemuseGet() != memuse) {
+        printf("memuse %"PRIu64", expected %"PRIu64": ", HtpBodyMemuseGet(), memuse);
+        goto end;
+    }
+
+    result = 1;
+end:
+    HtpBodyFree(body);
+    return result;
+}
+
 /** \test BG crash */
 static int HTPSegvTest01(void) {
     int result = 0;
@@ -4807,6 +5378,8 @@ void HTPParserRegisterTests(void) {
     UtRegisterTest("HTPParserTest11", HTPParserTest11, 1);
     UtRegisterTest("HTPParserTest12", HTPParserTest12, 1);
     UtRegisterTest("HTPParserTest13", HTPParserTest13, 1);
+    UtRegisterTest("HTPParserTest14", HTPParserTest14, 1);
+    UtRegisterTest("HTPParserTest15", HTPParserTest15, 1);
     UtRegisterTest("HTPParserConfigTest01", HTPParserConfigTest01, 1);
     UtRegisterTest("HTPParserConfigTest02", HTPParserConfigTest02, 1);
     UtRegisterTest("HTPParserConfigTest03", HTPParserConfigTest03, 1);
@@ -4819,6 +5392,8 @@ void HTPParserRegisterTests(void) {
     UtRegisterTest("HTPParserDecodingTest05", HTPParserDecodingTest05, 1);
 
     UtRegisterTest("HTPBodyReassemblyTest01", HTPBodyReassemblyTest01, 1);
+    UtRegisterTest("HTPBodyArenaTest01", HTPBodyArenaTest01, 1);
+    UtRegisterTest("HTPBodyLinearizeTest01", HTPBodyLinearizeTest01, 1);
 
     UtRegisterTest("HTPSegvTest01", HTPSegvTest01, 1);
 
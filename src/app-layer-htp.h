@@ -152,11 +152,21 @@ struct HtpBodyChunk_ {
 } __attribute__((__packed__));
 typedef struct HtpBodyChunk_ HtpBodyChunk;
 
+/** Block of memory the chunks of a body and their data are stored in */
+typedef struct HtpBodyBlock_ {
+    struct HtpBodyBlock_ *next; /**< Pointer to the next block */
+    uint32_t size;              /**< Size of the block, after this header */
+    uint32_t used;              /**< Bytes of the block in use */
+} HtpBodyBlock;
+
 /** Struct used to hold all the chunks of a body on a request */
 typedef struct HtpBody_ {
     HtpBodyChunk *first; /**< Pointer to the first chunk */
     HtpBodyChunk *last;  /**< Pointer to the last chunk */
 
+    HtpBodyBlock *first_block; /**< Pointer to the first block */
+    HtpBodyBlock *last_block;  /**< Pointer to the block we append to */
+
     /* Holds the length of the htp request body */
     uint64_t content_len;
     /* Holds the length of the htp request body seen so far */
@@ -165,6 +175,13 @@ typedef struct HtpBody_ {
     uint64_t body_parsed;
     /* inspection tracker */
     uint64_t body_inspected;
+
+    /* the chunks copied into one buffer for inspection. Only appended
+     * to, so each byte is copied once. */
+    uint8_t *linear;
+    uint32_t linear_size;   /**< size of the buffer itself */
+    uint32_t linear_len;    /**< data len in the buffer */
+    uint64_t linear_offset; /**< stream offset of linear[0] */
 } HtpBody;
 
 #define HTP_REQ_BODY_COMPLETE   0x01    /**< body is complete or limit is reached,
@@ -175,6 +192,7 @@ typedef struct HtpBody_ {
 #define HTP_BOUNDARY_OPEN       0x10    /**< We have a boundary string */
 #define HTP_FILENAME_SET        0x20    /**< filename is registered in the flow */
 #define HTP_DONTSTORE           0x40    /**< not storing this file */
+#define HTP_HEADERS_SET         0x80    /**< header buffers are set up */
 
 #define HTP_TX_HAS_FILE             0x01
 #define HTP_TX_HAS_FILENAME         0x02    /**< filename is known at this time */
@@ -207,6 +225,17 @@ typedef struct HtpTxUserData_ {
     uint8_t request_body_type;
     uint8_t response_body_type;
 
+    /** http_header buffers, "name: value\r\n" for each header except the
+     *  (set-)cookie, set up once the headers are complete */
+    uint8_t *request_headers;
+    uint8_t *response_headers;
+    uint32_t request_headers_len;
+    uint32_t response_headers_len;
+
+    /** headers looked up once the headers are complete */
+    htp_header_t *request_cookie;
+    htp_header_t *request_user_agent;
+    htp_header_t *response_cookie;
 } HtpTxUserData;
 
 typedef struct HtpState_ {
@@ -242,6 +271,10 @@ void HTPFreeConfig(void);
 
 htp_tx_t *HTPTransactionMain(const HtpState *);
 
+int HTPTxGetHeaderBuffer(htp_tx_t *, uint8_t, uint8_t **, uint32_t *);
+htp_header_t *HTPTxGetCookie(htp_tx_t *, uint8_t);
+htp_header_t *HTPTxGetUserAgent(htp_tx_t *);
+
 int HTPCallbackRequestBodyData(htp_tx_data_t *);
 int HtpTransactionGetLoggableId(Flow *);
 void HtpBodyPrint(HtpBody *);
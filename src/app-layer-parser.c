@@ -54,6 +54,7 @@
 #include "app-layer-smtp.h"
 
 #include "util-spm.h"
+#include "util-line.h"
 
 #include "util-debug.h"
 #include "decode-events.h"
@@ -353,6 +354,17 @@ int AlpParseFieldByEOF(AppLayerParserResult *output, AppLayerParserState *pstate
     SCReturnInt(0);
 }
 
+/** \brief Find a delimiter, using the newline scanner for CRLF as that
+ *         is what the line based protocols use. */
+static inline uint8_t *AlpFindDelimiter(uint8_t *input, uint32_t input_len,
+                                        const uint8_t *delim, uint8_t delim_len)
+{
+    if (delim_len == 2 && delim[0] == 0x0d && delim[1] == 0x0a)
+        return SCLineFindCRLF(input, input_len);
+
+    return SpmSearch(input, input_len, (uint8_t *)delim, delim_len);
+}
+
 /** \brief Parse a field up to a delimeter.
  *
  * \retval  1 Field found and stored.
@@ -368,7 +380,7 @@ int AlpParseFieldByDelimiter(AppLayerParserResult *output, AppLayerParserState *
                 pstate->store_len, delim_len);
 
     if (pstate->store_len == 0) {
-        uint8_t *ptr = SpmSearch(input, input_len, (uint8_t*)delim, delim_len);
+        uint8_t *ptr = AlpFindDelimiter(input, input_len, delim, delim_len);
         if (ptr != NULL) {
             uint32_t len = ptr - input;
             SCLogDebug(" len %" PRIu32 "", len);
@@ -397,7 +409,7 @@ int AlpParseFieldByDelimiter(AppLayerParserResult *output, AppLayerParserState *
             pstate->store_len = input_len;
         }
     } else {
-        uint8_t *ptr = SpmSearch(input, input_len, (uint8_t*)delim, delim_len);
+        uint8_t *ptr = AlpFindDelimiter(input, input_len, delim, delim_len);
         if (ptr != NULL) {
             uint32_t len = ptr - input;
             SCLogDebug("len %" PRIu32 " + %" PRIu32 " = %" PRIu32 "", len,
@@ -438,8 +450,8 @@ int AlpParseFieldByDelimiter(AppLayerParserResult *output, AppLayerParserState *
                     SCLogDebug("input_len < delim_len, checking pstate->store");
 
                     if (pstate->store_len >= delim_len) {
-                        ptr = SpmSearch(pstate->store, pstate->store_len, (uint8_t*)delim,
-                                        delim_len);
+                        ptr = AlpFindDelimiter(pstate->store, pstate->store_len,
+                                               delim, delim_len);
                         if (ptr != NULL) {
                             SCLogDebug("now we found the delim");
 
@@ -485,7 +497,7 @@ int AlpParseFieldByDelimiter(AppLayerParserResult *output, AppLayerParserState *
             if (delim_len > input_len && delim_len <= pstate->store_len) {
                 SCLogDebug("input_len < delim_len, checking pstate->store");
 
-                ptr = SpmSearch(pstate->store, pstate->store_len, (uint8_t*)delim, delim_len);
+                ptr = AlpFindDelimiter(pstate->store, pstate->store_len, delim, delim_len);
                 if (ptr != NULL) {
                     SCLogDebug("now we found the delim");
 
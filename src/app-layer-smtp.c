@@ -50,6 +50,7 @@
 
 #include "conf.h"
 #include "decode-events.h"
+#include "util-line.h"
 
 #define SMTP_MAX_REQUEST_AND_REPLY_LINE_LENGTH 510
 
@@ -185,10 +186,54 @@ SCEnumCharMap smtp_reply_map[ ] = {
 //    return;
 //}
 
+/**
+ * \internal
+ * \brief Append a fragment of a line to a line buffer.
+ *
+ * The buffer is allocated on first use and grows by doubling, up to
+ * SMTP_LINE_BUFFER_LIMIT. Data that doesn't fit anymore is dropped.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SMTPLineBufferAppend(uint8_t **buf, int32_t *buf_size,
+                                int32_t buf_len, uint8_t *data,
+                                int32_t data_len, int32_t *appended,
+                                uint32_t *dropped)
+{
+    *dropped = 0;
+    if (buf_len + data_len > SMTP_LINE_BUFFER_LIMIT) {
+        *dropped = buf_len + data_len - SMTP_LINE_BUFFER_LIMIT;
+        data_len = SMTP_LINE_BUFFER_LIMIT - buf_len;
+    }
+
+    if (buf_len + data_len > *buf_size) {
+        int32_t size = (*buf_size > 0) ? *buf_size : SMTP_LINE_BUFFER_MIN;
+        while (size < buf_len + data_len)
+            size *= 2;
+        if (size > SMTP_LINE_BUFFER_LIMIT)
+            size = SMTP_LINE_BUFFER_LIMIT;
+
+        uint8_t *ptr = SCRealloc(*buf, size);
+        if (ptr == NULL)
+            return -1;
+        *buf = ptr;
+        *buf_size = size;
+    }
+
+    memcpy(*buf + buf_len, data, data_len);
+    *appended = data_len;
+    return 0;
+}
+
 /**
  * \internal
  * \brief Get the next line from input.  It doesn't do any length validation.
  *
+ * Lines are parsed from the input directly.  Only lines that are
+ * fragmented over input chunks are put together in the line buffer of the
+ * direction, which is kept for the lifetime of the state.
+ *
  * \param state The smtp state.
  *
  * \retval  0 On suceess.
@@ -199,197 +244,124 @@ static int SMTPGetLine(SMTPState *state)
 {
     SCEnter();
 
+    uint8_t **db;
+    int32_t *db_len;
+    uint8_t *current_line_db;
+    uint8_t *current_line_lf_seen;
+    uint8_t **line_buf;
+    int32_t *line_buf_size;
+    uint32_t *db_dropped;
+    int32_t appended = 0;
+    uint32_t dropped = 0;
+
     /* we have run out of input */
     if (state->input_len <= 0)
         return -1;
 
-    /* toserver */
     if (state->direction == 0) {
-        if (state->ts_current_line_lf_seen == 1) {
-            /* we have seen the lf for the previous line.  Clear the parser
-             * details to parse new line */
-            state->ts_current_line_lf_seen = 0;
-            if (state->ts_current_line_db == 1) {
-                state->ts_current_line_db = 0;
-                SCFree(state->ts_db);
-                state->ts_db = NULL;
-                state->ts_db_len = 0;
-                state->current_line = NULL;
-                state->current_line_len = 0;
-            }
+        db = &state->ts_db;
+        db_len = &state->ts_db_len;
+        current_line_db = &state->ts_current_line_db;
+        current_line_lf_seen = &state->ts_current_line_lf_seen;
+        line_buf = &state->ts_line_buf;
+        line_buf_size = &state->ts_line_buf_size;
+        db_dropped = &state->ts_db_dropped;
+    } else {
+        db = &state->tc_db;
+        db_len = &state->tc_db_len;
+        current_line_db = &state->tc_current_line_db;
+        current_line_lf_seen = &state->tc_current_line_lf_seen;
+        line_buf = &state->tc_line_buf;
+        line_buf_size = &state->tc_line_buf_size;
+        db_dropped = &state->tc_db_dropped;
+    }
+
+    if (*current_line_lf_seen == 1) {
+        /* we have seen the lf for the previous line.  Clear the parser
+         * details to parse new line */
+        *current_line_lf_seen = 0;
+        if (*current_line_db == 1) {
+            *current_line_db = 0;
+            *db = NULL;
+            *db_len = 0;
+            *db_dropped = 0;
+            state->current_line = NULL;
+            state->current_line_len = 0;
         }
+    }
 
-        uint8_t *lf_idx = memchr(state->input, 0x0a, state->input_len);
-
-        if (lf_idx == NULL) {
-            /* fragmented lines.  Decoder event for special cases.  Not all
-             * fragmented lines should be treated as a possible evasion
-             * attempt.  With multi payload smtp chunks we can have valid
-             * cases of fragmentation.  But within the same segment chunk
-             * if we see fragmentation then it's definitely something you
-             * should alert about */
-            if (state->ts_current_line_db == 0) {
-                state->ts_db = SCMalloc(state->input_len);
-                if (state->ts_db == NULL) {
-                    return -1;
-                }
-                state->ts_current_line_db = 1;
-                memcpy(state->ts_db, state->input, state->input_len);
-                state->ts_db_len = state->input_len;
-            } else {
-                state->ts_db = SCRealloc(state->ts_db, (state->ts_db_len +
-                                                        state->input_len));
-                if (state->ts_db == NULL) {
-                    return -1;
-                }
-                memcpy(state->ts_db + state->ts_db_len,
-                       state->input, state->input_len);
-                state->ts_db_len += state->input_len;
-            } /* else */
-            state->input += state->input_len;
-            state->input_len = 0;
+    uint8_t *lf_idx = SCLineFindLF(state->input, state->input_len);
 
+    if (lf_idx == NULL) {
+        /* fragmented lines.  Decoder event for special cases.  Not all
+         * fragmented lines should be treated as a possible evasion
+         * attempt.  With multi payload smtp chunks we can have valid
+         * cases of fragmentation.  But within the same segment chunk
+         * if we see fragmentation then it's definitely something you
+         * should alert about */
+        if (SMTPLineBufferAppend(line_buf, line_buf_size, *db_len,
+                                 state->input, state->input_len,
+                                 &appended, &dropped) < 0) {
             return -1;
+        }
+        *current_line_db = 1;
+        *db = *line_buf;
+        *db_len += appended;
+        *db_dropped += dropped;
 
-        } else {
-            state->ts_current_line_lf_seen = 1;
-
-            if (state->ts_current_line_db == 1) {
-                state->ts_db = SCRealloc(state->ts_db,
-                                         (state->ts_db_len +
-                                          (lf_idx + 1 - state->input)));
-                if (state->ts_db == NULL) {
-                    return -1;
-                }
-                memcpy(state->ts_db + state->ts_db_len,
-                       state->input, (lf_idx + 1 - state->input));
-                state->ts_db_len += (lf_idx + 1 - state->input);
-
-                if (state->ts_db_len > 1 &&
-                    state->ts_db[state->ts_db_len - 2] == 0x0D) {
-                    state->ts_db_len -= 2;
-                    state->current_line_delimiter_len = 2;
-                } else {
-                    state->ts_db_len -= 1;
-                    state->current_line_delimiter_len = 1;
-                }
-
-                state->current_line = state->ts_db;
-                state->current_line_len = state->ts_db_len;
-
-            } else {
-                state->current_line = state->input;
-                state->current_line_len = lf_idx - state->input;
-
-                if (state->input != lf_idx &&
-                    *(lf_idx - 1) == 0x0D) {
-                    state->current_line_len--;
-                    state->current_line_delimiter_len = 2;
-                } else {
-                    state->current_line_delimiter_len = 1;
-                }
-            }
-
-            state->input_len -= (lf_idx - state->input) + 1;
-            state->input = (lf_idx + 1);
+        state->input += state->input_len;
+        state->input_len = 0;
 
-            return 0;
-        }
+        return -1;
 
-        /* toclient */
     } else {
-        if (state->tc_current_line_lf_seen == 1) {
-            /* we have seen the lf for the previous line.  Clear the parser
-             * details to parse new line */
-            state->tc_current_line_lf_seen = 0;
-            if (state->tc_current_line_db == 1) {
-                state->tc_current_line_db = 0;
-                SCFree(state->tc_db);
-                state->tc_db = NULL;
-                state->tc_db_len = 0;
-                state->current_line = NULL;
-                state->current_line_len = 0;
-            }
-        }
+        *current_line_lf_seen = 1;
 
-        uint8_t *lf_idx = memchr(state->input, 0x0a, state->input_len);
-
-        if (lf_idx == NULL) {
-            /* fragmented lines.  Decoder event for special cases.  Not all
-             * fragmented lines should be treated as a possible evasion
-             * attempt.  With multi payload smtp chunks we can have valid
-             * cases of fragmentation.  But within the same segment chunk
-             * if we see fragmentation then it's definitely something you
-             * should alert about */
-            if (state->tc_current_line_db == 0) {
-                state->tc_db = SCMalloc(state->input_len);
-                if (state->tc_db == NULL) {
-                    return -1;
-                }
-                state->tc_current_line_db = 1;
-                memcpy(state->tc_db, state->input, state->input_len);
-                state->tc_db_len = state->input_len;
+        if (*current_line_db == 1) {
+            if (SMTPLineBufferAppend(line_buf, line_buf_size, *db_len,
+                                     state->input, (lf_idx + 1 - state->input),
+                                     &appended, &dropped) < 0) {
+                return -1;
+            }
+            *db = *line_buf;
+            *db_len += appended;
+            *db_dropped += dropped;
+
+            if (*db_dropped > 0) {
+                /* the line was cut at the buffer limit, so the delimiter
+                 * didn't make it into the buffer */
+                state->current_line_delimiter_len = 0;
+            } else if (*db_len > 1 && (*db)[*db_len - 2] == 0x0D) {
+                *db_len -= 2;
+                state->current_line_delimiter_len = 2;
             } else {
-                state->tc_db = SCRealloc(state->tc_db, (state->tc_db_len +
-                                                        state->input_len));
-                if (state->tc_db == NULL) {
-                    return -1;
-                }
-                memcpy(state->tc_db + state->tc_db_len,
-                       state->input, state->input_len);
-                state->tc_db_len += state->input_len;
-            } /* else */
-            state->input += state->input_len;
-            state->input_len = 0;
+                *db_len -= 1;
+                state->current_line_delimiter_len = 1;
+            }
 
-            return -1;
+            state->current_line = *db;
+            state->current_line_len = *db_len;
+            state->current_line_dropped = *db_dropped;
 
         } else {
-            state->tc_current_line_lf_seen = 1;
-
-            if (state->tc_current_line_db == 1) {
-                state->tc_db = SCRealloc(state->tc_db,
-                                         (state->tc_db_len +
-                                          (lf_idx + 1 - state->input)));
-                if (state->tc_db == NULL) {
-                    return -1;
-                }
-                memcpy(state->tc_db + state->tc_db_len,
-                       state->input, (lf_idx + 1 - state->input));
-                state->tc_db_len += (lf_idx + 1 - state->input);
-
-                if (state->tc_db_len > 1 &&
-                    state->tc_db[state->tc_db_len - 2] == 0x0D) {
-                    state->tc_db_len -= 2;
-                    state->current_line_delimiter_len = 2;
-                } else {
-                    state->tc_db_len -= 1;
-                    state->current_line_delimiter_len = 1;
-                }
-
-                state->current_line = state->tc_db;
-                state->current_line_len = state->tc_db_len;
-
+            state->current_line = state->input;
+            state->current_line_len = lf_idx - state->input;
+            state->current_line_dropped = 0;
+
+            if (state->input != lf_idx &&
+                *(lf_idx - 1) == 0x0D) {
+                state->current_line_len--;
+                state->current_line_delimiter_len = 2;
             } else {
-                state->current_line = state->input;
-                state->current_line_len = lf_idx - state->input;
-
-                if (state->input != lf_idx &&
-                    *(lf_idx - 1) == 0x0D) {
-                    state->current_line_len--;
-                    state->current_line_delimiter_len = 2;
-                } else {
-                    state->current_line_delimiter_len = 1;
-                }
+                state->current_line_delimiter_len = 1;
             }
+        }
 
-            state->input_len -= (lf_idx - state->input) + 1;
-            state->input = (lf_idx + 1);
+        state->input_len -= (lf_idx - state->input) + 1;
+        state->input = (lf_idx + 1);
 
-            return 0;
-        } /* else - if (lf_idx == NULL) */
+        return 0;
     }
-
 }
 
 static int SMTPInsertCommandIntoCommandBuffer(uint8_t command, SMTPState *state, Flow *f)
@@ -440,7 +412,8 @@ static int SMTPProcessCommandBDAT(SMTPState *state, Flow *f,
     SCEnter();
 
     state->bdat_chunk_idx += (state->current_line_len +
-                              state->current_line_delimiter_len);
+                              state->current_line_delimiter_len +
+                              state->current_line_dropped);
     if (state->bdat_chunk_idx > state->bdat_chunk_len) {
         state->parser_state &= ~SMTP_PARSER_STATE_COMMAND_DATA_MODE;
         /* decoder event */
@@ -795,11 +768,11 @@ static void SMTPStateFree(void *p)
     if (smtp_state->cmds != NULL) {
         SCFree(smtp_state->cmds);
     }
-    if (smtp_state->ts_current_line_db) {
-        SCFree(smtp_state->ts_db);
+    if (smtp_state->ts_line_buf != NULL) {
+        SCFree(smtp_state->ts_line_buf);
     }
-    if (smtp_state->tc_current_line_db) {
-        SCFree(smtp_state->tc_db);
+    if (smtp_state->tc_line_buf != NULL) {
+        SCFree(smtp_state->tc_line_buf);
     }
 
     SCFree(smtp_state);
@@ -3296,6 +3269,90 @@ end:
     return result;
 }
 
+/**
+ * \test Test that fragmented lines are put together in the line buffer of
+ *       the state, which is reused for the next fragmented line, and that
+ *       lines over the buffer limit are cut.
+ */
+int SMTPParserTest14(void)
+{
+    int result = 0;
+    SMTPState state;
+    uint8_t *line_buf = NULL;
+    uint8_t *big = NULL;
+
+    memset(&state, 0, sizeof(state));
+
+    uint8_t request1[] = "EHLO b";
+    uint8_t request2[] = "oo.com\r\nMAIL";
+    uint8_t request3[] = " FROM:<a@b.c>\n";
+
+    state.input = request1;
+    state.input_len = sizeof(request1) - 1;
+    if (SMTPGetLine(&state) != -1 || state.ts_db_len != 6) {
+        printf("expected the fragment to be buffered: ");
+        goto end;
+    }
+    line_buf = state.ts_line_buf;
+
+    state.input = request2;
+    state.input_len = sizeof(request2) - 1;
+    if (SMTPGetLine(&state) != 0 || state.current_line_len != 12 ||
+        state.current_line_delimiter_len != 2 ||
+        memcmp(state.current_line, "EHLO boo.com", 12) != 0) {
+        printf("EHLO line not put together: ");
+        goto end;
+    }
+    if (SMTPGetLine(&state) != -1 || state.ts_db_len != 4) {
+        printf("expected the MAIL fragment to be buffered: ");
+        goto end;
+    }
+
+    state.input = request3;
+    state.input_len = sizeof(request3) - 1;
+    if (SMTPGetLine(&state) != 0 || state.current_line_len != 17 ||
+        state.current_line_delimiter_len != 1 ||
+        memcmp(state.current_line, "MAIL FROM:<a@b.c>", 17) != 0) {
+        printf("MAIL line not put together: ");
+        goto end;
+    }
+    if (state.ts_line_buf != line_buf) {
+        printf("line buffer not reused: ");
+        goto end;
+    }
+
+    big = SCMalloc(SMTP_LINE_BUFFER_LIMIT);
+    if (big == NULL)
+        goto end;
+    memset(big, 'a', SMTP_LINE_BUFFER_LIMIT);
+
+    state.input = big;
+    state.input_len = SMTP_LINE_BUFFER_LIMIT;
+    if (SMTPGetLine(&state) != -1)
+        goto end;
+    state.input = request2;
+    state.input_len = sizeof(request2) - 1;
+    if (SMTPGetLine(&state) != 0 ||
+        state.current_line_len != SMTP_LINE_BUFFER_LIMIT ||
+        state.current_line_delimiter_len != 0 ||
+        state.current_line_dropped != 8) {
+        printf("long line not cut at the limit: ");
+        goto end;
+    }
+    if (state.ts_line_buf_size != SMTP_LINE_BUFFER_LIMIT) {
+        printf("line buffer grew past the limit: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (big != NULL)
+        SCFree(big);
+    if (state.ts_line_buf != NULL)
+        SCFree(state.ts_line_buf);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SMTPParserRegisterTests(void)
@@ -3314,6 +3371,7 @@ void SMTPParserRegisterTests(void)
     UtRegisterTest("SMTPParserTest11", SMTPParserTest11, 1);
     UtRegisterTest("SMTPParserTest12", SMTPParserTest12, 1);
     UtRegisterTest("SMTPParserTest13", SMTPParserTest13, 1);
+    UtRegisterTest("SMTPParserTest14", SMTPParserTest14, 1);
 #endif /* UNITTESTS */
 
     return;
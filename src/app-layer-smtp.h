@@ -38,6 +38,11 @@ enum {
     SMTP_DECODER_EVENT_DATA_COMMAND_REJECTED,
 };
 
+/** initial size of the buffer fragmented lines are put together in */
+#define SMTP_LINE_BUFFER_MIN    256
+/** max size of the line buffer, the rest of longer lines is dropped */
+#define SMTP_LINE_BUFFER_LIMIT  65536
+
 typedef struct SMTPState_ {
     /* current input that is being parsed */
     uint8_t *input;
@@ -50,23 +55,37 @@ typedef struct SMTPState_ {
     /** length of the line in current_line.  Doesn't include the delimiter */
     int32_t current_line_len;
     uint8_t current_line_delimiter_len;
+    /** bytes of the line that didn't fit in the line buffer */
+    uint32_t current_line_dropped;
     PatternMatcherQueue *thread_local_data;
 
-    /** used to indicate if the current_line buffer is a malloced buffer.  We
-     * use a malloced buffer, if a line is fragmented */
+    /** used to indicate if the current_line is in the line buffer.  We
+     * use the line buffer, if a line is fragmented */
     uint8_t *tc_db;
     int32_t tc_db_len;
     uint8_t tc_current_line_db;
     /** we have see LF for the currently parsed line */
     uint8_t tc_current_line_lf_seen;
+    /** buffer fragmented lines are put together in, kept for the lifetime
+     *  of the state */
+    uint8_t *tc_line_buf;
+    int32_t tc_line_buf_size;
+    /** bytes of the fragmented line dropped at the buffer limit */
+    uint32_t tc_db_dropped;
 
-    /** used to indicate if the current_line buffer is a malloced buffer.  We
-     * use a malloced buffer, if a line is fragmented */
+    /** used to indicate if the current_line is in the line buffer.  We
+     * use the line buffer, if a line is fragmented */
     uint8_t *ts_db;
     int32_t ts_db_len;
     uint8_t ts_current_line_db;
     /** we have see LF for the currently parsed line */
     uint8_t ts_current_line_lf_seen;
+    /** buffer fragmented lines are put together in, kept for the lifetime
+     *  of the state */
+    uint8_t *ts_line_buf;
+    int32_t ts_line_buf_size;
+    /** bytes of the fragmented line dropped at the buffer limit */
+    uint32_t ts_db_dropped;
 
     /** var to indicate parser state */
     uint8_t parser_state;
@@ -481,6 +481,9 @@ typedef struct Packet_
     struct Packet_ *next;
     struct Packet_ *prev;
 
+    /* per thread packet pool cache this packet was handed out by */
+    struct PktPoolCache_ *pool;
+
     /* tunnel/encapsulation handling */
     struct Packet_ *root; /* in case of tunnel this is a ptr
                            * to the 'real' packet, the one we
@@ -607,12 +610,30 @@ typedef struct DecodeThreadVars_
         (p)->icmpv6vars.comp_csum = -1;   \
     } while (0)
 
+/* bytes at the start of the inline buffer cleared on init, enough for the
+ * largest header stack a pseudo packet builder fills in field by field */
+#define PACKET_HEADER_CLEAR_SIZE 128
+
 /**
  *  \brief Initialize a packet structure for use.
+ *
+ *  The Packet and the header area at the start of the inline buffer are
+ *  cleared, the payload bytes behind that are not. Packets built from a
+ *  copy (tunnel, stream and defrag pseudo packets, PacketCopyData) write
+ *  every byte up to the packet length before it is read. Builders that
+ *  set headers field by field (flow timeout pseudo packets) may only rely
+ *  on the first PACKET_HEADER_CLEAR_SIZE bytes being zero for a fresh
+ *  packet and have to clear them themselves for a recycled one, as
+ *  PACKET_RECYCLE never touches the buffer.
  */
+#define PACKET_CLEAR(p) \
+    memset((p), 0x00, sizeof(Packet) + \
+            (default_packet_size < PACKET_HEADER_CLEAR_SIZE ? \
+             default_packet_size : PACKET_HEADER_CLEAR_SIZE))
+
 #ifndef __SC_CUDA_SUPPORT__
 #define PACKET_INITIALIZE(p) { \
-    memset((p), 0x00, SIZE_OF_PACKET); \
+    PACKET_CLEAR((p)); \
     SCMutexInit(&(p)->tunnel_mutex, NULL); \
     PACKET_RESET_CHECKSUMS((p)); \
     (p)->pkt = ((uint8_t *)(p)) + sizeof(Packet); \
@@ -620,7 +641,7 @@ typedef struct DecodeThreadVars_
 }
 #else
 #define PACKET_INITIALIZE(p) { \
-    memset((p), 0x00, SIZE_OF_PACKET); \
+    PACKET_CLEAR((p)); \
     SCMutexInit(&(p)->tunnel_mutex, NULL); \
     PACKET_RESET_CHECKSUMS((p)); \
     SCMutexInit(&(p)->cuda_mutex, NULL); \
@@ -632,7 +653,11 @@ typedef struct DecodeThreadVars_
 
 /**
  *  \brief Recycle a packet structure for reuse.
- *  \todo the mutex destroy & init is necessary because of the memset, reconsider
+ *
+ *  Only the fields that may have been set while processing the packet are
+ *  reset, the per protocol fields only if their header was decoded. The
+ *  payload buffer is left alone and the tunnel mutex is unlocked at this
+ *  point, so it doesn't need a destroy/init either.
  */
 #define PACKET_DO_RECYCLE(p) do {               \
         CLEAR_ADDR(&(p)->src);                  \
@@ -689,8 +714,6 @@ typedef struct DecodeThreadVars_
         (p)->pcap_cnt = 0;                      \
         (p)->tunnel_rtv_cnt = 0;                \
         (p)->tunnel_tpr_cnt = 0;                \
-        SCMutexDestroy(&(p)->tunnel_mutex);     \
-        SCMutexInit(&(p)->tunnel_mutex, NULL);  \
         (p)->events.cnt = 0;                    \
         (p)->next = NULL;                       \
         (p)->prev = NULL;                       \
@@ -266,6 +266,20 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
             } else {
                 match_offset = (uint32_t)((found - buffer) + cd->content_len);
                 SCLogDebug("content %"PRIu32" matched at offset %"PRIu32"", cd->id, match_offset);
+
+                /* an smsg with the stream bytes preceding it: the stream
+                 * mpm only found the fast pattern across the two, other
+                 * matches were inspected with the previous smsg. */
+                if (det_ctx->stream_span_offset != 0 && sm == s->mpm_sm) {
+                    uint32_t match_start = (uint32_t)(found - buffer);
+                    if (match_start >= det_ctx->stream_span_offset) {
+                        SCReturnInt(0);
+                    } else if (match_offset <= det_ctx->stream_span_offset) {
+                        prev_offset = match_start + 1;
+                        continue;
+                    }
+                }
+
                 det_ctx->buffer_offset = match_offset;
 
                 /* Match branch, add replace to the list if needed */
@@ -27,9 +27,8 @@
 
 #include "app-layer-htp.h"
 
-int DetectEngineRunHttpClientBodyMpm(DetectEngineCtx *,
-                                     DetectEngineThreadCtx *, Flow *f,
-                                     HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpClientBodyMpmTx(DetectEngineCtx *, DetectEngineThreadCtx *,
+        Flow *, HtpState *, int, uint8_t);
 int DetectEngineInspectHttpClientBody(ThreadVars *tv,
                                       DetectEngineCtx *,
                                       DetectEngineThreadCtx *,
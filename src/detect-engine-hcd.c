@@ -55,64 +55,23 @@
 #include "app-layer-htp.h"
 #include "app-layer-protos.h"
 
-int DetectEngineRunHttpCookieMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                 HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http cookie mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpCookieMpmTx(DetectEngineThreadCtx *det_ctx,
+                                        htp_tx_t *tx, uint8_t flags)
 {
-    htp_tx_t *tx = NULL;
-    uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL)
-            continue;
-
-        htp_header_t *h = NULL;
-        if (flags & STREAM_TOSERVER) {
-            h = (htp_header_t *)table_getc(tx->request_headers,
-                                           "Cookie");
-            if (h == NULL) {
-                SCLogDebug("HTTP cookie header not present in this request");
-                continue;
-            }
-        } else {
-            h = (htp_header_t *)table_getc(tx->response_headers,
-                                           "Set-Cookie");
-            if (h == NULL) {
-                SCLogDebug("HTTP Set-Cookie header not present in this request");
-                continue;
-            }
-        }
-
-        cnt += HttpCookiePatternSearch(det_ctx,
-                                       (uint8_t *)bstr_ptr(h->value),
-                                       bstr_len(h->value), flags);
+    htp_header_t *h = HTPTxGetCookie(tx, flags);
+    if (h == NULL) {
+        SCLogDebug("HTTP (Set-)Cookie header not present in this tx");
+        return 0;
     }
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpCookiePatternSearch(det_ctx,
+                                   (uint8_t *)bstr_ptr(h->value),
+                                   bstr_len(h->value), flags);
 }
 
 /**
@@ -139,21 +98,10 @@ int DetectEngineInspectHttpCookie(ThreadVars *tv,
     if (tx == NULL)
         return 0;
 
-    htp_header_t *h = NULL;
-    if (flags & STREAM_TOSERVER) {
-        h = (htp_header_t *)table_getc(tx->request_headers,
-                                       "Cookie");
-        if (h == NULL) {
-            SCLogDebug("HTTP cookie header not present in this request");
-            return 0;
-        }
-    } else {
-        h = (htp_header_t *)table_getc(tx->response_headers,
-                                       "Set-Cookie");
-        if (h == NULL) {
-            SCLogDebug("HTTP Set-Cookie header not present in this request");
-            return 0;
-        }
+    htp_header_t *h = HTPTxGetCookie(tx, flags);
+    if (h == NULL) {
+        SCLogDebug("HTTP (Set-)Cookie header not present in this tx");
+        return 0;
     }
 
     det_ctx->buffer_offset = 0;
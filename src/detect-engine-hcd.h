@@ -28,7 +28,7 @@
 int DetectEngineInspectHttpCookie(ThreadVars *tv,
                                   DetectEngineCtx *, DetectEngineThreadCtx *,
                                   Signature *, Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpCookieMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpCookieMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpCookieRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HCD_H__ */
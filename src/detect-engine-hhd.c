@@ -126,6 +126,14 @@ static uint8_t *DetectEngineHHDGetBufferForTX(int tx_id,
         goto end;
     }
 
+    /* use the buffer of the tx if the headers are complete, otherwise
+     * build one for this packet */
+    uint32_t tx_buffer_len = 0;
+    if (HTPTxGetHeaderBuffer(tx, flags, &headers_buffer, &tx_buffer_len) == 1) {
+        *buffer_len = tx_buffer_len;
+        goto end;
+    }
+
     table_t *headers;
     if (flags & STREAM_TOSERVER) {
         headers = tx->request_headers;
@@ -186,46 +194,26 @@ static uint8_t *DetectEngineHHDGetBufferForTX(int tx_id,
     return headers_buffer;
 }
 
-int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                 HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http header mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpHeaderMpmTx(DetectEngineCtx *de_ctx,
+                                        DetectEngineThreadCtx *det_ctx, Flow *f,
+                                        HtpState *htp_state, int tx_id,
+                                        uint8_t flags)
 {
-    uint32_t cnt = 0;
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    FLOWLOCK_WRLOCK(f);
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    /* get the transaction id */
-    int idx = AppLayerTransactionGetInspectId(f);
-    /* error!  get out of here */
-    if (idx == -1)
-        goto end;
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-        uint32_t buffer_len = 0;
-        uint8_t *buffer = DetectEngineHHDGetBufferForTX(idx,
-                                                        NULL, det_ctx,
-                                                        f, htp_state,
-                                                        flags,
-                                                        &buffer_len);
-        if (buffer_len == 0)
-            continue;
-
-        cnt += HttpHeaderPatternSearch(det_ctx, buffer, buffer_len, flags);
-    }
+    uint32_t buffer_len = 0;
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx_id,
+                                                    de_ctx, det_ctx,
+                                                    f, htp_state,
+                                                    flags,
+                                                    &buffer_len);
+    if (buffer_len == 0)
+        return 0;
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpHeaderPatternSearch(det_ctx, buffer, buffer_len, flags);
 }
 
 int DetectEngineInspectHttpHeader(ThreadVars *tv,
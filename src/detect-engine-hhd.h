@@ -30,8 +30,8 @@ int DetectEngineInspectHttpHeader(ThreadVars *tv,
                                   DetectEngineThreadCtx *det_ctx,
                                   Signature *s, Flow *f, uint8_t flags,
                                   void *alstate, int tx_id);
-int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                 HtpState *htp_state, uint8_t flags);
+uint32_t DetectEngineRunHttpHeaderMpmTx(DetectEngineCtx *, DetectEngineThreadCtx *,
+        Flow *, HtpState *, int, uint8_t);
 void DetectEngineCleanHHDBuffers(DetectEngineThreadCtx *det_ctx);
 
 void DetectEngineHttpHeaderRegisterTests(void);
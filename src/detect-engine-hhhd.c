@@ -57,49 +57,22 @@
 
 #include "detect-engine-hhhd.h"
 
-int DetectEngineRunHttpHHMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                              HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http host mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpHHMpmTx(DetectEngineThreadCtx *det_ctx,
+                                    htp_tx_t *tx, uint8_t flags)
 {
-    htp_tx_t *tx = NULL;
-    uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL || tx->parsed_uri == NULL || tx->parsed_uri->hostname == NULL)
-            continue;
-        uint8_t *hname = (uint8_t *)bstr_ptr(tx->parsed_uri->hostname);
-        if (hname == NULL)
-            continue;
-        uint32_t hname_len = bstr_len(tx->parsed_uri->hostname);
-
-        cnt += HttpHHPatternSearch(det_ctx, hname, hname_len, flags);
-    }
+    if (tx->parsed_uri == NULL || tx->parsed_uri->hostname == NULL)
+        return 0;
+    uint8_t *hname = (uint8_t *)bstr_ptr(tx->parsed_uri->hostname);
+    if (hname == NULL)
+        return 0;
+    uint32_t hname_len = bstr_len(tx->parsed_uri->hostname);
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpHHPatternSearch(det_ctx, hname, hname_len, flags);
 }
 
 /**
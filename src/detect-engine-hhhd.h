@@ -28,7 +28,7 @@
 int DetectEngineInspectHttpHH(ThreadVars *tv,
                               DetectEngineCtx *, DetectEngineThreadCtx *,
                               Signature *, Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpHHMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpHHMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpHHRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HHHD_H__ */
@@ -55,48 +55,21 @@
 #include "app-layer-htp.h"
 #include "app-layer-protos.h"
 
-int DetectEngineRunHttpMethodMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                 HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http method mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpMethodMpmTx(DetectEngineThreadCtx *det_ctx,
+                                        htp_tx_t *tx, uint8_t flags)
 {
-    htp_tx_t *tx = NULL;
-    uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL || tx->request_method == NULL)
-            continue;
-
-        cnt += HttpMethodPatternSearch(det_ctx,
-                                       (uint8_t *)bstr_ptr(tx->request_method),
-                                       bstr_len(tx->request_method),
-                                       flags);
-    }
+    if (tx->request_method == NULL)
+        return 0;
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpMethodPatternSearch(det_ctx,
+                                   (uint8_t *)bstr_ptr(tx->request_method),
+                                   bstr_len(tx->request_method),
+                                   flags);
 }
 
 /**
@@ -28,7 +28,7 @@
 int DetectEngineInspectHttpMethod(ThreadVars *tv,
                                   DetectEngineCtx *, DetectEngineThreadCtx *,
                                   Signature *, Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpMethodMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpMethodMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpMethodRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HMD_H__ */
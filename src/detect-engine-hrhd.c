@@ -56,62 +56,36 @@
 #include "app-layer-protos.h"
 
 
-int DetectEngineRunHttpRawHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                    HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http raw header mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpRawHeaderMpmTx(DetectEngineThreadCtx *det_ctx,
+                                           htp_tx_t *tx, uint8_t flags)
 {
-    SCEnter();
-    htp_tx_t *tx = NULL;
     uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
 
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
+    bstr *raw_headers = htp_tx_get_request_headers_raw(tx);
+    if (raw_headers != NULL) {
+        cnt += HttpRawHeaderPatternSearch(det_ctx,
+                                          (uint8_t *)bstr_ptr(raw_headers),
+                                          bstr_len(raw_headers), flags);
+    } else {
+        SCLogDebug("no raw headers");
     }
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL)
-            continue;
-
-        bstr *raw_headers = htp_tx_get_request_headers_raw(tx);
-        if (raw_headers != NULL) {
-            cnt += HttpRawHeaderPatternSearch(det_ctx,
-                                              (uint8_t *)bstr_ptr(raw_headers),
-                                              bstr_len(raw_headers), flags);
-        } else {
-            SCLogDebug("no raw headers");
-        }
 #ifdef HAVE_HTP_TX_GET_RESPONSE_HEADERS_RAW
-        raw_headers = htp_tx_get_response_headers_raw(tx);
-        if (raw_headers != NULL) {
-            cnt += HttpRawHeaderPatternSearch(det_ctx,
-                                              (uint8_t *)bstr_ptr(raw_headers),
-                                              bstr_len(raw_headers), flags);
-        } else {
-            SCLogDebug("no raw headers");
-        }
-#endif /* HAVE_HTP_TX_GET_RESPONSE_HEADERS_RAW */
+    raw_headers = htp_tx_get_response_headers_raw(tx);
+    if (raw_headers != NULL) {
+        cnt += HttpRawHeaderPatternSearch(det_ctx,
+                                          (uint8_t *)bstr_ptr(raw_headers),
+                                          bstr_len(raw_headers), flags);
+    } else {
+        SCLogDebug("no raw headers");
     }
+#endif /* HAVE_HTP_TX_GET_RESPONSE_HEADERS_RAW */
 
-end:
-    FLOWLOCK_UNLOCK(f);
-    SCReturnInt(cnt);
+    return cnt;
 }
 
 /**
@@ -28,8 +28,7 @@
 int DetectEngineInspectHttpRawHeader(ThreadVars *tv, DetectEngineCtx *,
                                      DetectEngineThreadCtx *, Signature *,
                                      Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpRawHeaderMpm(DetectEngineThreadCtx *, Flow *, HtpState *,
-                                    uint8_t);
+uint32_t DetectEngineRunHttpRawHeaderMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpRawHeaderRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HHD_H__ */
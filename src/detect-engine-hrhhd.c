@@ -57,64 +57,34 @@
 
 #include "detect-engine-hrhhd.h"
 
-int DetectEngineRunHttpHRHMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                              HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http raw host mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpHRHMpmTx(DetectEngineThreadCtx *det_ctx,
+                                     htp_tx_t *tx, uint8_t flags)
 {
-    htp_tx_t *tx = NULL;
-    uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        uint8_t *hname;
-        uint32_t hname_len;
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL)
-            continue;
+    uint8_t *hname;
+    uint32_t hname_len;
 
-        if (tx->parsed_uri_incomplete == NULL || tx->parsed_uri_incomplete->hostname == NULL) {
-            htp_header_t *h = NULL;
-            h = (htp_header_t *)table_getc(tx->request_headers, "Host");
-            if (h == NULL) {
-                SCLogDebug("HTTP host header not present in this request");
-                continue;
-            }
-            hname = (uint8_t *)bstr_ptr(h->value);
-            hname_len = bstr_len(h->value);
-        } else {
-            hname = (uint8_t *)bstr_ptr(tx->parsed_uri_incomplete->hostname);
-            if (hname == NULL)
-                continue;
-            hname_len = bstr_len(tx->parsed_uri_incomplete->hostname);
+    if (tx->parsed_uri_incomplete == NULL || tx->parsed_uri_incomplete->hostname == NULL) {
+        htp_header_t *h = NULL;
+        h = (htp_header_t *)table_getc(tx->request_headers, "Host");
+        if (h == NULL) {
+            SCLogDebug("HTTP host header not present in this request");
+            return 0;
         }
-
-        cnt += HttpHRHPatternSearch(det_ctx, hname, hname_len, flags);
+        hname = (uint8_t *)bstr_ptr(h->value);
+        hname_len = bstr_len(h->value);
+    } else {
+        hname = (uint8_t *)bstr_ptr(tx->parsed_uri_incomplete->hostname);
+        if (hname == NULL)
+            return 0;
+        hname_len = bstr_len(tx->parsed_uri_incomplete->hostname);
     }
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpHRHPatternSearch(det_ctx, hname, hname_len, flags);
 }
 
 /**
@@ -28,7 +28,7 @@
 int DetectEngineInspectHttpHRH(ThreadVars *tv,
                                DetectEngineCtx *, DetectEngineThreadCtx *,
                                Signature *, Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpHRHMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpHRHMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpHRHRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HRHHD_H__ */
@@ -26,8 +26,7 @@
 
 #include "app-layer-htp.h"
 
-int DetectEngineRunHttpRawUriMpm(DetectEngineThreadCtx *,
-                                 Flow *f, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpRawUriMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 int DetectEngineInspectHttpRawUri(ThreadVars *tv,
                                   DetectEngineCtx *, DetectEngineThreadCtx *,
                                   Signature *, Flow *, uint8_t, void *, int);
@@ -54,6 +54,7 @@
 #include "util-unittest-helper.h"
 #include "app-layer.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-body.h"
 #include "app-layer-protos.h"
 
 #define BUFFER_STEP 50
@@ -132,6 +133,10 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(int tx_id,
     /* no new data */
     if (htud->response_body.body_inspected == htud->response_body.content_len_so_far) {
         SCLogDebug("no new data");
+        /* the whole body has been inspected, the linear copy of it is
+         * no longer needed */
+        if (htud->tcflags & HTP_RES_BODY_COMPLETE)
+            HtpBodyLinearFree(&htud->response_body);
         goto end;
     }
 
@@ -181,42 +186,34 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(int tx_id,
         goto end;
     }
 
-    int first = 1;
+    /* find the first chunk to inspect: the new ones and the ones that
+     * are still within the window of the inspected data */
     while (cur != NULL) {
-        /* see if we can filter out chunks */
-        if (htud->response_body.body_inspected > 0) {
-            if (cur->stream_offset < htud->response_body.body_inspected) {
-                if ((htud->response_body.body_inspected - cur->stream_offset) > htp_state->cfg->response_inspect_window) {
-                    cur = cur->next;
-                    continue;
-                } else {
-                    /* include this one */
-                }
-            } else {
-                /* include this one */
-            }
-        }
-
-        if (first) {
-            det_ctx->hsbd[index].offset = cur->stream_offset;
-            first = 0;
+        if (htud->response_body.body_inspected > 0 &&
+            cur->stream_offset < htud->response_body.body_inspected &&
+            (htud->response_body.body_inspected - cur->stream_offset) > htp_state->cfg->response_inspect_window) {
+            cur = cur->next;
+            continue;
         }
+        break;
+    }
+    if (cur == NULL)
+        goto end;
 
-        /* see if we need to grow the buffer */
-        if (det_ctx->hsbd[index].buffer == NULL || (det_ctx->hsbd[index].buffer_len + cur->len) > det_ctx->hsbd[index].buffer_size) {
-            det_ctx->hsbd[index].buffer_size += cur->len * 2;
+    /* bring the linear body buffer of the tx up to date, this only copies
+     * the chunks we haven't seen before */
+    if (HtpBodyLinearize(&htud->response_body, cur->stream_offset) < 0)
+        goto end;
 
-            if ((det_ctx->hsbd[index].buffer = SCRealloc(det_ctx->hsbd[index].buffer, det_ctx->hsbd[index].buffer_size)) == NULL) {
-                det_ctx->hsbd[index].buffer_size = 0;
-                det_ctx->hsbd[index].buffer_len = 0;
-                goto end;
-            }
-        }
-        memcpy(det_ctx->hsbd[index].buffer + det_ctx->hsbd[index].buffer_len, cur->data, cur->len);
-        det_ctx->hsbd[index].buffer_len += cur->len;
+    uint64_t start = cur->stream_offset;
+    if (start < htud->response_body.linear_offset)
+        start = htud->response_body.linear_offset;
 
-        cur = cur->next;
-    }
+    det_ctx->hsbd[index].offset = start;
+    det_ctx->hsbd[index].buffer = htud->response_body.linear +
+        (start - htud->response_body.linear_offset);
+    det_ctx->hsbd[index].buffer_len = htud->response_body.linear_len -
+        (uint32_t)(start - htud->response_body.linear_offset);
 
     /* update inspected tracker */
     htud->response_body.body_inspected = htud->response_body.last->stream_offset + htud->response_body.last->len;
@@ -227,47 +224,26 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(int tx_id,
     return buffer;
 }
 
-int DetectEngineRunHttpServerBodyMpm(DetectEngineCtx *de_ctx,
-                                     DetectEngineThreadCtx *det_ctx, Flow *f,
-                                     HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http server body mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpServerBodyMpmTx(DetectEngineCtx *de_ctx,
+                                            DetectEngineThreadCtx *det_ctx, Flow *f,
+                                            HtpState *htp_state, int tx_id,
+                                            uint8_t flags)
 {
-    uint32_t cnt = 0;
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    FLOWLOCK_WRLOCK(f);
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    /* get the transaction id */
-    int idx = AppLayerTransactionGetInspectId(f);
-    /* error!  get out of here */
-    if (idx == -1)
-        goto end;
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-        uint32_t buffer_len = 0;
-        uint8_t *buffer = DetectEngineHSBDGetBufferForTX(idx,
-                                                         de_ctx, det_ctx,
-                                                         f, htp_state,
-                                                         flags,
-                                                         &buffer_len);
-        if (buffer_len == 0)
-            continue;
-
-        cnt += HttpServerBodyPatternSearch(det_ctx,buffer, buffer_len, flags);
-    }
+    uint32_t buffer_len = 0;
+    uint8_t *buffer = DetectEngineHSBDGetBufferForTX(tx_id,
+                                                     de_ctx, det_ctx,
+                                                     f, htp_state,
+                                                     flags,
+                                                     &buffer_len);
+    if (buffer_len == 0)
+        return 0;
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpServerBodyPatternSearch(det_ctx, buffer, buffer_len, flags);
 }
 
 int DetectEngineInspectHttpServerBody(ThreadVars *tv,
@@ -27,9 +27,8 @@
 
 #include "app-layer-htp.h"
 
-int DetectEngineRunHttpServerBodyMpm(DetectEngineCtx *de_ctx,
-                                     DetectEngineThreadCtx *det_ctx, Flow *f,
-                                     HtpState *htp_state, uint8_t flags);
+uint32_t DetectEngineRunHttpServerBodyMpmTx(DetectEngineCtx *, DetectEngineThreadCtx *,
+        Flow *, HtpState *, int, uint8_t);
 int DetectEngineInspectHttpServerBody(ThreadVars *tv,
                                       DetectEngineCtx *de_ctx,
                                       DetectEngineThreadCtx *det_ctx,
@@ -57,47 +57,20 @@
  *
  * \retval cnt Number of matches reported by the mpm algo.
  */
-int DetectEngineRunHttpStatCodeMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                   HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http stat code mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpStatCodeMpmTx(DetectEngineThreadCtx *det_ctx,
+                                          htp_tx_t *tx, uint8_t flags)
 {
-    SCEnter();
-
-    uint32_t cnt = 0;
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        SCReturnInt(0);
-    }
-
-    /* locking the flow, we will inspect the htp state */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    int idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-    htp_tx_t *tx = NULL;
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for ( ; idx < size; idx++)
-    {
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL || tx->response_status == NULL)
-            continue;
-
-        cnt += HttpStatCodePatternSearch(det_ctx,
-                                        (uint8_t *)bstr_ptr(tx->response_status),
-                                         bstr_len(tx->response_status), flags);
-    }
+    if (tx->response_status == NULL)
+        return 0;
 
-end:
-    FLOWLOCK_UNLOCK(f);
-    SCReturnInt(cnt);
+    return HttpStatCodePatternSearch(det_ctx,
+                                     (uint8_t *)bstr_ptr(tx->response_status),
+                                     bstr_len(tx->response_status), flags);
 }
 
 /**
@@ -25,8 +25,7 @@
 
 #include "app-layer-htp.h"
 
-int DetectEngineRunHttpStatCodeMpm(DetectEngineThreadCtx *,
-                                   Flow *f, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpStatCodeMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 int DetectEngineInspectHttpStatCode(ThreadVars *tv,
                                     DetectEngineCtx *, DetectEngineThreadCtx *,
                                     Signature *, Flow *, uint8_t, void *, int);
@@ -25,8 +25,7 @@
 
 #include "app-layer-htp.h"
 
-int DetectEngineRunHttpStatMsgMpm(DetectEngineThreadCtx *,
-                                  Flow *f, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpStatMsgMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 int DetectEngineInspectHttpStatMsg(ThreadVars *tv,
                                    DetectEngineCtx *, DetectEngineThreadCtx *,
                                    Signature *, Flow *, uint8_t, void *, int tx_id);
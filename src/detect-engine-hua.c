@@ -56,54 +56,23 @@
 
 #include "detect-engine-hua.h"
 
-int DetectEngineRunHttpUAMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                             HtpState *htp_state, uint8_t flags)
+/**
+ * \brief Run the http user agent mpm against a single transaction.
+ *
+ * \warning Flow should be locked by the caller.
+ */
+uint32_t DetectEngineRunHttpUAMpmTx(DetectEngineThreadCtx *det_ctx,
+                                    htp_tx_t *tx, uint8_t flags)
 {
-    htp_tx_t *tx = NULL;
-    uint32_t cnt = 0;
-    int idx;
-
-    /* we need to lock because the buffers are not actually true buffers
-     * but are ones that point to a buffer given by libhtp */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL) {
-        SCLogDebug("no HTTP state");
-        goto end;
-    }
-
-    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
-        SCLogDebug("HTP state has no conn(p)");
-        goto end;
-    }
-
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++) {
-
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL)
-            continue;
-
-        htp_header_t *h = (htp_header_t *)table_getc(tx->request_headers,
-                                                     "User-Agent");
-        if (h == NULL) {
-            SCLogDebug("HTTP user agent header not present in this request");
-            continue;
-        }
-
-        cnt += HttpUAPatternSearch(det_ctx,
-                                   (uint8_t *)bstr_ptr(h->value),
-                                   bstr_len(h->value), flags);
+    htp_header_t *h = HTPTxGetUserAgent(tx);
+    if (h == NULL) {
+        SCLogDebug("HTTP user agent header not present in this request");
+        return 0;
     }
 
- end:
-    FLOWLOCK_UNLOCK(f);
-    return cnt;
+    return HttpUAPatternSearch(det_ctx,
+                               (uint8_t *)bstr_ptr(h->value),
+                               bstr_len(h->value), flags);
 }
 
 /**
@@ -130,8 +99,7 @@ int DetectEngineInspectHttpUA(ThreadVars *tv,
     if (tx == NULL)
         return 0;
 
-    htp_header_t *h = (htp_header_t *)table_getc(tx->request_headers,
-                                                 "User-Agent");
+    htp_header_t *h = HTPTxGetUserAgent(tx);
     if (h == NULL) {
         SCLogDebug("HTTP user agent header not present in this request");
         return 0;
@@ -28,7 +28,7 @@
 int DetectEngineInspectHttpUA(ThreadVars *tv,
                               DetectEngineCtx *, DetectEngineThreadCtx *,
                               Signature *, Flow *, uint8_t, void *, int);
-int DetectEngineRunHttpUAMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectEngineRunHttpUAMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 void DetectEngineHttpUARegisterTests(void);
 
 #endif /* __DETECT_ENGINE_HUA_H__ */
@@ -48,6 +48,8 @@
 #include "detect-uricontent.h"
 
 #include "stream.h"
+#include "stream-tcp.h"
+#include "stream-tcp-inline.h"
 
 #include "util-cuda-handlers.h"
 #include "util-mpm-b2g-cuda.h"
@@ -315,16 +317,14 @@ uint32_t HttpClientBodyPatternSearch(DetectEngineThreadCtx *det_ctx,
         if (det_ctx->sgh->mpm_hcbd_ctx_ts == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hcbd_ctx_ts->mpm_type].
-            Search(det_ctx->sgh->mpm_hcbd_ctx_ts, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLarge(det_ctx->sgh->mpm_hcbd_ctx_ts, &det_ctx->mtcu,
+                             &det_ctx->pmq, body, body_len);
     } else {
         if (det_ctx->sgh->mpm_hcbd_ctx_tc == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hcbd_ctx_tc->mpm_type].
-            Search(det_ctx->sgh->mpm_hcbd_ctx_tc, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLarge(det_ctx->sgh->mpm_hcbd_ctx_tc, &det_ctx->mtcu,
+                             &det_ctx->pmq, body, body_len);
     }
 
     SCReturnUInt(ret);
@@ -349,16 +349,14 @@ uint32_t HttpServerBodyPatternSearch(DetectEngineThreadCtx *det_ctx,
         if (det_ctx->sgh->mpm_hsbd_ctx_ts == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hsbd_ctx_ts->mpm_type].
-            Search(det_ctx->sgh->mpm_hsbd_ctx_ts, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLarge(det_ctx->sgh->mpm_hsbd_ctx_ts, &det_ctx->mtcu,
+                             &det_ctx->pmq, body, body_len);
     } else {
         if (det_ctx->sgh->mpm_hsbd_ctx_tc == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hsbd_ctx_tc->mpm_type].
-            Search(det_ctx->sgh->mpm_hsbd_ctx_tc, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLarge(det_ctx->sgh->mpm_hsbd_ctx_tc, &det_ctx->mtcu,
+                             &det_ctx->pmq, body, body_len);
     }
 
     SCReturnUInt(ret);
@@ -706,7 +704,38 @@ uint32_t HttpHRHPatternSearch(DetectEngineThreadCtx *det_ctx,
     SCReturnUInt(ret);
 }
 
+/**
+ *  \brief Add the data of an smsg to the tail of the stream kept for the
+ *         stream mpm, keeping at most size bytes.
+ */
+static inline void StreamMpmTailUpdate(uint8_t *tail, uint16_t *tail_len,
+                                       uint16_t size, uint8_t *buf,
+                                       uint32_t buflen)
+{
+    if (buflen >= size) {
+        memcpy(tail, buf + buflen - size, size);
+        *tail_len = size;
+    } else {
+        uint16_t keep = *tail_len;
+        if (keep + buflen > size)
+            keep = size - buflen;
+
+        memmove(tail, tail + *tail_len - keep, keep);
+        memcpy(tail + keep, buf, buflen);
+        *tail_len = keep + buflen;
+    }
+}
+
 /** \brief Pattern match -- searches for only one pattern per signature.
+ *
+ *  With a streaming matcher the search continues in the state the previous
+ *  smsgs of the direction ended in, so patterns spanning smsgs are found.
+ *  These are added to det_ctx->smsg_span_pmq as well. If an smsg starts in
+ *  the middle of a pattern, the bytes preceding it are stored in
+ *  det_ctx->smsg_tail for the payload inspection. Only the last
+ *  STREAM_MPM_TAIL_SIZE bytes are kept, so longer patterns spanning smsgs
+ *  can be reported by the mpm but not be matched by the inspection. The
+ *  stream's copy of these bytes is allocated when it's first needed.
  *
  *  \param det_ctx detection engine thread ctx
  *  \param p packet
@@ -722,44 +751,115 @@ uint32_t StreamPatternSearch(DetectEngineThreadCtx *det_ctx, Packet *p,
 
     uint32_t ret = 0;
     uint8_t cnt = 0;
+    MpmCtx *mpm_ctx = (flags & STREAM_TOSERVER) ?
+        det_ctx->sgh->mpm_stream_ctx_ts : det_ctx->sgh->mpm_stream_ctx_tc;
+    MpmTableElmt *m = &mpm_table[mpm_ctx->mpm_type];
+    TcpStream *stream = NULL;
+    uint32_t state = 0;
+    uint8_t tail[STREAM_MPM_TAIL_SIZE];
+    uint16_t tail_len = 0;
+    uint16_t tail_size = 0;
+
+    /* in inline mode the smsgs overlap, so they are searched one by one */
+    if (m->SearchStream != NULL && !StreamTcpInlineMode() &&
+        p->flow != NULL && p->flow->protoctx != NULL)
+    {
+        TcpSession *ssn = (TcpSession *)p->flow->protoctx;
+        stream = (flags & STREAM_TOSERVER) ? &ssn->client : &ssn->server;
+
+        if (mpm_ctx->maxlen > STREAM_MPM_TAIL_SIZE)
+            tail_size = STREAM_MPM_TAIL_SIZE;
+        else if (mpm_ctx->maxlen > 0)
+            tail_size = mpm_ctx->maxlen - 1;
+
+        /* raw reassembly queues the smsgs back to back up to
+         * ra_raw_base_seq, so the smsgs continue the ones we searched
+         * last unless smsgs were dropped without being searched. After
+         * a gap we can't tell. */
+        uint32_t len = 0;
+        int gap = 0;
+        StreamMsg *s;
+        for (s = smsg; s != NULL; s = s->next) {
+            if (s->flags & STREAM_GAP)
+                gap = 1;
+            else
+                len += s->data.data_len;
+        }
+
+        FLOWLOCK_RDLOCK(p->flow);
+        if (stream->mpm_ctx == mpm_ctx && gap == 0 &&
+            stream->ra_raw_base_seq + 1 - len == stream->mpm_next_seq)
+        {
+            state = stream->mpm_state;
+            tail_len = stream->mpm_tail_len;
+            if (tail_len > 0)
+                memcpy(tail, stream->mpm_tail, tail_len);
+        }
+        FLOWLOCK_UNLOCK(p->flow);
+    }
 
     //PrintRawDataFp(stdout, smsg->data.data, smsg->data.data_len);
 
     uint32_t r;
-    if (flags & STREAM_TOSERVER) {
-        for ( ; smsg != NULL; smsg = smsg->next) {
-            r = mpm_table[det_ctx->sgh->mpm_stream_ctx_ts->mpm_type].
-                Search(det_ctx->sgh->mpm_stream_ctx_ts, &det_ctx->mtcs,
-                       &det_ctx->smsg_pmq[cnt], smsg->data.data,
-                       smsg->data.data_len);
-            if (r > 0) {
-                ret += r;
-
-                SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
-
-                /* merge results with overall pmq */
-                PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
+    for ( ; smsg != NULL; smsg = smsg->next) {
+        det_ctx->smsg_tail_len[cnt] = 0;
+
+        if (stream != NULL) {
+            if (state != 0 && tail_len > 0) {
+                memcpy(det_ctx->smsg_tail[cnt], tail, tail_len);
+                det_ctx->smsg_tail_len[cnt] = tail_len;
             }
 
-            cnt++;
-        }
-    } else {
-        for ( ; smsg != NULL; smsg = smsg->next) {
-            r = mpm_table[det_ctx->sgh->mpm_stream_ctx_tc->mpm_type].
-                Search(det_ctx->sgh->mpm_stream_ctx_tc, &det_ctx->mtcs,
-                       &det_ctx->smsg_pmq[cnt], smsg->data.data,
-                       smsg->data.data_len);
-            if (r > 0) {
-                ret += r;
-
-                SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
-
-                /* merge results with overall pmq */
-                PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
+            r = m->SearchStream(mpm_ctx, &det_ctx->mtcs,
+                                &det_ctx->smsg_pmq[cnt], smsg->data.data,
+                                smsg->data.data_len, &state,
+                                &det_ctx->smsg_span_pmq);
+
+            if (smsg->flags & STREAM_GAP) {
+                SCLogDebug("gap after smsg %p, starting over", smsg);
+                state = 0;
+                tail_len = 0;
+            } else {
+                StreamMpmTailUpdate(tail, &tail_len, tail_size,
+                                    smsg->data.data, smsg->data.data_len);
             }
+        } else {
+            r = m->Search(mpm_ctx, &det_ctx->mtcs, &det_ctx->smsg_pmq[cnt],
+                          smsg->data.data, smsg->data.data_len);
+        }
+        if (r > 0) {
+            ret += r;
+
+            SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
 
-            cnt++;
+            /* merge results with overall pmq */
+            PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
+        }
+
+        cnt++;
+    }
+
+    if (stream != NULL) {
+        /* the tail is only of use if the next smsg can continue a pattern */
+        if (state == 0)
+            tail_len = 0;
+
+        FLOWLOCK_WRLOCK(p->flow);
+        if (tail_len > 0 && stream->mpm_tail == NULL) {
+            if (StreamTcpCheckMemcap((uint64_t)STREAM_MPM_TAIL_SIZE) == 1)
+                stream->mpm_tail = SCMalloc(STREAM_MPM_TAIL_SIZE);
+            if (stream->mpm_tail != NULL)
+                StreamTcpIncrMemuse((uint64_t)STREAM_MPM_TAIL_SIZE);
+            else
+                tail_len = 0;
         }
+        stream->mpm_ctx = mpm_ctx;
+        stream->mpm_state = state;
+        stream->mpm_next_seq = stream->ra_raw_base_seq + 1;
+        stream->mpm_tail_len = tail_len;
+        if (tail_len > 0)
+            memcpy(stream->mpm_tail, tail, tail_len);
+        FLOWLOCK_UNLOCK(p->flow);
     }
 
     SCReturnInt(ret);
@@ -820,10 +920,12 @@ void StreamPatternCleanup(ThreadVars *t, DetectEngineThreadCtx *det_ctx, StreamM
 
     while (smsg != NULL) {
         PmqReset(&det_ctx->smsg_pmq[cnt]);
+        det_ctx->smsg_tail_len[cnt] = 0;
 
         smsg = smsg->next;
         cnt++;
     }
+    PmqReset(&det_ctx->smsg_span_pmq);
 }
 
 void PatternMatchDestroy(MpmCtx *mpm_ctx, uint16_t mpm_matcher) {
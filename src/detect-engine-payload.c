@@ -31,6 +31,7 @@
 #include "detect.h"
 #include "detect-engine.h"
 #include "detect-parse.h"
+#include "detect-content.h"
 #include "detect-engine-content-inspection.h"
 
 #include "util-debug.h"
@@ -127,6 +128,57 @@ int DetectEngineInspectStreamPayload(DetectEngineCtx *de_ctx,
     SCReturnInt(0);
 }
 
+/**
+ *  \brief Do the content inspection on an smsg together with the bytes of
+ *         the stream preceding it, for a fast pattern spanning the start of
+ *         the smsg.
+ *
+ *  Only a match with the fast pattern across the smsg start is accepted,
+ *  other matches were inspected with the previous smsg already. Offset and
+ *  depth are relative to the smsg start, which is lost in the joined
+ *  buffer, so signatures using them are not inspected.
+ *
+ *  \param tail bytes of the stream preceding the smsg data
+ *  \param tail_len no of bytes in tail, max STREAM_MPM_TAIL_SIZE
+ *  \param payload smsg data
+ *  \param payload_len length of the smsg data, max MSG_DATA_SIZE
+ *
+ *  \retval 0 no match
+ *  \retval 1 match
+ */
+int DetectEngineInspectStreamPayloadTail(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Signature *s, Flow *f,
+        uint8_t *tail, uint16_t tail_len, uint8_t *payload, uint32_t payload_len)
+{
+    SCEnter();
+
+    if (s->mpm_sm == NULL || tail_len == 0)
+        SCReturnInt(0);
+
+    SigMatch *sm = s->sm_lists[DETECT_SM_LIST_PMATCH];
+    for ( ; sm != NULL; sm = sm->next) {
+        if (sm->type != DETECT_CONTENT)
+            continue;
+
+        DetectContentData *cd = (DetectContentData *)sm->ctx;
+        if (!(cd->flags & (DETECT_CONTENT_DISTANCE|DETECT_CONTENT_WITHIN)) &&
+            (cd->flags & (DETECT_CONTENT_OFFSET|DETECT_CONTENT_DEPTH|
+                          DETECT_CONTENT_OFFSET_BE|DETECT_CONTENT_DEPTH_BE)))
+        {
+            SCReturnInt(0);
+        }
+    }
+
+    memcpy(det_ctx->smsg_join, tail, tail_len);
+    memcpy(det_ctx->smsg_join + tail_len, payload, payload_len);
+
+    det_ctx->stream_span_offset = tail_len;
+    int r = DetectEngineInspectStreamPayload(de_ctx, det_ctx, s, f,
+            det_ctx->smsg_join, tail_len + payload_len);
+    det_ctx->stream_span_offset = 0;
+    SCReturnInt(r);
+}
+
 #ifdef UNITTESTS
 
 /** \test Not the first but the second occurence of "abc" should be used
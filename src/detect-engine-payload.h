@@ -30,6 +30,9 @@ int DetectEngineInspectPacketPayload(DetectEngineCtx *,
 int DetectEngineInspectStreamPayload(DetectEngineCtx *,
         DetectEngineThreadCtx *, Signature *, Flow *,
         uint8_t *, uint32_t);
+int DetectEngineInspectStreamPayloadTail(DetectEngineCtx *,
+        DetectEngineThreadCtx *, Signature *, Flow *,
+        uint8_t *, uint16_t, uint8_t *, uint32_t);
 
 void PayloadRegisterTests(void);
 
@@ -200,6 +200,11 @@ void DetectEngineStateFree(DetectEngineState *state) {
 
     state->cnt = 0;
 
+    if (state->mpm_cache[0].ids != NULL)
+        SCFree(state->mpm_cache[0].ids);
+    if (state->mpm_cache[1].ids != NULL)
+        SCFree(state->mpm_cache[1].ids);
+
     SCFree(state);
 }
 
@@ -228,9 +233,57 @@ void DetectEngineStateReset(DetectEngineState *state) {
 
     state->cnt = 0;
 
+    /* the results may be for a sgh of an old de_ctx */
+    DeStateMpmCacheReset(&state->mpm_cache[0], NULL, 0);
+    DeStateMpmCacheReset(&state->mpm_cache[1], NULL, 0);
+
     SCReturn;
 }
 
+/**
+ *  \brief (re)start a mpm cache for a sgh and transaction
+ *  \param cache LOCKED cache
+ *  \param sgh sgh the results will be produced with
+ *  \param tx_id transaction the results will be for
+ */
+void DeStateMpmCacheReset(DeStateMpmCache *cache, SigGroupHead *sgh, int tx_id) {
+    cache->sgh = sgh;
+    cache->tx_id = tx_id;
+    cache->buffers = 0;
+    cache->cnt = 0;
+}
+
+/**
+ *  \brief add the mpm results of a buffer to the cache
+ *  \param cache LOCKED cache
+ *  \param ids pattern ids that matched in the buffer
+ *  \param cnt number of ids
+ *  \param buffer SIG_GROUP_HEAD_MPM_* flag of the buffer
+ *  \retval 0 ok
+ *  \retval -1 out of memory, buffer not cached
+ */
+int DeStateMpmCacheAdd(DeStateMpmCache *cache, uint32_t *ids, uint32_t cnt,
+        uint32_t buffer) {
+    if (cache->cnt + cnt > cache->size) {
+        uint32_t size = cache->size ? cache->size * 2 : 8;
+        while (size < cache->cnt + cnt)
+            size *= 2;
+
+        uint32_t *ptr = SCRealloc(cache->ids, size * sizeof(uint32_t));
+        if (unlikely(ptr == NULL))
+            return -1;
+        cache->ids = ptr;
+        cache->size = size;
+    }
+
+    if (cnt > 0) {
+        memcpy(cache->ids + cache->cnt, ids, cnt * sizeof(uint32_t));
+        cache->cnt += cnt;
+    }
+    cache->buffers |= buffer;
+    return 0;
+}
+
 /**
  *  \brief update the transaction id
  *
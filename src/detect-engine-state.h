@@ -116,6 +116,18 @@ typedef struct DeStateStore_ {
     struct DeStateStore_ *next;                     /**< ptr to the next array */
 } DeStateStore;
 
+/** mpm results of the http buffers of a transaction that can't change
+ *  anymore, so later packets of the transaction don't scan them again */
+typedef struct DeStateMpmCache_ {
+    struct SigGroupHead_ *sgh;      /**< sgh the results were produced with */
+    int tx_id;                      /**< transaction the results are for */
+    uint32_t buffers;               /**< SIG_GROUP_HEAD_MPM_* flags of the
+                                     *   buffers that are cached */
+    uint32_t *ids;                  /**< pattern ids that matched */
+    uint32_t cnt;
+    uint32_t size;
+} DeStateMpmCache;
+
 /** \brief State store main object */
 typedef struct DetectEngineState_ {
     DeStateStore *head;             /**< signature state storage */
@@ -130,6 +142,7 @@ typedef struct DetectEngineState_ {
     uint16_t toserver_filestore_cnt;/**< number of sigs with filestore that
                                      *   cannot match in to server direction. */
     uint16_t flags;
+    DeStateMpmCache mpm_cache[2];   /**< to server, to client */
 } DetectEngineState;
 
 void DeStateRegisterTests(void);
@@ -137,6 +150,8 @@ void DeStateRegisterTests(void);
 DeStateStore *DeStateStoreAlloc(void);
 void DeStateStoreFree(DeStateStore *);
 void DetectEngineStateReset(DetectEngineState *state);
+void DeStateMpmCacheReset(DeStateMpmCache *, struct SigGroupHead_ *, int);
+int DeStateMpmCacheAdd(DeStateMpmCache *, uint32_t *, uint32_t, uint32_t);
 
 DetectEngineState *DetectEngineStateAlloc(void);
 void DetectEngineStateFree(DetectEngineState *);
@@ -1082,6 +1082,7 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data) {
         //PmqSetup(&det_ctx->smsg_pmq[i], 0, DetectContentMaxId(de_ctx));
         PmqSetup(&det_ctx->smsg_pmq[i], 0, de_ctx->max_fp_id);
     }
+    PmqSetup(&det_ctx->smsg_span_pmq, 0, de_ctx->max_fp_id);
 
     /* IP-ONLY */
     DetectEngineIPOnlyThreadInit(de_ctx,&det_ctx->io_ctx);
@@ -1169,6 +1170,7 @@ static TmEcode DetectEngineThreadCtxInitForLiveRuleSwap(ThreadVars *tv, void *in
     for (i = 0; i < 256; i++) {
         PmqSetup(&det_ctx->smsg_pmq[i], 0, DetectContentMaxId(de_ctx));
     }
+    PmqSetup(&det_ctx->smsg_span_pmq, 0, DetectContentMaxId(de_ctx));
 
     /* IP-ONLY */
     DetectEngineIPOnlyThreadInit(de_ctx,&det_ctx->io_ctx);
@@ -1241,6 +1243,7 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
     for (i = 0; i < 256; i++) {
         PmqFree(&det_ctx->smsg_pmq[i]);
     }
+    PmqFree(&det_ctx->smsg_span_pmq);
 
     if (det_ctx->de_state_sig_array != NULL)
         SCFree(det_ctx->de_state_sig_array);
@@ -1250,22 +1253,15 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
     if (det_ctx->bj_values != NULL)
         SCFree(det_ctx->bj_values);
 
+    /* the hsbd and hcbd buffers point into the tx bodies, they are
+     * not ours to free */
     if (det_ctx->hsbd != NULL) {
         SCLogDebug("det_ctx hsbd %u", det_ctx->hsbd_buffers_list_len);
-        for (i = 0; i < det_ctx->hsbd_buffers_list_len; i++) {
-            if (det_ctx->hsbd[i].buffer != NULL)
-                SCFree(det_ctx->hsbd[i].buffer);
-        }
         SCFree(det_ctx->hsbd);
     }
 
     if (det_ctx->hcbd != NULL) {
         SCLogDebug("det_ctx hcbd %u", det_ctx->hcbd_buffers_list_len);
-        for (i = 0; i < det_ctx->hcbd_buffers_list_len; i++) {
-            if (det_ctx->hcbd[i].buffer != NULL)
-                SCFree(det_ctx->hcbd[i].buffer);
-            SCLogDebug("det_ctx->hcbd[i].buffer_size %u", det_ctx->hcbd[i].buffer_size);
-        }
         SCFree(det_ctx->hcbd);
     }
 
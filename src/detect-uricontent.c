@@ -275,56 +275,20 @@ static inline int DoDetectAppLayerUricontentMatch (DetectEngineThreadCtx *det_ct
 }
 
 /**
- *  \brief Run the pattern matcher against the uri(s)
+ * \brief Run the uri mpm against the normalized uri of a single transaction.
  *
- *  We run against _all_ uri(s) we have as the pattern matcher will
- *  flag each sig that has a match. We need to do this for all uri(s)
- *  to not miss possible events.
- *
- *  \param f locked flow
- *  \param htp_state initialized htp state
- *
- *  \warning Make sure the flow/state is locked
- *  \todo what should we return? Just the fact that we matched?
+ * \warning Flow should be locked by the caller.
  */
-uint32_t DetectUricontentInspectMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
-                                    HtpState *htp_state, uint8_t flags)
+uint32_t DetectUricontentInspectMpmTx(DetectEngineThreadCtx *det_ctx,
+                                      htp_tx_t *tx, uint8_t flags)
 {
-    SCEnter();
-
-    uint32_t cnt = 0;
-    int idx = 0;
-    htp_tx_t *tx = NULL;
-
-    /* locking the flow, we will inspect the htp state */
-    FLOWLOCK_RDLOCK(f);
-
-    if (htp_state == NULL || htp_state->connp == NULL) {
-        SCLogDebug("no HTTP state / no connp");
-        FLOWLOCK_UNLOCK(f);
-        SCReturnUInt(0U);
-    }
+    if (tx->request_uri_normalized == NULL)
+        return 0;
 
-    idx = AppLayerTransactionGetInspectId(f);
-    if (idx == -1) {
-        goto end;
-    }
-
-    int size = (int)list_size(htp_state->connp->conn->transactions);
-    for (; idx < size; idx++)
-    {
-        tx = list_get(htp_state->connp->conn->transactions, idx);
-        if (tx == NULL || tx->request_uri_normalized == NULL)
-            continue;
-
-        cnt += DoDetectAppLayerUricontentMatch(det_ctx, (uint8_t *)
-                                               bstr_ptr(tx->request_uri_normalized),
-                                               bstr_len(tx->request_uri_normalized),
-                                               flags);
-    }
-end:
-    FLOWLOCK_UNLOCK(f);
-    SCReturnUInt(cnt);
+    return DoDetectAppLayerUricontentMatch(det_ctx, (uint8_t *)
+                                           bstr_ptr(tx->request_uri_normalized),
+                                           bstr_len(tx->request_uri_normalized),
+                                           flags);
 }
 
 /*
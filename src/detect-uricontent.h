@@ -36,6 +36,6 @@ uint32_t DetectUricontentMaxId(DetectEngineCtx *);
 //uint32_t DetectUricontentInspectMpm(DetectEngineThreadCtx *det_ctx, void *alstate);
 void DetectUricontentPrint(DetectContentData *);
 
-uint32_t DetectUricontentInspectMpm(DetectEngineThreadCtx *, Flow *, HtpState *, uint8_t);
+uint32_t DetectUricontentInspectMpmTx(DetectEngineThreadCtx *, htp_tx_t *, uint8_t);
 
 #endif /* __DETECT_URICONTENT_H__ */
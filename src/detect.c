@@ -938,6 +938,182 @@ end:
 #define SMS_USED_PM             0x02
 #define SMS_USED_STREAM_PM      0x04
 
+/**
+ * \internal
+ * \brief Get the http buffers of a transaction that can't change anymore.
+ *
+ *        Request headers are complete once the body starts, unless the
+ *        body is chunked as trailers are added to the headers. Same for
+ *        the response. The raw headers buffer holds both the request and
+ *        the response headers.
+ *
+ * \retval buffers SIG_GROUP_HEAD_MPM_* flags of the complete buffers
+ */
+static uint32_t DetectHttpMpmCompleteBuffers(htp_tx_t *tx, uint8_t flags)
+{
+    uint32_t buffers = 0;
+    int req_done = (tx->progress >= TX_PROGRESS_WAIT ||
+            (tx->progress > TX_PROGRESS_REQ_HEADERS &&
+             tx->request_transfer_coding != CHUNKED));
+    int res_done = (tx->progress >= TX_PROGRESS_DONE ||
+            (tx->progress > TX_PROGRESS_RES_HEADERS &&
+             tx->response_transfer_coding != CHUNKED));
+
+    if (flags & STREAM_TOSERVER) {
+        if (req_done) {
+            buffers |= SIG_GROUP_HEAD_MPM_URI | SIG_GROUP_HEAD_MPM_HRUD |
+                SIG_GROUP_HEAD_MPM_HMD | SIG_GROUP_HEAD_MPM_HUAD |
+                SIG_GROUP_HEAD_MPM_HHHD | SIG_GROUP_HEAD_MPM_HRHHD |
+                SIG_GROUP_HEAD_MPM_HHD | SIG_GROUP_HEAD_MPM_HCD;
+        }
+    } else {
+        if (res_done) {
+            buffers |= SIG_GROUP_HEAD_MPM_HSMD | SIG_GROUP_HEAD_MPM_HSCD |
+                SIG_GROUP_HEAD_MPM_HHD | SIG_GROUP_HEAD_MPM_HCD;
+        }
+    }
+#ifdef HAVE_HTP_TX_GET_RESPONSE_HEADERS_RAW
+    if (req_done && res_done)
+        buffers |= SIG_GROUP_HEAD_MPM_HRHD;
+#else
+    if (req_done)
+        buffers |= SIG_GROUP_HEAD_MPM_HRHD;
+#endif
+
+    return buffers;
+}
+
+/* run the mpm of a http buffer, unless its results for this tx are cached.
+ * Store the results if the buffer can't change anymore. */
+#define HTTP_MPM_RUN(buffer, prof_id, call) do {                            \
+    if (!(sgh_flags & (buffer)) || (cached & (buffer)))                     \
+        break;                                                              \
+    uint32_t pmq_cnt = det_ctx->pmq.pattern_id_array_cnt;                   \
+    PACKET_PROFILING_DETECT_START(p, (prof_id));                            \
+    cnt += (call);                                                          \
+    PACKET_PROFILING_DETECT_END(p, (prof_id));                              \
+    if (cache != NULL && (complete & (buffer))) {                           \
+        (void)DeStateMpmCacheAdd(cache,                                     \
+                det_ctx->pmq.pattern_id_array + pmq_cnt,                    \
+                det_ctx->pmq.pattern_id_array_cnt - pmq_cnt, (buffer));     \
+    }                                                                       \
+} while (0)
+
+/**
+ * \internal
+ * \brief Run the mpm on all http buffers of the transactions that still
+ *        need inspection, walking the transactions only once.
+ *
+ *        The results of the buffers of the inspected transaction that
+ *        can't change anymore are kept in the flow's de_state, so later
+ *        packets of the transaction reuse them instead of scanning the
+ *        buffers again.
+ *
+ * \param de_ctx    Pointer to the detection engine context.
+ * \param det_ctx   Pointer to the detection engine thread context.
+ * \param p         Packet, with a flow.
+ * \param htp_state Http state of the flow.
+ * \param flags     STREAM_* flags, the direction decides the buffers.
+ *
+ * \retval cnt number of matches
+ */
+static uint32_t DetectEngineRunHttpMpm(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Packet *p, HtpState *htp_state,
+        uint8_t flags)
+{
+    Flow *f = p->flow;
+    uint32_t sgh_flags = det_ctx->sgh->flags;
+    uint32_t cnt = 0;
+
+    /* de_state lock before the flow lock, like the stateful detection */
+    SCMutexLock(&f->de_state_m);
+    /* write lock as the body and header buffer getters update the
+     * inspection trackers in the htp state */
+    FLOWLOCK_WRLOCK(f);
+
+    if (htp_state->connp == NULL || htp_state->connp->conn == NULL) {
+        SCLogDebug("HTP state has no conn(p)");
+        goto end;
+    }
+
+    int idx = AppLayerTransactionGetInspectId(f);
+    if (idx == -1)
+        goto end;
+
+    int inspect_id = idx;
+    int size = (int)list_size(htp_state->connp->conn->transactions);
+    for (; idx < size; idx++) {
+        htp_tx_t *tx = list_get(htp_state->connp->conn->transactions, idx);
+        if (tx == NULL)
+            continue;
+
+        /* only the inspected tx is cached, for the later ones the pmq
+         * may already hold some of their ids */
+        DeStateMpmCache *cache = NULL;
+        uint32_t cached = 0;
+        uint32_t complete = 0;
+        if (idx == inspect_id) {
+            if (f->de_state == NULL)
+                f->de_state = DetectEngineStateAlloc();
+            if (f->de_state != NULL)
+                cache = &f->de_state->mpm_cache[(flags & STREAM_TOSERVER) ? 0 : 1];
+        }
+        if (cache != NULL) {
+            if (cache->sgh == det_ctx->sgh && cache->tx_id == idx) {
+                uint32_t u;
+                for (u = 0; u < cache->cnt; u++) {
+                    MpmVerifyMatch(&det_ctx->mtcu, &det_ctx->pmq, cache->ids[u]);
+                }
+                cnt += cache->cnt;
+                cached = cache->buffers;
+            } else {
+                DeStateMpmCacheReset(cache, det_ctx->sgh, idx);
+            }
+            complete = DetectHttpMpmCompleteBuffers(tx, flags);
+        }
+
+        if (flags & STREAM_TOSERVER) {
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_URI, PROF_DETECT_MPM_URI,
+                    DetectUricontentInspectMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HRUD, PROF_DETECT_MPM_HRUD,
+                    DetectEngineRunHttpRawUriMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HCBD, PROF_DETECT_MPM_HCBD,
+                    DetectEngineRunHttpClientBodyMpmTx(de_ctx, det_ctx, f,
+                        htp_state, idx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HMD, PROF_DETECT_MPM_HMD,
+                    DetectEngineRunHttpMethodMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HUAD, PROF_DETECT_MPM_HUAD,
+                    DetectEngineRunHttpUAMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HHHD, PROF_DETECT_MPM_HHHD,
+                    DetectEngineRunHttpHHMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HRHHD, PROF_DETECT_MPM_HRHHD,
+                    DetectEngineRunHttpHRHMpmTx(det_ctx, tx, flags));
+        } else if (flags & STREAM_TOCLIENT) {
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HSBD, PROF_DETECT_MPM_HSBD,
+                    DetectEngineRunHttpServerBodyMpmTx(de_ctx, det_ctx, f,
+                        htp_state, idx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HSMD, PROF_DETECT_MPM_HSMD,
+                    DetectEngineRunHttpStatMsgMpmTx(det_ctx, tx, flags));
+            HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HSCD, PROF_DETECT_MPM_HSCD,
+                    DetectEngineRunHttpStatCodeMpmTx(det_ctx, tx, flags));
+        }
+        HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HHD, PROF_DETECT_MPM_HHD,
+                DetectEngineRunHttpHeaderMpmTx(NULL, det_ctx, f,
+                    htp_state, idx, flags));
+        HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HRHD, PROF_DETECT_MPM_HRHD,
+                DetectEngineRunHttpRawHeaderMpmTx(det_ctx, tx, flags));
+        HTTP_MPM_RUN(SIG_GROUP_HEAD_MPM_HCD, PROF_DETECT_MPM_HCD,
+                DetectEngineRunHttpCookieMpmTx(det_ctx, tx, flags));
+    }
+
+end:
+    FLOWLOCK_UNLOCK(f);
+    SCMutexUnlock(&f->de_state_m);
+    return cnt;
+}
+
+#undef HTTP_MPM_RUN
+
 /**
  * \internal
  * \brief Run mpm on packet, stream and other buffers based on
@@ -991,74 +1167,9 @@ static inline void DetectMpmPrefilter(DetectEngineCtx *de_ctx,
 
         /* all http based mpms */
         if (alproto == ALPROTO_HTTP && alstate != NULL) {
-            if (p->flowflags & FLOW_PKT_TOSERVER) {
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_URI) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_URI);
-                    DetectUricontentInspectMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_URI);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRUD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRUD);
-                    DetectEngineRunHttpRawUriMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRUD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HCBD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HCBD);
-                    DetectEngineRunHttpClientBodyMpm(de_ctx, det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HCBD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HMD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HMD);
-                    DetectEngineRunHttpMethodMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HMD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HUAD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HUAD);
-                    DetectEngineRunHttpUAMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HUAD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HHHD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HHHD);
-                    DetectEngineRunHttpHHMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HHHD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRHHD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRHHD);
-                    DetectEngineRunHttpHRHMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRHHD);
-                }
-            } else { /* implied FLOW_PKT_TOCLIENT */
-                if ((p->flowflags & FLOW_PKT_TOCLIENT) && (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSBD)) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSBD);
-                    DetectEngineRunHttpServerBodyMpm(de_ctx, det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSBD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSMD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSMD);
-                    DetectEngineRunHttpStatMsgMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSMD);
-                }
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSCD) {
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSCD);
-                    DetectEngineRunHttpStatCodeMpm(det_ctx, p->flow, alstate, flags);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSCD);
-                }
-            }
-            if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HHD) {
-                PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HHD);
-                DetectEngineRunHttpHeaderMpm(det_ctx, p->flow, alstate, flags);
-                PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HHD);
-            }
-            if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRHD) {
-                PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRHD);
-                DetectEngineRunHttpRawHeaderMpm(det_ctx, p->flow, alstate, flags);
-                PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRHD);
-            }
-            if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HCD) {
-                PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HCD);
-                DetectEngineRunHttpCookieMpm(det_ctx, p->flow, alstate, flags);
-                PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HCD);
-            }
+            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HTTP);
+            DetectEngineRunHttpMpm(de_ctx, det_ctx, p, alstate, flags);
+            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HTTP);
         }
     } else {
         SCLogDebug("NOT p->flowflags & FLOW_PKT_ESTABLISHED");
@@ -1082,65 +1193,39 @@ static void DebugInspectIds(Packet *p, Flow *f, StreamMsg *smsg)
 }
 #endif
 
-static void AlertDebugLogModeSyncFlowbitsNamesToPacketStruct(Packet *p, DetectEngineCtx *de_ctx)
+typedef struct AlertDebugLogFlowbitsNames_ {
+    Packet *p;
+    DetectEngineCtx *de_ctx;
+    int cnt;
+} AlertDebugLogFlowbitsNames;
+
+static void AlertDebugLogModeAddFlowbitName(uint16_t idx, void *data)
 {
-#define MALLOC_JUMP 5
+    AlertDebugLogFlowbitsNames *names = (AlertDebugLogFlowbitsNames *)data;
 
-    int i = 0;
+    /* returns a copy of the name */
+    char *name = VariableIdxGetName(names->de_ctx, idx, DETECT_FLOWBITS);
+    if (name != NULL) {
+        names->p->debuglog_flowbits_names[names->cnt++] = name;
+    }
+}
 
-    GenericVar *gv = p->flow->flowvar;
+static void AlertDebugLogModeSyncFlowbitsNamesToPacketStruct(Packet *p, DetectEngineCtx *de_ctx)
+{
+    AlertDebugLogFlowbitsNames names = { p, de_ctx, 0 };
 
-    while (gv != NULL) {
-        i++;
-        gv = gv->next;
-    }
-    if (i == 0)
+    int cnt = FlowBitsForEach(p->flow->flowbits, NULL, NULL);
+    if (cnt == 0)
         return;
 
-    p->debuglog_flowbits_names_len = i;
-
-    p->debuglog_flowbits_names = SCMalloc(sizeof(char *) *
-                                          p->debuglog_flowbits_names_len);
+    p->debuglog_flowbits_names = SCMalloc(sizeof(char *) * cnt);
     if (p->debuglog_flowbits_names == NULL) {
         return;
     }
-    memset(p->debuglog_flowbits_names, 0,
-           sizeof(char *) * p->debuglog_flowbits_names_len);
-
-    i = 0;
-    gv = p->flow->flowvar;
-    while (gv != NULL) {
-        if (gv->type != DETECT_FLOWBITS) {
-            gv = gv->next;
-            continue;
-        }
-
-        FlowBit *fb = (FlowBit *) gv;
-        char *name = VariableIdxGetName(de_ctx, fb->idx, fb->type);
-        if (name != NULL) {
-            p->debuglog_flowbits_names[i] = SCStrdup(name);
-            if (p->debuglog_flowbits_names[i] == NULL) {
-                return;
-            }
-            i++;
-        }
-
-        if (i == p->debuglog_flowbits_names_len) {
-            p->debuglog_flowbits_names_len += MALLOC_JUMP;
-            p->debuglog_flowbits_names = SCRealloc(p->debuglog_flowbits_names,
-                                                   sizeof(char *) *
-                                                   p->debuglog_flowbits_names_len);
-            if (p->debuglog_flowbits_names == NULL) {
-                return;
-            }
-            memset(p->debuglog_flowbits_names +
-                   p->debuglog_flowbits_names_len - MALLOC_JUMP,
-                   0, sizeof(char *) * MALLOC_JUMP);
-        }
-
-        gv = gv->next;
-    }
+    memset(p->debuglog_flowbits_names, 0, sizeof(char *) * cnt);
+    p->debuglog_flowbits_names_len = cnt;
 
+    FlowBitsForEach(p->flow->flowbits, AlertDebugLogModeAddFlowbitName, &names);
     return;
 }
 
@@ -1206,6 +1291,8 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
                 p->flow->de_ctx_id = de_ctx->id;
                 GenericVarFree(p->flow->flowvar);
                 p->flow->flowvar = NULL;
+                FlowBitsFree(p->flow->flowbits);
+                p->flow->flowbits = NULL;
             }
 
             /* set the iponly stuff */
@@ -1399,7 +1486,7 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
          * can't match and we skip it. */
         if ((p->flags & PKT_HAS_FLOW) && (s->flags & SIG_FLAG_REQUIRE_FLOWVAR)) {
             FLOWLOCK_RDLOCK(p->flow);
-            int m  = p->flow->flowvar ? 1 : 0;
+            int m  = (p->flow->flowvar || p->flow->flowbits) ? 1 : 0;
             FLOWLOCK_UNLOCK(p->flow);
 
             /* no flowvars? skip this sig */
@@ -1482,7 +1569,16 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
                             continue;
                         }
 
-                        if (DetectEngineInspectStreamPayload(de_ctx, det_ctx, s, p->flow, smsg_inspect->data.data, smsg_inspect->data.data_len) == 1) {
+                        /* if the stream mpm found the fast pattern across
+                         * the start of an smsg, the match may span it */
+                        if (DetectEngineInspectStreamPayload(de_ctx, det_ctx, s, p->flow, smsg_inspect->data.data, smsg_inspect->data.data_len) == 1 ||
+                            ((sms_runflags & SMS_USED_STREAM_PM) && det_ctx->smsg_tail_len[pmq_idx] > 0 &&
+                             (s->flags & SIG_FLAG_MPM_STREAM) && !(s->flags & SIG_FLAG_MPM_STREAM_NEG) &&
+                             (det_ctx->smsg_span_pmq.pattern_id_bitarray[(s->mpm_pattern_id_div_8)] & s->mpm_pattern_id_mod_8) &&
+                             DetectEngineInspectStreamPayloadTail(de_ctx, det_ctx, s, p->flow,
+                                 det_ctx->smsg_tail[pmq_idx], det_ctx->smsg_tail_len[pmq_idx],
+                                 smsg_inspect->data.data, smsg_inspect->data.data_len) == 1))
+                        {
                             SCLogDebug("match in smsg %p", smsg);
                             pmatch = 1;
                             det_ctx->flags |= DETECT_ENGINE_THREAD_CTX_STREAM_CONTENT_MATCH;
@@ -4388,6 +4484,9 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
     if (DetectSetFastPatternAndItsId(de_ctx) < 0)
         return -1;
 
+    /* make the flowbits bitmaps big enough for all our names */
+    FlowBitSetMaxIdx(de_ctx->variable_names_idx);
+
     /* if we are using single sgh_mpm_context then let us init the standard mpm
      * contexts using the mpm_ctx factory */
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
@@ -11413,6 +11512,432 @@ int SigTestSIMDMask04(void) {
 #endif
 }
 
+/**
+ * \test Test that rules on the different http request buffers alert when
+ *       the http mpms run from the single walk over the transactions.
+ */
+static int SigTestHttpMpm01(void)
+{
+    TcpSession ssn;
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    Flow f;
+    uint8_t http_buf[] =
+        "POST /one/two HTTP/1.1\r\n"
+        "Host: www.three.org\r\n"
+        "User-Agent: four\r\n"
+        "Cookie: five\r\n"
+        "Content-Length: 3\r\n\r\n"
+        "six";
+    uint32_t http_len = sizeof(http_buf) - 1;
+    char *sigs[] = {
+        "alert http any any -> any any (content:\"/one/\"; http_uri; sid:1;)",
+        "alert http any any -> any any (content:\"POST\"; http_method; sid:2;)",
+        "alert http any any -> any any (content:\"four\"; http_user_agent; sid:3;)",
+        "alert http any any -> any any (content:\"five\"; http_cookie; sid:4;)",
+        "alert http any any -> any any (content:\"six\"; http_client_body; sid:5;)",
+        "alert http any any -> any any (content:\"three\"; http_host; nocase; sid:6;)",
+        "alert http any any -> any any (content:\"User-Agent\"; http_header; sid:7;)",
+        /* in the request, but not in these buffers */
+        "alert http any any -> any any (content:\"four\"; http_uri; sid:8;)",
+        "alert http any any -> any any (content:\"six\"; http_header; sid:9;)",
+        "alert http any any -> any any (content:\"POST\"; http_cookie; sid:10;)",
+    };
+    int alerts[] = { 1, 1, 1, 1, 1, 1, 1, 0, 0, 0 };
+    int result = 0;
+    int i;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    p = UTHBuildPacket(NULL, 0, IPPROTO_TCP);
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.flags |= FLOW_IPV4;
+    p->flow = &f;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+    p->flowflags |= FLOW_PKT_ESTABLISHED;
+    p->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+
+    de_ctx->flags |= DE_QUIET;
+    de_ctx->mpm_matcher = MPM_AC;
+
+    Signature *prev = NULL;
+    for (i = 0; i < (int)(sizeof(sigs) / sizeof(sigs[0])); i++) {
+        Signature *s = SigInit(de_ctx, sigs[i]);
+        if (s == NULL) {
+            printf("sig %d failed to parse: ", i + 1);
+            goto end;
+        }
+        if (prev == NULL)
+            de_ctx->sig_list = s;
+        else
+            prev->next = s;
+        prev = s;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    int r = AppLayerParse(NULL, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf, http_len);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+
+    for (i = 0; i < (int)(sizeof(alerts) / sizeof(alerts[0])); i++) {
+        if ((PacketAlertCheck(p, i + 1) ? 1 : 0) != alerts[i]) {
+            printf("sid %d %s: ", i + 1,
+                    alerts[i] ? "didn't match but should have" :
+                    "matched but shouldn't have");
+            goto end;
+        }
+    }
+
+    result = 1;
+
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL)
+        SigGroupCleanup(de_ctx);
+    if (de_ctx != NULL)
+        SigCleanSignatures(de_ctx);
+    if (de_ctx != NULL)
+        DetectEngineCtxFree(de_ctx);
+
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
+/**
+ * \test Test that the mpm results of a complete http buffer are kept for
+ *       the tx and reused, and that an incomplete buffer isn't cached.
+ */
+static int SigTestHttpMpmCache(uint8_t *http_buf, uint32_t http_len,
+        int complete)
+{
+    TcpSession ssn;
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    Flow f;
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    p = UTHBuildPacket(NULL, 0, IPPROTO_TCP);
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.flags |= FLOW_IPV4;
+    p->flow = &f;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+    p->flowflags |= FLOW_PKT_ESTABLISHED;
+    p->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, "alert http any any -> any any "
+                               "(content:\"/one/\"; http_uri; sid:1;)");
+    if (de_ctx->sig_list == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    int r = AppLayerParse(NULL, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf, http_len);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    det_ctx->sgh = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p);
+    if (det_ctx->sgh == NULL)
+        goto end;
+
+    uint32_t id = ((DetectContentData *)de_ctx->sig_list->mpm_sm->ctx)->id;
+
+    DetectEngineRunHttpMpm(de_ctx, det_ctx, p, f.alstate, STREAM_TOSERVER);
+    if (det_ctx->pmq.pattern_id_array_cnt != 1 ||
+        det_ctx->pmq.pattern_id_array[0] != id) {
+        printf("expected pattern %u in the pmq: ", id);
+        goto end;
+    }
+    PmqReset(&det_ctx->pmq);
+
+    DeStateMpmCache *cache = &f.de_state->mpm_cache[0];
+    if (!complete) {
+        if (cache->buffers & SIG_GROUP_HEAD_MPM_URI) {
+            printf("incomplete uri cached: ");
+            goto end;
+        }
+        result = 1;
+        goto end;
+    }
+
+    if (cache->sgh != det_ctx->sgh || cache->tx_id != 0 ||
+        !(cache->buffers & SIG_GROUP_HEAD_MPM_URI) ||
+        cache->cnt != 1 || cache->ids[0] != id) {
+        printf("uri results not cached: ");
+        goto end;
+    }
+
+    /* the next run takes the ids from the cache instead of scanning */
+    cache->ids[0] = id ^ 1;
+    DetectEngineRunHttpMpm(de_ctx, det_ctx, p, f.alstate, STREAM_TOSERVER);
+    if (det_ctx->pmq.pattern_id_array_cnt != 1 ||
+        det_ctx->pmq.pattern_id_array[0] != (id ^ 1)) {
+        printf("cache not used: ");
+        goto end;
+    }
+    PmqReset(&det_ctx->pmq);
+
+    /* after a reset the uri is scanned again */
+    DetectEngineStateReset(f.de_state);
+    DetectEngineRunHttpMpm(de_ctx, det_ctx, p, f.alstate, STREAM_TOSERVER);
+    if (det_ctx->pmq.pattern_id_array_cnt != 1 ||
+        det_ctx->pmq.pattern_id_array[0] != id) {
+        printf("expected pattern %u in the pmq after reset: ", id);
+        goto end;
+    }
+    PmqReset(&det_ctx->pmq);
+
+    result = 1;
+
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL)
+        SigGroupCleanup(de_ctx);
+    if (de_ctx != NULL)
+        SigCleanSignatures(de_ctx);
+    if (de_ctx != NULL)
+        DetectEngineCtxFree(de_ctx);
+
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
+static int SigTestHttpMpmCache01(void)
+{
+    uint8_t http_buf[] =
+        "GET /one/two HTTP/1.1\r\n"
+        "Host: www.three.org\r\n\r\n";
+
+    return SigTestHttpMpmCache(http_buf, sizeof(http_buf) - 1, 1);
+}
+
+/** \test the request body is still coming in, the uri can't change */
+static int SigTestHttpMpmCache02(void)
+{
+    uint8_t http_buf[] =
+        "POST /one/two HTTP/1.1\r\n"
+        "Host: www.three.org\r\n"
+        "Content-Length: 10\r\n\r\n"
+        "abc";
+
+    return SigTestHttpMpmCache(http_buf, sizeof(http_buf) - 1, 1);
+}
+
+/** \test chunked request body, trailers may still update the headers */
+static int SigTestHttpMpmCache03(void)
+{
+    uint8_t http_buf[] =
+        "POST /one/two HTTP/1.1\r\n"
+        "Host: www.three.org\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n"
+        "3\r\nabc\r\n";
+
+    return SigTestHttpMpmCache(http_buf, sizeof(http_buf) - 1, 0);
+}
+
+
+/**
+ *  \brief Queue an smsg with buf as if raw reassembly added it to the
+ *         to server stream.
+ */
+static int SigTestStreamMpmQueue(TcpSession *ssn, char *buf)
+{
+    StreamMsg *smsg = StreamMsgGetFromPool();
+    if (smsg == NULL)
+        return 0;
+
+    uint32_t len = strlen(buf);
+    memcpy(smsg->data.data, buf, len);
+    smsg->data.data_len = len;
+    smsg->data.seq = ssn->client.ra_raw_base_seq + 1;
+    ssn->client.ra_raw_base_seq += len;
+
+    if (ssn->toserver_smsg_head == NULL) {
+        ssn->toserver_smsg_head = smsg;
+    } else {
+        ssn->toserver_smsg_tail->next = smsg;
+        smsg->prev = ssn->toserver_smsg_tail;
+    }
+    ssn->toserver_smsg_tail = smsg;
+    return 1;
+}
+
+/**
+ *  \brief Run the stream "xxabc" "defyy" through detection, either with a
+ *         run per smsg or with both smsgs in one run.
+ *
+ *  \param one_run both smsgs in one run
+ *  \param skip an smsg between the two isn't searched, as if its sgh had
+ *              no stream mpm
+ *  \param alerts sids 1 to 4 expected to alert, as bits 0 to 3
+ */
+static int SigTestStreamMpm(int one_run, int skip, int alerts)
+{
+    int result = 0;
+    Flow f;
+    TcpSession ssn;
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    int sid;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    p = UTHBuildPacket((uint8_t *)"zz", 2, IPPROTO_TCP);
+    if (p == NULL)
+        goto end;
+    p->tcph->th_seq = htonl(1000);
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.flags |= FLOW_IPV4;
+    f.proto = p->proto;
+    p->flow = &f;
+    p->flowflags |= FLOW_PKT_TOSERVER|FLOW_PKT_ESTABLISHED;
+    p->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+
+    StreamTcpInitConfig(TRUE);
+    ssn.client.ra_raw_base_seq = 100;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->mpm_matcher = MPM_AC;
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"abcdef\"; sid:1;)");
+    if (de_ctx->sig_list == NULL)
+        goto end;
+    de_ctx->sig_list->next = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"ABCdef\"; sid:2;)");
+    if (de_ctx->sig_list->next == NULL)
+        goto end;
+    de_ctx->sig_list->next->next = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"ABCDEF\"; nocase; sid:3;)");
+    if (de_ctx->sig_list->next->next == NULL)
+        goto end;
+    /* the fast pattern doesn't span the smsgs */
+    de_ctx->sig_list->next->next->next = SigInit(de_ctx, "alert tcp any any -> any any "
+            "(content:\"xxab\"; content:\"def\"; fast_pattern; sid:4;)");
+    if (de_ctx->sig_list->next->next->next == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    if (SigTestStreamMpmQueue(&ssn, "xxabc") == 0)
+        goto end;
+    if (!one_run) {
+        SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+        if (p->alerts.cnt != 0) {
+            printf("alert on the first smsg: ");
+            goto end;
+        }
+    }
+    if (skip) {
+        /* an smsg dropped without being searched */
+        if (SigTestStreamMpmQueue(&ssn, "zz") == 0)
+            goto end;
+        StreamMsgReturnListToPool(ssn.toserver_smsg_head);
+        ssn.toserver_smsg_head = ssn.toserver_smsg_tail = NULL;
+    }
+
+    if (SigTestStreamMpmQueue(&ssn, "defyy") == 0)
+        goto end;
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+
+    for (sid = 1; sid <= 4; sid++) {
+        if (PacketAlertCheck(p, sid) != ((alerts >> (sid - 1)) & 1)) {
+            printf("sid %d %s: ", sid, (alerts >> (sid - 1)) & 1 ?
+                    "didn't alert, but should have" : "alerted, but shouldn't have");
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+        if (det_ctx != NULL)
+            DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    StreamTcpMpmTailFree(&ssn.client);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    UTHFreePacket(p);
+    return result;
+}
+
+/** \test pattern spanning smsgs inspected in two runs. The case sensitive
+ *        sid 2 differs from the stream in the first smsg only. */
+static int SigTestStreamMpm01(void)
+{
+    return SigTestStreamMpm(0, 0, 0x5);
+}
+
+/** \test pattern spanning two smsgs inspected in one run */
+static int SigTestStreamMpm02(void)
+{
+    return SigTestStreamMpm(1, 0, 0x5);
+}
+
+/** \test an smsg between the two wasn't searched, so the mpm starts over
+ *        and "abc" "zz" "def" doesn't match */
+static int SigTestStreamMpm03(void)
+{
+    return SigTestStreamMpm(0, 1, 0x0);
+}
+
 #endif /* UNITTESTS */
 
 void SigRegisterTests(void) {
@@ -11625,6 +12150,14 @@ void SigRegisterTests(void) {
     UtRegisterTest("SigTestSIMDMask03", SigTestSIMDMask03, 1);
     UtRegisterTest("SigTestSIMDMask04", SigTestSIMDMask04, 1);
 
+    UtRegisterTest("SigTestHttpMpm01", SigTestHttpMpm01, 1);
+    UtRegisterTest("SigTestHttpMpmCache01", SigTestHttpMpmCache01, 1);
+    UtRegisterTest("SigTestHttpMpmCache02", SigTestHttpMpmCache02, 1);
+    UtRegisterTest("SigTestHttpMpmCache03", SigTestHttpMpmCache03, 1);
+    UtRegisterTest("SigTestStreamMpm01", SigTestStreamMpm01, 1);
+    UtRegisterTest("SigTestStreamMpm02", SigTestStreamMpm02, 1);
+    UtRegisterTest("SigTestStreamMpm03", SigTestStreamMpm03, 1);
+
 #endif /* UNITTESTS */
 }
 
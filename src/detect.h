@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include "flow.h"
+#include "stream.h"
 
 #include "detect-engine-proto.h"
 #include "detect-reference.h"
@@ -726,9 +727,10 @@ enum {
     ENGINE_SGH_MPM_FACTORY_CONTEXT_AUTO
 };
 
+/** body data of a tx to inspect, buffer points into the linear body
+ *  buffer of the tx */
 typedef struct HttpReassembledBody_ {
     uint8_t *buffer;
-    uint32_t buffer_size;   /**< size of the buffer itself */
     uint32_t buffer_len;    /**< data len in the buffer */
     uint64_t offset;        /**< data offset */
 } HttpReassembledBody;
@@ -749,6 +751,9 @@ typedef struct DetectionEngineThreadCtx_ {
     uint32_t buffer_offset;
     /* used by pcre match function alone */
     uint32_t pcre_match_start_offset;
+    /** if set, the buffer inspected is an smsg preceded by this many
+     *  bytes of the stream, and the fast pattern has to match across */
+    uint32_t stream_span_offset;
 
     /* counter for the filestore array below -- up here for cache reasons. */
     uint16_t filestore_cnt;
@@ -806,6 +811,14 @@ typedef struct DetectionEngineThreadCtx_ {
     MpmThreadCtx mtcs;  /**< thread ctx for stream mpm */
     PatternMatcherQueue pmq;
     PatternMatcherQueue smsg_pmq[256];
+    /** patterns the stream mpm matched across the start of an smsg */
+    PatternMatcherQueue smsg_span_pmq;
+    /** bytes of the stream preceding each smsg, set if the stream mpm
+     *  continued in the middle of a pattern at the start of the smsg */
+    uint8_t smsg_tail[256][STREAM_MPM_TAIL_SIZE];
+    uint16_t smsg_tail_len[256];
+    /** buffer to inspect an smsg together with the bytes preceding it */
+    uint8_t smsg_join[STREAM_MPM_TAIL_SIZE + MSG_DATA_SIZE];
 
     /** ip only rules ctx */
     DetectEngineIPOnlyThreadCtx io_ctx;
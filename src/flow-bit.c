@@ -24,11 +24,10 @@
  * but called that way because of Snort's flowbits.
  * It's a binary storage.
  *
- * \todo move away from a linked list implementation
- * \todo use different datatypes, such as string, int, etc.
- * \todo have more than one instance of the same var, and be able to match on a
- *       specific one, or one all at a time. So if a certain capture matches
- *       multiple times, we can operate on all of them.
+ * The bits of a flow are kept in a bitmap indexed by the flowbit's name
+ * idx. The bitmap is allocated on the first set and sized for all the
+ * names of the detection engine, so setting and checking a bit is a
+ * single byte operation.
  */
 
 #include "suricata-common.h"
@@ -39,94 +38,97 @@
 #include "flow-private.h"
 #include "detect.h"
 #include "util-var.h"
+#include "util-atomic.h"
 #include "util-debug.h"
 #include "util-unittest.h"
 
+/** size in bytes of new bitmaps, enough for the names of the detection
+ *  engine(s) built so far */
+static uint16_t flowbits_size = 0;
+
+/** memory used by the bitmaps of all flows */
+SC_ATOMIC_DECLARE(uint64_t, flowbits_memuse);
+
+void FlowBitInitCtx(void)
+{
+    SC_ATOMIC_INIT(flowbits_memuse);
+}
+
+/** \brief size the flow bitmaps for name idx's up to and including max_idx
+ *
+ *  Called when a detection engine is built. Bitmaps never shrink, so that
+ *  flows that are already tracked keep working after a rule reload. */
+void FlowBitSetMaxIdx(uint16_t max_idx)
+{
+    uint16_t size = (max_idx >> 3) + 1;
+    if (size > flowbits_size)
+        flowbits_size = size;
+}
+
+uint64_t FlowBitGetMemuse(void)
+{
+    return SC_ATOMIC_GET(flowbits_memuse);
+}
+
 /* get the flowbit with idx from the flow */
-static FlowBit *FlowBitGet(Flow *f, uint16_t idx) {
-    GenericVar *gv = f->flowvar;
-    for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
-            return (FlowBit *)gv;
-        }
-    }
+static int FlowBitGet(Flow *f, uint16_t idx) {
+    FlowBits *fbs = f->flowbits;
+    if (fbs == NULL || (idx >> 3) >= fbs->size)
+        return 0;
 
-    return NULL;
+    return (fbs->bits[idx >> 3] & (1 << (idx & 7))) != 0;
 }
 
 /* add a flowbit to the flow */
 static void FlowBitAdd(Flow *f, uint16_t idx) {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        fb = SCMalloc(sizeof(FlowBit));
-        if (unlikely(fb == NULL))
+    FlowBits *fbs = f->flowbits;
+
+    if (fbs == NULL || (idx >> 3) >= fbs->size) {
+        /* the idx may be beyond the size if the name was added after the
+         * engine was built, e.g. by a rule reload */
+        uint16_t size = (idx >> 3) + 1;
+        if (size < flowbits_size)
+            size = flowbits_size;
+        uint16_t old_size = fbs ? fbs->size : 0;
+
+        fbs = SCRealloc(fbs, sizeof(FlowBits) + size);
+        if (unlikely(fbs == NULL))
             return;
+        memset(fbs->bits + old_size, 0x00, size - old_size);
+        fbs->size = size;
 
-        fb->type = DETECT_FLOWBITS;
-        fb->idx = idx;
-        fb->next = NULL;
-        GenericVarAppend(&f->flowvar, (GenericVar *)fb);
-
-        //printf("FlowBitAdd: adding flowbit with idx %" PRIu32 "\n", idx);
-#ifdef FLOWBITS_STATS
-        SCMutexLock(&flowbits_mutex);
-        flowbits_added++;
-        flowbits_memuse += sizeof(FlowBit);
-        if (flowbits_memuse > flowbits_memuse_max)
-            flowbits_memuse_max = flowbits_memuse;
-        SCMutexUnlock(&flowbits_mutex);
-#endif /* FLOWBITS_STATS */
+        (void) SC_ATOMIC_ADD(flowbits_memuse, (size - old_size) +
+                (old_size == 0 ? sizeof(FlowBits) : 0));
+        f->flowbits = fbs;
     }
+
+    fbs->bits[idx >> 3] |= (1 << (idx & 7));
 }
 
 static void FlowBitRemove(Flow *f, uint16_t idx) {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL)
+    FlowBits *fbs = f->flowbits;
+    if (fbs == NULL || (idx >> 3) >= fbs->size)
         return;
 
-    GenericVarRemove(&f->flowvar, (GenericVar *)fb);
-
-    //printf("FlowBitRemove: remove flowbit with idx %" PRIu32 "\n", idx);
-#ifdef FLOWBITS_STATS
-    SCMutexLock(&flowbits_mutex);
-    flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
-    else {
-        printf("ERROR: flowbits memory usage going below 0!\n");
-        flowbits_memuse = 0;
-    }
-    SCMutexUnlock(&flowbits_mutex);
-#endif /* FLOWBITS_STATS */
+    fbs->bits[idx >> 3] &= ~(1 << (idx & 7));
 }
 
 void FlowBitSet(Flow *f, uint16_t idx) {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        FlowBitAdd(f, idx);
-    }
-
+    FlowBitAdd(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
 void FlowBitUnset(Flow *f, uint16_t idx) {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        FlowBitRemove(f, idx);
-    }
-
+    FlowBitRemove(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
 void FlowBitToggle(Flow *f, uint16_t idx) {
     FLOWLOCK_WRLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
+    if (FlowBitGet(f, idx)) {
         FlowBitRemove(f, idx);
     } else {
         FlowBitAdd(f, idx);
@@ -138,12 +140,7 @@ void FlowBitToggle(Flow *f, uint16_t idx) {
 int FlowBitIsset(Flow *f, uint16_t idx) {
     int r = 0;
     FLOWLOCK_RDLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        r = 1;
-    }
-
+    r = FlowBitGet(f, idx);
     FLOWLOCK_UNLOCK(f);
     return r;
 }
@@ -151,33 +148,41 @@ int FlowBitIsset(Flow *f, uint16_t idx) {
 int FlowBitIsnotset(Flow *f, uint16_t idx) {
     int r = 0;
     FLOWLOCK_RDLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        r = 1;
-    }
-
+    r = !FlowBitGet(f, idx);
     FLOWLOCK_UNLOCK(f);
     return r;
 }
 
-void FlowBitFree(FlowBit *fb) {
-    if (fb == NULL)
-        return;
+/** \brief call Func for every bit that is set in the bitmap
+ *
+ *  \retval cnt number of bits set */
+int FlowBitsForEach(FlowBits *fbs, void (*Func)(uint16_t, void *), void *data)
+{
+    uint16_t i;
+    int cnt = 0;
+
+    if (fbs == NULL)
+        return 0;
+
+    for (i = 0; i < fbs->size; i++) {
+        uint8_t byte = fbs->bits[i];
+        while (byte != 0) {
+            int bit = __builtin_ctz(byte);
+            byte &= byte - 1;
+            if (Func != NULL)
+                Func((uint16_t)((i << 3) + bit), data);
+            cnt++;
+        }
+    }
+    return cnt;
+}
 
-    SCFree(fb);
+void FlowBitsFree(FlowBits *fbs) {
+    if (fbs == NULL)
+        return;
 
-#ifdef FLOWBITS_STATS
-    SCMutexLock(&flowbits_mutex);
-    flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
-    else {
-        printf("ERROR: flowbits memory usage going below 0!\n");
-        flowbits_memuse = 0;
-    }
-    SCMutexUnlock(&flowbits_mutex);
-#endif /* FLOWBITS_STATS */
+    (void) SC_ATOMIC_SUB(flowbits_memuse, sizeof(FlowBits) + fbs->size);
+    SCFree(fbs);
 }
 
 
@@ -191,11 +196,11 @@ static int FlowBitTest01 (void) {
 
     FlowBitAdd(&f, 0);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -205,11 +210,11 @@ static int FlowBitTest02 (void) {
     Flow f;
     memset(&f, 0, sizeof(Flow));
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -221,23 +226,23 @@ static int FlowBitTest03 (void) {
 
     FlowBitAdd(&f, 0);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL) {
-        printf("fb == NULL although it was just added: ");
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0) {
+        printf("fb == 0 although it was just added: ");
         goto end;
     }
 
     FlowBitRemove(&f, 0);
 
     fb = FlowBitGet(&f,0);
-    if (fb != NULL) {
-        printf("fb != NULL although it was just removed: ");
+    if (fb != 0) {
+        printf("fb != 0 although it was just removed: ");
         goto end;
     } else {
         ret = 1;
     }
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -252,11 +257,11 @@ static int FlowBitTest04 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -271,11 +276,11 @@ static int FlowBitTest05 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,1);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,1);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -290,11 +295,11 @@ static int FlowBitTest06 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,2);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,2);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -309,11 +314,11 @@ static int FlowBitTest07 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,3);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,3);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -328,21 +333,21 @@ static int FlowBitTest08 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,0);
 
     fb = FlowBitGet(&f,0);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -357,21 +362,21 @@ static int FlowBitTest09 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,1);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,1);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,1);
 
     fb = FlowBitGet(&f,1);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -386,21 +391,21 @@ static int FlowBitTest10 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,2);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,2);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,2);
 
     fb = FlowBitGet(&f,2);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -415,21 +420,75 @@ static int FlowBitTest11 (void) {
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,3);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,3);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,3);
 
     fb = FlowBitGet(&f,3);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    FlowBitsFree(f.flowbits);
+    return ret;
+}
+
+/** \test bitmap grows for an idx beyond its size and keeps the bits
+ *        already set, memuse follows the bitmap */
+static int FlowBitTest12 (void) {
+    int ret = 0;
+    uint64_t memuse = FlowBitGetMemuse();
+
+    Flow f;
+    memset(&f, 0, sizeof(Flow));
+
+    FlowBitAdd(&f, 3);
+    if (f.flowbits == NULL) {
+        printf("no bitmap: ");
+        goto end;
+    }
+    uint16_t size = f.flowbits->size;
+
+    FlowBitAdd(&f, (size << 3) + 100);
+    if (f.flowbits->size != size + 13) {
+        printf("size %u, expected %u: ", f.flowbits->size, size + 13);
+        goto end;
+    }
+
+    if (!FlowBitGet(&f, 3) || !FlowBitGet(&f, (size << 3) + 100) ||
+            FlowBitGet(&f, 4) || FlowBitGet(&f, (size << 3) + 99)) {
+        printf("wrong bits set: ");
+        goto end;
+    }
+
+    if (FlowBitsForEach(f.flowbits, NULL, NULL) != 2) {
+        printf("expected 2 bits: ");
+        goto end;
+    }
+
+    if (FlowBitGetMemuse() != memuse + sizeof(FlowBits) + f.flowbits->size) {
+        printf("memuse %"PRIu64", expected %"PRIuMAX": ", FlowBitGetMemuse(),
+                (uintmax_t)(memuse + sizeof(FlowBits) + f.flowbits->size));
+        goto end;
+    }
+
+    FlowBitsFree(f.flowbits);
+    f.flowbits = NULL;
+
+    if (FlowBitGetMemuse() != memuse) {
+        printf("memuse %"PRIu64" after free, expected %"PRIu64": ",
+                FlowBitGetMemuse(), memuse);
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitsFree(f.flowbits);
     return ret;
 }
 
@@ -448,6 +507,7 @@ void FlowBitRegisterTests(void) {
     UtRegisterTest("FlowBitTest09", FlowBitTest09, 1);
     UtRegisterTest("FlowBitTest10", FlowBitTest10, 1);
     UtRegisterTest("FlowBitTest11", FlowBitTest11, 1);
+    UtRegisterTest("FlowBitTest12", FlowBitTest12, 1);
 #endif /* UNITTESTS */
 }
 
@@ -27,15 +27,17 @@
 #include "flow.h"
 #include "util-var.h"
 
-typedef struct FlowBit_ {
-    uint8_t type; /* type, DETECT_FLOWBITS in this case */
-    GenericVar *next; /* right now just implement this as a list,
-                       * in the long run we have think of something
-                       * faster. */
-    uint16_t idx; /* name idx */
-} FlowBit;
+/** bitmap of the flowbits of a flow, indexed by name idx */
+typedef struct FlowBits_ {
+    uint16_t size;      /**< size of bits in bytes */
+    uint8_t bits[];
+} FlowBits;
 
-void FlowBitFree(FlowBit *);
+void FlowBitInitCtx(void);
+void FlowBitSetMaxIdx(uint16_t);
+uint64_t FlowBitGetMemuse(void);
+void FlowBitsFree(FlowBits *);
+int FlowBitsForEach(FlowBits *, void (*Func)(uint16_t, void *), void *);
 void FlowBitRegisterTests(void);
 
 void FlowBitSet(Flow *, uint16_t);
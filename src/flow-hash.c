@@ -48,6 +48,7 @@ SC_ATOMIC_EXTERN(unsigned int, flow_prune_idx);
 SC_ATOMIC_EXTERN(unsigned char, flow_flags);
 
 static Flow *FlowGetUsedFlow(void);
+static Flow *FlowThreadGetUsedFlow(FlowThreadTable *);
 
 #ifdef FLOW_DEBUG_STATS
 #define FLOW_DEBUG_STATS_PROTO_ALL      0
@@ -189,7 +190,7 @@ typedef struct FlowHashKey6_ {
     };
 } FlowHashKey6;
 
-/* calculate the hash key for this packet
+/* calculate the hash for this packet
  *
  * we're using:
  *  hash_rand -- set at init time
@@ -202,7 +203,7 @@ typedef struct FlowHashKey6_ {
  *
  *  For ICMP we only consider UNREACHABLE errors atm.
  */
-static inline uint32_t FlowGetKey(Packet *p) {
+static inline uint32_t FlowGetHash(Packet *p) {
     uint32_t key;
 
     if (p->ip4h != NULL) {
@@ -226,7 +227,7 @@ static inline uint32_t FlowGetKey(Packet *p) {
             fhk.recur = (uint16_t)p->recursion_level;
 
             uint32_t hash = hashword(fhk.u32, 4, flow_config.hash_rand);
-            key = hash % flow_config.hash_size;
+            key = hash;
 
         } else if (ICMPV4_DEST_UNREACH_IS_VALID(p)) {
             uint32_t psrc = IPV4_GET_RAW_IPSRC_U32(ICMPV4_GET_EMB_IPV4(p));
@@ -250,7 +251,7 @@ static inline uint32_t FlowGetKey(Packet *p) {
             fhk.recur = (uint16_t)p->recursion_level;
 
             uint32_t hash = hashword(fhk.u32, 4, flow_config.hash_rand);
-            key = hash % flow_config.hash_size;
+            key = hash;
 
         } else {
             FlowHashKey4 fhk;
@@ -267,7 +268,7 @@ static inline uint32_t FlowGetKey(Packet *p) {
             fhk.recur = (uint16_t)p->recursion_level;
 
             uint32_t hash = hashword(fhk.u32, 4, flow_config.hash_rand);
-            key = hash % flow_config.hash_size;
+            key = hash;
         }
     } else if (p->ip6h != NULL) {
         FlowHashKey6 fhk;
@@ -301,7 +302,7 @@ static inline uint32_t FlowGetKey(Packet *p) {
         fhk.recur = (uint16_t)p->recursion_level;
 
         uint32_t hash = hashword(fhk.u32, 10, flow_config.hash_rand);
-        key = hash % flow_config.hash_size;
+        key = hash;
     } else
         key = 0;
 
@@ -468,7 +469,8 @@ Flow *FlowGetFlowFromHash (Packet *p)
     FlowHashCountInit;
 
     /* get the key to our bucket */
-    uint32_t key = FlowGetKey(p);
+    uint32_t hash = FlowGetHash(p);
+    uint32_t key = hash % flow_config.hash_size;
     /* get our hash bucket and lock it */
     FlowBucket *fb = &flow_hash[key];
     FBLOCK_LOCK(fb);
@@ -495,6 +497,8 @@ Flow *FlowGetFlowFromHash (Packet *p)
         /* got one, now lock, initialize and return */
         FlowInit(f,p);
         f->fb = fb;
+        f->flow_hash = hash;
+        FlowWheelAdd(f, (int32_t)p->ts.tv_sec);
 
         FBLOCK_UNLOCK(fb);
         FlowHashCountUpdate;
@@ -532,6 +536,8 @@ Flow *FlowGetFlowFromHash (Packet *p)
                 /* initialize and return */
                 FlowInit(f,p);
                 f->fb = fb;
+                f->flow_hash = hash;
+                FlowWheelAdd(f, (int32_t)p->ts.tv_sec);
 
                 FBLOCK_UNLOCK(fb);
                 FlowHashCountUpdate;
@@ -633,6 +639,7 @@ static Flow *FlowGetUsedFlow(void) {
 
         f->hnext = NULL;
         f->hprev = NULL;
+        FlowWheelRemove(f);
         f->fb = NULL;
         FBLOCK_UNLOCK(fb);
 
@@ -646,3 +653,181 @@ static Flow *FlowGetUsedFlow(void) {
 
     return NULL;
 }
+
+/** \internal
+ *  \brief Get a new flow for a thread local table
+ *
+ *  Takes a flow from the thread's spare queue first. If that is empty we
+ *  alloc a new flow within the global memcap. If that fails too, an unused
+ *  flow is taken from the thread's own hash.
+ *
+ *  \retval f *LOCKED* flow on succes, NULL on error.
+ */
+static Flow *FlowThreadGetNew(FlowThreadTable *ft, Packet *p) {
+    Flow *f = NULL;
+
+    if (FlowCreateCheck(p) == 0) {
+        return NULL;
+    }
+
+    f = FlowDequeue(&ft->spare_q);
+    if (f == NULL) {
+        if (!(FLOW_CHECK_MEMCAP(sizeof(Flow)))) {
+            /* the table's timeout scan will use the emergency timeouts
+             * until enough flows were returned to the spare queue */
+            ft->emergency = 1;
+
+            f = FlowThreadGetUsedFlow(ft);
+            if (f == NULL) {
+                return NULL;
+            }
+        } else {
+            f = FlowAlloc();
+            if (f == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    FLOWLOCK_WRLOCK(f);
+    return f;
+}
+
+/** \brief Get a flow from a thread local flow table
+ *
+ *  Same as FlowGetFlowFromHash(), except that the table is only ever used
+ *  by the calling thread, so the bucket isn't locked.
+ *
+ *  \param ft the calling thread's flow table
+ *  \param p packet
+ *
+ *  \retval f *LOCKED* flow or NULL
+ */
+Flow *FlowGetFlowFromThreadHash(FlowThreadTable *ft, Packet *p)
+{
+    Flow *f = NULL;
+
+    uint32_t hash = FlowGetHash(p);
+    FlowBucket *fb = &ft->hash[hash % ft->hash_size];
+
+    /* see if the bucket already has a flow */
+    if (fb->head == NULL) {
+        f = FlowThreadGetNew(ft, p);
+        if (f == NULL) {
+            return NULL;
+        }
+
+        fb->head = f;
+        fb->tail = f;
+
+        FlowReference(&p->flow, f);
+
+        FlowInit(f,p);
+        f->fb = fb;
+        f->flow_hash = hash;
+        return f;
+    }
+
+    f = fb->head;
+
+    if (FlowCompare(f, p) == 0) {
+        Flow *pf = NULL; /* previous flow */
+
+        while (f) {
+            pf = f;
+            f = f->hnext;
+
+            if (f == NULL) {
+                f = pf->hnext = FlowThreadGetNew(ft, p);
+                if (f == NULL) {
+                    return NULL;
+                }
+                fb->tail = f;
+                f->hprev = pf;
+
+                FlowReference(&p->flow, f);
+
+                FlowInit(f,p);
+                f->fb = fb;
+                f->flow_hash = hash;
+                return f;
+            }
+
+            if (FlowCompare(f, p) != 0) {
+                /* move to the top of the row to reward active flows */
+                if (f->hnext) {
+                    f->hnext->hprev = f->hprev;
+                }
+                if (f->hprev) {
+                    f->hprev->hnext = f->hnext;
+                }
+                if (f == fb->tail) {
+                    fb->tail = f->hprev;
+                }
+
+                f->hnext = fb->head;
+                f->hprev = NULL;
+                fb->head->hprev = f;
+                fb->head = f;
+
+                FlowReference(&p->flow, f);
+                FLOWLOCK_WRLOCK(f);
+                return f;
+            }
+        }
+    }
+
+    FlowReference(&p->flow, f);
+    FLOWLOCK_WRLOCK(f);
+    return f;
+}
+
+/** \internal
+ *  \brief Get a flow from a thread local hash directly.
+ *
+ *  Thread local version of FlowGetUsedFlow(). The flow lock is still
+ *  tried as a pseudo packet of the flow may be handled by another thread.
+ *
+ *  \retval f flow or NULL
+ */
+static Flow *FlowThreadGetUsedFlow(FlowThreadTable *ft) {
+    uint32_t idx = ft->prune_idx % ft->hash_size;
+    uint32_t cnt = ft->hash_size;
+
+    while (cnt--) {
+        if (++idx >= ft->hash_size)
+            idx = 0;
+
+        FlowBucket *fb = &ft->hash[idx];
+        Flow *f = fb->tail;
+        if (f == NULL)
+            continue;
+
+        if (FLOWLOCK_TRYWRLOCK(f) != 0)
+            continue;
+
+        if (SC_ATOMIC_GET(f->use_cnt) > 0) {
+            FLOWLOCK_UNLOCK(f);
+            continue;
+        }
+
+        if (f->hprev != NULL)
+            f->hprev->hnext = f->hnext;
+        if (fb->head == f)
+            fb->head = f->hnext;
+        fb->tail = f->hprev;
+
+        f->hnext = NULL;
+        f->hprev = NULL;
+        f->fb = NULL;
+
+        FlowClearMemory (f, f->protomap);
+
+        FLOWLOCK_UNLOCK(f);
+
+        ft->prune_idx = idx;
+        return f;
+    }
+
+    return NULL;
+}
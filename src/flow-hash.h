@@ -24,6 +24,8 @@
 #ifndef __FLOW_HASH_H__
 #define __FLOW_HASH_H__
 
+#include "flow-queue.h"
+
 /** Spinlocks or Mutex for the flow buckets. */
 //#define FBLOCK_SPIN
 #define FBLOCK_MUTEX
@@ -66,9 +68,38 @@ typedef struct FlowBucket_ {
     #error Enable FBLOCK_SPIN or FBLOCK_MUTEX
 #endif
 
+/** \brief per thread flow table
+ *
+ *  Used by the workers runmodes if "flow.thread-local" is enabled. With RSS
+ *  or fanout keeping all packets of a flow on one capture thread, that thread
+ *  is the only one looking up, inserting and timing out flows in its table.
+ *  The bucket locks are therefore never taken on the packet path: they are
+ *  only initialized so the shutdown code can walk all tables the same way.
+ */
+typedef struct FlowThreadTable_ {
+    FlowBucket *hash;
+    uint32_t hash_size;
+    uint32_t prealloc;
+
+    /** spare flows of this thread */
+    FlowQueue spare_q;
+
+    /** next row to check in the incremental timeout scan */
+    uint32_t timeout_idx;
+    /** packet time (sec) of the last timeout scan */
+    int32_t timeout_ts;
+    /** row to start looking for a flow to reuse under memcap pressure */
+    uint32_t prune_idx;
+    /** set if we had to reuse active flows, cleared by the timeout scan */
+    uint8_t emergency;
+
+    struct FlowThreadTable_ *next;
+} FlowThreadTable;
+
 /* prototypes */
 
 Flow *FlowGetFlowFromHash(Packet *);
+Flow *FlowGetFlowFromThreadHash(FlowThreadTable *, Packet *);
 
 /** enable to print stats on hash lookups in flow-debug.log */
 //#define FLOW_DEBUG_STATS
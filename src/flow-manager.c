@@ -37,6 +37,7 @@
 #include "flow-queue.h"
 #include "flow-hash.h"
 #include "flow-util.h"
+#include "flow-bit.h"
 #include "flow-var.h"
 #include "flow-private.h"
 #include "flow-timeout.h"
@@ -76,6 +77,10 @@ SC_ATOMIC_EXTERN(unsigned char, flow_flags);
 #define FLOW_EMERG_MODE_UPDATE_DELAY_SEC 0
 #define FLOW_EMERG_MODE_UPDATE_DELAY_NSEC 100000
 #define NEW_FLOW_COUNT_COND 10
+/* part of a thread local flow table checked per timeout scan */
+#define FLOW_THREAD_TIMEOUT_ROWS_DIV 8
+/* number of one second slots in the timeout wheel */
+#define FLOW_WHEEL_SIZE 1024
 
 typedef struct FlowTimeoutCounters_ {
     uint32_t new;
@@ -83,6 +88,19 @@ typedef struct FlowTimeoutCounters_ {
     uint32_t clo;
 } FlowTimeoutCounters;
 
+typedef struct FlowWheelCounters_ {
+    uint32_t lag;           /**< seconds the wheel was behind */
+    uint32_t checked;       /**< flows taken from the wheel */
+    uint32_t rescheduled;   /**< flows put back into the wheel */
+} FlowWheelCounters;
+
+/** timeout wheel: the flows of the global hash, each in the slot of the
+ *  second at which it may time out. Slot lists are protected by the
+ *  queue lock. */
+static FlowQueue flow_wheel[FLOW_WHEEL_SIZE];
+/** last second the wheel was processed, only updated by the manager */
+static int32_t flow_wheel_ts = 0;
+
 /**
  * \brief Used to kill flow manager thread(s).
  *
@@ -240,6 +258,184 @@ static int FlowManagerFlowTimedOut(Flow *f, struct timeval *ts) {
     return 1;
 }
 
+/** \internal
+ *  \brief update the timeout counters for a pruned flow
+ *
+ *  \param counters ptr to FlowTimeoutCounters structure
+ *  \param state state the flow was in when it timed out
+ */
+static inline void FlowTimeoutCountersIncr(FlowTimeoutCounters *counters, int state) {
+    switch (state) {
+        case FLOW_STATE_NEW:
+        default:
+            counters->new++;
+            break;
+        case FLOW_STATE_ESTABLISHED:
+            counters->est++;
+            break;
+        case FLOW_STATE_CLOSED:
+            counters->clo++;
+            break;
+    }
+}
+
+/** \internal
+ *  \brief remove a flow from the hash bucket it's in
+ *
+ *  \param f *LOCKED* flow, its bucket needs to be locked as well
+ */
+static inline void FlowManagerHashRemove(Flow *f) {
+    if (f->hprev != NULL)
+        f->hprev->hnext = f->hnext;
+    if (f->hnext != NULL)
+        f->hnext->hprev = f->hprev;
+    if (f->fb->head == f)
+        f->fb->head = f->hnext;
+    if (f->fb->tail == f)
+        f->fb->tail = f->hprev;
+
+    f->hnext = NULL;
+    f->hprev = NULL;
+}
+
+/** \internal
+ *  \brief unlink a flow from a wheel slot
+ *
+ *  \param q *LOCKED* wheel slot
+ *  \param f flow
+ */
+static inline void FlowWheelUnlink(FlowQueue *q, Flow *f) {
+    if (f->lprev != NULL)
+        f->lprev->lnext = f->lnext;
+    if (f->lnext != NULL)
+        f->lnext->lprev = f->lprev;
+    if (q->top == f)
+        q->top = f->lnext;
+    if (q->bot == f)
+        q->bot = f->lprev;
+
+    f->lnext = NULL;
+    f->lprev = NULL;
+    f->wheel_slot = FLOW_WHEEL_NONE;
+    q->len--;
+}
+
+/** \internal
+ *  \brief put a flow in the wheel slot of second \a ts
+ *
+ *  Seconds the manager already processed are mapped to the next one it
+ *  will process, so the flow doesn't have to wait for a full turn.
+ *
+ *  \param f flow that is in no slot. The caller has to make sure no one
+ *           else schedules it at the same time, by holding its bucket
+ *           lock or its flow lock.
+ *  \param ts second at which the flow may time out
+ */
+static void FlowWheelInsert(Flow *f, int32_t ts) {
+    /* just a hint, racy read is fine */
+    int32_t wheel_ts = flow_wheel_ts;
+    if (ts <= wheel_ts)
+        ts = wheel_ts + 1;
+
+    uint16_t slot = (uint32_t)ts % FLOW_WHEEL_SIZE;
+    FlowQueue *q = &flow_wheel[slot];
+
+    FQLOCK_LOCK(q);
+    f->lprev = NULL;
+    f->lnext = q->top;
+    if (q->top != NULL)
+        q->top->lprev = f;
+    else
+        q->bot = f;
+    q->top = f;
+    q->len++;
+    f->wheel_slot = slot + 1;
+    FQLOCK_UNLOCK(q);
+}
+
+/**
+ *  \brief schedule a new flow in the timeout wheel
+ *
+ *  \param f *LOCKED* new flow, its bucket needs to be locked as well
+ *  \param ts timestamp of the flow's first packet
+ */
+void FlowWheelAdd(Flow *f, int32_t ts) {
+    FlowWheelInsert(f, ts + FlowGetFlowTimeout(f, FLOW_STATE_NEW, 0) + 1);
+}
+
+/**
+ *  \brief remove a flow from the timeout wheel
+ *
+ *  Flows that are not scheduled, e.g. because the manager is looking at
+ *  them, are left alone.
+ *
+ *  \param f *LOCKED* flow, its bucket needs to be locked as well
+ */
+void FlowWheelRemove(Flow *f) {
+    /* the bucket lock keeps others from scheduling the flow, but the
+     * manager may still take it from its slot */
+    uint16_t slot = f->wheel_slot;
+    if (slot == FLOW_WHEEL_NONE)
+        return;
+
+    FlowQueue *q = &flow_wheel[slot - 1];
+    FQLOCK_LOCK(q);
+    if (f->wheel_slot == slot)
+        FlowWheelUnlink(q, f);
+    FQLOCK_UNLOCK(q);
+}
+
+/**
+ *  \brief reschedule a flow after its state changed
+ *
+ *  The wheel only moves flows that saw packets to a later slot, so a flow
+ *  whose timeout got shorter, e.g. a tcp session that was closed, has to
+ *  be moved to the slot of its new timeout here. Flows the manager is
+ *  looking at are left alone, it gets the new state itself.
+ *
+ *  \param f *LOCKED* flow
+ */
+void FlowWheelUpdate(Flow *f) {
+    /* the flow lock keeps others from scheduling or removing the flow,
+     * but the manager may still take it from its slot */
+    uint16_t slot = f->wheel_slot;
+    if (slot == FLOW_WHEEL_NONE)
+        return;
+
+    FlowQueue *q = &flow_wheel[slot - 1];
+    FQLOCK_LOCK(q);
+    if (f->wheel_slot != slot) {
+        FQLOCK_UNLOCK(q);
+        return;
+    }
+    FlowWheelUnlink(q, f);
+    FQLOCK_UNLOCK(q);
+
+    FlowWheelInsert(f, f->lastts_sec +
+            FlowGetFlowTimeout(f, FlowGetFlowState(f), 0) + 1);
+}
+
+/** \brief initialize the timeout wheel
+ *  \warning Not thread safe */
+void FlowWheelInit(void) {
+    uint32_t i;
+
+    for (i = 0; i < FLOW_WHEEL_SIZE; i++) {
+        FlowQueueInit(&flow_wheel[i]);
+    }
+    flow_wheel_ts = 0;
+}
+
+/** \brief destroy the timeout wheel. The flows in it are not touched.
+ *  \warning Not thread safe */
+void FlowWheelShutdown(void) {
+    uint32_t i;
+
+    for (i = 0; i < FLOW_WHEEL_SIZE; i++) {
+        FlowQueueDestroy(&flow_wheel[i]);
+    }
+}
+
 /**
  *  \internal
  *
@@ -249,11 +445,12 @@ static int FlowManagerFlowTimedOut(Flow *f, struct timeval *ts) {
  *  \param ts timestamp
  *  \param emergency bool indicating emergency mode
  *  \param counters ptr to FlowTimeoutCounters structure
+ *  \param spare_q spare queue to return the flows to, NULL for the global one
  *
  *  \retval cnt timed out flows
  */
 static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
-        int emergency, FlowTimeoutCounters *counters)
+        int emergency, FlowTimeoutCounters *counters, FlowQueue *spare_q)
 {
     uint32_t cnt = 0;
 
@@ -277,18 +474,9 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
         /* check if the flow is fully timed out and
          * ready to be discarded. */
         if (FlowManagerFlowTimedOut(f, ts) == 1) {
-            /* remove from the hash */
-            if (f->hprev != NULL)
-                f->hprev->hnext = f->hnext;
-            if (f->hnext != NULL)
-                f->hnext->hprev = f->hprev;
-            if (f->fb->head == f)
-                f->fb->head = f->hnext;
-            if (f->fb->tail == f)
-                f->fb->tail = f->hprev;
-
-            f->hnext = NULL;
-            f->hprev = NULL;
+            /* remove from the hash and the timeout wheel */
+            FlowManagerHashRemove(f);
+            FlowWheelRemove(f);
 
             FlowClearMemory (f, f->protomap);
 
@@ -297,22 +485,13 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
             FLOWLOCK_UNLOCK(f);
 
             /* move to spare list */
-            FlowMoveToSpare(f);
+            if (spare_q == NULL)
+                FlowMoveToSpare(f);
+            else
+                FlowEnqueue(spare_q, f);
 
             cnt++;
-
-            switch (state) {
-                case FLOW_STATE_NEW:
-                default:
-                    counters->new++;
-                    break;
-                case FLOW_STATE_ESTABLISHED:
-                    counters->est++;
-                    break;
-                case FLOW_STATE_CLOSED:
-                    counters->clo++;
-                    break;
-            }
+            FlowTimeoutCountersIncr(counters, state);
         } else {
             FLOWLOCK_UNLOCK(f);
         }
@@ -353,7 +532,7 @@ uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt, FlowTimeoutCounte
             goto next;
 
         /* we have a flow, or more than one */
-        cnt += FlowManagerHashRowTimeout(fb->tail, ts, emergency, counters);
+        cnt += FlowManagerHashRowTimeout(fb->tail, ts, emergency, counters, NULL);
 
 next:
         FBLOCK_UNLOCK(fb);
@@ -365,6 +544,210 @@ next:
     return cnt;
 }
 
+/** \internal
+ *  \brief check the flows in a wheel slot for timing out
+ *
+ *  Flows that saw packets since they were scheduled are moved to the slot
+ *  of their current timeout, the others are pruned.
+ *
+ *  \param q wheel slot
+ *  \param ts timestamp
+ *  \param emergency bool indicating emergency mode
+ *  \param counters ptr to FlowTimeoutCounters structure
+ *  \param wcounters ptr to FlowWheelCounters structure
+ *
+ *  \retval cnt timed out flows
+ */
+static uint32_t FlowWheelSlotTimeout(FlowQueue *q, struct timeval *ts,
+        int emergency, FlowTimeoutCounters *counters,
+        FlowWheelCounters *wcounters)
+{
+    uint32_t cnt = 0;
+
+    /* only look at the flows that are in the slot now, flows put back
+     * a full turn ahead end up in the same slot */
+    FQLOCK_LOCK(q);
+    uint32_t todo = q->len;
+    FQLOCK_UNLOCK(q);
+
+    while (todo--) {
+        FQLOCK_LOCK(q);
+        Flow *f = q->bot;
+        if (f == NULL) {
+            FQLOCK_UNLOCK(q);
+            break;
+        }
+        FlowWheelUnlink(q, f);
+        FQLOCK_UNLOCK(q);
+
+        wcounters->checked++;
+
+        /* until we have the bucket lock the flow may be pruned from the
+         * hash and reused. In that case whoever reuses it schedules it
+         * again, so we just forget about it. */
+        FlowBucket *fb = f->fb;
+        if (fb == NULL)
+            continue;
+
+        FBLOCK_LOCK(fb);
+        if (f->fb != fb || f->wheel_slot != FLOW_WHEEL_NONE) {
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        if (FLOWLOCK_TRYWRLOCK(f) != 0) {
+            /* busy, try again next second */
+            FlowWheelInsert(f, (int32_t)ts->tv_sec + 1);
+            wcounters->rescheduled++;
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        int state = FlowGetFlowState(f);
+
+        if (FlowManagerFlowTimeout(f, state, ts, emergency) == 0) {
+            FlowWheelInsert(f, f->lastts_sec +
+                    FlowGetFlowTimeout(f, state, emergency) + 1);
+            wcounters->rescheduled++;
+            FLOWLOCK_UNLOCK(f);
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        if (FlowManagerFlowTimedOut(f, ts) == 0) {
+            /* still in use or being reassembled */
+            FlowWheelInsert(f, (int32_t)ts->tv_sec + 1);
+            wcounters->rescheduled++;
+            FLOWLOCK_UNLOCK(f);
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        FlowManagerHashRemove(f);
+        FBLOCK_UNLOCK(fb);
+
+        FlowClearMemory (f, f->protomap);
+
+        /* no one is referring to this flow, use_cnt 0, removed from hash
+         * so we can unlock it and move it back to the spare queue. */
+        FLOWLOCK_UNLOCK(f);
+        FlowMoveToSpare(f);
+
+        cnt++;
+        FlowTimeoutCountersIncr(counters, state);
+    }
+
+    return cnt;
+}
+
+/**
+ *  \brief time out flows from the timeout wheel
+ *
+ *  Processes the wheel slots of the seconds since the last call up to and
+ *  including \a ts. As flows only come up when they may have timed out,
+ *  the cost is proportional to the number of flows expiring rather than
+ *  to the size of the hash.
+ *
+ *  New flows are scheduled using the normal timeouts, so in emergency mode
+ *  FlowTimeoutHash() still needs to be used to find the flows the shorter
+ *  emergency timeouts apply to.
+ *
+ *  \param ts timestamp
+ *  \param counters ptr to FlowTimeoutCounters structure
+ *  \param wcounters ptr to FlowWheelCounters structure
+ *
+ *  \retval cnt number of timed out flows
+ */
+uint32_t FlowTimeoutWheel(struct timeval *ts, FlowTimeoutCounters *counters,
+        FlowWheelCounters *wcounters)
+{
+    uint32_t cnt = 0;
+    int32_t sec = flow_wheel_ts;
+    int emergency = 0;
+
+    if (SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)
+        emergency = 1;
+
+    if ((int32_t)ts->tv_sec <= sec)
+        return 0;
+
+    /* on the first run there is no lag to speak of */
+    if (sec > 0)
+        wcounters->lag = (int32_t)ts->tv_sec - sec - 1;
+
+    /* no need to go round more than once */
+    if ((int32_t)ts->tv_sec - sec > FLOW_WHEEL_SIZE)
+        sec = (int32_t)ts->tv_sec - FLOW_WHEEL_SIZE;
+
+    while (sec < (int32_t)ts->tv_sec) {
+        sec++;
+        cnt += FlowWheelSlotTimeout(&flow_wheel[(uint32_t)sec % FLOW_WHEEL_SIZE],
+                ts, emergency, counters, wcounters);
+        flow_wheel_ts = sec;
+    }
+
+    return cnt;
+}
+
+/**
+ *  \brief time out flows from a thread local flow table
+ *
+ *  Called by the thread owning the table, at most once per second of
+ *  packet time. Each call checks FLOW_THREAD_TIMEOUT_ROWS_DIV'th of the
+ *  hash, or all of it if the table is in emergency mode. Spare flows over
+ *  the table's prealloc setting are freed.
+ *
+ *  As the scan is driven by the thread's own packets, flows in a table of
+ *  a thread that doesn't see any traffic are only timed out at shutdown.
+ *
+ *  \param ft the thread's flow table
+ *  \param ts timestamp
+ *
+ *  \retval cnt number of timed out flows
+ */
+uint32_t FlowTimeoutThreadHash(FlowThreadTable *ft, struct timeval *ts) {
+    uint32_t cnt = 0;
+    uint32_t rows = ft->hash_size;
+    FlowTimeoutCounters counters = { 0, 0, 0, };
+
+    ft->timeout_ts = (int32_t)ts->tv_sec;
+
+    if (!ft->emergency) {
+        rows = ft->hash_size / FLOW_THREAD_TIMEOUT_ROWS_DIV;
+        if (rows == 0)
+            rows = ft->hash_size;
+    }
+
+    while (rows--) {
+        FlowBucket *fb = &ft->hash[ft->timeout_idx];
+        if (++ft->timeout_idx >= ft->hash_size)
+            ft->timeout_idx = 0;
+
+        if (fb->tail == NULL)
+            continue;
+
+        cnt += FlowManagerHashRowTimeout(fb->tail, ts, ft->emergency,
+                &counters, &ft->spare_q);
+    }
+
+    if (ft->spare_q.len > ft->prealloc) {
+        uint32_t tofree = ft->spare_q.len - ft->prealloc;
+        while (tofree--) {
+            Flow *f = FlowDequeue(&ft->spare_q);
+            if (f == NULL)
+                break;
+            FlowFree(f);
+        }
+    }
+
+    if (ft->emergency && ft->prealloc > 0 &&
+        ft->spare_q.len * 100 / ft->prealloc > flow_config.emergency_recovery) {
+        ft->emergency = 0;
+    }
+
+    return cnt;
+}
+
 /** \brief Thread that manages the flow table and times out flows.
  *
  *  \param td ThreadVars casted to void ptr
@@ -406,9 +789,21 @@ void *FlowManagerThread(void *td)
     uint16_t flow_mgr_cnt_est = SCPerfTVRegisterCounter("flow_mgr.est_pruned", th_v,
             SC_PERF_TYPE_UINT64,
             "NULL");
+    uint16_t flow_mgr_wheel_lag = SCPerfTVRegisterCounter("flow_mgr.wheel_lag", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
+    uint16_t flow_mgr_wheel_checked = SCPerfTVRegisterCounter("flow_mgr.wheel_checked", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
+    uint16_t flow_mgr_wheel_resched = SCPerfTVRegisterCounter("flow_mgr.wheel_rescheduled", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
     uint16_t flow_mgr_memuse = SCPerfTVRegisterCounter("flow.memuse", th_v,
             SC_PERF_TYPE_Q_NORMAL,
             "NULL");
+    uint16_t flow_mgr_flowbits_memuse = SCPerfTVRegisterCounter("flowbits.memuse", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
     uint16_t flow_mgr_spare = SCPerfTVRegisterCounter("flow.spare", th_v,
             SC_PERF_TYPE_Q_NORMAL,
             "NULL");
@@ -473,13 +868,18 @@ void *FlowManagerThread(void *td)
             last_sec = (uint32_t)ts.tv_sec;
         }
 
-        /* see if we still have enough spare flows */
-        FlowUpdateSpareFlows();
+        /* see if we still have enough spare flows. With thread local
+         * flow tables the workers maintain their own spare queues. */
+        if (flow_thread_tables == NULL)
+            FlowUpdateSpareFlows();
 
         /* try to time out flows */
         FlowTimeoutCounters counters = { 0, 0, 0, };
-        FlowTimeoutHash(&ts, 0 /* check all */, &counters);
-
+        FlowWheelCounters wcounters = { 0, 0, 0, };
+        FlowTimeoutWheel(&ts, &counters, &wcounters);
+        /* the wheel is scheduled with the normal timeouts */
+        if (emerg == TRUE)
+            FlowTimeoutHash(&ts, 0 /* check all */, &counters);
 
         DefragTimeoutHash(&ts);
         //uint32_t hosts_pruned =
@@ -494,8 +894,12 @@ void *FlowManagerThread(void *td)
         SCPerfCounterAddUI64(flow_mgr_cnt_clo, th_v->sc_perf_pca, (uint64_t)counters.clo);
         SCPerfCounterAddUI64(flow_mgr_cnt_new, th_v->sc_perf_pca, (uint64_t)counters.new);
         SCPerfCounterAddUI64(flow_mgr_cnt_est, th_v->sc_perf_pca, (uint64_t)counters.est);
+        SCPerfCounterSetUI64(flow_mgr_wheel_lag, th_v->sc_perf_pca, (uint64_t)wcounters.lag);
+        SCPerfCounterAddUI64(flow_mgr_wheel_checked, th_v->sc_perf_pca, (uint64_t)wcounters.checked);
+        SCPerfCounterAddUI64(flow_mgr_wheel_resched, th_v->sc_perf_pca, (uint64_t)wcounters.rescheduled);
         long long unsigned int flow_memuse = SC_ATOMIC_GET(flow_memuse);
         SCPerfCounterSetUI64(flow_mgr_memuse, th_v->sc_perf_pca, (uint64_t)flow_memuse);
+        SCPerfCounterSetUI64(flow_mgr_flowbits_memuse, th_v->sc_perf_pca, FlowBitGetMemuse());
 
         uint32_t len = 0;
         FQLOCK_LOCK(&flow_spare_q);
@@ -848,6 +1252,175 @@ static int FlowMgrTest05 (void) {
 
     return result;
 }
+
+/**
+ *  \test   Test timing out flows through the timeout wheel
+ *
+ *  \retval On success it returns 1 and on failure 0.
+ */
+
+static int FlowMgrTest06 (void) {
+    int result = 0;
+    uint8_t payload[] = "Payload";
+    struct timeval ts;
+    uint32_t i;
+
+    FlowInitConfig(FLOW_QUIET);
+    uint32_t spare = flow_spare_q.len;
+
+    TimeGet(&ts);
+    int32_t start = (int32_t)ts.tv_sec;
+
+    for (i = 0; i < 10; i++) {
+        Packet *p = UTHBuildPacket(payload, sizeof(payload), IPPROTO_UDP);
+        if (p == NULL)
+            goto end;
+        p->src.addr_data32[0] = i;
+        p->dst.addr_data32[0] = i + 1;
+        p->ts.tv_sec = start;
+        FlowHandlePacket(NULL, p);
+        if (p->flow != NULL)
+            SC_ATOMIC_RESET(p->flow->use_cnt);
+        UTHFreePacket(p);
+    }
+
+    if (flow_spare_q.len != spare - 10) {
+        printf("expected %u spare flows, got %u: ", spare - 10, flow_spare_q.len);
+        goto end;
+    }
+
+    /* first run goes round the wheel once */
+    FlowTimeoutCounters counters = { 0, 0, 0, };
+    FlowWheelCounters wcounters = { 0, 0, 0, };
+    if (FlowTimeoutWheel(&ts, &counters, &wcounters) != 0) {
+        printf("no flow should have timed out: ");
+        goto end;
+    }
+    if (wcounters.checked != 10 || wcounters.rescheduled != 10) {
+        printf("expected 10 checked and rescheduled flows, got %u and %u: ",
+                wcounters.checked, wcounters.rescheduled);
+        goto end;
+    }
+
+    /* no flow is due, so none should be looked at */
+    memset(&wcounters, 0, sizeof(wcounters));
+    ts.tv_sec = start + 10;
+    if (FlowTimeoutWheel(&ts, &counters, &wcounters) != 0 ||
+        wcounters.checked != 0) {
+        printf("no flow should have been checked, got %u: ", wcounters.checked);
+        goto end;
+    }
+    if (wcounters.lag != 9) {
+        printf("expected lag 9, got %u: ", wcounters.lag);
+        goto end;
+    }
+
+    /* now the new timeout expired for all of them */
+    memset(&wcounters, 0, sizeof(wcounters));
+    ts.tv_sec = start + FLOW_IPPROTO_UDP_NEW_TIMEOUT + 1;
+    if (FlowTimeoutWheel(&ts, &counters, &wcounters) != 10) {
+        printf("expected 10 timed out flows: ");
+        goto end;
+    }
+    if (counters.new != 10 || wcounters.checked != 10 ||
+        wcounters.rescheduled != 0) {
+        printf("expected 10 new pruned and checked, 0 rescheduled, got "
+                "%u %u %u: ", counters.new, wcounters.checked,
+                wcounters.rescheduled);
+        goto end;
+    }
+
+    if (flow_spare_q.len != spare) {
+        printf("expected %u spare flows, got %u: ", spare, flow_spare_q.len);
+        goto end;
+    }
+
+    result = 1;
+end:
+    FlowShutdown();
+    return result;
+}
+
+static int flow_mgr_test_state = FLOW_STATE_NEW;
+
+static int FlowMgrTestGetState(void *ctx) {
+    return flow_mgr_test_state;
+}
+
+/**
+ *  \test   Test that a flow is moved in the timeout wheel when its state
+ *          changes
+ *
+ *  \retval On success it returns 1 and on failure 0.
+ */
+
+static int FlowMgrTest07 (void) {
+    int result = 0;
+    uint8_t payload[] = "Payload";
+    struct timeval ts;
+    Flow *f = NULL;
+
+    FlowInitConfig(FLOW_QUIET);
+    FlowSetFlowStateFunc(IPPROTO_UDP, FlowMgrTestGetState);
+    flow_mgr_test_state = FLOW_STATE_NEW;
+
+    TimeGet(&ts);
+    int32_t start = (int32_t)ts.tv_sec;
+
+    Packet *p = UTHBuildPacket(payload, sizeof(payload), IPPROTO_UDP);
+    if (p == NULL)
+        goto end;
+    p->ts.tv_sec = start;
+    FlowHandlePacket(NULL, p);
+    f = p->flow;
+    if (f != NULL)
+        SC_ATOMIC_RESET(f->use_cnt);
+    UTHFreePacket(p);
+    if (f == NULL)
+        goto end;
+
+    /* first run goes round the wheel once and puts the flow in the slot
+     * of its new timeout */
+    FlowTimeoutCounters counters = { 0, 0, 0, };
+    FlowWheelCounters wcounters = { 0, 0, 0, };
+    if (FlowTimeoutWheel(&ts, &counters, &wcounters) != 0) {
+        printf("no flow should have timed out: ");
+        goto end;
+    }
+
+    flow_mgr_test_state = FLOW_STATE_ESTABLISHED;
+    FLOWLOCK_WRLOCK(f);
+    FlowWheelUpdate(f);
+    FLOWLOCK_UNLOCK(f);
+    if (f->wheel_slot != (uint32_t)(start + FLOW_IPPROTO_UDP_EST_TIMEOUT + 1) %
+                FLOW_WHEEL_SIZE + 1) {
+        printf("flow not in the slot of its established timeout: ");
+        goto end;
+    }
+
+    flow_mgr_test_state = FLOW_STATE_CLOSED;
+    FLOWLOCK_WRLOCK(f);
+    FlowWheelUpdate(f);
+    FLOWLOCK_UNLOCK(f);
+
+    /* the closed timeout expired, so the flow has to come up now */
+    memset(&wcounters, 0, sizeof(wcounters));
+    ts.tv_sec = start + flow_proto[FLOW_PROTO_UDP].closed_timeout + 1;
+    if (FlowTimeoutWheel(&ts, &counters, &wcounters) != 1) {
+        printf("expected 1 timed out flow, %u checked: ", wcounters.checked);
+        goto end;
+    }
+    if (counters.clo != 1) {
+        printf("expected 1 closed pruned, got %u: ", counters.clo);
+        goto end;
+    }
+
+    result = 1;
+end:
+    FlowSetFlowStateFunc(IPPROTO_UDP, NULL);
+    FlowShutdown();
+    return result;
+}
 #endif /* UNITTESTS */
 
 /**
@@ -860,5 +1433,7 @@ void FlowMgrRegisterTests (void) {
     UtRegisterTest("FlowMgrTest03 -- Timeout a flow in emergency having fresh TcpSession", FlowMgrTest03, 1);
     UtRegisterTest("FlowMgrTest04 -- Timeout a flow in emergency having TcpSession with segments", FlowMgrTest04, 1);
     UtRegisterTest("FlowMgrTest05 -- Test flow Allocations when it reach memcap", FlowMgrTest05, 1);
+    UtRegisterTest("FlowMgrTest06 -- Test flow timeout wheel", FlowMgrTest06, 1);
+    UtRegisterTest("FlowMgrTest07 -- Test flow timeout wheel reschedule", FlowMgrTest07, 1);
 #endif /* UNITTESTS */
 }
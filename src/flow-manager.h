@@ -24,12 +24,20 @@
 #ifndef __FLOW_MANAGER_H__
 #define __FLOW_MANAGER_H__
 
+#include "flow-hash.h"
+
 /** flow manager scheduling condition */
 SCCondT flow_manager_cond;
 SCMutex flow_manager_mutex;
 #define FlowWakeupFlowManagerThread() SCCondSignal(&flow_manager_cond)
 
 void FlowManagerThreadSpawn(void);
+uint32_t FlowTimeoutThreadHash(FlowThreadTable *, struct timeval *);
+void FlowWheelInit(void);
+void FlowWheelShutdown(void);
+void FlowWheelAdd(Flow *, int32_t);
+void FlowWheelRemove(Flow *);
+void FlowWheelUpdate(Flow *);
 void FlowKillFlowManagerThread(void);
 void FlowMgrRegisterTests (void);
 
@@ -81,6 +81,10 @@ FlowQueue flow_spare_q;
 FlowBucket *flow_hash;
 FlowConfig flow_config;
 
+/** list of the thread local flow tables, set up before the threads are
+ *  spawned and only walked at shutdown afterwards */
+FlowThreadTable *flow_thread_tables;
+
 /** flow memuse counter (atomic), for enforcing memcap limit */
 SC_ATOMIC_DECLARE(long long unsigned int, flow_memuse);
 
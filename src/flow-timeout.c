@@ -27,6 +27,7 @@
 #include "conf.h"
 #include "threadvars.h"
 #include "tm-threads.h"
+#include "tmqh-flow.h"
 #include "runmodes.h"
 
 #include "util-random.h"
@@ -140,7 +141,9 @@ static inline Packet *FlowForceReassemblyPseudoPacketSetup(Packet *p,
             p->dp = f->sp;
         }
 
-        /* set the ip header */
+        /* set the ip header, the packet buffer isn't cleared when the
+         * packet is recycled so clear both headers first */
+        memset(GET_PKT_DATA(p), 0x00, 40);
         p->ip4h = (IPV4Hdr *)GET_PKT_DATA(p);
         /* version 4 and length 20 bytes for the tcp header */
         p->ip4h->ip_verhl = 0x45;
@@ -177,7 +180,9 @@ static inline Packet *FlowForceReassemblyPseudoPacketSetup(Packet *p,
             p->dp = f->sp;
         }
 
-        /* set the ip header */
+        /* set the ip header, the packet buffer isn't cleared when the
+         * packet is recycled so clear both headers first */
+        memset(GET_PKT_DATA(p), 0x00, 60);
         p->ip6h = (IPV6Hdr *)GET_PKT_DATA(p);
         /* version 6 */
         p->ip6h->s_ip6_vfc = 0x60;
@@ -484,9 +489,15 @@ int FlowForceReassemblyForFlowV2(Flow *f, int server, int client)
  * - be robust in case of future changes
  * - locking overhead if neglectable when no other thread fights us
  *
- * \param q The queue to process flows from.
+ * \param hash the hash rows to process flows from
+ * \param hash_size number of rows
+ * \param reassemble_p packet used for the reassembly
+ *
+ * \retval 0 ok
+ * \retval -1 out of packets
  */
-static inline void FlowForceReassemblyForHash(void)
+static inline int FlowForceReassemblyForHashRows(FlowBucket *hash,
+        uint32_t hash_size, Packet *reassemble_p)
 {
     Flow *f;
     TcpSession *ssn;
@@ -496,13 +507,8 @@ static inline void FlowForceReassemblyForHash(void)
 
     uint32_t idx = 0;
 
-    /* We use this packet just for reassembly purpose */
-    Packet *reassemble_p = PacketGetFromAlloc();
-    if (reassemble_p == NULL)
-        return;
-
-    for (idx = 0; idx < flow_config.hash_size; idx++) {
-        FlowBucket *fb = &flow_hash[idx];
+    for (idx = 0; idx < hash_size; idx++) {
+        FlowBucket *fb = &hash[idx];
         if (fb == NULL)
             continue;
         FBLOCK_LOCK(fb);
@@ -578,9 +584,8 @@ static inline void FlowForceReassemblyForHash(void)
                 FLOWLOCK_UNLOCK(f);
 
                 if (p == NULL) {
-                    TmqhOutputPacketpool(NULL, reassemble_p);
                     FBLOCK_UNLOCK(fb);
-                    return;
+                    return -1;
                 }
                 PKT_SET_SRC(p, PKT_SRC_FFR_SHUTDOWN);
 
@@ -611,9 +616,8 @@ static inline void FlowForceReassemblyForHash(void)
                 FLOWLOCK_UNLOCK(f);
 
                 if (p == NULL) {
-                    TmqhOutputPacketpool(NULL, reassemble_p);
                     FBLOCK_UNLOCK(fb);
-                    return;
+                    return -1;
                 }
                 PKT_SET_SRC(p, PKT_SRC_FFR_SHUTDOWN);
 
@@ -644,6 +648,32 @@ static inline void FlowForceReassemblyForHash(void)
         FBLOCK_UNLOCK(fb);
     }
 
+    return 0;
+}
+
+/**
+ * \internal
+ * \brief Forces reassembly for the flows in the global hash and in the
+ *        thread local flow tables.
+ */
+static inline void FlowForceReassemblyForHash(void)
+{
+    /* We use this packet just for reassembly purpose */
+    Packet *reassemble_p = PacketGetFromAlloc();
+    if (reassemble_p == NULL)
+        return;
+
+    if (FlowForceReassemblyForHashRows(flow_hash, flow_config.hash_size,
+                reassemble_p) == 0)
+    {
+        FlowThreadTable *ft = flow_thread_tables;
+        for ( ; ft != NULL; ft = ft->next) {
+            if (FlowForceReassemblyForHashRows(ft->hash, ft->hash_size,
+                        reassemble_p) < 0)
+                break;
+        }
+    }
+
     PKT_SET_SRC(reassemble_p, PKT_SRC_FFR_SHUTDOWN);
     TmqhOutputPacketpool(NULL, reassemble_p);
     return;
@@ -678,7 +708,7 @@ void FlowForceReassembly(void)
             if (!(strlen(tv->inq->name) == strlen("packetpool") &&
                   strcasecmp(tv->inq->name, "packetpool") == 0)) {
                 PacketQueue *q = &trans_q[tv->inq->id];
-                while (q->len != 0) {
+                while (q->len != 0 || TmqhFlowRingsLen(tv->inq->id) != 0) {
                     usleep(100);
                 }
                 TmThreadsSetFlag(tv, THV_PAUSE);
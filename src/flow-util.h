@@ -25,6 +25,7 @@
 #define __FLOW_UTIL_H__
 
 #include "detect-engine-state.h"
+#include "flow-bit.h"
 #include "tmqh-flow.h"
 
 #define COPY_TIMESTAMP(src,dst) ((dst)->tv_sec = (src)->tv_sec, (dst)->tv_usec = (src)->tv_usec)
@@ -58,11 +59,13 @@
         (f)->sgh_toclient = NULL; \
         (f)->tag_list = NULL; \
         (f)->flowvar = NULL; \
+        (f)->flowbits = NULL; \
         SCMutexInit(&(f)->de_state_m, NULL); \
         (f)->hnext = NULL; \
         (f)->hprev = NULL; \
         (f)->lnext = NULL; \
         (f)->lprev = NULL; \
+        (f)->wheel_slot = FLOW_WHEEL_NONE; \
         SC_ATOMIC_INIT((f)->autofp_tmqh_flow_qid);  \
         (void) SC_ATOMIC_SET((f)->autofp_tmqh_flow_qid, -1);  \
         RESET_COUNTERS((f)); \
@@ -96,6 +99,8 @@
         (f)->tag_list = NULL; \
         GenericVarFree((f)->flowvar); \
         (f)->flowvar = NULL; \
+        FlowBitsFree((f)->flowbits); \
+        (f)->flowbits = NULL; \
         if (SC_ATOMIC_GET((f)->autofp_tmqh_flow_qid) != -1) {   \
             (void) SC_ATOMIC_SET((f)->autofp_tmqh_flow_qid, -1);   \
         }                                       \
@@ -112,6 +117,7 @@
         } \
         DetectTagDataListFree((f)->tag_list); \
         GenericVarFree((f)->flowvar); \
+        FlowBitsFree((f)->flowbits); \
         SCMutexDestroy(&(f)->de_state_m); \
         SC_ATOMIC_DESTROY((f)->autofp_tmqh_flow_qid);   \
         (f)->tag_list = NULL; \
@@ -38,6 +38,7 @@
 #include "flow-queue.h"
 #include "flow-hash.h"
 #include "flow-util.h"
+#include "flow-bit.h"
 #include "flow-var.h"
 #include "flow-private.h"
 #include "flow-timeout.h"
@@ -70,6 +71,9 @@
 
 #define FLOW_DEFAULT_PREALLOC    10000
 
+/** size of the global hash once thread local flow tables are used */
+#define FLOW_THREAD_LOCAL_GLOBAL_HASHSIZE 1024
+
 /** atomic int that is used when freeing a flow from the hash. In this
  *  case we walk the hash to find a flow to free. This var records where
  *  we left off in the hash. Without this only the top rows of the hash
@@ -260,16 +264,29 @@ static inline int FlowUpdateSeenFlag(Packet *p)
  */
 void FlowHandlePacket (ThreadVars *tv, Packet *p)
 {
+    Flow *f;
+
     /* Get this packet's flow from the hash. FlowHandlePacket() will setup
      * a new flow if nescesary. If we get NULL, we're out of flow memory.
      * The returned flow is locked. */
-    Flow *f = FlowGetFlowFromHash(p);
+    if (tv != NULL && tv->flow_table != NULL) {
+        FlowThreadTable *ft = tv->flow_table;
+
+        if ((int32_t)p->ts.tv_sec != ft->timeout_ts)
+            FlowTimeoutThreadHash(ft, &p->ts);
+
+        f = FlowGetFlowFromThreadHash(ft, p);
+    } else {
+        f = FlowGetFlowFromHash(p);
+    }
     if (f == NULL)
         return;
 
     /* update the last seen timestamp of this flow */
     f->lastts_sec = p->ts.tv_sec;
 
+    uint32_t seen = f->flags & (FLOW_TO_DST_SEEN|FLOW_TO_SRC_SEEN);
+
     /* update flags and counters */
     if (FlowGetPacketDirection(f,p) == TOSERVER) {
         if (FlowUpdateSeenFlag(p)) {
@@ -295,6 +312,10 @@ void FlowHandlePacket (ThreadVars *tv, Packet *p)
     if ((f->flags & FLOW_TO_DST_SEEN) && (f->flags & FLOW_TO_SRC_SEEN)) {
         SCLogDebug("pkt %p FLOW_PKT_ESTABLISHED", p);
         p->flowflags |= FLOW_PKT_ESTABLISHED;
+
+        /* for flows without a protocol state this changes the timeout */
+        if (seen != (FLOW_TO_DST_SEEN|FLOW_TO_SRC_SEEN))
+            FlowWheelUpdate(f);
     }
 
     /*set the detection bypass flags*/
@@ -323,8 +344,11 @@ void FlowInitConfig(char quiet)
     memset(&flow_config,  0, sizeof(flow_config));
     SC_ATOMIC_INIT(flow_flags);
     SC_ATOMIC_INIT(flow_memuse);
+    FlowBitInitCtx();
     SC_ATOMIC_INIT(flow_prune_idx);
     FlowQueueInit(&flow_spare_q);
+    FlowWheelInit();
+    flow_thread_tables = NULL;
 
     unsigned int seed = RandomTimePreseed();
     /* set defaults */
@@ -377,6 +401,11 @@ void FlowInitConfig(char quiet)
             flow_config.prealloc = configval;
         }
     }
+    int thread_local = 0;
+    if (ConfGetBool("flow.thread-local", &thread_local) == 1 && thread_local == 1) {
+        flow_config.thread_local = 1;
+    }
+    flow_config.thread_hash_size = flow_config.hash_size;
     SCLogDebug("Flow config from suricata.yaml: memcap: %"PRIu64", hash-size: "
                "%"PRIu32", prealloc: %"PRIu32, flow_config.memcap,
                flow_config.hash_size, flow_config.prealloc);
@@ -443,6 +472,142 @@ void FlowInitConfig(char quiet)
     return;
 }
 
+/** \internal
+ *  \brief clear and free all flows in a hash
+ */
+static void FlowHashFree(FlowBucket *hash, uint32_t hash_size)
+{
+    uint32_t u;
+
+    for (u = 0; u < hash_size; u++) {
+        Flow *f = hash[u].head;
+        while (f) {
+#ifdef DEBUG_VALIDATION
+            BUG_ON(SC_ATOMIC_GET(f->use_cnt) != 0);
+#endif
+            Flow *n = f->hnext;
+            uint8_t proto_map = FlowGetProtoMapping(f->proto);
+            FlowClearMemory(f, proto_map);
+            FlowFree(f);
+            f = n;
+        }
+
+        FBLOCK_DESTROY(&hash[u]);
+    }
+    SCFree(hash);
+}
+
+/** \internal
+ *  \brief replace the global hash by a small one
+ *
+ *  The threads with a table of their own never use the global hash, so
+ *  at full size it would only take memory from the memcap. A small one is
+ *  kept for packets handled outside of those threads.
+ *
+ *  \warning Not thread safe, call before spawning the threads
+ */
+static void FlowGlobalHashShrink(void)
+{
+    uint32_t i;
+
+    if (flow_config.hash_size <= FLOW_THREAD_LOCAL_GLOBAL_HASHSIZE)
+        return;
+
+    FlowHashFree(flow_hash, flow_config.hash_size);
+    (void) SC_ATOMIC_SUB(flow_memuse, flow_config.hash_size * sizeof(FlowBucket));
+
+    flow_config.hash_size = FLOW_THREAD_LOCAL_GLOBAL_HASHSIZE;
+    flow_hash = SCCalloc(flow_config.hash_size, sizeof(FlowBucket));
+    if (unlikely(flow_hash == NULL)) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered in FlowGlobalHashShrink. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < flow_config.hash_size; i++) {
+        FBLOCK_INIT(&flow_hash[i]);
+    }
+    (void) SC_ATOMIC_ADD(flow_memuse, flow_config.hash_size * sizeof(FlowBucket));
+
+    SCLogDebug("global flow hash shrunk to %"PRIu32" buckets",
+            flow_config.hash_size);
+}
+
+/** \brief setup a thread local flow table
+ *
+ *  The hash size and prealloc settings are divided over the threads. The
+ *  global spare queue is no longer maintained once thread tables are in
+ *  use, so its flows are released here, and the global hash is shrunk.
+ *
+ *  \param threads number of worker threads sharing the global settings
+ *
+ *  \retval ft the table, registered for shutdown. Exits on error.
+ *
+ *  \warning Not thread safe, call before spawning the threads
+ */
+FlowThreadTable *FlowThreadTableAlloc(uint32_t threads)
+{
+    Flow *f;
+    uint32_t i;
+
+    if (threads == 0)
+        threads = 1;
+
+    while ((f = FlowDequeue(&flow_spare_q)) != NULL) {
+        FlowFree(f);
+    }
+    if (flow_thread_tables == NULL)
+        FlowGlobalHashShrink();
+
+    FlowThreadTable *ft = SCMalloc(sizeof(FlowThreadTable));
+    if (unlikely(ft == NULL)) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered in FlowThreadTableAlloc. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+    memset(ft, 0, sizeof(FlowThreadTable));
+    FlowQueueInit(&ft->spare_q);
+
+    ft->hash_size = flow_config.thread_hash_size / threads;
+    if (ft->hash_size == 0)
+        ft->hash_size = 1;
+    ft->prealloc = flow_config.prealloc / threads;
+
+    uint64_t hash_size = ft->hash_size * sizeof(FlowBucket);
+    if (!(FLOW_CHECK_MEMCAP(hash_size))) {
+        SCLogError(SC_ERR_FLOW_INIT, "allocating thread local flow hash failed: "
+                "max flow memcap reached. Memcap %"PRIu64", Memuse %"PRIu64".",
+                flow_config.memcap,
+                ((uint64_t)SC_ATOMIC_GET(flow_memuse) + hash_size));
+        exit(EXIT_FAILURE);
+    }
+    ft->hash = SCCalloc(ft->hash_size, sizeof(FlowBucket));
+    if (unlikely(ft->hash == NULL)) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered in FlowThreadTableAlloc. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < ft->hash_size; i++) {
+        FBLOCK_INIT(&ft->hash[i]);
+    }
+    (void) SC_ATOMIC_ADD(flow_memuse, hash_size);
+
+    for (i = 0; i < ft->prealloc; i++) {
+        f = FlowAlloc();
+        if (f == NULL) {
+            SCLogError(SC_ERR_FLOW_INIT, "preallocating thread local flows "
+                    "failed: max flow memcap reached. Memcap %"PRIu64", "
+                    "Memuse %"PRIu64".", flow_config.memcap,
+                    ((uint64_t)SC_ATOMIC_GET(flow_memuse) + (uint64_t)sizeof(Flow)));
+            exit(EXIT_FAILURE);
+        }
+        FlowEnqueue(&ft->spare_q, f);
+    }
+
+    ft->next = flow_thread_tables;
+    flow_thread_tables = ft;
+
+    SCLogDebug("thread local flow table: %"PRIu32" buckets, %"PRIu32" "
+            "preallocated flows", ft->hash_size, ft->prealloc);
+    return ft;
+}
+
 /** \brief print some flow stats
  *  \warning Not thread safe */
 static void FlowPrintStats (void)
@@ -459,7 +624,6 @@ static void FlowPrintStats (void)
 void FlowShutdown(void)
 {
     Flow *f;
-    uint32_t u;
 
     FlowPrintStats();
 
@@ -470,27 +634,27 @@ void FlowShutdown(void)
 
     /* clear and free the hash */
     if (flow_hash != NULL) {
-        /* clean up flow mutexes */
-        for (u = 0; u < flow_config.hash_size; u++) {
-            Flow *f = flow_hash[u].head;
-            while (f) {
-#ifdef DEBUG_VALIDATION
-                BUG_ON(SC_ATOMIC_GET(f->use_cnt) != 0);
-#endif
-                Flow *n = f->hnext;
-                uint8_t proto_map = FlowGetProtoMapping(f->proto);
-                FlowClearMemory(f, proto_map);
-                FlowFree(f);
-                f = n;
-            }
+        FlowHashFree(flow_hash, flow_config.hash_size);
+        flow_hash = NULL;
+    }
 
-            FBLOCK_DESTROY(&flow_hash[u]);
+    /* and the thread local tables */
+    while (flow_thread_tables != NULL) {
+        FlowThreadTable *ft = flow_thread_tables;
+        flow_thread_tables = ft->next;
+
+        while((f = FlowDequeue(&ft->spare_q))) {
+            FlowFree(f);
         }
-        SCFree(flow_hash);
-        flow_hash = NULL;
+        FlowQueueDestroy(&ft->spare_q);
+
+        FlowHashFree(ft->hash, ft->hash_size);
+        (void) SC_ATOMIC_SUB(flow_memuse, ft->hash_size * sizeof(FlowBucket));
+        SCFree(ft);
     }
     (void) SC_ATOMIC_SUB(flow_memuse, flow_config.hash_size * sizeof(FlowBucket));
     FlowQueueDestroy(&flow_spare_q);
+    FlowWheelShutdown();
 
     SC_ATOMIC_DESTROY(flow_prune_idx);
     SC_ATOMIC_DESTROY(flow_memuse);
@@ -1071,6 +1235,91 @@ static int FlowTest09 (void) {
     return result;
 }
 
+/**
+ *  \test   Test flow lookups and timeouts in a thread local flow table
+ *
+ *  \retval On success it returns 1 and on failure 0.
+ */
+
+static int FlowTest10 (void) {
+    int result = 0;
+    ThreadVars tv;
+    uint8_t payload[] = "Payload";
+    Packet *p1 = NULL, *p2 = NULL;
+    struct timeval ts;
+    int i;
+
+    memset(&tv, 0, sizeof(tv));
+    FlowInitConfig(FLOW_QUIET);
+
+    tv.flow_table = FlowThreadTableAlloc(4);
+    FlowThreadTable *ft = tv.flow_table;
+    uint32_t spare = ft->spare_q.len;
+
+    /* global spare flows are given up for the thread tables */
+    if (flow_spare_q.len != 0 || spare != flow_config.prealloc / 4) {
+        printf("global spare %"PRIu32", thread spare %"PRIu32": ",
+                flow_spare_q.len, spare);
+        goto end;
+    }
+
+    /* and so is most of the global hash */
+    if (flow_config.hash_size != FLOW_THREAD_LOCAL_GLOBAL_HASHSIZE ||
+        ft->hash_size != flow_config.thread_hash_size / 4) {
+        printf("global hash %"PRIu32", thread hash %"PRIu32": ",
+                flow_config.hash_size, ft->hash_size);
+        goto end;
+    }
+
+    p1 = UTHBuildPacketReal(payload, sizeof(payload), IPPROTO_TCP,
+            "192.168.1.5", "192.168.1.1", 41424, 80);
+    p2 = UTHBuildPacketReal(payload, sizeof(payload), IPPROTO_TCP,
+            "192.168.1.1", "192.168.1.5", 80, 41424);
+    if (p1 == NULL || p2 == NULL)
+        goto end;
+
+    FlowHandlePacket(&tv, p1);
+    FlowHandlePacket(&tv, p2);
+    if (p1->flow == NULL || p1->flow != p2->flow) {
+        printf("both directions should map to the same flow: ");
+        goto end;
+    }
+    if (!(p2->flowflags & FLOW_PKT_ESTABLISHED)) {
+        printf("flow should be established: ");
+        goto end;
+    }
+    if (ft->spare_q.len != spare - 1) {
+        printf("thread spare %"PRIu32", expected %"PRIu32": ",
+                ft->spare_q.len, spare - 1);
+        goto end;
+    }
+
+    FlowDeReference(&p1->flow);
+    FlowDeReference(&p2->flow);
+
+    /* the incremental scan must reach the flow's row eventually */
+    ts.tv_sec = p1->ts.tv_sec + 5000;
+    ts.tv_usec = 0;
+    uint32_t cnt = 0;
+    for (i = 0; i < 64 && cnt == 0; i++) {
+        cnt = FlowTimeoutThreadHash(ft, &ts);
+    }
+    if (cnt != 1 || ft->spare_q.len != spare) {
+        printf("timed out %"PRIu32", thread spare %"PRIu32": ",
+                cnt, ft->spare_q.len);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (p1 != NULL)
+        UTHFreePacket(p1);
+    if (p2 != NULL)
+        UTHFreePacket(p2);
+    FlowShutdown();
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 /**
@@ -1083,6 +1332,7 @@ void FlowRegisterTests (void) {
     UtRegisterTest("FlowTest07 -- Test flow Allocations when it reach memcap", FlowTest07, 1);
     UtRegisterTest("FlowTest08 -- Test flow Allocations when it reach memcap", FlowTest08, 1);
     UtRegisterTest("FlowTest09 -- Test flow Allocations when it reach memcap", FlowTest09, 1);
+    UtRegisterTest("FlowTest10 -- Test thread local flow table", FlowTest10, 1);
 
     FlowMgrRegisterTests();
 #endif /* UNITTESTS */
@@ -223,6 +223,12 @@ typedef struct FlowCnf_
     uint32_t emerg_timeout_est;
     uint32_t emergency_recovery;
 
+    /** use thread local flow tables in the workers runmodes */
+    uint8_t thread_local;
+    /** hash-size setting, divided over the thread local tables. Once they
+     *  are used hash_size is the size of the small global hash. */
+    uint32_t thread_hash_size;
+
 } FlowConfig;
 
 /* Hash key for the flow hash */
@@ -293,6 +299,8 @@ typedef struct Flow_
 
     /** flow queue id, used with autofp */
     SC_ATOMIC_DECLARE(int, autofp_tmqh_flow_qid);
+    /** symmetric hash of the flow's tuple, see FlowGetHash() */
+    uint32_t flow_hash;
 
     uint32_t probing_parser_toserver_al_proto_masks;
     uint32_t probing_parser_toclient_al_proto_masks;
@@ -346,6 +354,8 @@ typedef struct Flow_
 
     /* pointer to the var list */
     GenericVar *flowvar;
+    /** flowbits bitmap, see flow-bit.c */
+    struct FlowBits_ *flowbits;
 
     SCMutex de_state_m;          /**< mutex lock for the de_state object */
 
@@ -354,9 +364,13 @@ typedef struct Flow_
     struct Flow_ *hprev;
     struct FlowBucket_ *fb;
 
-    /** queue list pointers, protected by queue mutex */
+    /** queue list pointers, protected by queue mutex. While the flow is
+     *  in the global hash they link it into its timeout wheel slot. */
     struct Flow_ *lnext; /* list */
     struct Flow_ *lprev;
+    /** timeout wheel slot the flow is in plus one, FLOW_WHEEL_NONE if it's
+     *  not scheduled. Only changed while the slot's queue lock is held. */
+    uint16_t wheel_slot;
     struct timeval startts;
 #ifdef DEBUG
     uint32_t todstpktcnt;
@@ -365,6 +379,10 @@ typedef struct Flow_
 #endif
 } Flow;
 
+/** flow is not in the timeout wheel. Zero, so that flows that are set up
+ *  without FLOW_INITIALIZE, like in the unittests, aren't either. */
+#define FLOW_WHEEL_NONE 0
+
 enum {
     FLOW_STATE_NEW = 0,
     FLOW_STATE_ESTABLISHED,
@@ -384,6 +402,7 @@ typedef struct FlowProto_ {
 
 void FlowHandlePacket (ThreadVars *, Packet *);
 void FlowInitConfig (char);
+struct FlowThreadTable_ *FlowThreadTableAlloc(uint32_t);
 void FlowPrintQueueInfo (void);
 void FlowShutdown(void);
 void FlowSetIPOnlyFlag(Flow *, char);
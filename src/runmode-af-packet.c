@@ -136,6 +136,8 @@ void *ParseAFPConfig(const char *iface)
     SC_ATOMIC_INIT(aconf->ref);
     (void) SC_ATOMIC_ADD(aconf->ref, 1);
     aconf->buffer_size = 0;
+    aconf->block_size = 0;
+    aconf->block_timeout = 0;
     aconf->cluster_id = 1;
     aconf->cluster_type = PACKET_FANOUT_HASH;
     aconf->promisc = 1;
@@ -200,6 +202,22 @@ void *ParseAFPConfig(const char *iface)
                 aconf->iface);
         aconf->flags |= AFP_RING_MODE;
     }
+    (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "tpacket-v3", (int *)&boolval);
+    if (boolval) {
+        if (!(aconf->flags & AFP_RING_MODE)) {
+            SCLogInfo("tpacket-v3 activated but use-mmap "
+                      "set to no. Disabling feature");
+        } else {
+#ifdef HAVE_TPACKET_V3
+            SCLogInfo("Enabling tpacket v3 capture on iface %s",
+                    aconf->iface);
+            aconf->flags |= AFP_TPACKET_V3;
+#else
+            SCLogWarning(SC_ERR_NO_AF_PACKET, "tpacket-v3 activated but "
+                         "not supported by this build. Disabling feature");
+#endif
+        }
+    }
     (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "use-emergency-flush", (int *)&boolval);
     if (boolval) {
         SCLogInfo("Enabling ring emergency flush on iface %s",
@@ -304,6 +322,24 @@ void *ParseAFPConfig(const char *iface)
         aconf->ring_size = max_pending_packets * 2 / aconf->threads;
     }
 
+    if ((ConfGetChildValueIntWithDefault(if_root, if_default, "block-size", &value)) == 1) {
+        if (value <= 0 || value % getpagesize() != 0) {
+            SCLogWarning(SC_ERR_INVALID_VALUE, "block-size must be a multiple "
+                         "of the page size (%d), using default value",
+                         getpagesize());
+        } else {
+            aconf->block_size = value;
+        }
+    }
+    if ((ConfGetChildValueIntWithDefault(if_root, if_default, "block-timeout", &value)) == 1) {
+        if (value < 0) {
+            SCLogWarning(SC_ERR_INVALID_VALUE, "Invalid block-timeout, using "
+                         "kernel default value");
+        } else {
+            aconf->block_timeout = value;
+        }
+    }
+
     (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "disable-promisc", (int *)&boolval);
     if (boolval) {
         SCLogInfo("Disabling promiscuous mode on iface %s",
@@ -25,6 +25,9 @@
 #include "cuda-packet-batcher.h"
 #include "source-pfring.h"
 
+#include "flow.h"
+#include "flow-private.h"
+
 #include "alert-fastlog.h"
 #include "alert-prelude.h"
 #include "alert-unified2-alert.h"
@@ -84,6 +87,12 @@ int RunModeErfFileSingle(DetectEngineCtx *de_ctx)
         exit(EXIT_FAILURE);
     }
 
+    /* the only thread handles all packets, so it can use a flow table
+     * of its own */
+    if (flow_config.thread_local) {
+        tv->flow_table = FlowThreadTableAlloc(1);
+    }
+
     TmModule *tm_module = TmModuleGetByName("ReceiveErfFile");
     if (tm_module == NULL) {
         printf("ERROR: TmModuleGetByName failed for ReceiveErfFile\n");
@@ -172,7 +181,7 @@ int RunModeErfFileAutoFp(DetectEngineCtx *de_ctx)
     ThreadVars *tv =
         TmThreadCreatePacketHandler("ReceiveErfFile",
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, autofp_queue_handler,
                                     "pktacqloop");
     if (tv == NULL) {
         printf("ERROR: TmThreadsCreate failed\n");
@@ -218,7 +227,7 @@ int RunModeErfFileAutoFp(DetectEngineCtx *de_ctx)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, autofp_queue_handler,
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -26,6 +26,9 @@
 #include "source-pfring.h"
 #include "detect-engine-mpm.h"
 
+#include "flow.h"
+#include "flow-private.h"
+
 #include "alert-fastlog.h"
 #include "alert-prelude.h"
 #include "alert-unified2-alert.h"
@@ -87,6 +90,12 @@ int RunModeFilePcapSingle(DetectEngineCtx *de_ctx)
         exit(EXIT_FAILURE);
     }
 
+    /* the only thread handles all packets, so it can use a flow table
+     * of its own */
+    if (flow_config.thread_local) {
+        tv->flow_table = FlowThreadTableAlloc(1);
+    }
+
     TmModule *tm_module = TmModuleGetByName("ReceivePcapFile");
     if (tm_module == NULL) {
         printf("ERROR: TmModuleGetByName failed for ReceivePcap\n");
@@ -423,7 +432,7 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
     ThreadVars *tv_receivepcap =
         TmThreadCreatePacketHandler("ReceivePcapFile",
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, autofp_queue_handler,
                                     "pktacqloop");
     if (tv_receivepcap == NULL) {
         printf("ERROR: TmThreadsCreate failed\n");
@@ -465,7 +474,7 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, autofp_queue_handler,
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
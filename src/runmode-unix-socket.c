@@ -43,22 +43,56 @@
 #include "output.h"
 #include "host.h"
 #include "defrag.h"
+#include "util-signal.h"
+#include "util-path.h"
+
+#ifdef HAVE_NSS
+#include <secmod.h>
+#endif
+
+#ifndef OS_WIN32
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 static const char *default_mode = NULL;
 
 int unix_socket_mode_is_running = 0;
 
+/** number of processed files kept for pcap-file-status */
+#define PCAP_FILES_DONE_MAX     1000
+
+enum {
+    PCAP_FILE_QUEUED,
+    PCAP_FILE_RUNNING,
+    PCAP_FILE_DONE,
+    PCAP_FILE_FAILED,
+};
+
 typedef struct PcapFiles_ {
     char *filename;
     char *output_dir;
+    int status;
+    /** pid of the worker process handling the file */
+    pid_t pid;
     TAILQ_ENTRY(PcapFiles_) next;
 } PcapFiles;
 
 typedef struct PcapCommand_ {
     DetectEngineCtx *de_ctx;
     TAILQ_HEAD(, PcapFiles_) files;
+    /** files being processed, oldest first */
+    TAILQ_HEAD(, PcapFiles_) running_files;
+    /** processed files with their final status, the last
+     *  PCAP_FILES_DONE_MAX */
+    TAILQ_HEAD(, PcapFiles_) done_files;
+    int done_cnt;
     int running;
-    char *currentfile;
+    /** number of files processed at the same time, each in its own
+     *  worker process if more than 1 */
+    int workers;
 } PcapCommand;
 
 const char *RunModeUnixSocketGetDefaultMode(void)
@@ -123,16 +157,96 @@ static TmEcode UnixSocketPcapFilesNumber(json_t *cmd, json_t* answer, void *data
 static TmEcode UnixSocketPcapCurrent(json_t *cmd, json_t* answer, void *data)
 {
     PcapCommand *this = (PcapCommand *) data;
+    PcapFiles *cfile = TAILQ_FIRST(&this->running_files);
 
-    if (this->currentfile) {
-        json_object_set_new(answer, "message", json_string(this->currentfile));
+    if (cfile != NULL) {
+        json_object_set_new(answer, "message", json_string(cfile->filename));
     } else {
         json_object_set_new(answer, "message", json_string("None"));
     }
     return TM_ECODE_OK;
 }
 
+static const char *PcapFilesStatusString(int status)
+{
+    switch (status) {
+        case PCAP_FILE_QUEUED:
+            return "queued";
+        case PCAP_FILE_RUNNING:
+            return "running";
+        case PCAP_FILE_DONE:
+            return "done";
+        case PCAP_FILE_FAILED:
+            return "failed";
+    }
+    return "unknown";
+}
+
+/**
+ * \brief append the files of a list, starting at file, to a json array
+ *
+ * \retval 0 in case of error, 1 in case of success
+ */
+static int PcapFilesStatusAppend(json_t *jarray, PcapFiles *file, int *counts)
+{
+    for ( ; file != NULL; file = TAILQ_NEXT(file, next)) {
+        json_t *jfile = json_object();
+        if (jfile == NULL)
+            return 0;
+        json_object_set_new(jfile, "filename", json_string(file->filename));
+        if (file->output_dir)
+            json_object_set_new(jfile, "output-dir", json_string(file->output_dir));
+        json_object_set_new(jfile, "status",
+                            json_string(PcapFilesStatusString(file->status)));
+        json_array_append_new(jarray, jfile);
+        counts[file->status]++;
+    }
+    return 1;
+}
 
+/**
+ * \brief return the status of the queued, running and processed files
+ *
+ * \retval 0 in case of error, 1 in case of success
+ */
+static TmEcode UnixSocketPcapFilesStatus(json_t *cmd, json_t* answer, void *data)
+{
+    PcapCommand *this = (PcapCommand *) data;
+    int counts[PCAP_FILE_FAILED + 1] = { 0, 0, 0, 0 };
+    json_t *jdata;
+    json_t *jarray;
+
+    jdata = json_object();
+    if (jdata == NULL) {
+        json_object_set_new(answer, "message",
+                            json_string("internal error at json object creation"));
+        return TM_ECODE_FAILED;
+    }
+    jarray = json_array();
+    if (jarray == NULL) {
+        json_decref(jdata);
+        json_object_set_new(answer, "message",
+                            json_string("internal error at json object creation"));
+        return TM_ECODE_FAILED;
+    }
+    if (!PcapFilesStatusAppend(jarray, TAILQ_FIRST(&this->done_files), counts) ||
+        !PcapFilesStatusAppend(jarray, TAILQ_FIRST(&this->running_files), counts) ||
+        !PcapFilesStatusAppend(jarray, TAILQ_FIRST(&this->files), counts)) {
+        json_decref(jarray);
+        json_decref(jdata);
+        json_object_set_new(answer, "message",
+                            json_string("internal error at json object creation"));
+        return TM_ECODE_FAILED;
+    }
+    json_object_set_new(jdata, "workers", json_integer(this->workers));
+    json_object_set_new(jdata, "queued", json_integer(counts[PCAP_FILE_QUEUED]));
+    json_object_set_new(jdata, "running", json_integer(counts[PCAP_FILE_RUNNING]));
+    json_object_set_new(jdata, "done", json_integer(counts[PCAP_FILE_DONE]));
+    json_object_set_new(jdata, "failed", json_integer(counts[PCAP_FILE_FAILED]));
+    json_object_set_new(jdata, "files", jarray);
+    json_object_set_new(answer, "message", jdata);
+    return TM_ECODE_OK;
+}
 
 static void PcapFilesFree(PcapFiles *cfile)
 {
@@ -145,6 +259,21 @@ static void PcapFilesFree(PcapFiles *cfile)
     SCFree(cfile);
 }
 
+/**
+ * \brief Move a processed file to the done list, with its final status
+ */
+static void PcapFilesSetDone(PcapCommand *this, PcapFiles *cfile, int status)
+{
+    cfile->status = status;
+    TAILQ_INSERT_TAIL(&this->done_files, cfile, next);
+    if (++this->done_cnt > PCAP_FILES_DONE_MAX) {
+        PcapFiles *old = TAILQ_FIRST(&this->done_files);
+        TAILQ_REMOVE(&this->done_files, old, next);
+        PcapFilesFree(old);
+        this->done_cnt--;
+    }
+}
+
 /**
  * \brief Add file to file queue
  *
@@ -259,7 +388,60 @@ TmEcode UnixSocketAddPcapFile(json_t *cmd, json_t* answer, void *data)
 }
 
 /**
- * \brief Handle the file queue
+ * \brief Stop the pcap-file running mode and free its resources
+ */
+static void UnixSocketPcapFileCleanup(void)
+{
+    TmThreadKillThreadsFamily(TVT_MGMT);
+    TmThreadClearThreadsFamily(TVT_MGMT);
+    TmThreadDisableThreadsWithTMS(TM_FLAG_RECEIVE_TM | TM_FLAG_DECODE_TM);
+    FlowForceReassembly();
+    TmThreadKillThreadsFamily(TVT_PPT);
+    TmThreadClearThreadsFamily(TVT_PPT);
+    RunModeShutDown();
+    SCPerfReleaseResources();
+    /* thread killed, we can run non thread-safe shutdown functions */
+    FlowShutdown();
+    HostCleanup();
+    StreamTcpFreeConfig(STREAM_VERBOSE);
+    DefragDestroy();
+    TmqResetQueues();
+}
+
+/**
+ * \brief Start a 'pcap-file' running mode on a file
+ *
+ * \retval TM_ECODE_OK on success, TM_ECODE_FAILED if the file or
+ *         the output dir can't be set
+ */
+static TmEcode UnixSocketPcapFileStart(PcapCommand *this, PcapFiles *cfile)
+{
+    if (ConfSet("pcap-file.file", cfile->filename, 1) != 1) {
+        SCLogInfo("Can not set working file to '%s'", cfile->filename);
+        return TM_ECODE_FAILED;
+    }
+    if (cfile->output_dir) {
+        if (ConfSet("default-log-dir", cfile->output_dir, 1) != 1) {
+            SCLogInfo("Can not set output dir to '%s'", cfile->output_dir);
+            return TM_ECODE_FAILED;
+        }
+    }
+    unix_manager_file_task_running = 1;
+    SCPerfInitCounterApi();
+    DefragInit();
+    FlowInitConfig(FLOW_QUIET);
+    StreamTcpInitConfig(STREAM_VERBOSE);
+    RunModeInitializeOutputs();
+    RunModeDispatch(RUNMODE_PCAP_FILE, NULL, this->de_ctx);
+    FlowManagerThreadSpawn();
+    SCPerfSpawnThreads();
+    /* Un-pause all the paused threads */
+    TmThreadContinueThreads();
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief Handle the file queue, one file at a time
  *
  * This function check if there is currently a file
  * being parse. If it is not the case, it will start to
@@ -267,13 +449,11 @@ TmEcode UnixSocketAddPcapFile(json_t *cmd, json_t* answer, void *data)
  * running mode after having set the file and the output dir.
  * This function also handles the cleaning of the previous
  * running mode.
- *
- * \param this a UnixCommand:: structure
- * \retval 0 in case of error, 1 in case of success
  */
-TmEcode UnixSocketPcapFilesCheck(void *data)
+static TmEcode UnixSocketPcapFilesCheckSingle(PcapCommand *this)
 {
-    PcapCommand *this = (PcapCommand *) data;
+    PcapFiles *cfile;
+
     if (unix_manager_file_task_running == 1) {
         return TM_ECODE_OK;
     }
@@ -281,59 +461,224 @@ TmEcode UnixSocketPcapFilesCheck(void *data)
         if (unix_manager_file_task_failed) {
             SCLogInfo("Preceeding taks failed, cleaning the running mode");
         }
+        cfile = TAILQ_FIRST(&this->running_files);
+        if (cfile != NULL) {
+            TAILQ_REMOVE(&this->running_files, cfile, next);
+            PcapFilesSetDone(this, cfile, unix_manager_file_task_failed ?
+                             PCAP_FILE_FAILED : PCAP_FILE_DONE);
+        }
         unix_manager_file_task_failed = 0;
         this->running = 0;
-        if (this->currentfile) {
-            SCFree(this->currentfile);
-        }
-        this->currentfile = NULL;
-        TmThreadKillThreadsFamily(TVT_MGMT);
-        TmThreadClearThreadsFamily(TVT_MGMT);
-        TmThreadDisableThreadsWithTMS(TM_FLAG_RECEIVE_TM | TM_FLAG_DECODE_TM);
-        FlowForceReassembly();
-        TmThreadKillThreadsFamily(TVT_PPT);
-        TmThreadClearThreadsFamily(TVT_PPT);
-        RunModeShutDown();
-        SCPerfReleaseResources();
-        /* thread killed, we can run non thread-safe shutdown functions */
-        FlowShutdown();
-        HostCleanup();
-        StreamTcpFreeConfig(STREAM_VERBOSE);
-        DefragDestroy();
-        TmqResetQueues();
+        UnixSocketPcapFileCleanup();
     }
     if (!TAILQ_EMPTY(&this->files)) {
-        PcapFiles *cfile = TAILQ_FIRST(&this->files);
+        cfile = TAILQ_FIRST(&this->files);
         TAILQ_REMOVE(&this->files, cfile, next);
         SCLogInfo("Starting run for '%s'", cfile->filename);
-        unix_manager_file_task_running = 1;
+        if (UnixSocketPcapFileStart(this, cfile) != TM_ECODE_OK) {
+            PcapFilesSetDone(this, cfile, PCAP_FILE_FAILED);
+            return TM_ECODE_FAILED;
+        }
+        cfile->status = PCAP_FILE_RUNNING;
+        TAILQ_INSERT_TAIL(&this->running_files, cfile, next);
         this->running = 1;
-        if (ConfSet("pcap-file.file", cfile->filename, 1) != 1) {
-            SCLogInfo("Can not set working file to '%s'", cfile->filename);
-            PcapFilesFree(cfile);
+    }
+    return TM_ECODE_OK;
+}
+
+#ifndef OS_WIN32
+static volatile sig_atomic_t unix_socket_worker_stop = 0;
+
+static void UnixSocketPcapWorkerSignalHandler(int sig)
+{
+    unix_socket_worker_stop = 1;
+}
+
+/**
+ * \brief Process a file in a forked worker process
+ *
+ * The worker starts a 'pcap-file' running mode on the file, with its
+ * own flow, stream and defrag tables, and exits once the file is done.
+ * The detection engine is shared with the parent copy on write. The
+ * exit status tells the parent if the run failed.
+ *
+ * Only the forking thread exists in the child. In this mode the engine
+ * has no other threads than the main thread, which only sleeps and
+ * checks the thread states, and the unix manager thread, which forks.
+ * So no lock the worker needs can be held by a thread that is gone.
+ * NSS doesn't survive a fork, its modules are restarted.
+ */
+static void UnixSocketPcapFileWorker(PcapCommand *this, PcapFiles *cfile)
+{
+    int failed;
+
+#if defined(HAVE_SYS_PRCTL_H) && defined(PR_SET_PDEATHSIG)
+    /* don't outlive the engine */
+    (void)prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+#ifdef HAVE_NSS
+    if (SECMOD_RestartModules(PR_FALSE) != SECSuccess) {
+        SCLogError(SC_ERR_INITIALIZATION, "Unable to restart NSS in the worker "
+                   "for '%s'", cfile->filename);
+        _exit(EXIT_FAILURE);
+    }
+#endif
+    UtilSignalHandlerSetup(SIGINT, UnixSocketPcapWorkerSignalHandler);
+    UtilSignalHandlerSetup(SIGTERM, UnixSocketPcapWorkerSignalHandler);
+    UnixManagerCloseSockets();
+
+    if (UnixSocketPcapFileStart(this, cfile) != TM_ECODE_OK) {
+        fflush(NULL);
+        _exit(EXIT_FAILURE);
+    }
+    while (unix_manager_file_task_running == 1 && unix_socket_worker_stop == 0) {
+        usleep(10000);
+    }
+    failed = (unix_manager_file_task_failed == 1 || unix_socket_worker_stop);
+    UnixSocketPcapFileCleanup();
+    fflush(NULL);
+    _exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * \brief Check if a running file logs to the same directory as a file
+ *
+ * \retval 1 if the log directory is in use, 0 if not
+ */
+static int UnixSocketPcapFileLogDirBusy(PcapCommand *this, PcapFiles *cfile)
+{
+    char dir[PATH_MAX];
+    char rdir[PATH_MAX];
+    PcapFiles *rfile;
+
+    /* no output-dir means the default-log-dir */
+    if (cfile->output_dir == NULL || realpath(cfile->output_dir, dir) == NULL)
+        dir[0] = '\0';
+
+    TAILQ_FOREACH(rfile, &this->running_files, next) {
+        if (rfile->output_dir == NULL ||
+            realpath(rfile->output_dir, rdir) == NULL)
+            rdir[0] = '\0';
+        if (strcmp(dir, rdir) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Handle the file queue, up to PcapCommand::workers files at a time
+ *
+ * Every file is processed in a worker process. This function reaps the
+ * workers that are done, records the status of their file and starts
+ * workers for queued files. Files logging to the same directory are
+ * processed one after the other, as the workers would mix their records
+ * in the log files and overwrite each other's stored files.
+ */
+static TmEcode UnixSocketPcapFilesCheckWorkers(PcapCommand *this)
+{
+    PcapFiles *cfile;
+    PcapFiles *tfile;
+    pid_t pid;
+    int status;
+
+    TAILQ_FOREACH_SAFE(cfile, &this->running_files, next, tfile) {
+        pid = waitpid(cfile->pid, &status, WNOHANG);
+        if (pid == 0)
+            continue;
+        TAILQ_REMOVE(&this->running_files, cfile, next);
+        if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+            SCLogInfo("Run for '%s' done", cfile->filename);
+            PcapFilesSetDone(this, cfile, PCAP_FILE_DONE);
+        } else {
+            SCLogInfo("Run for '%s' failed", cfile->filename);
+            PcapFilesSetDone(this, cfile, PCAP_FILE_FAILED);
+        }
+        this->running--;
+    }
+
+    TAILQ_FOREACH_SAFE(cfile, &this->files, next, tfile) {
+        if (this->running >= this->workers)
+            break;
+        if (UnixSocketPcapFileLogDirBusy(this, cfile))
+            continue;
+
+        TAILQ_REMOVE(&this->files, cfile, next);
+        SCLogInfo("Starting run for '%s'", cfile->filename);
+
+        /* the child would write out our buffered output again */
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0) {
+            UnixSocketPcapFileWorker(this, cfile);
+            /* not reached */
+        } else if (pid < 0) {
+            SCLogError(SC_ERR_SYSCALL, "Unable to fork worker for '%s': %s",
+                       cfile->filename, strerror(errno));
+            PcapFilesSetDone(this, cfile, PCAP_FILE_FAILED);
             return TM_ECODE_FAILED;
         }
-        if (cfile->output_dir) {
-            if (ConfSet("default-log-dir", cfile->output_dir, 1) != 1) {
-                SCLogInfo("Can not set output dir to '%s'", cfile->output_dir);
-                PcapFilesFree(cfile);
-                return TM_ECODE_FAILED;
+        cfile->pid = pid;
+        cfile->status = PCAP_FILE_RUNNING;
+        TAILQ_INSERT_TAIL(&this->running_files, cfile, next);
+        this->running++;
+    }
+    return TM_ECODE_OK;
+}
+#endif /* OS_WIN32 */
+
+/**
+ * \brief Check if an enabled output logs to an absolute path, outside of
+ *        the default-log-dir
+ *
+ * \retval 1 if one does, 0 if not
+ */
+static int UnixSocketOutputsAbsolute(void)
+{
+    static const char *keys[] = { "filename", "log-dir", "dir", "waldo", NULL };
+    ConfNode *outputs = ConfGetNode("outputs");
+    ConfNode *output, *output_config;
+    const char *enabled;
+    const char *val;
+    int i;
+
+    if (outputs == NULL)
+        return 0;
+
+    TAILQ_FOREACH(output, &outputs->head, next) {
+        output_config = ConfNodeLookupChild(output, output->val);
+        if (output_config == NULL)
+            continue;
+
+        enabled = ConfNodeLookupChildValue(output_config, "enabled");
+        if (enabled == NULL || !ConfValIsTrue(enabled))
+            continue;
+
+        for (i = 0; keys[i] != NULL; i++) {
+            val = ConfNodeLookupChildValue(output_config, keys[i]);
+            if (val != NULL && PathIsAbsolute(val)) {
+                SCLogInfo("output %s logs to %s", output->val, val);
+                return 1;
             }
         }
-        this->currentfile = SCStrdup(cfile->filename);
-        PcapFilesFree(cfile);
-        SCPerfInitCounterApi();
-        DefragInit();
-        FlowInitConfig(FLOW_QUIET);
-        StreamTcpInitConfig(STREAM_VERBOSE);
-        RunModeInitializeOutputs();
-        RunModeDispatch(RUNMODE_PCAP_FILE, NULL, this->de_ctx);
-        FlowManagerThreadSpawn();
-        SCPerfSpawnThreads();
-        /* Un-pause all the paused threads */
-        TmThreadContinueThreads();
     }
-    return TM_ECODE_OK;
+    return 0;
+}
+
+/**
+ * \brief Handle the file queue
+ *
+ * \param this a UnixCommand:: structure
+ * \retval 0 in case of error, 1 in case of success
+ */
+TmEcode UnixSocketPcapFilesCheck(void *data)
+{
+    PcapCommand *this = (PcapCommand *) data;
+
+#ifndef OS_WIN32
+    if (this->workers > 1)
+        return UnixSocketPcapFilesCheckWorkers(this);
+#endif
+    return UnixSocketPcapFilesCheckSingle(this);
 }
 #endif
 
@@ -372,6 +717,7 @@ int RunModeUnixSocketSingle(DetectEngineCtx *de_ctx)
 {
 #ifdef BUILD_UNIX_SOCKET
     PcapCommand *pcapcmd = SCMalloc(sizeof(PcapCommand));
+    intmax_t workers = 1;
 
     if (unlikely(pcapcmd == NULL)) {
         SCLogError(SC_ERR_MEM_ALLOC, "Can not allocate pcap command");
@@ -379,7 +725,32 @@ int RunModeUnixSocketSingle(DetectEngineCtx *de_ctx)
     }
     pcapcmd->de_ctx = de_ctx;
     TAILQ_INIT(&pcapcmd->files);
-    pcapcmd->currentfile = NULL;
+    TAILQ_INIT(&pcapcmd->running_files);
+    TAILQ_INIT(&pcapcmd->done_files);
+    pcapcmd->done_cnt = 0;
+    pcapcmd->running = 0;
+
+    if (ConfGetInt("unix-command.pcap-workers", &workers) != 1) {
+        workers = 1;
+    }
+#ifdef OS_WIN32
+    workers = 1;
+#endif
+    if (workers < 1 || workers > INT_MAX) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "Invalid unix-command.pcap-workers "
+                     "value %"PRIdMAX", using 1", workers);
+        workers = 1;
+    }
+    pcapcmd->workers = (int)workers;
+    if (pcapcmd->workers > 1 && UnixSocketOutputsAbsolute()) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENT, "Outputs with an absolute path "
+                     "would be shared by the pcap workers, using 1");
+        pcapcmd->workers = 1;
+    }
+    if (pcapcmd->workers > 1) {
+        SCLogInfo("Processing up to %d pcap files at the same time",
+                  pcapcmd->workers);
+    }
 
     UnixManagerThreadSpawn(de_ctx, 1);
 
@@ -389,6 +760,7 @@ int RunModeUnixSocketSingle(DetectEngineCtx *de_ctx)
     UnixManagerRegisterCommand("pcap-file-number", UnixSocketPcapFilesNumber, pcapcmd, 0);
     UnixManagerRegisterCommand("pcap-file-list", UnixSocketPcapFilesList, pcapcmd, 0);
     UnixManagerRegisterCommand("pcap-current", UnixSocketPcapCurrent, pcapcmd, 0);
+    UnixManagerRegisterCommand("pcap-file-status", UnixSocketPcapFilesStatus, pcapcmd, 0);
 
     UnixManagerRegisterBackgroundTask(UnixSocketPcapFilesCheck, pcapcmd);
 #endif
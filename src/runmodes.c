@@ -477,6 +477,11 @@ void SetupOutputs(ThreadVars *tv)
 }
 
 float threading_detect_ratio = 1;
+/** number of packets a thread takes from its inq at once */
+uint16_t threading_batch_size = 1;
+/** queue handler between the capture and the processing threads in the
+ *  autofp runmodes */
+char *autofp_queue_handler = "flow";
 
 /**
  * Initialize the output modules.
@@ -496,4 +501,27 @@ void RunModeInitialize(void)
     }
 
     SCLogDebug("threading.detect-thread-ratio %f", threading_detect_ratio);
+
+    intmax_t batch_size = 1;
+    if (ConfGetInt("threading.batch-size", &batch_size) != 1) {
+        batch_size = 1;
+    } else if (batch_size < 1 || batch_size > THV_BATCH_SIZE_MAX) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry %"PRIdMAX" "
+                   "for threading.batch-size in conf, must be between 1 and %d. "
+                   "Killing engine.", batch_size, THV_BATCH_SIZE_MAX);
+        exit(EXIT_FAILURE);
+    }
+    threading_batch_size = (uint16_t)batch_size;
+    SCLogDebug("threading.batch-size %"PRIu16, threading_batch_size);
+
+    if (ConfGet("autofp-queue-handler", &autofp_queue_handler) != 1) {
+        autofp_queue_handler = "flow";
+    } else if (strcasecmp(autofp_queue_handler, "flow") != 0 &&
+               strcasecmp(autofp_queue_handler, "flow-lockfree") != 0) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
+                   "for autofp-queue-handler in conf.  Killing engine.",
+                   autofp_queue_handler);
+        exit(EXIT_FAILURE);
+    }
+    SCLogDebug("autofp-queue-handler %s", autofp_queue_handler);
 }
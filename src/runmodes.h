@@ -66,6 +66,8 @@ void RunModeShutDown(void);
 
 int threading_set_cpu_affinity;
 extern float threading_detect_ratio;
+extern uint16_t threading_batch_size;
+extern char *autofp_queue_handler;
 
 extern int debuglog_enabled;
 
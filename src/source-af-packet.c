@@ -156,9 +156,30 @@ enum {
 
 union thdr {
     struct tpacket2_hdr *h2;
+#ifdef HAVE_TPACKET_V3
+    struct tpacket3_hdr *h3;
+#endif
     void *raw;
 };
 
+#ifdef HAVE_TPACKET_V3
+/**
+ * \brief Private area of a TPACKET_V3 ring block
+ *
+ * Counts the references on the block: one per packet still in the engine
+ * plus one for the reader while it walks the block. The block is given
+ * back to the kernel when it drops to zero.
+ */
+typedef struct AFPBlockPriv_ {
+    SC_ATOMIC_DECLARE(unsigned int, users);
+} AFPBlockPriv;
+
+/** the kernel puts the private area right after the block descriptor,
+ *  aligned on 8 bytes (BLK_HDR_LEN in af_packet.c) */
+#define AFP_V3_BLOCK_PRIV(pbd) \
+    ((AFPBlockPriv *)((uint8_t *)(pbd) + ((sizeof(struct tpacket_block_desc) + 7) & ~7)))
+#endif
+
 /**
  * \brief Structure to hold thread specific variables.
  */
@@ -177,6 +198,8 @@ typedef struct AFPThreadVars_
     uint32_t pkts;
     uint64_t bytes;
     uint32_t errs;
+    /* TPACKET_V3 frames left unread when a block was abandoned */
+    uint32_t lost;
 
     ThreadVars *tv;
     TmSlot *slot;
@@ -211,9 +234,15 @@ typedef struct AFPThreadVars_
     int copy_mode;
 
     struct tpacket_req req;
+#ifdef HAVE_TPACKET_V3
+    struct tpacket_req3 req3;
+#endif
+    int block_size;
+    int block_timeout;
     unsigned int tp_hdrlen;
     unsigned int ring_buflen;
     char *ring_buf;
+    /* frame pointers, or block pointers in TPACKET_V3 mode */
     char *frame_buf;
     unsigned int frame_offset;
     int ring_size;
@@ -846,6 +875,219 @@ next_frame:
     SCReturnInt(AFP_READ_OK);
 }
 
+#ifdef HAVE_TPACKET_V3
+/**
+ * \brief Drop a reference on a TPACKET_V3 block
+ *
+ * The last reference gives the block back to the kernel.
+ */
+static inline void AFPDerefBlock(struct tpacket_block_desc *pbd)
+{
+    AFPBlockPriv *priv = AFP_V3_BLOCK_PRIV(pbd);
+
+    if (SC_ATOMIC_SUB(priv->users, 1) == 0) {
+        /* all reads of the block's frames have to be done before the
+         * kernel can see the block as free */
+        hw_barrier();
+        pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    }
+}
+
+TmEcode AFPReleaseDataFromRingV3(ThreadVars *t, Packet *p)
+{
+    int ret = TM_ECODE_OK;
+    /* Need to be in copy mode and need to detect early release
+       where Ethernet header could not be set (and pseudo packet) */
+    if ((p->afp_v.copy_mode != AFP_COPY_MODE_NONE) && !PKT_IS_PSEUDOPKT(p)) {
+        ret = AFPWritePacket(p);
+    }
+
+    if (AFPDerefSocket(p->afp_v.mpeer) == 0)
+        goto cleanup;
+
+    if (p->afp_v.relptr) {
+        AFPDerefBlock(p->afp_v.relptr);
+    }
+
+cleanup:
+    AFPV_CLEANUP(&p->afp_v);
+    return ret;
+}
+
+/**
+ * \brief Build a packet pointing to a frame of a TPACKET_V3 block
+ *
+ * The packet data is not copied: the packet holds a reference on the
+ * block which is dropped by AFPReleaseDataFromRingV3().
+ *
+ * \param pbd block the frame belongs to
+ * \param h3 frame header
+ */
+static int AFPReadFromFrameV3(AFPThreadVars *ptv, struct tpacket_block_desc *pbd,
+                              struct tpacket3_hdr *h3)
+{
+    Packet *p = NULL;
+    struct sockaddr_ll *from;
+
+    p = PacketGetFromQueueOrAlloc();
+    if (p == NULL) {
+        SCReturnInt(AFP_FAILURE);
+    }
+    PKT_SET_SRC(p, PKT_SRC_WIRE);
+
+    from = (void *)h3 + TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+
+    ptv->pkts++;
+    ptv->bytes += h3->tp_len;
+    (void) SC_ATOMIC_ADD(ptv->livedev->pkts, 1);
+    p->livedev = ptv->livedev;
+
+    /* add forged header */
+    if (ptv->cooked) {
+        SllHdr * hdrp = (SllHdr *)ptv->data;
+        /* XXX this is minimalist, but this seems enough */
+        hdrp->sll_protocol = from->sll_protocol;
+    }
+
+    p->datalink = ptv->datalink;
+    if (h3->tp_len > h3->tp_snaplen) {
+        SCLogDebug("Packet length (%d) > snaplen (%d), truncating",
+                h3->tp_len, h3->tp_snaplen);
+    }
+    if (PacketSetData(p, (unsigned char*)h3 + h3->tp_mac, h3->tp_snaplen) == -1) {
+        TmqhOutputPacketpool(ptv->tv, p);
+        SCReturnInt(AFP_FAILURE);
+    }
+    (void) SC_ATOMIC_ADD(AFP_V3_BLOCK_PRIV(pbd)->users, 1);
+    p->afp_v.relptr = pbd;
+    p->ReleaseData = AFPReleaseDataFromRingV3;
+    p->afp_v.mpeer = ptv->mpeer;
+    AFPRefSocket(ptv->mpeer);
+
+    p->afp_v.copy_mode = ptv->copy_mode;
+    if (p->afp_v.copy_mode != AFP_COPY_MODE_NONE) {
+        p->afp_v.peer = ptv->mpeer->peer;
+    } else {
+        p->afp_v.peer = NULL;
+    }
+
+    /* Timestamp */
+    p->ts.tv_sec = h3->tp_sec;
+    p->ts.tv_usec = h3->tp_nsec/1000;
+    SCLogDebug("pktlen: %" PRIu32 " (pkt %p, pkt data %p)",
+            GET_PKT_LEN(p), p, GET_PKT_DATA(p));
+
+    /* We only check for checksum disable */
+    if (ptv->checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
+        p->flags |= PKT_IGNORE_CHECKSUM;
+    } else if (ptv->checksum_mode == CHECKSUM_VALIDATION_AUTO) {
+        if (ptv->livedev->ignore_checksum) {
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        } else if (ChecksumAutoModeCheck(ptv->pkts,
+                    SC_ATOMIC_GET(ptv->livedev->pkts),
+                    SC_ATOMIC_GET(ptv->livedev->invalid_checksums))) {
+            ptv->livedev->ignore_checksum = 1;
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        }
+    } else {
+        if (h3->tp_status & TP_STATUS_CSUMNOTREADY) {
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        }
+    }
+
+    if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
+        TmqhOutputPacketpool(ptv->tv, p);
+        SCReturnInt(AFP_FAILURE);
+    }
+
+    SCReturnInt(AFP_READ_OK);
+}
+
+/**
+ * \brief AF packet read function for TPACKET_V3 ring
+ *
+ * Walks every block the kernel has handed over, processing all the frames
+ * of a block in one go. A block goes back to the kernel once the last of
+ * its packets has been released.
+ *
+ * \param user pointer to AFPThreadVars
+ * \retval AFP_READ_OK, AFP_KERNEL_DROP or AFP_FAILURE
+ */
+int AFPReadFromRingV3(AFPThreadVars *ptv)
+{
+    struct tpacket_block_desc *pbd;
+    union thdr h;
+    uint8_t emergency_flush = 0;
+    uint32_t status;
+    uint32_t i;
+
+    /* Loop till we have blocks available */
+    while (1) {
+        if (unlikely(suricata_ctl_flags != 0)) {
+            break;
+        }
+
+        pbd = ((struct tpacket_block_desc **)ptv->frame_buf)[ptv->frame_offset];
+        if (pbd == NULL) {
+            SCReturnInt(AFP_FAILURE);
+        }
+
+        /* Block is owned by the kernel or its packets are still used by
+         * suricata */
+        status = pbd->hdr.bh1.block_status;
+        if (!(status & TP_STATUS_USER) || (status & TP_STATUS_USER_BUSY)) {
+            break;
+        }
+
+        if ((ptv->flags & AFP_EMERGENCY_MODE) && (emergency_flush == 1)) {
+            pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            goto next_block;
+        }
+
+        /* The reader holds a reference while walking the block so that
+         * the packets released meanwhile don't give it back early. */
+        SC_ATOMIC_RESET(AFP_V3_BLOCK_PRIV(pbd)->users);
+        (void) SC_ATOMIC_ADD(AFP_V3_BLOCK_PRIV(pbd)->users, 1);
+        pbd->hdr.bh1.block_status = status | TP_STATUS_USER_BUSY;
+
+        h.raw = (uint8_t *)pbd + pbd->hdr.bh1.offset_to_first_pkt;
+        for (i = 0; i < pbd->hdr.bh1.num_pkts; i++) {
+            uint32_t next_offset = h.h3->tp_next_offset;
+
+            if (AFPReadFromFrameV3(ptv, pbd, h.h3) != AFP_READ_OK) {
+                /* the thread goes down, so the rest of the block is
+                 * never read */
+                ptv->lost += pbd->hdr.bh1.num_pkts - i - 1;
+                AFPDerefBlock(pbd);
+                if (++ptv->frame_offset >= ptv->req3.tp_block_nr) {
+                    ptv->frame_offset = 0;
+                }
+                SCReturnInt(AFP_FAILURE);
+            }
+            h.raw = (uint8_t *)h.raw + next_offset;
+        }
+        AFPDerefBlock(pbd);
+
+        if (status & TP_STATUS_LOSING) {
+            emergency_flush = 1;
+            AFPDumpCounters(ptv);
+        }
+
+next_block:
+        if (++ptv->frame_offset >= ptv->req3.tp_block_nr) {
+            ptv->frame_offset = 0;
+            /* Get out of loop to be sure we will reach maintenance tasks */
+            break;
+        }
+    }
+
+    if ((emergency_flush) && (ptv->flags & AFP_EMERGENCY_MODE)) {
+        SCReturnInt(AFP_KERNEL_DROP);
+    }
+    SCReturnInt(AFP_READ_OK);
+}
+#endif /* HAVE_TPACKET_V3 */
+
 /**
  * \brief Reference socket
  *
@@ -1026,7 +1268,11 @@ TmEcode ReceiveAFPLoop(ThreadVars *tv, void *data, void *slot)
                 continue;
             }
         } else if (r > 0) {
-            if (ptv->flags & AFP_RING_MODE) {
+            if (ptv->flags & AFP_TPACKET_V3) {
+#ifdef HAVE_TPACKET_V3
+                r = AFPReadFromRingV3(ptv);
+#endif
+            } else if (ptv->flags & AFP_RING_MODE) {
                 r = AFPReadFromRing(ptv);
             } else {
                 /* AFPRead will call TmThreadsSlotProcessPkt on read packets */
@@ -1171,13 +1417,176 @@ frame size: TPACKET_ALIGN(snaplen + TPACKET_ALIGN(TPACKET_ALIGN(tp_hdrlen) + siz
     return 1;
 }
 
+#ifdef HAVE_TPACKET_V3
+static int AFPComputeRingParamsV3(AFPThreadVars *ptv, int order)
+{
+    /* Frames have a variable size in TPACKET_V3, tp_frame_size is only
+     * used to size the ring for ring_size full sized packets */
+    int tp_hdrlen = sizeof(struct tpacket3_hdr);
+    int snaplen = default_packet_size;
+
+    memset(&ptv->req3, 0, sizeof(ptv->req3));
+    ptv->req3.tp_frame_size = TPACKET_ALIGN(snaplen +TPACKET_ALIGN(TPACKET_ALIGN(tp_hdrlen) + sizeof(struct sockaddr_ll) + ETH_HLEN) - ETH_HLEN);
+    if (ptv->block_size) {
+        ptv->req3.tp_block_size = ptv->block_size;
+    } else {
+        ptv->req3.tp_block_size = getpagesize() << order;
+    }
+    int frames_per_block = ptv->req3.tp_block_size / ptv->req3.tp_frame_size;
+    if (frames_per_block == 0) {
+        SCLogInfo("frame size to big");
+        return -1;
+    }
+    ptv->req3.tp_frame_nr = ptv->ring_size;
+    ptv->req3.tp_block_nr = ptv->req3.tp_frame_nr / frames_per_block + 1;
+    /* exact division */
+    ptv->req3.tp_frame_nr = ptv->req3.tp_block_nr * frames_per_block;
+    ptv->req3.tp_retire_blk_tov = ptv->block_timeout;
+    ptv->req3.tp_sizeof_priv = sizeof(AFPBlockPriv);
+    SCLogInfo("AF_PACKET V3 RX Ring params: block_size=%d block_nr=%d frame_size=%d frame_nr=%d",
+              ptv->req3.tp_block_size, ptv->req3.tp_block_nr,
+              ptv->req3.tp_frame_size, ptv->req3.tp_frame_nr);
+    return 1;
+}
+#endif
+
+#define DEFAULT_ORDER 3
+
+static int AFPSetupRing(AFPThreadVars *ptv, char *devname)
+{
+    int r;
+    int order;
+    unsigned int i;
+
+    /* Allocate RX ring */
+    for (order = DEFAULT_ORDER; order >= 0; order--) {
+        if (AFPComputeRingParams(ptv, order) != 1) {
+            SCLogInfo("Ring parameter are incorrect. Please correct the devel");
+        }
+
+        r = setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING, (void *) &ptv->req, sizeof(ptv->req));
+        if (r < 0) {
+            if (errno == ENOMEM) {
+                SCLogInfo("Memory issue with ring parameters. Retrying.");
+                continue;
+            }
+            SCLogError(SC_ERR_MEM_ALLOC,
+                    "Unable to allocate RX Ring for iface %s: (%d) %s",
+                    devname,
+                    errno,
+                    strerror(errno));
+            return -1;
+        } else {
+            break;
+        }
+    }
+
+    if (order < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC,
+                "Unable to allocate RX Ring for iface %s (order 0 failed)",
+                devname);
+        return -1;
+    }
+
+    /* Allocate the Ring */
+    ptv->ring_buflen = ptv->req.tp_block_nr * ptv->req.tp_block_size;
+    ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
+            MAP_SHARED, ptv->socket, 0);
+    if (ptv->ring_buf == MAP_FAILED) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+        return -1;
+    }
+    /* allocate a ring for each frame header pointer*/
+    ptv->frame_buf = SCMalloc(ptv->req.tp_frame_nr * sizeof (union thdr *));
+    if (ptv->frame_buf == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate frame buf");
+        return -1;
+    }
+    memset(ptv->frame_buf, 0, ptv->req.tp_frame_nr * sizeof (union thdr *));
+    /* fill the header ring with proper frame ptr*/
+    ptv->frame_offset = 0;
+    for (i = 0; i < ptv->req.tp_block_nr; ++i) {
+        void *base = &ptv->ring_buf[i * ptv->req.tp_block_size];
+        unsigned int j;
+        for (j = 0; j < ptv->req.tp_block_size / ptv->req.tp_frame_size; ++j, ++ptv->frame_offset) {
+            (((union thdr **)ptv->frame_buf)[ptv->frame_offset]) = base;
+            base += ptv->req.tp_frame_size;
+        }
+    }
+    ptv->frame_offset = 0;
+    return 0;
+}
+
+#ifdef HAVE_TPACKET_V3
+static int AFPSetupRingV3(AFPThreadVars *ptv, char *devname)
+{
+    int r;
+    int order;
+    unsigned int i;
+
+    /* Allocate RX ring */
+    for (order = DEFAULT_ORDER; order >= 0; order--) {
+        if (AFPComputeRingParamsV3(ptv, order) != 1) {
+            SCLogError(SC_ERR_AFP_CREATE, "Ring parameters are incorrect for iface %s",
+                       devname);
+            return -1;
+        }
+
+        r = setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING, (void *) &ptv->req3, sizeof(ptv->req3));
+        if (r < 0) {
+            /* a block size set by the user can't be decreased */
+            if (errno == ENOMEM && ptv->block_size == 0) {
+                SCLogInfo("Memory issue with ring parameters. Retrying.");
+                continue;
+            }
+            SCLogError(SC_ERR_MEM_ALLOC,
+                    "Unable to allocate RX Ring for iface %s: (%d) %s",
+                    devname,
+                    errno,
+                    strerror(errno));
+            return -1;
+        } else {
+            break;
+        }
+    }
+
+    if (order < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC,
+                "Unable to allocate RX Ring for iface %s (order 0 failed)",
+                devname);
+        return -1;
+    }
+
+    /* Allocate the Ring */
+    ptv->ring_buflen = ptv->req3.tp_block_nr * ptv->req3.tp_block_size;
+    ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
+            MAP_SHARED, ptv->socket, 0);
+    if (ptv->ring_buf == MAP_FAILED) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+        return -1;
+    }
+    /* allocate a ring for each block pointer */
+    ptv->frame_buf = SCMalloc(ptv->req3.tp_block_nr * sizeof (struct tpacket_block_desc *));
+    if (ptv->frame_buf == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate frame buf");
+        return -1;
+    }
+    for (i = 0; i < ptv->req3.tp_block_nr; ++i) {
+        struct tpacket_block_desc *pbd = (struct tpacket_block_desc *)
+            &ptv->ring_buf[i * ptv->req3.tp_block_size];
+        ((struct tpacket_block_desc **)ptv->frame_buf)[i] = pbd;
+        SC_ATOMIC_INIT(AFP_V3_BLOCK_PRIV(pbd)->users);
+    }
+    ptv->frame_offset = 0;
+    return 0;
+}
+#endif
+
 static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
 {
     int r;
     struct packet_mreq sock_params;
     struct sockaddr_ll bind_address;
-    int order;
-    unsigned int i;
     int if_idx;
 
     /* open socket */
@@ -1275,7 +1684,12 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
     }
 
     if (ptv->flags & AFP_RING_MODE) {
-        int val = TPACKET_V2;
+        int version = TPACKET_V2;
+#ifdef HAVE_TPACKET_V3
+        if (ptv->flags & AFP_TPACKET_V3)
+            version = TPACKET_V3;
+#endif
+        int val = version;
         unsigned int len = sizeof(val);
         if (getsockopt(ptv->socket, SOL_PACKET, PACKET_HDRLEN, &val, &len) < 0) {
             if (errno == ENOPROTOOPT) {
@@ -1287,72 +1701,24 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
         }
         ptv->tp_hdrlen = val;
 
-        val = TPACKET_V2;
+        val = version;
         if (setsockopt(ptv->socket, SOL_PACKET, PACKET_VERSION, &val,
                     sizeof(val)) < 0) {
             SCLogError(SC_ERR_AFP_CREATE,
-                       "Can't activate TPACKET_V2 on packet socket: %s",
-                       strerror(errno));
+                       "Can't activate TPACKET_V%d on packet socket: %s",
+                       version + 1, strerror(errno));
             goto socket_err;
         }
 
-        /* Allocate RX ring */
-#define DEFAULT_ORDER 3
-        for (order = DEFAULT_ORDER; order >= 0; order--) {
-            if (AFPComputeRingParams(ptv, order) != 1) {
-                SCLogInfo("Ring parameter are incorrect. Please correct the devel");
-            }
-
-            r = setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING, (void *) &ptv->req, sizeof(ptv->req));
-            if (r < 0) {
-                if (errno == ENOMEM) {
-                    SCLogInfo("Memory issue with ring parameters. Retrying.");
-                    continue;
-                }
-                SCLogError(SC_ERR_MEM_ALLOC,
-                        "Unable to allocate RX Ring for iface %s: (%d) %s",
-                        devname,
-                        errno,
-                        strerror(errno));
-                goto socket_err;
-            } else {
-                break;
-            }
-        }
-
-        if (order < 0) {
-            SCLogError(SC_ERR_MEM_ALLOC,
-                    "Unable to allocate RX Ring for iface %s (order 0 failed)",
-                    devname);
-            goto socket_err;
+        if (ptv->flags & AFP_TPACKET_V3) {
+#ifdef HAVE_TPACKET_V3
+            r = AFPSetupRingV3(ptv, devname);
+#endif
+        } else {
+            r = AFPSetupRing(ptv, devname);
         }
-
-        /* Allocate the Ring */
-        ptv->ring_buflen = ptv->req.tp_block_nr * ptv->req.tp_block_size;
-        ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
-                MAP_SHARED, ptv->socket, 0);
-        if (ptv->ring_buf == MAP_FAILED) {
-            SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+        if (r < 0)
             goto socket_err;
-        }
-        /* allocate a ring for each frame header pointer*/
-        ptv->frame_buf = SCMalloc(ptv->req.tp_frame_nr * sizeof (union thdr *));
-        if (ptv->frame_buf == NULL) {
-            SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate frame buf");
-            goto mmap_err;
-        }
-        memset(ptv->frame_buf, 0, ptv->req.tp_frame_nr * sizeof (union thdr *));
-        /* fill the header ring with proper frame ptr*/
-        ptv->frame_offset = 0;
-        for (i = 0; i < ptv->req.tp_block_nr; ++i) {
-            void *base = &ptv->ring_buf[i * ptv->req.tp_block_size];
-            unsigned int j;
-            for (j = 0; j < ptv->req.tp_block_size / ptv->req.tp_frame_size; ++j, ++ptv->frame_offset) {
-                (((union thdr **)ptv->frame_buf)[ptv->frame_offset]) = base;
-                base += ptv->req.tp_frame_size;
-            }
-        }
-        ptv->frame_offset = 0;
     }
 
     SCLogInfo("Using interface '%s' via socket %d", (char *)devname, ptv->socket);
@@ -1395,9 +1761,8 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
 frame_err:
     if (ptv->frame_buf)
         SCFree(ptv->frame_buf);
-mmap_err:
-    /* Packet mmap does the cleaning when socket is closed */
 socket_err:
+    /* Packet mmap does the cleaning when socket is closed */
     close(ptv->socket);
     ptv->socket = -1;
 error:
@@ -1491,6 +1856,8 @@ TmEcode ReceiveAFPThreadInit(ThreadVars *tv, void *initdata, void **data) {
 
     ptv->buffer_size = afpconfig->buffer_size;
     ptv->ring_size = afpconfig->ring_size;
+    ptv->block_size = afpconfig->block_size;
+    ptv->block_timeout = afpconfig->block_timeout;
 
     ptv->promisc = afpconfig->promisc;
     ptv->checksum_mode = afpconfig->checksum_mode;
@@ -1593,6 +1960,10 @@ void ReceiveAFPThreadExitStats(ThreadVars *tv, void *data) {
 #endif
 
     SCLogInfo("(%s) Packets %" PRIu32 ", bytes %" PRIu64 "", tv->name, ptv->pkts, ptv->bytes);
+    if (ptv->lost > 0) {
+        SCLogInfo("(%s) Packets left unread in the ring: %" PRIu32 "",
+                  tv->name, ptv->lost);
+    }
 }
 
 /**
@@ -43,6 +43,7 @@
 #define AFP_ZERO_COPY (1<<1)
 #define AFP_SOCK_PROTECT (1<<2)
 #define AFP_EMERGENCY_MODE (1<<3)
+#define AFP_TPACKET_V3 (1<<4)
 
 #define AFP_COPY_MODE_NONE  0
 #define AFP_COPY_MODE_TAP   1
@@ -60,6 +61,9 @@ typedef struct AFPIfaceConfig_
     int buffer_size;
     /* ring size in number of packets */
     int ring_size;
+    /* TPACKET_V3 block size in bytes and block timeout in msec */
+    int block_size;
+    int block_timeout;
     /* cluster param */
     int cluster_id;
     int cluster_type;
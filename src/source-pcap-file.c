@@ -42,6 +42,7 @@
 #include "flow-manager.h"
 #include "util-profiling.h"
 #include "runmode-unix-socket.h"
+#include "util-pcap-mmap.h"
 
 extern uint8_t suricata_ctl_flags;
 extern int max_pending_packets;
@@ -50,6 +51,8 @@ extern int max_pending_packets;
 
 typedef struct PcapFileGlobalVars_ {
     pcap_t *pcap_handle;
+    /** set instead of pcap_handle when the file is read through mmap */
+    PcapMmapFile *mmap_file;
     void (*Decoder)(ThreadVars *, DecodeThreadVars *, Packet *, u_int8_t *, u_int16_t, PacketQueue *);
     int datalink;
     struct bpf_program filter;
@@ -73,6 +76,10 @@ typedef struct PcapFileThreadVars_
 
     uint8_t done;
     uint32_t errs;
+
+    /** wall clock time of the start and end of the read */
+    struct timeval start;
+    struct timeval end;
 } PcapFileThreadVars;
 
 static PcapFileGlobalVars pcap_g;
@@ -111,6 +118,33 @@ void TmModuleDecodePcapFileRegister (void) {
     tmm_modules[TMM_DECODEPCAPFILE].flags = TM_FLAG_DECODE_TM;
 }
 
+/**
+ * \brief release the reference a packet holds on the mmap'd file
+ */
+static TmEcode PcapFileMmapReleaseData(ThreadVars *t, Packet *p)
+{
+    if (p->pcap_v.mmap_file != NULL) {
+        PcapMmapDeref(p->pcap_v.mmap_file);
+        p->pcap_v.mmap_file = NULL;
+    }
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief close the file, whichever way it is read
+ */
+static void PcapFileClose(void)
+{
+    if (pcap_g.pcap_handle != NULL) {
+        pcap_close(pcap_g.pcap_handle);
+        pcap_g.pcap_handle = NULL;
+    }
+    if (pcap_g.mmap_file != NULL) {
+        PcapMmapDeref(pcap_g.mmap_file);
+        pcap_g.mmap_file = NULL;
+    }
+}
+
 void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt) {
     SCEnter();
 
@@ -132,7 +166,17 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt) {
     ptv->pkts++;
     ptv->bytes += h->caplen;
 
-    if (unlikely(PacketCopyData(p, pkt, h->caplen))) {
+    if (pcap_g.mmap_file != NULL) {
+        /* point to the mapped file, the packet holds a reference on it */
+        if (unlikely(PacketSetData(p, pkt, h->caplen))) {
+            TmqhOutputPacketpool(ptv->tv, p);
+            PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
+            SCReturn;
+        }
+        PcapMmapRef(pcap_g.mmap_file);
+        p->pcap_v.mmap_file = pcap_g.mmap_file;
+        p->ReleaseData = PcapFileMmapReleaseData;
+    } else if (unlikely(PacketCopyData(p, pkt, h->caplen))) {
         TmqhOutputPacketpool(ptv->tv, p);
         PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
         SCReturn;
@@ -140,13 +184,40 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt) {
     PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
 
     if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
-        pcap_breakloop(pcap_g.pcap_handle);
+        if (pcap_g.pcap_handle != NULL)
+            pcap_breakloop(pcap_g.pcap_handle);
         ptv->cb_result = TM_ECODE_FAILED;
     }
 
     SCReturn;
 }
 
+/**
+ * \brief pcap_dispatch counterpart for the mmap'd file
+ *
+ * \retval cnt number of packets read, 0 at end of file, -1 on error
+ */
+static int PcapFileMmapDispatch(PcapFileThreadVars *ptv, int cnt)
+{
+    PcapMmapPacket pkt;
+    struct pcap_pkthdr h;
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        int r = PcapMmapNext(pcap_g.mmap_file, &pkt);
+        if (r <= 0)
+            return (r < 0) ? -1 : i;
+
+        h.ts = pkt.ts;
+        h.caplen = pkt.caplen;
+        h.len = pkt.len;
+        PcapFileCallbackLoop((char *)ptv, &h, pkt.data);
+        if (ptv->cb_result == TM_ECODE_FAILED)
+            return i + 1;
+    }
+    return i;
+}
+
 /**
  *  \brief Main PCAP file reading Loop function
  */
@@ -161,6 +232,7 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
 
     ptv->slot = s->slot_next;
     ptv->cb_result = TM_ECODE_OK;
+    gettimeofday(&ptv->start, NULL);
 
     while (1) {
         if (suricata_ctl_flags & (SURICATA_STOP | SURICATA_KILL)) {
@@ -177,28 +249,38 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
         } while (packet_q_len == 0);
 
         /* Right now we just support reading packets one at a time. */
-        r = pcap_dispatch(pcap_g.pcap_handle, (int)packet_q_len,
-                          (pcap_handler)PcapFileCallbackLoop, (u_char *)ptv);
+        if (pcap_g.mmap_file != NULL) {
+            r = PcapFileMmapDispatch(ptv, (int)packet_q_len);
+        } else {
+            r = pcap_dispatch(pcap_g.pcap_handle, (int)packet_q_len,
+                              (pcap_handler)PcapFileCallbackLoop, (u_char *)ptv);
+        }
         if (unlikely(r == -1)) {
-            SCLogError(SC_ERR_PCAP_DISPATCH, "error code %" PRId32 " %s",
-                       r, pcap_geterr(pcap_g.pcap_handle));
+            /* the mmap reader logged the error already */
+            if (pcap_g.pcap_handle != NULL) {
+                SCLogError(SC_ERR_PCAP_DISPATCH, "error code %" PRId32 " %s",
+                           r, pcap_geterr(pcap_g.pcap_handle));
+            }
             if (! RunModeUnixSocketIsActive()) {
                 /* in the error state we just kill the engine */
                 EngineKill();
                 SCReturnInt(TM_ECODE_FAILED);
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
+                PcapFileClose();
                 UnixSocketPcapFile(TM_ECODE_DONE);
                 SCReturnInt(TM_ECODE_DONE);
             }
         } else if (unlikely(r == 0)) {
             SCLogInfo("pcap file end of file reached (pcap err code %" PRId32 ")", r);
+            if (pcap_g.mmap_file != NULL && pcap_g.mmap_file->truncated > 0) {
+                SCLogInfo("%" PRIu64 " packets were truncated to %u bytes",
+                          pcap_g.mmap_file->truncated, PCAP_MMAP_MAX_CAPLEN);
+            }
+            gettimeofday(&ptv->end, NULL);
             if (! RunModeUnixSocketIsActive()) {
                 EngineStop();
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
+                PcapFileClose();
                 UnixSocketPcapFile(TM_ECODE_DONE);
                 SCReturnInt(TM_ECODE_DONE);
             }
@@ -209,8 +291,7 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
                 EngineKill();
                 SCReturnInt(TM_ECODE_FAILED);
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
+                PcapFileClose();
                 UnixSocketPcapFile(TM_ECODE_DONE);
                 SCReturnInt(TM_ECODE_DONE);
             }
@@ -236,38 +317,64 @@ TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data) {
         SCReturnInt(TM_ECODE_FAILED);
     memset(ptv, 0, sizeof(PcapFileThreadVars));
 
-    char errbuf[PCAP_ERRBUF_SIZE] = "";
-    pcap_g.pcap_handle = pcap_open_offline((char *)initdata, errbuf);
-    if (pcap_g.pcap_handle == NULL) {
-        SCLogError(SC_ERR_FOPEN, "%s\n", errbuf);
-        SCFree(ptv);
-        if (! RunModeUnixSocketIsActive()) {
-            return TM_ECODE_FAILED;
-        } else {
-            UnixSocketPcapFile(TM_ECODE_FAILED);
-            SCReturnInt(TM_ECODE_DONE);
-        }
+    int use_mmap = 0;
+    if (ConfGetBool("pcap-file.use-mmap", &use_mmap) != 1)
+        use_mmap = 0;
+    if (use_mmap && ConfGet("bpf-filter", &tmpbpfstring) == 1) {
+        SCLogWarning(SC_WARN_UNCOMMON, "bpf-filter is not supported by the "
+                     "mmap pcap file reader, reading the file with libpcap");
+        use_mmap = 0;
     }
 
-    if (ConfGet("bpf-filter", &tmpbpfstring) != 1) {
-        SCLogDebug("could not get bpf or none specified");
+    if (use_mmap) {
+        pcap_g.mmap_file = PcapMmapOpen((char *)initdata);
+        if (pcap_g.mmap_file == NULL) {
+            SCFree(ptv);
+            if (! RunModeUnixSocketIsActive()) {
+                return TM_ECODE_FAILED;
+            } else {
+                UnixSocketPcapFile(TM_ECODE_FAILED);
+                SCReturnInt(TM_ECODE_DONE);
+            }
+        }
+        pcap_g.datalink = pcap_g.mmap_file->datalink;
+        SCLogInfo("reading %s file through mmap",
+                  pcap_g.mmap_file->format == PCAP_MMAP_FORMAT_PCAPNG ? "pcapng" : "pcap");
     } else {
-        SCLogInfo("using bpf-filter \"%s\"", tmpbpfstring);
-
-        if(pcap_compile(pcap_g.pcap_handle,&pcap_g.filter,tmpbpfstring,1,0) < 0) {
-            SCLogError(SC_ERR_BPF,"bpf compilation error %s",pcap_geterr(pcap_g.pcap_handle));
+        char errbuf[PCAP_ERRBUF_SIZE] = "";
+        pcap_g.pcap_handle = pcap_open_offline((char *)initdata, errbuf);
+        if (pcap_g.pcap_handle == NULL) {
+            SCLogError(SC_ERR_FOPEN, "%s\n", errbuf);
             SCFree(ptv);
-            return TM_ECODE_FAILED;
+            if (! RunModeUnixSocketIsActive()) {
+                return TM_ECODE_FAILED;
+            } else {
+                UnixSocketPcapFile(TM_ECODE_FAILED);
+                SCReturnInt(TM_ECODE_DONE);
+            }
         }
 
-        if(pcap_setfilter(pcap_g.pcap_handle,&pcap_g.filter) < 0) {
-            SCLogError(SC_ERR_BPF,"could not set bpf filter %s",pcap_geterr(pcap_g.pcap_handle));
-            SCFree(ptv);
-            return TM_ECODE_FAILED;
+        if (ConfGet("bpf-filter", &tmpbpfstring) != 1) {
+            SCLogDebug("could not get bpf or none specified");
+        } else {
+            SCLogInfo("using bpf-filter \"%s\"", tmpbpfstring);
+
+            if(pcap_compile(pcap_g.pcap_handle,&pcap_g.filter,tmpbpfstring,1,0) < 0) {
+                SCLogError(SC_ERR_BPF,"bpf compilation error %s",pcap_geterr(pcap_g.pcap_handle));
+                SCFree(ptv);
+                return TM_ECODE_FAILED;
+            }
+
+            if(pcap_setfilter(pcap_g.pcap_handle,&pcap_g.filter) < 0) {
+                SCLogError(SC_ERR_BPF,"could not set bpf filter %s",pcap_geterr(pcap_g.pcap_handle));
+                SCFree(ptv);
+                return TM_ECODE_FAILED;
+            }
         }
+
+        pcap_g.datalink = pcap_datalink(pcap_g.pcap_handle);
     }
 
-    pcap_g.datalink = pcap_datalink(pcap_g.pcap_handle);
     SCLogDebug("datalink %" PRId32 "", pcap_g.datalink);
 
     switch(pcap_g.datalink) {
@@ -291,8 +398,7 @@ TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data) {
             if (! RunModeUnixSocketIsActive()) {
                 SCReturnInt(TM_ECODE_FAILED);
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
+                PcapFileClose();
                 UnixSocketPcapFile(TM_ECODE_DONE);
                 SCReturnInt(TM_ECODE_DONE);
             }
@@ -307,7 +413,16 @@ void ReceivePcapFileThreadExitStats(ThreadVars *tv, void *data) {
     SCEnter();
     PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
 
+    if (ptv->end.tv_sec == 0)
+        gettimeofday(&ptv->end, NULL);
+    double elapsed = (ptv->end.tv_sec - ptv->start.tv_sec) +
+        (ptv->end.tv_usec - ptv->start.tv_usec) / 1000000.0;
+
     SCLogInfo("Pcap-file module read %" PRIu32 " packets, %" PRIu64 " bytes", ptv->pkts, ptv->bytes);
+    if (elapsed > 0) {
+        SCLogInfo("Pcap-file module read rate %.3f GB/s (%.3f seconds)",
+                  ptv->bytes / elapsed / 1000000000.0, elapsed);
+    }
     return;
 }
 
@@ -39,6 +39,8 @@ char *PcapLiveGetDevice(int);
 /* per packet Pcap vars */
 typedef struct PcapPacketVars_
 {
+    /** mmap'd pcap file the packet data points into */
+    struct PcapMmapFile_ *mmap_file;
 } PcapPacketVars;
 
 /** needs to be able to contain Windows adapter id's, so
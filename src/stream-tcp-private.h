@@ -25,6 +25,7 @@
 #define __STREAM_TCP_PRIVATE_H__
 
 #include "decode.h"
+#include "stream.h"
 
 typedef struct StreamTcpSackRecord_ {
     uint32_t le;    /**< left edge, host order */
@@ -39,6 +40,11 @@ typedef struct TcpSegment_ {
     uint32_t seq;
     struct TcpSegment_ *next;
     struct TcpSegment_ *prev;
+    /* red-black tree index of the stream's segments on seq */
+    struct TcpSegment_ *rb_left;
+    struct TcpSegment_ *rb_right;
+    struct TcpSegment_ *rb_parent;
+    uint8_t rb_red;
     uint8_t flags;
 } TcpSegment;
 
@@ -63,9 +69,19 @@ typedef struct TcpStream_ {
 
     TcpSegment *seg_list;           /**< list of TCP segments that are not yet (fully) used in reassembly */
     TcpSegment *seg_list_tail;      /**< Last segment in the reassembled stream seg list*/
+    TcpSegment *seg_tree;           /**< root of the index of seg_list on seq,
+                                         NULL until an out of order insert */
 
     StreamTcpSackRecord *sack_head; /**< head of list of SACK records */
     StreamTcpSackRecord *sack_tail; /**< tail of list of SACK records */
+
+    /* stream mpm */
+    struct MpmCtx_ *mpm_ctx;        /**< stream mpm ctx the mpm_state belongs to */
+    uint32_t mpm_state;             /**< stream mpm state at the end of the last inspected smsg */
+    uint32_t mpm_next_seq;          /**< seq the next smsg has to start at to continue in mpm_state */
+    uint16_t mpm_tail_len;          /**< no of bytes in mpm_tail */
+    uint8_t *mpm_tail;              /**< last bytes of the inspected smsgs,
+                                         STREAM_MPM_TAIL_SIZE, alloc'd on first use */
 } TcpStream;
 
 /* from /usr/include/netinet/tcp.h */
@@ -55,6 +55,8 @@
 #include "util-debug.h"
 #include "app-layer-protos.h"
 #include "app-layer.h"
+#include "app-layer-htp.h"
+#include "app-layer-htp-body.h"
 
 #include "detect-engine-state.h"
 
@@ -72,7 +74,7 @@ static uint64_t segment_pool_memcnt = 0;
  * payloads. We do this to prevent having to do an SCMalloc call for every
  * data segment we receive, which would be a large performance penalty.
  * The cost is in memory of course. */
-#define segment_pool_num 8
+#define segment_pool_num STREAMTCP_SEGMENT_POOLS
 static uint16_t segment_pool_pktsizes[segment_pool_num] = {4, 16, 112, 248, 512,
                                                            768, 1448, 0xffff};
 //static uint16_t segment_pool_poolsizes[segment_pool_num] = {2048, 3072, 3072,
@@ -92,6 +94,15 @@ static uint64_t segment_pool_cnt = 0;
 #endif
 /* index to the right pool for all packet sizes. */
 static uint16_t segment_pool_idx[65536]; /* O(1) lookups of the pool */
+/* no of segments moved between a thread's segment cache and the pool at
+ * once. A thread caches up to twice this per pool, which is limited to
+ * about 128k of payload for the pools of the bigger segments. */
+static uint16_t segment_pool_cache_batch[segment_pool_num];
+#define SEGMENT_CACHE_MAX_BATCH 32
+/* bit per pool, set when a thread couldn't get a segment from that pool.
+ * While it's set the other threads hand their cached segments of that pool
+ * back instead of keeping them. */
+SC_ATOMIC_DECLARE(uint8_t, segment_pool_starved);
 static int check_overlap_different_data = 0;
 
 /* Memory use counter */
@@ -140,8 +151,11 @@ void StreamTcpReassembleDecrMemuse(uint64_t size) {
 
 void StreamTcpReassembleMemuseCounter(ThreadVars *tv, TcpReassemblyThreadCtx *rtv) {
     uint64_t smemuse = SC_ATOMIC_GET(ra_memuse);
-    if (tv != NULL && rtv != NULL)
+    if (tv != NULL && rtv != NULL) {
         SCPerfCounterSetUI64(rtv->counter_tcp_reass_memuse, tv->sc_perf_pca, smemuse);
+        SCPerfCounterSetUI64(rtv->counter_htp_body_memuse, tv->sc_perf_pca,
+                HtpBodyMemuseGet());
+    }
     return;
 }
 
@@ -223,6 +237,310 @@ void TcpSegmentPoolCleanup(void *ptr) {
     return;
 }
 
+/* Index of the segment list.
+ *
+ * seg_list is kept sorted on seq and its segments don't overlap, so a
+ * red-black tree with the same in-order sequence lets us find the place
+ * of an out of order segment without walking the list. The tree nodes
+ * are the segments themselves. As the tree order follows the list order,
+ * segments are linked into the tree next to their list neighbours and
+ * no seq compares are needed to maintain it.
+ *
+ * Streams that only get in order segments never need the index, so it is
+ * built on the first out of order insert. Until then seg_tree is NULL and
+ * appending at the tail does no tree work. */
+
+static void StreamTcpSegmentIndexRotateLeft(TcpStream *stream, TcpSegment *x)
+{
+    TcpSegment *y = x->rb_right;
+
+    x->rb_right = y->rb_left;
+    if (y->rb_left != NULL)
+        y->rb_left->rb_parent = x;
+    y->rb_parent = x->rb_parent;
+    if (x->rb_parent == NULL)
+        stream->seg_tree = y;
+    else if (x == x->rb_parent->rb_left)
+        x->rb_parent->rb_left = y;
+    else
+        x->rb_parent->rb_right = y;
+    y->rb_left = x;
+    x->rb_parent = y;
+}
+
+static void StreamTcpSegmentIndexRotateRight(TcpStream *stream, TcpSegment *x)
+{
+    TcpSegment *y = x->rb_left;
+
+    x->rb_left = y->rb_right;
+    if (y->rb_right != NULL)
+        y->rb_right->rb_parent = x;
+    y->rb_parent = x->rb_parent;
+    if (x->rb_parent == NULL)
+        stream->seg_tree = y;
+    else if (x == x->rb_parent->rb_right)
+        x->rb_parent->rb_right = y;
+    else
+        x->rb_parent->rb_left = y;
+    y->rb_right = x;
+    x->rb_parent = y;
+}
+
+/**
+ *  \brief Add a segment to the index. The segment has to be linked into
+ *         seg_list already, it's put in the tree next to its list
+ *         neighbours.
+ */
+static void StreamTcpSegmentIndexInsert(TcpStream *stream, TcpSegment *seg)
+{
+    seg->rb_left = seg->rb_right = NULL;
+    seg->rb_red = 1;
+
+    /* the in order predecessor has no right child or else the successor,
+     * which is then the leftmost node of that subtree, has no left child */
+    if (seg->prev != NULL && seg->prev->rb_right == NULL) {
+        seg->rb_parent = seg->prev;
+        seg->prev->rb_right = seg;
+    } else if (seg->next != NULL) {
+        seg->rb_parent = seg->next;
+        seg->next->rb_left = seg;
+    } else {
+        seg->rb_parent = NULL;
+        stream->seg_tree = seg;
+    }
+
+    while (seg->rb_parent != NULL && seg->rb_parent->rb_red) {
+        TcpSegment *parent = seg->rb_parent;
+        TcpSegment *gparent = parent->rb_parent;
+
+        if (parent == gparent->rb_left) {
+            TcpSegment *uncle = gparent->rb_right;
+            if (uncle != NULL && uncle->rb_red) {
+                parent->rb_red = 0;
+                uncle->rb_red = 0;
+                gparent->rb_red = 1;
+                seg = gparent;
+                continue;
+            }
+            if (seg == parent->rb_right) {
+                StreamTcpSegmentIndexRotateLeft(stream, parent);
+                seg = parent;
+                parent = seg->rb_parent;
+            }
+            parent->rb_red = 0;
+            gparent->rb_red = 1;
+            StreamTcpSegmentIndexRotateRight(stream, gparent);
+        } else {
+            TcpSegment *uncle = gparent->rb_left;
+            if (uncle != NULL && uncle->rb_red) {
+                parent->rb_red = 0;
+                uncle->rb_red = 0;
+                gparent->rb_red = 1;
+                seg = gparent;
+                continue;
+            }
+            if (seg == parent->rb_left) {
+                StreamTcpSegmentIndexRotateRight(stream, parent);
+                seg = parent;
+                parent = seg->rb_parent;
+            }
+            parent->rb_red = 0;
+            gparent->rb_red = 1;
+            StreamTcpSegmentIndexRotateLeft(stream, gparent);
+        }
+    }
+    stream->seg_tree->rb_red = 0;
+}
+
+/**
+ *  \brief Build the index from seg_list. Appending in list order always
+ *         links the segment as the right child of the last node.
+ */
+static void StreamTcpSegmentIndexBuild(TcpStream *stream)
+{
+    TcpSegment *seg = stream->seg_list;
+
+    if (seg == NULL)
+        return;
+
+    seg->rb_left = seg->rb_right = seg->rb_parent = NULL;
+    seg->rb_red = 0;
+    stream->seg_tree = seg;
+
+    for (seg = seg->next; seg != NULL; seg = seg->next)
+        StreamTcpSegmentIndexInsert(stream, seg);
+}
+
+/**
+ *  \brief Remove a segment from the index, if the stream has one.
+ */
+static void StreamTcpSegmentIndexRemove(TcpStream *stream, TcpSegment *seg)
+{
+    TcpSegment *child, *parent;
+    uint8_t red;
+
+    if (stream->seg_tree == NULL)
+        return;
+
+    if (seg->rb_left != NULL && seg->rb_right != NULL) {
+        /* take the successor out of its place and put it in seg's place */
+        TcpSegment *succ = seg->rb_right;
+        while (succ->rb_left != NULL)
+            succ = succ->rb_left;
+
+        child = succ->rb_right;
+        parent = succ->rb_parent;
+        red = succ->rb_red;
+
+        if (parent == seg) {
+            parent = succ;
+        } else {
+            if (child != NULL)
+                child->rb_parent = parent;
+            parent->rb_left = child;
+            succ->rb_right = seg->rb_right;
+            seg->rb_right->rb_parent = succ;
+        }
+
+        succ->rb_parent = seg->rb_parent;
+        succ->rb_left = seg->rb_left;
+        succ->rb_red = seg->rb_red;
+        seg->rb_left->rb_parent = succ;
+        if (seg->rb_parent == NULL)
+            stream->seg_tree = succ;
+        else if (seg == seg->rb_parent->rb_left)
+            seg->rb_parent->rb_left = succ;
+        else
+            seg->rb_parent->rb_right = succ;
+    } else {
+        child = (seg->rb_left != NULL) ? seg->rb_left : seg->rb_right;
+        parent = seg->rb_parent;
+        red = seg->rb_red;
+
+        if (child != NULL)
+            child->rb_parent = parent;
+        if (parent == NULL)
+            stream->seg_tree = child;
+        else if (seg == parent->rb_left)
+            parent->rb_left = child;
+        else
+            parent->rb_right = child;
+    }
+
+    seg->rb_left = seg->rb_right = seg->rb_parent = NULL;
+
+    if (red)
+        return;
+
+    /* a black node was taken out, restore the black heights */
+    while (child != stream->seg_tree && (child == NULL || !child->rb_red)) {
+        if (child == parent->rb_left) {
+            TcpSegment *sibling = parent->rb_right;
+            if (sibling->rb_red) {
+                sibling->rb_red = 0;
+                parent->rb_red = 1;
+                StreamTcpSegmentIndexRotateLeft(stream, parent);
+                sibling = parent->rb_right;
+            }
+            if ((sibling->rb_left == NULL || !sibling->rb_left->rb_red) &&
+                (sibling->rb_right == NULL || !sibling->rb_right->rb_red))
+            {
+                sibling->rb_red = 1;
+                child = parent;
+                parent = child->rb_parent;
+            } else {
+                if (sibling->rb_right == NULL || !sibling->rb_right->rb_red) {
+                    sibling->rb_left->rb_red = 0;
+                    sibling->rb_red = 1;
+                    StreamTcpSegmentIndexRotateRight(stream, sibling);
+                    sibling = parent->rb_right;
+                }
+                sibling->rb_red = parent->rb_red;
+                parent->rb_red = 0;
+                sibling->rb_right->rb_red = 0;
+                StreamTcpSegmentIndexRotateLeft(stream, parent);
+                child = stream->seg_tree;
+            }
+        } else {
+            TcpSegment *sibling = parent->rb_left;
+            if (sibling->rb_red) {
+                sibling->rb_red = 0;
+                parent->rb_red = 1;
+                StreamTcpSegmentIndexRotateRight(stream, parent);
+                sibling = parent->rb_left;
+            }
+            if ((sibling->rb_left == NULL || !sibling->rb_left->rb_red) &&
+                (sibling->rb_right == NULL || !sibling->rb_right->rb_red))
+            {
+                sibling->rb_red = 1;
+                child = parent;
+                parent = child->rb_parent;
+            } else {
+                if (sibling->rb_left == NULL || !sibling->rb_left->rb_red) {
+                    sibling->rb_right->rb_red = 0;
+                    sibling->rb_red = 1;
+                    StreamTcpSegmentIndexRotateLeft(stream, sibling);
+                    sibling = parent->rb_left;
+                }
+                sibling->rb_red = parent->rb_red;
+                parent->rb_red = 0;
+                sibling->rb_left->rb_red = 0;
+                StreamTcpSegmentIndexRotateRight(stream, parent);
+                child = stream->seg_tree;
+            }
+        }
+    }
+    if (child != NULL)
+        child->rb_red = 0;
+}
+
+/**
+ *  \brief Let new_seg take the place of old_seg in the index. Only valid
+ *         if new_seg also takes old_seg's place in seg_list.
+ */
+static void StreamTcpSegmentIndexReplace(TcpStream *stream, TcpSegment *old_seg,
+        TcpSegment *new_seg)
+{
+    new_seg->rb_left = old_seg->rb_left;
+    new_seg->rb_right = old_seg->rb_right;
+    new_seg->rb_parent = old_seg->rb_parent;
+    new_seg->rb_red = old_seg->rb_red;
+
+    if (new_seg->rb_left != NULL)
+        new_seg->rb_left->rb_parent = new_seg;
+    if (new_seg->rb_right != NULL)
+        new_seg->rb_right->rb_parent = new_seg;
+    if (new_seg->rb_parent == NULL)
+        stream->seg_tree = new_seg;
+    else if (new_seg->rb_parent->rb_left == old_seg)
+        new_seg->rb_parent->rb_left = new_seg;
+    else
+        new_seg->rb_parent->rb_right = new_seg;
+
+    old_seg->rb_left = old_seg->rb_right = old_seg->rb_parent = NULL;
+}
+
+/**
+ *  \brief Find the last segment in the list that starts at or before seq.
+ *
+ *  \retval seg the segment or NULL if all segments start after seq
+ */
+static TcpSegment *StreamTcpSegmentIndexLookup(TcpStream *stream, uint32_t seq)
+{
+    TcpSegment *node = stream->seg_tree;
+    TcpSegment *found = NULL;
+
+    while (node != NULL) {
+        if (SEQ_LEQ(node->seq, seq)) {
+            found = node;
+            node = node->rb_right;
+        } else {
+            node = node->rb_left;
+        }
+    }
+    return found;
+}
+
 /**
  *  \brief Function to return the segment back to the pool.
  *
@@ -250,6 +568,101 @@ void StreamTcpSegmentReturntoPool(TcpSegment *seg)
 #endif
 }
 
+/**
+ *  \brief Move segments from a thread's segment cache back to the pool
+ *         until cnt are left.
+ */
+static void StreamTcpSegmentCacheFlush(TcpSegmentCache *cache, uint16_t idx,
+        uint16_t cnt)
+{
+    if (cache->cnt <= cnt)
+        return;
+
+    SCMutexLock(&segment_pool_mutex[idx]);
+    while (cache->cnt > cnt) {
+        TcpSegment *seg = cache->list;
+        cache->list = seg->next;
+        cache->cnt--;
+
+        seg->next = NULL;
+        PoolReturn(segment_pool[idx], (void *) seg);
+    }
+    SCMutexUnlock(&segment_pool_mutex[idx]);
+}
+
+/**
+ *  \brief Get a batch of segments from the pool into a thread's segment
+ *         cache. Only the segments the pool has ready are taken, a new
+ *         segment is only allocated if it has none.
+ */
+static void StreamTcpSegmentCacheRefill(TcpSegmentCache *cache, uint16_t idx)
+{
+    SCMutexLock(&segment_pool_mutex[idx]);
+    uint32_t cnt = segment_pool[idx]->alloc_list_size;
+    if (cnt > segment_pool_cache_batch[idx])
+        cnt = segment_pool_cache_batch[idx];
+    else if (cnt == 0)
+        cnt = 1;
+
+    while (cnt-- > 0) {
+        TcpSegment *seg = (TcpSegment *) PoolGet(segment_pool[idx]);
+        if (seg == NULL)
+            break;
+
+        seg->next = cache->list;
+        cache->list = seg;
+        cache->cnt++;
+    }
+    SCMutexUnlock(&segment_pool_mutex[idx]);
+
+    if (cache->cnt == 0) {
+        SC_ATOMIC_OR(segment_pool_starved, (uint8_t)(1 << idx));
+    } else if (SC_ATOMIC_GET(segment_pool_starved) & (1 << idx)) {
+        SC_ATOMIC_AND(segment_pool_starved, (uint8_t)~(1 << idx));
+    }
+}
+
+/**
+ *  \brief Return a segment to the segment cache of the reassembly thread.
+ *         If the cache is full, a batch of segments goes back to the pool.
+ *
+ *  \param ra_ctx reassembly thread ctx, if NULL the segment is returned to
+ *                the pool directly
+ *  \param seg    Segment which will be returned.
+ */
+static void StreamTcpSegmentReturntoCache(TcpReassemblyThreadCtx *ra_ctx,
+        TcpSegment *seg)
+{
+    if (seg == NULL)
+        return;
+
+    if (ra_ctx == NULL) {
+        StreamTcpSegmentReturntoPool(seg);
+        return;
+    }
+
+    uint16_t idx = segment_pool_idx[seg->pool_size];
+    TcpSegmentCache *cache = &ra_ctx->segment_cache[idx];
+
+    seg->prev = NULL;
+    seg->next = cache->list;
+    cache->list = seg;
+    cache->cnt++;
+
+    if (SC_ATOMIC_GET(segment_pool_starved) & (1 << idx)) {
+        /* another thread ran out of these, give them all back */
+        StreamTcpSegmentCacheFlush(cache, idx, 0);
+    } else if (cache->cnt > 2 * segment_pool_cache_batch[idx]) {
+        StreamTcpSegmentCacheFlush(cache, idx, segment_pool_cache_batch[idx]);
+    }
+
+#ifdef DEBUG
+    SCMutexLock(&segment_pool_cnt_mutex);
+    segment_pool_cnt--;
+    SCMutexUnlock(&segment_pool_cnt_mutex);
+#endif
+}
+
 /**
  *  \brief return all segments in this stream into the pool(s)
  *
@@ -271,6 +684,7 @@ void StreamTcpReturnStreamSegments (TcpStream *stream)
 
     stream->seg_list = NULL;
     stream->seg_list_tail = NULL;
+    stream->seg_tree = NULL;
 }
 
 int StreamTcpReassembleInit(char quiet)
@@ -279,6 +693,7 @@ int StreamTcpReassembleInit(char quiet)
 
     /* init the memcap/use tracker */
     SC_ATOMIC_INIT(ra_memuse);
+    SC_ATOMIC_INIT(segment_pool_starved);
 
 #ifdef DEBUG
     SCMutexInit(&segment_pool_memuse_mutex, NULL);
@@ -295,6 +710,13 @@ int StreamTcpReassembleInit(char quiet)
                                      (void *) &segment_pool_pktsizes[u16],
                                      TcpSegmentPoolCleanup, NULL);
         SCMutexUnlock(&segment_pool_mutex[u16]);
+
+        segment_pool_cache_batch[u16] = SEGMENT_CACHE_MAX_BATCH;
+        if (segment_pool_pktsizes[u16] > 65536 / (2 * SEGMENT_CACHE_MAX_BATCH)) {
+            segment_pool_cache_batch[u16] = 65536 / (2 * segment_pool_pktsizes[u16]);
+            if (segment_pool_cache_batch[u16] == 0)
+                segment_pool_cache_batch[u16] = 1;
+        }
     }
 
     uint16_t idx = 0;
@@ -376,6 +798,11 @@ TcpReassemblyThreadCtx *StreamTcpReassembleInitThreadCtx(void)
 void StreamTcpReassembleFreeThreadCtx(TcpReassemblyThreadCtx *ra_ctx)
 {
     SCEnter();
+    uint16_t u16;
+    for (u16 = 0; u16 < segment_pool_num; u16++) {
+        StreamTcpSegmentCacheFlush(&ra_ctx->segment_cache[u16], u16, 0);
+    }
+
     if (ra_ctx->stream_q != NULL) {
         StreamMsg *smsg;
         while ((smsg = StreamMsgGetFromQueue(ra_ctx->stream_q)) != NULL) {
@@ -577,6 +1004,8 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
         stream->seg_list_tail->next = seg;
         seg->prev = stream->seg_list_tail;
         stream->seg_list_tail = seg;
+        if (stream->seg_tree != NULL)
+            StreamTcpSegmentIndexInsert(stream, seg);
 
         goto end;
     }
@@ -586,6 +1015,22 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
         StreamTcpSetOSPolicy(stream, p);
     }
 
+    /* first out of order segment of this stream, index the list now */
+    if (stream->seg_tree == NULL)
+        StreamTcpSegmentIndexBuild(stream);
+
+    /* the segments that end before seg starts don't need to be looked at,
+     * so start at the last segment that starts at or before seg */
+    list_seg = StreamTcpSegmentIndexLookup(stream, seg->seq);
+    if (list_seg == NULL) {
+        list_seg = stream->seg_list;
+    }
+    while (list_seg->prev != NULL && SEQ_GT((list_seg->prev->seq +
+                    list_seg->prev->payload_len), seg->seq))
+    {
+        list_seg = list_seg->prev;
+    }
+
     for (; list_seg != NULL; list_seg = next_list_seg) {
         next_list_seg = list_seg->next;
 
@@ -612,6 +1057,7 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
                     seg->prev = list_seg->prev;
                 }
                 list_seg->prev = seg;
+                StreamTcpSegmentIndexInsert(stream, seg);
 
                 goto end;
 
@@ -660,6 +1106,7 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
                     list_seg->next = seg;
                     seg->prev = list_seg;
                     stream->seg_list_tail = seg;
+                    StreamTcpSegmentIndexInsert(stream, seg);
                     goto end;
                 }
             } else {
@@ -680,7 +1127,7 @@ int StreamTcpReassembleInsertSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
 
 end:
     if (return_seg == TRUE && seg != NULL) {
-        StreamTcpSegmentReturntoPool(seg);
+        StreamTcpSegmentReturntoCache(ra_ctx, seg);
     }
 
 #ifdef DEBUG
@@ -804,6 +1251,7 @@ static int HandleSegmentStartsBeforeListSegment(ThreadVars *tv, TcpReassemblyThr
             new_seg->prev = list_seg->prev;
             list_seg->prev->next = new_seg;
             list_seg->prev = new_seg;
+            StreamTcpSegmentIndexInsert(stream, new_seg);
 
             /* create a new seg, copy the list_seg data over */
             StreamTcpSegmentDataCopy(new_seg, seg);
@@ -863,8 +1311,8 @@ static int HandleSegmentStartsBeforeListSegment(ThreadVars *tv, TcpReassemblyThr
             /* update the stream last_seg in case of removal of list_seg */
             if (stream->seg_list_tail == list_seg)
                 stream->seg_list_tail = new_seg;
-
-            StreamTcpSegmentReturntoPool(list_seg);
+            StreamTcpSegmentIndexReplace(stream, list_seg, new_seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, list_seg);
             list_seg = new_seg;
             if (new_seg->prev != NULL) {
                 new_seg->prev->next = new_seg;
@@ -926,8 +1374,8 @@ static int HandleSegmentStartsBeforeListSegment(ThreadVars *tv, TcpReassemblyThr
                 /*update the stream last_seg in case of removal of list_seg*/
                 if (stream->seg_list_tail == list_seg)
                     stream->seg_list_tail = new_seg;
-
-                StreamTcpSegmentReturntoPool(list_seg);
+                StreamTcpSegmentIndexReplace(stream, list_seg, new_seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, list_seg);
                 list_seg = new_seg;
                 if (new_seg->prev != NULL) {
                     new_seg->prev->next = new_seg;
@@ -998,8 +1446,8 @@ static int HandleSegmentStartsBeforeListSegment(ThreadVars *tv, TcpReassemblyThr
                     /*update the stream last_seg in case of removal of list_seg*/
                     if (stream->seg_list_tail == list_seg)
                         stream->seg_list_tail = new_seg;
-
-                    StreamTcpSegmentReturntoPool(list_seg);
+                    StreamTcpSegmentIndexReplace(stream, list_seg, new_seg);
+                    StreamTcpSegmentReturntoCache(ra_ctx, list_seg);
                     list_seg = new_seg;
                     return_after = TRUE;
                 }
@@ -1066,8 +1514,8 @@ static int HandleSegmentStartsBeforeListSegment(ThreadVars *tv, TcpReassemblyThr
                 /*update the stream last_seg in case of removal of list_seg*/
                 if (stream->seg_list_tail == list_seg)
                     stream->seg_list_tail = new_seg;
-
-                StreamTcpSegmentReturntoPool(list_seg);
+                StreamTcpSegmentIndexReplace(stream, list_seg, new_seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, list_seg);
                 list_seg = new_seg;
                 return_after = TRUE;
             }
@@ -1259,6 +1707,7 @@ static int HandleSegmentStartsAtSameListSegment(ThreadVars *tv, TcpReassemblyThr
                     new_seg->next->prev = new_seg;
                 new_seg->prev = list_seg;
                 list_seg->next = new_seg;
+                StreamTcpSegmentIndexInsert(stream, new_seg);
                 SCLogDebug("new_seg %p, new_seg->next %p, new_seg->prev %p, "
                            "list_seg->next %p", new_seg, new_seg->next,
                            new_seg->prev, list_seg->next);
@@ -1463,6 +1912,7 @@ static int HandleSegmentStartsAfterListSegment(ThreadVars *tv, TcpReassemblyThre
                     new_seg->next->prev = new_seg;
                 new_seg->prev = list_seg;
                 list_seg->next = new_seg;
+                StreamTcpSegmentIndexInsert(stream, new_seg);
 
                 SCLogDebug("new_seg %p, new_seg->next %p, new_seg->prev %p, "
                            "list_seg->next %p new_seg->seq %"PRIu32"", new_seg,
@@ -1840,6 +2290,8 @@ static void StreamTcpRemoveSegmentFromStream(TcpStream *stream, TcpSegment *seg)
 
     if (stream->seg_list_tail == seg)
         stream->seg_list_tail = seg->prev;
+
+    StreamTcpSegmentIndexRemove(stream, seg);
 }
 
 /**
@@ -1929,7 +2381,7 @@ static int StreamTcpReassembleInlineAppLayer (ThreadVars *tv,
 
                 TcpSegment *next_seg = seg->next;
                 StreamTcpRemoveSegmentFromStream(stream, seg);
-                StreamTcpSegmentReturntoPool(seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, seg);
                 seg = next_seg;
                 continue;
             } else {
@@ -1945,7 +2397,7 @@ static int StreamTcpReassembleInlineAppLayer (ThreadVars *tv,
                     " so return it to pool", seg, seg->payload_len);
             TcpSegment *next_seg = seg->next;
             StreamTcpRemoveSegmentFromStream(stream, seg);
-            StreamTcpSegmentReturntoPool(seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, seg);
             seg = next_seg;
             continue;
         }
@@ -2050,97 +2502,110 @@ static int StreamTcpReassembleInlineAppLayer (ThreadVars *tv,
                 break;
             }
 
-            /* copy the data into the smsg */
-            uint16_t copy_size = sizeof(data) - data_len;
-            if (copy_size > payload_len) {
-                copy_size = payload_len;
-            }
-            if (SCLogDebugEnabled()) {
-                BUG_ON(copy_size > sizeof(data));
-            }
-            SCLogDebug("copy_size is %"PRIu16"", copy_size);
-            memcpy(data + data_len, seg->payload + payload_offset, copy_size);
-            data_len += copy_size;
-            ra_base_seq += copy_size;
-            SCLogDebug("ra_base_seq %"PRIu32", data_len %"PRIu32, ra_base_seq, data_len);
-
-            /* queue the smsg if it's full */
-            if (data_len == sizeof(data)) {
-                /* process what we have so far */
+            /* with the protocol known and nothing buffered the segment
+             * payload is passed on as is, without copying it */
+            if (data_len == 0 &&
+                (ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED))
+            {
                 STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
-                BUG_ON(data_len > sizeof(data));
                 AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
-                        data, data_len, flags);
+                        seg->payload + payload_offset, payload_len, flags);
                 PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
-                data_sent += data_len;
-                data_len = 0;
-            }
-
-            /* if the payload len is bigger than what we copied, we handle the
-             * rest of the payload next... */
-            if (copy_size < payload_len) {
-                SCLogDebug("copy_size %" PRIu32 " < %" PRIu32 "", copy_size,
-                            payload_len);
-
-                payload_offset += copy_size;
-                payload_len -= copy_size;
-                SCLogDebug("payload_offset is %"PRIu16", seg->payload_len is "
-                           "%"PRIu16" and stream->last_ack is %"PRIu32"",
-                            payload_offset, seg->payload_len, stream->last_ack);
+                ra_base_seq += payload_len;
+                data_sent += payload_len;
+            } else {
+                /* copy the data into the smsg */
+                uint16_t copy_size = sizeof(data) - data_len;
+                if (copy_size > payload_len) {
+                    copy_size = payload_len;
+                }
                 if (SCLogDebugEnabled()) {
-                    BUG_ON(payload_offset > seg->payload_len);
+                    BUG_ON(copy_size > sizeof(data));
                 }
-
-                /* we need a while loop here as the packets theoretically can be
-                 * 64k */
-                char segment_done = FALSE;
-                while (segment_done == FALSE) {
-                    SCLogDebug("new msg at offset %" PRIu32 ", payload_len "
-                               "%" PRIu32 "", payload_offset, payload_len);
+                SCLogDebug("copy_size is %"PRIu16"", copy_size);
+                memcpy(data + data_len, seg->payload + payload_offset, copy_size);
+                data_len += copy_size;
+                ra_base_seq += copy_size;
+                SCLogDebug("ra_base_seq %"PRIu32", data_len %"PRIu32, ra_base_seq, data_len);
+
+                /* queue the smsg if it's full */
+                if (data_len == sizeof(data)) {
+                    /* process what we have so far */
+                    STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
+                    BUG_ON(data_len > sizeof(data));
+                    AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
+                            data, data_len, flags);
+                    PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
+                    data_sent += data_len;
                     data_len = 0;
+                }
 
-                    copy_size = sizeof(data) - data_len;
-                    if (copy_size > (seg->payload_len - payload_offset)) {
-                        copy_size = (seg->payload_len - payload_offset);
-                    }
+                /* if the payload len is bigger than what we copied, we handle the
+                 * rest of the payload next... */
+                if (copy_size < payload_len) {
+                    SCLogDebug("copy_size %" PRIu32 " < %" PRIu32 "", copy_size,
+                                payload_len);
+
+                    payload_offset += copy_size;
+                    payload_len -= copy_size;
+                    SCLogDebug("payload_offset is %"PRIu16", seg->payload_len is "
+                               "%"PRIu16" and stream->last_ack is %"PRIu32"",
+                                payload_offset, seg->payload_len, stream->last_ack);
                     if (SCLogDebugEnabled()) {
-                        BUG_ON(copy_size > sizeof(data));
+                        BUG_ON(payload_offset > seg->payload_len);
                     }
 
-                    SCLogDebug("copy payload_offset %" PRIu32 ", data_len "
-                                "%" PRIu32 ", copy_size %" PRIu32 "",
-                                payload_offset, data_len, copy_size);
-                    memcpy(data + data_len, seg->payload +
-                            payload_offset, copy_size);
-                    data_len += copy_size;
-                    ra_base_seq += copy_size;
-                    SCLogDebug("ra_base_seq %"PRIu32, ra_base_seq);
-                    SCLogDebug("copied payload_offset %" PRIu32 ", "
-                               "data_len %" PRIu32 ", copy_size %" PRIu32 "",
-                               payload_offset, data_len, copy_size);
-
-                    if (data_len == sizeof(data)) {
-                        /* process what we have so far */
-                        STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
-                        BUG_ON(data_len > sizeof(data));
-                        AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
-                                data, data_len, flags);
-                        PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
-                        data_sent += data_len;
+                    /* we need a while loop here as the packets theoretically can be
+                     * 64k */
+                    char segment_done = FALSE;
+                    while (segment_done == FALSE) {
+                        SCLogDebug("new msg at offset %" PRIu32 ", payload_len "
+                                   "%" PRIu32 "", payload_offset, payload_len);
                         data_len = 0;
-                    }
-
-                    /* see if we have segment payload left to process */
-                    if ((copy_size + payload_offset) < seg->payload_len) {
-                        payload_offset += copy_size;
-                        payload_len -= copy_size;
 
+                        copy_size = sizeof(data) - data_len;
+                        if (copy_size > (seg->payload_len - payload_offset)) {
+                            copy_size = (seg->payload_len - payload_offset);
+                        }
                         if (SCLogDebugEnabled()) {
-                            BUG_ON(payload_offset > seg->payload_len);
+                            BUG_ON(copy_size > sizeof(data));
+                        }
+
+                        SCLogDebug("copy payload_offset %" PRIu32 ", data_len "
+                                    "%" PRIu32 ", copy_size %" PRIu32 "",
+                                    payload_offset, data_len, copy_size);
+                        memcpy(data + data_len, seg->payload +
+                                payload_offset, copy_size);
+                        data_len += copy_size;
+                        ra_base_seq += copy_size;
+                        SCLogDebug("ra_base_seq %"PRIu32, ra_base_seq);
+                        SCLogDebug("copied payload_offset %" PRIu32 ", "
+                                   "data_len %" PRIu32 ", copy_size %" PRIu32 "",
+                                   payload_offset, data_len, copy_size);
+
+                        if (data_len == sizeof(data)) {
+                            /* process what we have so far */
+                            STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
+                            BUG_ON(data_len > sizeof(data));
+                            AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
+                                    data, data_len, flags);
+                            PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
+                            data_sent += data_len;
+                            data_len = 0;
+                        }
+
+                        /* see if we have segment payload left to process */
+                        if ((copy_size + payload_offset) < seg->payload_len) {
+                            payload_offset += copy_size;
+                            payload_len -= copy_size;
+
+                            if (SCLogDebugEnabled()) {
+                                BUG_ON(payload_offset > seg->payload_len);
+                            }
+                        } else {
+                            payload_offset = 0;
+                            segment_done = TRUE;
                         }
-                    } else {
-                        payload_offset = 0;
-                        segment_done = TRUE;
                     }
                 }
             }
@@ -2267,7 +2732,7 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
             if (StreamTcpAppLayerSegmentProcessed(stream, seg)) {
                 TcpSegment *next_seg = seg->next;
                 StreamTcpRemoveSegmentFromStream(stream, seg);
-                StreamTcpSegmentReturntoPool(seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, seg);
                 seg = next_seg;
             /* otherwise, just flag it for removal */
             } else {
@@ -2289,7 +2754,7 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
                     " so return it to pool", seg, seg->payload_len);
             TcpSegment *next_seg = seg->next;
             StreamTcpRemoveSegmentFromStream(stream, seg);
-            StreamTcpSegmentReturntoPool(seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, seg);
             seg = next_seg;
             continue;
         }
@@ -2473,7 +2938,7 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
             if (seg->flags & SEGMENTTCP_FLAG_APPLAYER_PROCESSED) {
                 StreamTcpRemoveSegmentFromStream(stream, seg);
                 SCLogDebug("removing seg %p, seg->next %p", seg, seg->next);
-                StreamTcpSegmentReturntoPool(seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, seg);
             } else {
                 seg->flags |= SEGMENTTCP_FLAG_RAW_PROCESSED;
             }
@@ -2500,7 +2965,7 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
         if (StreamTcpAppLayerSegmentProcessed(stream, seg)) {
             TcpSegment *next_seg = seg->next;
             StreamTcpRemoveSegmentFromStream(stream, seg);
-            StreamTcpSegmentReturntoPool(seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, seg);
             seg = next_seg;
         } else {
             break;
@@ -2689,7 +3154,7 @@ static int StreamTcpReassembleAppLayer (ThreadVars *tv,
 
                 TcpSegment *next_seg = seg->next;
                 StreamTcpRemoveSegmentFromStream(stream, seg);
-                StreamTcpSegmentReturntoPool(seg);
+                StreamTcpSegmentReturntoCache(ra_ctx, seg);
                 seg = next_seg;
                 continue;
             } else {
@@ -2711,7 +3176,7 @@ static int StreamTcpReassembleAppLayer (ThreadVars *tv,
 
             TcpSegment *next_seg = seg->next;
             StreamTcpRemoveSegmentFromStream(stream, seg);
-            StreamTcpSegmentReturntoPool(seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, seg);
             seg = next_seg;
             continue;
         }
@@ -2851,109 +3316,121 @@ static int StreamTcpReassembleAppLayer (ThreadVars *tv,
                 break;
             }
 
-            /* copy the data into the smsg */
-            uint16_t copy_size = sizeof(data) - data_len;
-            if (copy_size > payload_len) {
-                copy_size = payload_len;
-            }
-            if (SCLogDebugEnabled()) {
-                BUG_ON(copy_size > sizeof(data));
-            }
-            SCLogDebug("copy_size is %"PRIu16"", copy_size);
-            memcpy(data + data_len, seg->payload + payload_offset, copy_size);
-            data_len += copy_size;
-            ra_base_seq += copy_size;
-            SCLogDebug("ra_base_seq %"PRIu32", data_len %"PRIu32, ra_base_seq, data_len);
-
-            /* queue the smsg if it's full */
-            if (data_len == sizeof(data)) {
-                /* process what we have so far */
+            /* with the protocol known and nothing buffered the segment
+             * payload is passed on as is, without copying it */
+            if (data_len == 0 &&
+                (ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED))
+            {
                 STREAM_SET_FLAGS(ssn, stream, p, flags);
-                BUG_ON(data_len > sizeof(data));
                 AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
-                        data, data_len, flags);
+                        seg->payload + payload_offset, payload_len, flags);
                 PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
-                data_len = 0;
-
-                /* if after the first data chunk we have no alproto yet,
-                 * there is no point in continueing here. */
-                if (!(ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED)) {
-                    SCLogDebug("no alproto after first data chunk");
-                    break;
+                ra_base_seq += payload_len;
+            } else {
+                /* copy the data into the smsg */
+                uint16_t copy_size = sizeof(data) - data_len;
+                if (copy_size > payload_len) {
+                    copy_size = payload_len;
                 }
-            }
-
-            /* if the payload len is bigger than what we copied, we handle the
-             * rest of the payload next... */
-            if (copy_size < payload_len) {
-                SCLogDebug("copy_size %" PRIu32 " < %" PRIu32 "", copy_size,
-                            payload_len);
-
-                payload_offset += copy_size;
-                payload_len -= copy_size;
-                SCLogDebug("payload_offset is %"PRIu16", seg->payload_len is "
-                           "%"PRIu16" and stream->last_ack is %"PRIu32"",
-                            payload_offset, seg->payload_len, stream->last_ack);
                 if (SCLogDebugEnabled()) {
-                    BUG_ON(payload_offset > seg->payload_len);
+                    BUG_ON(copy_size > sizeof(data));
                 }
-
-                /* we need a while loop here as the packets theoretically can be
-                 * 64k */
-                char segment_done = FALSE;
-                while (segment_done == FALSE) {
-                    SCLogDebug("new msg at offset %" PRIu32 ", payload_len "
-                               "%" PRIu32 "", payload_offset, payload_len);
+                SCLogDebug("copy_size is %"PRIu16"", copy_size);
+                memcpy(data + data_len, seg->payload + payload_offset, copy_size);
+                data_len += copy_size;
+                ra_base_seq += copy_size;
+                SCLogDebug("ra_base_seq %"PRIu32", data_len %"PRIu32, ra_base_seq, data_len);
+
+                /* queue the smsg if it's full */
+                if (data_len == sizeof(data)) {
+                    /* process what we have so far */
+                    STREAM_SET_FLAGS(ssn, stream, p, flags);
+                    BUG_ON(data_len > sizeof(data));
+                    AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
+                            data, data_len, flags);
+                    PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
                     data_len = 0;
 
-                    copy_size = sizeof(data) - data_len;
-                    if (copy_size > (seg->payload_len - payload_offset)) {
-                        copy_size = (seg->payload_len - payload_offset);
+                    /* if after the first data chunk we have no alproto yet,
+                     * there is no point in continueing here. */
+                    if (!(ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED)) {
+                        SCLogDebug("no alproto after first data chunk");
+                        break;
                     }
+                }
+
+                /* if the payload len is bigger than what we copied, we handle the
+                 * rest of the payload next... */
+                if (copy_size < payload_len) {
+                    SCLogDebug("copy_size %" PRIu32 " < %" PRIu32 "", copy_size,
+                                payload_len);
+
+                    payload_offset += copy_size;
+                    payload_len -= copy_size;
+                    SCLogDebug("payload_offset is %"PRIu16", seg->payload_len is "
+                               "%"PRIu16" and stream->last_ack is %"PRIu32"",
+                                payload_offset, seg->payload_len, stream->last_ack);
                     if (SCLogDebugEnabled()) {
-                        BUG_ON(copy_size > sizeof(data));
+                        BUG_ON(payload_offset > seg->payload_len);
                     }
 
-                    SCLogDebug("copy payload_offset %" PRIu32 ", data_len "
-                                "%" PRIu32 ", copy_size %" PRIu32 "",
-                                payload_offset, data_len, copy_size);
-                    memcpy(data + data_len, seg->payload +
-                            payload_offset, copy_size);
-                    data_len += copy_size;
-                    ra_base_seq += copy_size;
-                    SCLogDebug("ra_base_seq %"PRIu32, ra_base_seq);
-                    SCLogDebug("copied payload_offset %" PRIu32 ", "
-                               "data_len %" PRIu32 ", copy_size %" PRIu32 "",
-                               payload_offset, data_len, copy_size);
-
-                    if (data_len == sizeof(data)) {
-                        /* process what we have so far */
-                        STREAM_SET_FLAGS(ssn, stream, p, flags);
-                        BUG_ON(data_len > sizeof(data));
-                        AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
-                                data, data_len, flags);
-                        PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
+                    /* we need a while loop here as the packets theoretically can be
+                     * 64k */
+                    char segment_done = FALSE;
+                    while (segment_done == FALSE) {
+                        SCLogDebug("new msg at offset %" PRIu32 ", payload_len "
+                                   "%" PRIu32 "", payload_offset, payload_len);
                         data_len = 0;
 
-                        /* if after the first data chunk we have no alproto yet,
-                         * there is no point in continueing here. */
-                        if (!(ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED)) {
-                            SCLogDebug("no alproto after first data chunk");
-                            break;
+                        copy_size = sizeof(data) - data_len;
+                        if (copy_size > (seg->payload_len - payload_offset)) {
+                            copy_size = (seg->payload_len - payload_offset);
+                        }
+                        if (SCLogDebugEnabled()) {
+                            BUG_ON(copy_size > sizeof(data));
                         }
-                    }
 
-                    /* see if we have segment payload left to process */
-                    if ((copy_size + payload_offset) < seg->payload_len) {
-                        payload_offset += copy_size;
-                        payload_len -= copy_size;
+                        SCLogDebug("copy payload_offset %" PRIu32 ", data_len "
+                                    "%" PRIu32 ", copy_size %" PRIu32 "",
+                                    payload_offset, data_len, copy_size);
+                        memcpy(data + data_len, seg->payload +
+                                payload_offset, copy_size);
+                        data_len += copy_size;
+                        ra_base_seq += copy_size;
+                        SCLogDebug("ra_base_seq %"PRIu32, ra_base_seq);
+                        SCLogDebug("copied payload_offset %" PRIu32 ", "
+                                   "data_len %" PRIu32 ", copy_size %" PRIu32 "",
+                                   payload_offset, data_len, copy_size);
+
+                        if (data_len == sizeof(data)) {
+                            /* process what we have so far */
+                            STREAM_SET_FLAGS(ssn, stream, p, flags);
+                            BUG_ON(data_len > sizeof(data));
+                            AppLayerHandleTCPData(&ra_ctx->dp_ctx, p->flow, ssn,
+                                    data, data_len, flags);
+                            PACKET_PROFILING_APP_STORE(&ra_ctx->dp_ctx, p);
+                            data_len = 0;
+
+                            /* if after the first data chunk we have no alproto yet,
+                             * there is no point in continueing here. */
+                            if (!(ssn->flags & STREAMTCP_FLAG_APPPROTO_DETECTION_COMPLETED)) {
+                                SCLogDebug("no alproto after first data chunk");
+                                break;
+                            }
+                        }
 
-                        if (SCLogDebugEnabled()) {
-                            BUG_ON(payload_offset > seg->payload_len);
+                        /* see if we have segment payload left to process */
+                        if ((copy_size + payload_offset) < seg->payload_len) {
+                            payload_offset += copy_size;
+                            payload_len -= copy_size;
+
+                            if (SCLogDebugEnabled()) {
+                                BUG_ON(payload_offset > seg->payload_len);
+                            }
+                        } else {
+                            payload_offset = 0;
+                            segment_done = TRUE;
                         }
-                    } else {
-                        payload_offset = 0;
-                        segment_done = TRUE;
                     }
                 }
             }
@@ -3074,7 +3551,7 @@ static int StreamTcpReassembleRaw (TcpReassemblyThreadCtx *ra_ctx,
 
             TcpSegment *next_seg = seg->next;
             StreamTcpRemoveSegmentFromStream(stream, seg);
-            StreamTcpSegmentReturntoPool(seg);
+            StreamTcpSegmentReturntoCache(ra_ctx, seg);
             seg = next_seg;
             continue;
         }
@@ -3613,14 +4090,27 @@ TcpSegment* StreamTcpGetSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
     SCLogDebug("segment_pool_idx %" PRIu32 " for payload_len %" PRIu32 "",
                 idx, len);
 
-    SCMutexLock(&segment_pool_mutex[idx]);
-    TcpSegment *seg = (TcpSegment *) PoolGet(segment_pool[idx]);
+    TcpSegment *seg = NULL;
+    if (ra_ctx != NULL) {
+        TcpSegmentCache *cache = &ra_ctx->segment_cache[idx];
+        if (cache->cnt == 0) {
+            StreamTcpSegmentCacheRefill(cache, idx);
+        }
+        if (cache->list != NULL) {
+            seg = cache->list;
+            cache->list = seg->next;
+            cache->cnt--;
+        }
+    } else {
+        SCMutexLock(&segment_pool_mutex[idx]);
+        seg = (TcpSegment *) PoolGet(segment_pool[idx]);
+        SCMutexUnlock(&segment_pool_mutex[idx]);
+    }
 
     SCLogDebug("segment_pool[%u]->empty_list_size %u, segment_pool[%u]->alloc_"
                "list_size %u, alloc %u", idx, segment_pool[idx]->empty_list_size,
                idx, segment_pool[idx]->alloc_list_size,
                segment_pool[idx]->allocated);
-    SCMutexUnlock(&segment_pool_mutex[idx]);
 
     SCLogDebug("seg we return is %p", seg);
     if (seg == NULL) {
@@ -8882,6 +9372,260 @@ end:
     return ret;
 }
 
+/** \test insert out of order segments and check the list and the index
+ */
+static int StreamTcpReassembleInsertTest04(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSession ssn;
+    uint8_t check_contents[640];
+    TcpSegment *seg;
+    int i;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    StreamTcpUTInit(&ra_ctx);
+    StreamTcpUTSetupSession(&ssn);
+    StreamTcpUTSetupStream(&ssn.client, 1);
+
+    /* 64 segments of 10 bytes, inserted in a scrambled order */
+    for (i = 0; i < 64; i++) {
+        int n = (i * 37) % 64;
+
+        memset(check_contents + n * 10, 'A' + (n % 26), 10);
+        if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 2 + n * 10,
+                    'A' + (n % 26), 10) == -1) {
+            printf("failed to add segment %d: ", n);
+            goto end;
+        }
+    }
+
+    if (StreamTcpCheckStreamContents(check_contents, sizeof(check_contents),
+                &ssn.client) == 0) {
+        printf("failed in stream matching: ");
+        goto end;
+    }
+
+    for (seg = ssn.client.seg_list; seg != NULL; seg = seg->next) {
+        if (StreamTcpSegmentIndexLookup(&ssn.client, seg->seq) != seg ||
+            StreamTcpSegmentIndexLookup(&ssn.client, seg->seq + 5) != seg) {
+            printf("index lookup for seq %"PRIu32" failed: ", seg->seq);
+            goto end;
+        }
+    }
+    if (StreamTcpSegmentIndexLookup(&ssn.client, 1) != NULL) {
+        printf("index lookup before the first segment should fail: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    StreamTcpUTClearSession(&ssn);
+    StreamTcpUTDeinit(ra_ctx);
+    return ret;
+}
+
+/** \test the index is only built on the first out of order insert and
+ *        kept up to date by in order inserts after that
+ */
+static int StreamTcpReassembleInsertTest05(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSession ssn;
+    TcpSegment *seg;
+    int i;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    StreamTcpUTInit(&ra_ctx);
+    StreamTcpUTSetupSession(&ssn);
+    StreamTcpUTSetupStream(&ssn.client, 1);
+
+    /* in order, leaving a hole at seq 32 */
+    for (i = 0; i < 6; i++) {
+        if (i == 3)
+            continue;
+        if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 2 + i * 10,
+                    'A' + i, 10) == -1) {
+            printf("failed to add segment %d: ", i);
+            goto end;
+        }
+    }
+    if (ssn.client.seg_tree != NULL) {
+        printf("index built for in order segments: ");
+        goto end;
+    }
+
+    /* fill the hole */
+    if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 32, 'D', 10) == -1) {
+        printf("failed to add segment 3: ");
+        goto end;
+    }
+    if (ssn.client.seg_tree == NULL) {
+        printf("no index after an out of order segment: ");
+        goto end;
+    }
+
+    /* in order again */
+    if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 62, 'G', 10) == -1) {
+        printf("failed to add segment 6: ");
+        goto end;
+    }
+
+    if (StreamTcpCheckStreamContents((uint8_t *)"AAAAAAAAAABBBBBBBBBBCCCCCCCCCC"
+                "DDDDDDDDDDEEEEEEEEEEFFFFFFFFFFGGGGGGGGGG", 70, &ssn.client) == 0) {
+        printf("failed in stream matching: ");
+        goto end;
+    }
+
+    for (seg = ssn.client.seg_list; seg != NULL; seg = seg->next) {
+        if (StreamTcpSegmentIndexLookup(&ssn.client, seg->seq) != seg ||
+            StreamTcpSegmentIndexLookup(&ssn.client, seg->seq + 5) != seg) {
+            printf("index lookup for seq %"PRIu32" failed: ", seg->seq);
+            goto end;
+        }
+    }
+
+    ret = 1;
+end:
+    StreamTcpUTClearSession(&ssn);
+    StreamTcpUTDeinit(ra_ctx);
+    return ret;
+}
+
+/** \test segments go through the thread's segment cache and the cache
+ *        exchanges them with the pool in batches
+ */
+static int StreamTcpReassembleSegmentCacheTest01(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSegment *segs[100];
+    int i;
+
+    memset(&tv, 0x00, sizeof(tv));
+    memset(&segs, 0x00, sizeof(segs));
+
+    StreamTcpUTInit(&ra_ctx);
+
+    uint16_t idx = segment_pool_idx[100];
+    TcpSegmentCache *cache = &ra_ctx->segment_cache[idx];
+    uint16_t batch = segment_pool_cache_batch[idx];
+
+    for (i = 0; i < 100; i++) {
+        segs[i] = StreamTcpGetSegment(&tv, ra_ctx, 100);
+        if (segs[i] == NULL) {
+            printf("no segment %d: ", i);
+            goto end;
+        }
+        if (cache->cnt >= batch) {
+            printf("cache cnt %u, batch %u: ", cache->cnt, batch);
+            goto end;
+        }
+    }
+    if (segment_pool[idx]->outstanding != 100 + (uint32_t)cache->cnt) {
+        printf("pool outstanding %u, expected %u: ",
+                segment_pool[idx]->outstanding, 100 + (uint32_t)cache->cnt);
+        goto end;
+    }
+
+    for (i = 0; i < 100; i++) {
+        StreamTcpSegmentReturntoCache(ra_ctx, segs[i]);
+        segs[i] = NULL;
+        if (cache->cnt > 2 * batch) {
+            printf("cache cnt %u, batch %u: ", cache->cnt, batch);
+            goto end;
+        }
+    }
+    if (segment_pool[idx]->outstanding != cache->cnt) {
+        printf("pool outstanding %u, cache cnt %u: ",
+                segment_pool[idx]->outstanding, cache->cnt);
+        goto end;
+    }
+
+    /* freeing the thread ctx hands the cached segments back */
+    StreamTcpReassembleFreeThreadCtx(ra_ctx);
+    ra_ctx = NULL;
+    if (segment_pool[idx]->outstanding != 0) {
+        printf("pool outstanding %u: ", segment_pool[idx]->outstanding);
+        goto end;
+    }
+
+    ret = 1;
+end:
+    for (i = 0; i < 100; i++) {
+        if (segs[i] != NULL)
+            StreamTcpSegmentReturntoPool(segs[i]);
+    }
+    if (ra_ctx != NULL)
+        StreamTcpReassembleFreeThreadCtx(ra_ctx);
+    StreamTcpFreeConfig(TRUE);
+    return ret;
+}
+
+/** \test while a pool is marked as starved, returned segments go straight
+ *        back to the pool instead of staying in the thread's cache
+ */
+static int StreamTcpReassembleSegmentCacheTest02(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSegment *segs[10];
+    int i;
+
+    memset(&tv, 0x00, sizeof(tv));
+    memset(&segs, 0x00, sizeof(segs));
+
+    StreamTcpUTInit(&ra_ctx);
+
+    uint16_t idx = segment_pool_idx[100];
+    TcpSegmentCache *cache = &ra_ctx->segment_cache[idx];
+
+    for (i = 0; i < 10; i++) {
+        segs[i] = StreamTcpGetSegment(&tv, ra_ctx, 100);
+        if (segs[i] == NULL) {
+            printf("no segment %d: ", i);
+            goto end;
+        }
+    }
+
+    SC_ATOMIC_OR(segment_pool_starved, (uint8_t)(1 << idx));
+    for (i = 0; i < 10; i++) {
+        StreamTcpSegmentReturntoCache(ra_ctx, segs[i]);
+        segs[i] = NULL;
+    }
+    if (cache->cnt != 0 || segment_pool[idx]->outstanding != 0) {
+        printf("cache cnt %u, pool outstanding %u: ", cache->cnt,
+                segment_pool[idx]->outstanding);
+        goto end;
+    }
+
+    /* getting a segment from the pool again clears the mark */
+    segs[0] = StreamTcpGetSegment(&tv, ra_ctx, 100);
+    if (segs[0] == NULL) {
+        printf("no segment: ");
+        goto end;
+    }
+    if (SC_ATOMIC_GET(segment_pool_starved) & (1 << idx)) {
+        printf("pool still marked as starved: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    SC_ATOMIC_AND(segment_pool_starved, (uint8_t)~(1 << idx));
+    for (i = 0; i < 10; i++) {
+        if (segs[i] != NULL)
+            StreamTcpSegmentReturntoPool(segs[i]);
+    }
+    if (ra_ctx != NULL)
+        StreamTcpReassembleFreeThreadCtx(ra_ctx);
+    StreamTcpFreeConfig(TRUE);
+    return ret;
+}
+
 #endif /* UNITTESTS */
 
 /** \brief  The Function Register the Unit tests to test the reassembly engine
@@ -8953,6 +9697,10 @@ void StreamTcpReassembleRegisterTests(void) {
     UtRegisterTest("StreamTcpReassembleInsertTest01 -- insert with overlap", StreamTcpReassembleInsertTest01, 1);
     UtRegisterTest("StreamTcpReassembleInsertTest02 -- insert with overlap", StreamTcpReassembleInsertTest02, 1);
     UtRegisterTest("StreamTcpReassembleInsertTest03 -- insert with overlap", StreamTcpReassembleInsertTest03, 1);
+    UtRegisterTest("StreamTcpReassembleInsertTest04 -- insert out of order", StreamTcpReassembleInsertTest04, 1);
+    UtRegisterTest("StreamTcpReassembleInsertTest05 -- lazy index", StreamTcpReassembleInsertTest05, 1);
+    UtRegisterTest("StreamTcpReassembleSegmentCacheTest01 -- thread segment cache", StreamTcpReassembleSegmentCacheTest01, 1);
+    UtRegisterTest("StreamTcpReassembleSegmentCacheTest02 -- starved segment pool", StreamTcpReassembleSegmentCacheTest02, 1);
 
     StreamTcpInlineRegisterTests();
     StreamTcpUtilRegisterTests();
@@ -51,6 +51,16 @@ enum
     OS_POLICY_LAST
 };
 
+/** no of segment pools, one per payload size class */
+#define STREAMTCP_SEGMENT_POOLS 8
+
+/** free segments of one size class kept by a thread, so that getting and
+ *  returning segments doesn't take the pool lock every time */
+typedef struct TcpSegmentCache_ {
+    TcpSegment *list;   /**< the segments, linked through next */
+    uint16_t cnt;       /**< no of segments in list */
+} TcpSegmentCache;
+
 typedef struct TcpReassemblyThreadCtx_ {
     StreamMsgQueue *stream_q;
     AlpProtoDetectThreadCtx dp_ctx;   /**< proto detection thread data */
@@ -62,6 +72,10 @@ typedef struct TcpReassemblyThreadCtx_ {
     uint16_t counter_tcp_reass_memuse;
     /** count number of streams with a unrecoverable stream gap (missing pkts) */
     uint16_t counter_tcp_reass_gap;
+    /** account memory usage for the http body chunks */
+    uint16_t counter_htp_body_memuse;
+    /** free segments per segment pool */
+    TcpSegmentCache segment_cache[STREAMTCP_SEGMENT_POOLS];
 } TcpReassemblyThreadCtx;
 
 #define OS_POLICY_DEFAULT   OS_POLICY_BSD
@@ -35,6 +35,7 @@
 
 #include "flow.h"
 #include "flow-util.h"
+#include "flow-manager.h"
 
 #include "conf.h"
 #include "conf-yaml-loader.h"
@@ -156,6 +157,22 @@ int StreamTcpCheckMemcap(uint64_t size) {
     return 0;
 }
 
+/**
+ *  \brief Free the stream mpm tail of a stream, if it has one.
+ *
+ *  \param stream stream
+ */
+void StreamTcpMpmTailFree(TcpStream *stream)
+{
+    if (stream->mpm_tail == NULL)
+        return;
+
+    SCFree(stream->mpm_tail);
+    stream->mpm_tail = NULL;
+    stream->mpm_tail_len = 0;
+    StreamTcpDecrMemuse((uint64_t)STREAM_MPM_TAIL_SIZE);
+}
+
 /**
  *  \brief Function to return the stream back to the pool. It returns the
  *         segments in the stream to the segment pool.
@@ -183,6 +200,9 @@ void StreamTcpSessionClear(void *ssnptr)
     StreamTcpSackFreeList(&ssn->client);
     StreamTcpSackFreeList(&ssn->server);
 
+    StreamTcpMpmTailFree(&ssn->client);
+    StreamTcpMpmTailFree(&ssn->server);
+
     /* if we have (a) smsg(s), return to the pool */
     smsg = ssn->toserver_smsg_head;
     while(smsg != NULL) {
@@ -282,6 +302,9 @@ void StreamTcpSessionPoolCleanup(void *s)
     StreamTcpReturnStreamSegments(&ssn->client);
     StreamTcpReturnStreamSegments(&ssn->server);
 
+    StreamTcpMpmTailFree(&ssn->client);
+    StreamTcpMpmTailFree(&ssn->server);
+
     /* if we have (a) smsg(s), return to the pool */
     smsg = ssn->toserver_smsg_head;
     while(smsg != NULL) {
@@ -575,6 +598,9 @@ static void StreamTcpPacketSetState(Packet *p, TcpSession *ssn,
         return;
 
     ssn->state = state;
+
+    /* the flow timeout depends on the state */
+    FlowWheelUpdate(p->flow);
 }
 
 /**
@@ -4136,6 +4162,9 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     stt->ra_ctx->counter_tcp_reass_memuse = SCPerfTVRegisterCounter("tcp.reassembly_memuse", tv,
                                                         SC_PERF_TYPE_Q_NORMAL,
                                                         "NULL");
+    stt->ra_ctx->counter_htp_body_memuse = SCPerfTVRegisterCounter("http.body_memuse", tv,
+                                                        SC_PERF_TYPE_Q_NORMAL,
+                                                        "NULL");
     stt->ra_ctx->counter_tcp_reass_gap = SCPerfTVRegisterCounter("tcp.reassembly_gap", tv,
                                                         SC_PERF_TYPE_UINT64,
                                                         "NULL");
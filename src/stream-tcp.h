@@ -110,6 +110,7 @@ void StreamTcpSessionPktFree (Packet *);
 void StreamTcpIncrMemuse(uint64_t);
 void StreamTcpDecrMemuse(uint64_t);
 int StreamTcpCheckMemcap(uint64_t);
+void StreamTcpMpmTailFree(TcpStream *);
 
 void StreamTcpPseudoPacketSetupHeader(Packet *, Packet *);
 Packet *StreamTcpPseudoSetup(Packet *, uint8_t *, uint32_t);
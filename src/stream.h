@@ -36,6 +36,10 @@
 /** size of the data chunks sent to the app layer parser. */
 #define MSG_DATA_SIZE       4024 /* 4096 - 72 (size of rest of the struct) */
 
+/** max no of bytes of a stream kept for the stream mpm to inspect patterns
+ *  spanning the data chunks */
+#define STREAM_MPM_TAIL_SIZE    64
+
 typedef struct StreamMsg_ {
     uint8_t flags;  /**< msg flags */
     Flow *flow;     /**< parent flow */
@@ -189,8 +189,10 @@
 #include "tmqh-packetpool.h"
 
 #include "util-ringbuffer.h"
+#include "util-pcap-mmap.h"
 #include "util-mem.h"
 #include "util-memcmp.h"
+#include "util-line.h"
 #include "util-proto-name.h"
 #include "util-spm-bm.h"
 
@@ -1668,6 +1670,7 @@ int main(int argc, char **argv)
         ConfRegisterTests();
         ConfYamlRegisterTests();
         TmqhFlowRegisterTests();
+        TmqhPacketpoolRegisterTests();
         FlowRegisterTests();
         SCSigRegisterSignatureOrderingTests();
         SCRadixRegisterTests();
@@ -1694,6 +1697,7 @@ int main(int argc, char **argv)
         DeStateRegisterTests();
         DetectRingBufferRegisterTests();
         MemcmpRegisterTests();
+        LineRegisterTests();
         DetectEngineHttpClientBodyRegisterTests();
         DetectEngineHttpServerBodyRegisterTests();
         DetectEngineHttpHeaderRegisterTests();
@@ -1715,6 +1719,7 @@ int main(int argc, char **argv)
         DetectProtoTests();
         DetectPortTests();
         SCAtomicRegisterTests();
+        PcapMmapRegisterTests();
         if (list_unittests) {
             UtListTests(regex_arg);
         }
@@ -31,6 +31,7 @@
 #include "threads.h"
 
 struct TmSlot_;
+struct FlowThreadTable_;
 
 /** Thread flags set and read by threads to control the threads */
 #define THV_USE       1 /** thread is in use */
@@ -54,6 +55,9 @@ struct TmSlot_;
 /** Maximum no of times a thread can be restarted */
 #define THV_MAX_RESTARTS 50
 
+/** Maximum no of packets a thread takes from its inq at once */
+#define THV_BATCH_SIZE_MAX 64
+
 /** \brief Per thread variable structure */
 typedef struct ThreadVars_ {
     pthread_t t;
@@ -83,6 +87,14 @@ typedef struct ThreadVars_ {
     void (*InShutdownHandler)(struct ThreadVars_ *);
     void (*tmqh_out)(struct ThreadVars_ *, struct Packet_ *);
 
+    /** batch queue handlers, NULL if the queue handler doesn't support
+     *  batching */
+    uint16_t (*tmqh_in_batch)(struct ThreadVars_ *, struct Packet_ **, uint16_t);
+    void (*tmqh_out_batch)(struct ThreadVars_ *, struct Packet_ **, uint16_t);
+    /** max number of packets to take from the inq at once. 1 disables
+     *  batching. */
+    uint16_t batch_size;
+
     /** slot functions */
     void *(*tm_func)(void *);
     struct TmSlot_ *tm_slots;
@@ -100,6 +112,11 @@ typedef struct ThreadVars_ {
 
     uint8_t cap_flags; /**< Flags to indicate the capabilities of all the
                             TmModules resgitered under this thread */
+
+    /** thread local flow table, only set in the workers runmodes when
+     *  flow.thread-local is enabled */
+    struct FlowThreadTable_ *flow_table;
+
     struct ThreadVars_ *next;
     struct ThreadVars_ *prev;
 } ThreadVars;
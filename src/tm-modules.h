@@ -41,7 +41,8 @@ typedef struct TmModule_ {
     void (*ThreadExitPrintStats)(ThreadVars *, void *);
     TmEcode (*ThreadDeinit)(ThreadVars *, void *);
 
-    /** the packet processing function */
+    /** the packet processing function, batches of packets are run
+     *  through it one packet at a time (see TmThreadsSlotVarRunBatch) */
     TmEcode (*Func)(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
 
     TmEcode (*PktAcqLoop)(ThreadVars *, void *, void *);
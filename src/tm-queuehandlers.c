@@ -49,6 +49,7 @@ void TmqhSetup (void) {
 /** \brief Clean up registration time allocs */
 void TmqhCleanup(void) {
     TmqhRingBufferDestroy();
+    TmqhFlowDestroy();
 }
 
 Tmqh* TmqhGetQueueHandlerByName(char *name) {
@@ -29,6 +29,7 @@ enum {
     TMQH_NFQ,
     TMQH_PACKETPOOL,
     TMQH_FLOW,
+    TMQH_FLOW_LOCKFREE,
     TMQH_RINGBUFFER_MRSW,
     TMQH_RINGBUFFER_SRSW,
     TMQH_RINGBUFFER_SRMW,
@@ -41,8 +42,13 @@ typedef struct Tmqh_ {
     Packet *(*InHandler)(ThreadVars *);
     void (*InShutdownHandler)(ThreadVars *);
     void (*OutHandler)(ThreadVars *, Packet *);
+    /** optional batch versions of the in and out handlers */
+    uint16_t (*InHandlerBatch)(ThreadVars *, Packet **, uint16_t);
+    void (*OutHandlerBatch)(ThreadVars *, Packet **, uint16_t);
     void *(*OutHandlerCtxSetup)(char *);
     void (*OutHandlerCtxFree)(void *);
+    /** optional, registers the perf counters of the writer's outctx */
+    void (*OutHandlerRegisterCounters)(ThreadVars *);
     void (*RegisterTests)(void);
 } Tmqh;
 
@@ -32,6 +32,7 @@
 #include "threadvars.h"
 #include "tm-queues.h"
 #include "tm-queuehandlers.h"
+#include "tmqh-flow.h"
 #include "tm-threads.h"
 #include "tmqh-packetpool.h"
 #include "threads.h"
@@ -520,18 +521,65 @@ void *TmThreadsSlot1(void *td)
     return NULL;
 }
 
+static TmEcode TmThreadsSlotVarRunQueue(ThreadVars *, Packet *, TmSlot *,
+                                        PacketQueue *);
+
 /**
- * \brief Separate run function so we can call it recursively.
+ * \internal
+ * \brief Run the packets a slot put in its pre_pq through the rest of
+ *        the slots and output them.
  *
- * \todo Deal with post_pq for slots beyond the first.
+ * \param out_pq if not NULL the packets are put in here instead of being
+ *               output, so the caller can output them in order
+ *
+ * \retval TM_ECODE_OK or TM_ECODE_FAILED
  */
-TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
-                                          TmSlot *slot)
+static inline TmEcode TmThreadsSlotHandlePrePq(ThreadVars *tv, TmSlot *s,
+                                               PacketQueue *out_pq)
 {
     TmEcode r;
-    TmSlot *s;
     Packet *extra_p;
 
+    while (s->slot_pre_pq.top != NULL) {
+        extra_p = PacketDequeue(&s->slot_pre_pq);
+        if (unlikely(extra_p == NULL))
+            continue;
+
+        /* see if we need to process the packet */
+        if (s->slot_next != NULL) {
+            r = TmThreadsSlotVarRunQueue(tv, extra_p, s->slot_next, out_pq);
+            if (unlikely(r == TM_ECODE_FAILED)) {
+                TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+
+                SCMutexLock(&s->slot_post_pq.mutex_q);
+                TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
+                SCMutexUnlock(&s->slot_post_pq.mutex_q);
+
+                TmqhOutputPacketpool(tv, extra_p);
+                TmThreadsSetFlag(tv, THV_FAILED);
+                return TM_ECODE_FAILED;
+            }
+        }
+        if (out_pq != NULL)
+            PacketEnqueue(out_pq, extra_p);
+        else
+            tv->tmqh_out(tv, extra_p);
+    }
+
+    return TM_ECODE_OK;
+}
+
+/**
+ * \internal
+ * \brief Run a packet through the slots, the pseudo packets created on the
+ *        way are put in out_pq instead of being output if it's not NULL.
+ */
+static TmEcode TmThreadsSlotVarRunQueue(ThreadVars *tv, Packet *p,
+                                        TmSlot *slot, PacketQueue *out_pq)
+{
+    TmEcode r;
+    TmSlot *s;
+
     for (s = slot; s != NULL; s = s->slot_next) {
         TmSlotFunc SlotFunc = SC_ATOMIC_GET(s->SlotFunc);
         PACKET_PROFILING_TMM_START(p, s->tm_id);
@@ -558,30 +606,106 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
         }
 
         /* handle new packets */
-        while (s->slot_pre_pq.top != NULL) {
-            extra_p = PacketDequeue(&s->slot_pre_pq);
-            if (unlikely(extra_p == NULL))
-                continue;
+        if (TmThreadsSlotHandlePrePq(tv, s, out_pq) == TM_ECODE_FAILED)
+            return TM_ECODE_FAILED;
+    }
 
-            /* see if we need to process the packet */
-            if (s->slot_next != NULL) {
-                r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
-                if (unlikely(r == TM_ECODE_FAILED)) {
-                    TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+    return TM_ECODE_OK;
+}
 
-                    SCMutexLock(&s->slot_post_pq.mutex_q);
-                    TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
-                    SCMutexUnlock(&s->slot_post_pq.mutex_q);
+/**
+ * \brief Separate run function so we can call it recursively.
+ *
+ * \todo Deal with post_pq for slots beyond the first.
+ */
+TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
+                                          TmSlot *slot)
+{
+    return TmThreadsSlotVarRunQueue(tv, p, slot, NULL);
+}
 
-                    TmqhOutputPacketpool(tv, extra_p);
-                    TmThreadsSetFlag(tv, THV_FAILED);
-                    return TM_ECODE_FAILED;
-                }
+/**
+ * \internal
+ * \brief Output the packets of a batch that are done.
+ */
+static inline void TmThreadsSlotOutputBatch(ThreadVars *tv, Packet **out,
+                                            uint16_t cnt)
+{
+    uint16_t i;
+
+    if (tv->tmqh_out_batch != NULL) {
+        tv->tmqh_out_batch(tv, out, cnt);
+    } else {
+        for (i = 0; i < cnt; i++)
+            tv->tmqh_out(tv, out[i]);
+    }
+}
+
+/**
+ * \brief Run a batch of packets through the slots and output them.
+ *
+ *        Each packet is run through all the slots before the next one is,
+ *        so the flow, stream and app layer state a slot sees for a packet
+ *        is the same as without batching. The next packet's flow is
+ *        prefetched while a packet is processed.
+ *
+ *        The pseudo packets a slot creates for a packet are output right
+ *        after that packet, ahead of the later packets of the batch, so
+ *        the output order doesn't depend on the batch size.
+ *
+ *        Thread modules have no batch version of their Func: running one
+ *        module over the whole batch before the next module sees the first
+ *        packet lets the stream and app layer state run ahead of detect,
+ *        which changes what the rules see. Only the queue handoff is
+ *        batched.
+ *
+ * \param tv   thread vars
+ * \param pkts array of packets
+ * \param cnt  number of packets in pkts
+ * \param slot first slot to run
+ *
+ * \retval TM_ECODE_OK or TM_ECODE_FAILED. On failure the packets that
+ *         were processed are output and the others are returned to the
+ *         packet pool.
+ */
+TmEcode TmThreadsSlotVarRunBatch(ThreadVars *tv, Packet **pkts, uint16_t cnt,
+                                 TmSlot *slot)
+{
+    Packet *out[THV_BATCH_SIZE_MAX];
+    PacketQueue extra_pq;
+    Packet *extra_p;
+    uint16_t out_cnt = 0;
+    uint16_t i;
+
+    memset(&extra_pq, 0, sizeof(extra_pq));
+
+    for (i = 0; i < cnt; i++) {
+        if (i + 1 < cnt && pkts[i + 1]->flow != NULL)
+            prefetch(pkts[i + 1]->flow);
+
+        if (TmThreadsSlotVarRunQueue(tv, pkts[i], slot, &extra_pq) == TM_ECODE_FAILED) {
+            TmThreadsSlotOutputBatch(tv, out, out_cnt);
+            TmqhReleasePacketsToPacketPool(&extra_pq);
+            for (; i < cnt; i++)
+                TmqhOutputPacketpool(tv, pkts[i]);
+            return TM_ECODE_FAILED;
+        }
+
+        out[out_cnt++] = pkts[i];
+        while ((extra_p = PacketDequeue(&extra_pq)) != NULL) {
+            if (out_cnt == THV_BATCH_SIZE_MAX) {
+                TmThreadsSlotOutputBatch(tv, out, out_cnt);
+                out_cnt = 0;
             }
-            tv->tmqh_out(tv, extra_p);
+            out[out_cnt++] = extra_p;
+        }
+        if (out_cnt == THV_BATCH_SIZE_MAX) {
+            TmThreadsSlotOutputBatch(tv, out, out_cnt);
+            out_cnt = 0;
         }
     }
 
+    TmThreadsSlotOutputBatch(tv, out, out_cnt);
     return TM_ECODE_OK;
 }
 
@@ -728,6 +852,8 @@ void *TmThreadsSlotVar(void *td)
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
     Packet *p = NULL;
+    Packet *pkts[THV_BATCH_SIZE_MAX];
+    uint16_t cnt;
     char run = 1;
     TmEcode r = TM_ECODE_OK;
 
@@ -781,22 +907,37 @@ void *TmThreadsSlotVar(void *td)
             TmThreadsUnsetFlag(tv, THV_PAUSED);
         }
 
-        /* input a packet */
-        p = tv->tmqh_in(tv);
+        if (tv->batch_size > 1) {
+            /* input a batch of packets */
+            cnt = tv->tmqh_in_batch(tv, pkts, tv->batch_size);
 
-        if (p != NULL) {
-            /* run the thread module(s) */
-            r = TmThreadsSlotVarRun(tv, p, s);
-            if (r == TM_ECODE_FAILED) {
-                TmqhOutputPacketpool(tv, p);
-                TmThreadsSetFlag(tv, THV_FAILED);
-                break;
+            if (cnt > 0) {
+                /* run the thread module(s) */
+                /* run the thread module(s) and output the packets */
+                r = TmThreadsSlotVarRunBatch(tv, pkts, cnt, s);
+                if (r == TM_ECODE_FAILED) {
+                    TmThreadsSetFlag(tv, THV_FAILED);
+                    break;
+                }
             }
+        } else {
+            /* input a packet */
+            p = tv->tmqh_in(tv);
+
+            if (p != NULL) {
+                /* run the thread module(s) */
+                r = TmThreadsSlotVarRun(tv, p, s);
+                if (r == TM_ECODE_FAILED) {
+                    TmqhOutputPacketpool(tv, p);
+                    TmThreadsSetFlag(tv, THV_FAILED);
+                    break;
+                }
 
-            /* output the packet */
-            tv->tmqh_out(tv, p);
+                /* output the packet */
+                tv->tmqh_out(tv, p);
 
-        } /* if (p != NULL) */
+            } /* if (p != NULL) */
+        }
 
         /* now handle the post_pq packets */
         TmSlot *slot;
@@ -1387,6 +1528,13 @@ ThreadVars *TmThreadCreate(char *name, char *inq_name, char *inqh_name,
         tv->tmqh_in = tmqh->InHandler;
         tv->InShutdownHandler = tmqh->InShutdownHandler;
         SCLogDebug("tv->tmqh_in %p", tv->tmqh_in);
+
+        tv->batch_size = 1;
+        if (tmqh->InHandlerBatch != NULL) {
+            tv->tmqh_in_batch = tmqh->InHandlerBatch;
+            tv->batch_size = threading_batch_size;
+        }
+        SCLogDebug("tv->batch_size %"PRIu16, tv->batch_size);
     }
 
     /* set the outgoing queue */
@@ -1398,6 +1546,7 @@ ThreadVars *TmThreadCreate(char *name, char *inq_name, char *inqh_name,
             goto error;
 
         tv->tmqh_out = tmqh->OutHandler;
+        tv->tmqh_out_batch = tmqh->OutHandlerBatch;
         tv->outqh_name = tmqh->name;
 
         if (outq_name != NULL && strcmp(outq_name, "packetpool") != 0) {
@@ -1406,6 +1555,8 @@ ThreadVars *TmThreadCreate(char *name, char *inq_name, char *inqh_name,
             if (tmqh->OutHandlerCtxSetup != NULL) {
                 tv->outctx = tmqh->OutHandlerCtxSetup(outq_name);
                 tv->outq = NULL;
+                if (tv->outctx != NULL && tmqh->OutHandlerRegisterCounters != NULL)
+                    tmqh->OutHandlerRegisterCounters(tv);
             } else {
                 tmq = TmqGetQueueByName(outq_name);
                 if (tmq == NULL) {
@@ -1617,7 +1768,7 @@ void TmThreadKillThread(ThreadVars *tv)
         if (!(strlen(tv->inq->name) == strlen("packetpool") &&
               strcasecmp(tv->inq->name, "packetpool") == 0)) {
             PacketQueue *q = &trans_q[tv->inq->id];
-            while (q->len != 0) {
+            while (q->len != 0 || TmqhFlowRingsLen(tv->inq->id) != 0) {
                 usleep(1000);
             }
         }
@@ -1722,7 +1873,7 @@ void TmThreadDisableThreadsWithTMS(uint8_t tm_flags)
                 if (!(strlen(tv->inq->name) == strlen("packetpool") &&
                       strcasecmp(tv->inq->name, "packetpool") == 0)) {
                     PacketQueue *q = &trans_q[tv->inq->id];
-                    while (q->len != 0) {
+                    while (q->len != 0 || TmqhFlowRingsLen(tv->inq->id) != 0) {
                         usleep(1000);
                     }
                 }
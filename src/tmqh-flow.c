@@ -25,6 +25,15 @@
  * are sent to the same queue. We support different kind of q handlers.  Have
  * a look at "autofp-scheduler" conf to further undertsand the various q
  * handlers we provide.
+ *
+ * The "flow-lockfree" variant hands the packets over through a single
+ * reader, single writer ring per writer thread and output queue, instead
+ * of through the mutex and condition protected PacketQueue. The reader
+ * polls its rings, takes packets out in batches and backs off to sleeping
+ * when it finds them empty for a while. It requires a single reader per
+ * queue, which is what the autofp runmodes set up. Packets put in the
+ * PacketQueue directly, like the pseudo packets of a rule reload, are taken
+ * out of it as well.
  */
 
 #include "suricata.h"
@@ -33,39 +42,129 @@
 #include "threads.h"
 #include "threadvars.h"
 #include "tmqh-flow.h"
+#include "flow.h"
 
 #include "tm-queuehandlers.h"
 
 #include "conf.h"
+#include "util-atomic.h"
+#include "util-optimize.h"
 #include "util-unittest.h"
 
+/** size of a writer's ring, needs to be a power of 2 */
+#define TMQH_FLOW_RING_SIZE         1024
+/** max writers per queue for "flow-lockfree" */
+#define TMQH_FLOW_RING_MAX_WRITERS  64
+/** max packets the reader takes from a ring at once */
+#define TMQH_FLOW_RING_BATCH        32
+/** times the reader polls empty rings before it starts to sleep */
+#define TMQH_FLOW_RING_SPINS        256
+/** max usecs the reader sleeps before returning to the thread loop */
+#define TMQH_FLOW_RING_MAX_SLEEP    1024
+/** packets between updates of a writer's imbalance counters */
+#define TMQH_FLOW_IMBALANCE_INTERVAL 4096
+
+/** single reader, single writer packet ring. The indexes run freely and
+ *  are masked on access. Only the writer updates "write", only the reader
+ *  updates "read". */
+typedef struct TmqhFlowRing_ {
+    SC_ATOMIC_DECLARE(uint32_t, write);
+    /* keep the indexes on different cache lines */
+    uint8_t pad[64];
+    SC_ATOMIC_DECLARE(uint32_t, read);
+    Packet *array[TMQH_FLOW_RING_SIZE];
+} TmqhFlowRing;
+
+/** reader side of a "flow-lockfree" queue: the rings of all writers and
+ *  the batch of packets the reader is handing out. */
+typedef struct TmqhFlowRingSet_ {
+    TmqhFlowRing *rings[TMQH_FLOW_RING_MAX_WRITERS];
+    SC_ATOMIC_DECLARE(uint16_t, rings_cnt);
+    /** packets in the rings and the batch not yet processed. Kept apart
+     *  from the queue's len, which is updated under the queue lock. */
+    SC_ATOMIC_DECLARE(uint32_t, len);
+    uint8_t shutdown;
+
+    /* only used by the reader */
+    uint16_t next;              /**< ring to look at first */
+    uint16_t batch_idx;
+    uint16_t batch_len;
+    Packet *batch[TMQH_FLOW_RING_BATCH];
+} TmqhFlowRingSet;
+
+/** ring sets, indexed by queue id */
+static TmqhFlowRingSet *flow_ring_sets[256];
+
 Packet *TmqhInputFlow(ThreadVars *t);
+uint16_t TmqhInputFlowBatch(ThreadVars *t, Packet **pkts, uint16_t max);
+void TmqhOutputFlowBatch(ThreadVars *t, Packet **pkts, uint16_t cnt);
 void TmqhOutputFlowHash(ThreadVars *t, Packet *p);
+void TmqhOutputFlowTupleHash(ThreadVars *t, Packet *p);
 void TmqhOutputFlowActivePackets(ThreadVars *t, Packet *p);
 void TmqhOutputFlowRoundRobin(ThreadVars *t, Packet *p);
 void *TmqhOutputFlowSetupCtx(char *queue_str);
 void TmqhOutputFlowFreeCtx(void *ctx);
+void TmqhOutputFlowRegisterCounters(ThreadVars *t);
+Packet *TmqhInputFlowLockFree(ThreadVars *t);
+uint16_t TmqhInputFlowLockFreeBatch(ThreadVars *t, Packet **pkts, uint16_t max);
+void TmqhInputFlowLockFreeShutdownHandler(ThreadVars *t);
+void TmqhOutputFlowLockFreeHash(ThreadVars *t, Packet *p);
+void TmqhOutputFlowLockFreeTupleHash(ThreadVars *t, Packet *p);
+void TmqhOutputFlowLockFreeActivePackets(ThreadVars *t, Packet *p);
+void TmqhOutputFlowLockFreeRoundRobin(ThreadVars *t, Packet *p);
+void *TmqhOutputFlowLockFreeSetupCtx(char *queue_str);
 void TmqhFlowRegisterTests(void);
 
+static inline int32_t TmqhFlowGetQidRoundRobin(TmqhFlowCtx *, Packet *);
+static inline int32_t TmqhFlowGetQidActivePackets(TmqhFlowCtx *, Packet *);
+static inline int32_t TmqhFlowGetQidHash(TmqhFlowCtx *, Packet *);
+static inline int32_t TmqhFlowGetQidTupleHash(TmqhFlowCtx *, Packet *);
+
+/** queue selection of the configured scheduler, used by the batch
+ *  output handler */
+static int32_t (*TmqhFlowGetQid)(TmqhFlowCtx *, Packet *) = TmqhFlowGetQidActivePackets;
+
 void TmqhFlowRegister(void)
 {
     tmqh_table[TMQH_FLOW].name = "flow";
     tmqh_table[TMQH_FLOW].InHandler = TmqhInputFlow;
+    tmqh_table[TMQH_FLOW].InHandlerBatch = TmqhInputFlowBatch;
+    tmqh_table[TMQH_FLOW].OutHandlerBatch = TmqhOutputFlowBatch;
     tmqh_table[TMQH_FLOW].OutHandlerCtxSetup = TmqhOutputFlowSetupCtx;
     tmqh_table[TMQH_FLOW].OutHandlerCtxFree = TmqhOutputFlowFreeCtx;
+    tmqh_table[TMQH_FLOW].OutHandlerRegisterCounters = TmqhOutputFlowRegisterCounters;
     tmqh_table[TMQH_FLOW].RegisterTests = TmqhFlowRegisterTests;
 
+    tmqh_table[TMQH_FLOW_LOCKFREE].name = "flow-lockfree";
+    tmqh_table[TMQH_FLOW_LOCKFREE].InHandler = TmqhInputFlowLockFree;
+    tmqh_table[TMQH_FLOW_LOCKFREE].InHandlerBatch = TmqhInputFlowLockFreeBatch;
+    tmqh_table[TMQH_FLOW_LOCKFREE].InShutdownHandler = TmqhInputFlowLockFreeShutdownHandler;
+    tmqh_table[TMQH_FLOW_LOCKFREE].OutHandlerCtxSetup = TmqhOutputFlowLockFreeSetupCtx;
+    tmqh_table[TMQH_FLOW_LOCKFREE].OutHandlerCtxFree = TmqhOutputFlowFreeCtx;
+    tmqh_table[TMQH_FLOW_LOCKFREE].OutHandlerRegisterCounters = TmqhOutputFlowRegisterCounters;
+
     char *scheduler = NULL;
     if (ConfGet("autofp-scheduler", &scheduler) == 1) {
         if (strcasecmp(scheduler, "round-robin") == 0) {
             SCLogInfo("AutoFP mode using \"Round Robin\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowRoundRobin;
+            tmqh_table[TMQH_FLOW_LOCKFREE].OutHandler = TmqhOutputFlowLockFreeRoundRobin;
+            TmqhFlowGetQid = TmqhFlowGetQidRoundRobin;
         } else if (strcasecmp(scheduler, "active-packets") == 0) {
             SCLogInfo("AutoFP mode using \"Active Packets\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowActivePackets;
+            tmqh_table[TMQH_FLOW_LOCKFREE].OutHandler = TmqhOutputFlowLockFreeActivePackets;
+            TmqhFlowGetQid = TmqhFlowGetQidActivePackets;
         } else if (strcasecmp(scheduler, "hash") == 0) {
             SCLogInfo("AutoFP mode using \"Hash\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowHash;
+            tmqh_table[TMQH_FLOW_LOCKFREE].OutHandler = TmqhOutputFlowLockFreeHash;
+            TmqhFlowGetQid = TmqhFlowGetQidHash;
+        } else if (strcasecmp(scheduler, "flow-hash") == 0) {
+            SCLogInfo("AutoFP mode using \"Flow Hash\" flow load balancer");
+            tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowTupleHash;
+            tmqh_table[TMQH_FLOW_LOCKFREE].OutHandler = TmqhOutputFlowLockFreeTupleHash;
+            TmqhFlowGetQid = TmqhFlowGetQidTupleHash;
         } else {
             SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
                        "for autofp-scheduler in conf.  Killing engine.",
@@ -75,11 +174,33 @@ void TmqhFlowRegister(void)
     } else {
         SCLogInfo("AutoFP mode using default \"Active Packets\" flow load balancer");
         tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowActivePackets;
+        tmqh_table[TMQH_FLOW_LOCKFREE].OutHandler = TmqhOutputFlowLockFreeActivePackets;
+        TmqhFlowGetQid = TmqhFlowGetQidActivePackets;
     }
 
+    memset(flow_ring_sets, 0, sizeof(flow_ring_sets));
     return;
 }
 
+/** \brief free the "flow-lockfree" rings */
+void TmqhFlowDestroy(void)
+{
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        TmqhFlowRingSet *rs = flow_ring_sets[i];
+        if (rs == NULL)
+            continue;
+
+        for (j = 0; j < TMQH_FLOW_RING_MAX_WRITERS; j++) {
+            if (rs->rings[j] != NULL)
+                SCFree(rs->rings[j]);
+        }
+        SCFree(rs);
+        flow_ring_sets[i] = NULL;
+    }
+}
+
 /* same as 'simple' */
 Packet *TmqhInputFlow(ThreadVars *tv)
 {
@@ -104,6 +225,286 @@ Packet *TmqhInputFlow(ThreadVars *tv)
     }
 }
 
+/* same as 'simple' */
+uint16_t TmqhInputFlowBatch(ThreadVars *tv, Packet **pkts, uint16_t max)
+{
+    PacketQueue *q = &trans_q[tv->inq->id];
+    uint16_t cnt = 0;
+
+    SCPerfSyncCountersIfSignalled(tv, 0);
+
+    SCMutexLock(&q->mutex_q);
+    if (q->len == 0) {
+        /* if we have no packets in queue, wait... */
+        SCCondWait(&q->cond_q, &q->mutex_q);
+    }
+
+    while (cnt < max && q->len > 0) {
+        pkts[cnt++] = PacketDequeue(q);
+    }
+
+    SCMutexUnlock(&q->mutex_q);
+    return cnt;
+}
+
+/**
+ * \internal
+ * \brief get the ring of a writer into a queue, creating it if needed
+ *
+ * Rings are kept when the queues are reset, so they are reused when the
+ * threads are set up again, e.g. in unix socket mode.
+ *
+ * \param id queue id
+ * \param writer writer index for the queue
+ *
+ * \retval ring the ring or NULL on error
+ * \initonly
+ */
+static TmqhFlowRing *TmqhFlowRingGet(uint16_t id, uint16_t writer)
+{
+    if (writer >= TMQH_FLOW_RING_MAX_WRITERS) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "more than %d writers for "
+                   "queue %"PRIu16, TMQH_FLOW_RING_MAX_WRITERS, id);
+        return NULL;
+    }
+
+    TmqhFlowRingSet *rs = flow_ring_sets[id];
+    if (rs == NULL) {
+        rs = SCMalloc(sizeof(TmqhFlowRingSet));
+        if (unlikely(rs == NULL))
+            return NULL;
+        memset(rs, 0x00, sizeof(TmqhFlowRingSet));
+        SC_ATOMIC_INIT(rs->rings_cnt);
+        SC_ATOMIC_INIT(rs->len);
+        flow_ring_sets[id] = rs;
+    }
+    rs->shutdown = 0;
+
+    if (rs->rings[writer] == NULL) {
+        TmqhFlowRing *r = SCMalloc(sizeof(TmqhFlowRing));
+        if (unlikely(r == NULL))
+            return NULL;
+        memset(r, 0x00, sizeof(TmqhFlowRing));
+        SC_ATOMIC_INIT(r->write);
+        SC_ATOMIC_INIT(r->read);
+        rs->rings[writer] = r;
+    }
+
+    if (SC_ATOMIC_GET(rs->rings_cnt) <= writer)
+        (void) SC_ATOMIC_SET(rs->rings_cnt, writer + 1);
+
+    return rs->rings[writer];
+}
+
+/**
+ * \brief get the no of packets in the "flow-lockfree" rings of a queue
+ *
+ * The packets in the rings are not counted in the queue's len, so code
+ * waiting for a queue to drain needs to check both.
+ *
+ * \param id queue id
+ *
+ * \retval len no of packets, 0 if the queue has no rings
+ */
+uint32_t TmqhFlowRingsLen(uint16_t id)
+{
+    TmqhFlowRingSet *rs = flow_ring_sets[id];
+    if (rs == NULL)
+        return 0;
+
+    return SC_ATOMIC_GET(rs->len);
+}
+
+/**
+ * \internal
+ * \brief put a packet in a ring
+ *
+ * The ring set's len is kept up to date so the "active-packets" scheduler
+ * and the shutdown code, which waits for the queues to drain, keep working.
+ *
+ * \param q queue the ring feeds
+ * \param r ring
+ * \param p packet
+ */
+static inline void TmqhFlowRingPut(PacketQueue *q, TmqhFlowRing *r, Packet *p)
+{
+    TmqhFlowRingSet *rs = flow_ring_sets[q - trans_q];
+    uint32_t write = SC_ATOMIC_GET(r->write);
+
+    /* ring is full, wait for the reader to catch up */
+    while (write - SC_ATOMIC_GET(r->read) >= TMQH_FLOW_RING_SIZE) {
+        usleep(1);
+    }
+
+    r->array[write & (TMQH_FLOW_RING_SIZE - 1)] = p;
+    (void) SC_ATOMIC_ADD(rs->len, 1);
+    /* full barrier, publishes the packet */
+    (void) SC_ATOMIC_ADD(r->write, 1);
+}
+
+/**
+ * \internal
+ * \brief fill the reader's batch from the rings
+ *
+ * Starts at the ring after the one last read from, so that a busy writer
+ * can't starve the others.
+ *
+ * \param rs ring set
+ *
+ * \retval cnt number of packets in the batch
+ */
+static uint16_t TmqhFlowRingSetFill(TmqhFlowRingSet *rs)
+{
+    uint16_t cnt = SC_ATOMIC_GET(rs->rings_cnt);
+    uint16_t i;
+
+    for (i = 0; i < cnt; i++) {
+        uint16_t idx = (rs->next + i) % cnt;
+        TmqhFlowRing *r = rs->rings[idx];
+
+        uint32_t read = SC_ATOMIC_GET(r->read);
+        uint32_t avail = SC_ATOMIC_GET(r->write) - read;
+        if (avail == 0)
+            continue;
+        if (avail > TMQH_FLOW_RING_BATCH)
+            avail = TMQH_FLOW_RING_BATCH;
+
+        /* don't read the slots before the write index */
+        hw_barrier();
+
+        uint32_t u;
+        for (u = 0; u < avail; u++) {
+            rs->batch[u] = r->array[(read + u) & (TMQH_FLOW_RING_SIZE - 1)];
+        }
+        /* full barrier, hands the slots back to the writer */
+        (void) SC_ATOMIC_ADD(r->read, avail);
+
+        rs->batch_idx = 0;
+        rs->batch_len = (uint16_t)avail;
+        rs->next = (idx + 1) % cnt;
+        return rs->batch_len;
+    }
+
+    return 0;
+}
+
+/**
+ * \internal
+ * \brief get a packet put in the PacketQueue itself
+ *
+ * Other code can hand packets to a thread by putting them in its queue
+ * directly, e.g. the pseudo packets of a rule reload.
+ *
+ * \param q queue
+ *
+ * \retval p packet or NULL if the queue is empty
+ */
+static inline Packet *TmqhFlowQueueGet(PacketQueue *q)
+{
+    Packet *p = NULL;
+
+    if (q->len == 0)
+        return NULL;
+
+    SCMutexLock(&q->mutex_q);
+    p = PacketDequeue(q);
+    SCMutexUnlock(&q->mutex_q);
+    return p;
+}
+
+/**
+ * \brief get a packet from our rings
+ *
+ * Packets are taken out of the rings in batches. If all rings are empty
+ * we poll them for a while, then sleep with an increasing interval. If
+ * that doesn't turn up a packet either, NULL is returned so the thread
+ * can check its flags. Packets in the queue itself are handed out between
+ * the batches.
+ */
+Packet *TmqhInputFlowLockFree(ThreadVars *tv)
+{
+    PacketQueue *q = &trans_q[tv->inq->id];
+    TmqhFlowRingSet *rs = flow_ring_sets[tv->inq->id];
+    uint32_t spins = 0;
+    uint32_t sleep_usec = 1;
+    Packet *p = NULL;
+
+    SCPerfSyncCountersIfSignalled(tv, 0);
+
+    if (unlikely(rs == NULL)) {
+        p = TmqhFlowQueueGet(q);
+        if (p == NULL)
+            usleep(TMQH_FLOW_RING_MAX_SLEEP);
+        return p;
+    }
+
+    if (rs->batch_idx < rs->batch_len)
+        return rs->batch[rs->batch_idx++];
+
+    /* the last batch was handed out and processed */
+    if (rs->batch_len > 0) {
+        (void) SC_ATOMIC_SUB(rs->len, rs->batch_len);
+        rs->batch_len = 0;
+        rs->batch_idx = 0;
+    }
+
+    while (TmqhFlowRingSetFill(rs) == 0) {
+        p = TmqhFlowQueueGet(q);
+        if (p != NULL)
+            return p;
+
+        cc_barrier();
+        if (rs->shutdown != 0)
+            return NULL;
+
+        if (spins < TMQH_FLOW_RING_SPINS) {
+            spins++;
+            continue;
+        }
+        if (sleep_usec > TMQH_FLOW_RING_MAX_SLEEP)
+            return NULL;
+
+        usleep(sleep_usec);
+        sleep_usec <<= 1;
+    }
+
+    return rs->batch[rs->batch_idx++];
+}
+
+/**
+ * \brief get up to max packets from our rings
+ *
+ * Waits for the first packet like TmqhInputFlowLockFree, the rest is
+ * taken from the current batch without waiting.
+ */
+uint16_t TmqhInputFlowLockFreeBatch(ThreadVars *tv, Packet **pkts, uint16_t max)
+{
+    Packet *p = TmqhInputFlowLockFree(tv);
+    if (p == NULL)
+        return 0;
+
+    TmqhFlowRingSet *rs = flow_ring_sets[tv->inq->id];
+    uint16_t cnt = 1;
+
+    pkts[0] = p;
+    while (cnt < max && rs->batch_idx < rs->batch_len) {
+        pkts[cnt++] = rs->batch[rs->batch_idx++];
+    }
+    return cnt;
+}
+
+void TmqhInputFlowLockFreeShutdownHandler(ThreadVars *tv)
+{
+    if (tv == NULL || tv->inq == NULL)
+        return;
+
+    TmqhFlowRingSet *rs = flow_ring_sets[tv->inq->id];
+    if (rs == NULL)
+        return;
+
+    rs->shutdown = 1;
+}
+
 static int StoreQueueId(TmqhFlowCtx *ctx, char *name)
 {
     Tmq *tmq = TmqGetQueueByName(name);
@@ -135,20 +536,25 @@ static int StoreQueueId(TmqhFlowCtx *ctx, char *name)
     SC_ATOMIC_INIT(ctx->queues[ctx->size - 1].total_packets);
     SC_ATOMIC_INIT(ctx->queues[ctx->size - 1].total_flows);
 
+    if (ctx->lockfree) {
+        ctx->queues[ctx->size - 1].ring = TmqhFlowRingGet(id, tmq->writer_cnt - 1);
+        if (ctx->queues[ctx->size - 1].ring == NULL)
+            return -1;
+    }
+
     return 0;
 }
 
 /**
+ * \internal
  * \brief setup the queue handlers ctx
  *
- * Parses a comma separated string "queuename1,queuename2,etc"
- * and sets the ctx up to devide flows over these queue's.
- *
  * \param queue_str comma separated string with output queue names
+ * \param lockfree bool, set up the ctx for "flow-lockfree"
  *
  * \retval ctx queues handlers ctx or NULL in error
  */
-void *TmqhOutputFlowSetupCtx(char *queue_str)
+static void *TmqhOutputFlowSetupCtxReal(char *queue_str, uint8_t lockfree)
 {
     if (queue_str == NULL || strlen(queue_str) == 0)
         return NULL;
@@ -157,6 +563,7 @@ void *TmqhOutputFlowSetupCtx(char *queue_str)
     if (unlikely(ctx == NULL))
         return NULL;
     memset(ctx,0x00,sizeof(TmqhFlowCtx));
+    ctx->lockfree = lockfree;
 
     char *str = SCStrdup(queue_str);
     if (unlikely(str == NULL)) {
@@ -194,6 +601,36 @@ error:
     return NULL;
 }
 
+/**
+ * \brief setup the queue handlers ctx
+ *
+ * Parses a comma separated string "queuename1,queuename2,etc"
+ * and sets the ctx up to devide flows over these queue's.
+ *
+ * \param queue_str comma separated string with output queue names
+ *
+ * \retval ctx queues handlers ctx or NULL in error
+ */
+void *TmqhOutputFlowSetupCtx(char *queue_str)
+{
+    return TmqhOutputFlowSetupCtxReal(queue_str, 0);
+}
+
+/**
+ * \brief setup the "flow-lockfree" queue handlers ctx
+ *
+ * Like TmqhOutputFlowSetupCtx(), but also sets up a ring into each of the
+ * queues for the calling writer.
+ *
+ * \param queue_str comma separated string with output queue names
+ *
+ * \retval ctx queues handlers ctx or NULL in error
+ */
+void *TmqhOutputFlowLockFreeSetupCtx(char *queue_str)
+{
+    return TmqhOutputFlowSetupCtxReal(queue_str, 1);
+}
+
 void TmqhOutputFlowFreeCtx(void *ctx)
 {
     int i;
@@ -215,17 +652,86 @@ void TmqhOutputFlowFreeCtx(void *ctx)
 }
 
 /**
+ * \brief register the imbalance counters of a writer
+ *
+ * "autofp.queueN.imbalance" is how far, in percent, the share of the
+ * writer's packets that went to queue N is off from an even split.
+ *
+ * \param tv writer thread, with its outctx set up
+ */
+void TmqhOutputFlowRegisterCounters(ThreadVars *tv)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    char name[32];
+    uint16_t i;
+
+    for (i = 0; i < ctx->size; i++) {
+        snprintf(name, sizeof(name), "autofp.queue%"PRIu16".imbalance", i);
+        ctx->queues[i].imbalance_id = SCPerfTVRegisterCounter(name, tv,
+                SC_PERF_TYPE_DOUBLE, "NULL");
+    }
+    ctx->tv = tv;
+}
+
+/**
+ * \internal
+ * \brief update the imbalance counters from the per queue packet totals
+ *
+ * \param ctx flow queue handler ctx
+ */
+static void TmqhFlowUpdateImbalance(TmqhFlowCtx *ctx)
+{
+    uint64_t total = 0;
+    uint16_t i;
+
+    if (ctx->tv->sc_perf_pca == NULL)
+        return;
+
+    for (i = 0; i < ctx->size; i++) {
+        total += SC_ATOMIC_GET(ctx->queues[i].total_packets);
+    }
+    if (total == 0)
+        return;
+
+    double avg = (double)total / ctx->size;
+    for (i = 0; i < ctx->size; i++) {
+        double pkts = (double)SC_ATOMIC_GET(ctx->queues[i].total_packets);
+        SCPerfCounterSetDouble(ctx->queues[i].imbalance_id,
+                ctx->tv->sc_perf_pca, (pkts - avg) * 100.0 / avg);
+    }
+}
+
+/**
+ * \internal
+ * \brief account a packet to a queue
+ *
+ * \param ctx flow queue handler ctx
+ * \param qid queue index
+ */
+static inline void TmqhFlowCountPacket(TmqhFlowCtx *ctx, int32_t qid)
+{
+    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+
+    if (ctx->tv != NULL &&
+        ++ctx->imbalance_pkts >= TMQH_FLOW_IMBALANCE_INTERVAL) {
+        ctx->imbalance_pkts = 0;
+        TmqhFlowUpdateImbalance(ctx);
+    }
+}
+
+/**
+ * \internal
  * \brief select the queue to output in a round robin fashion.
  *
- * \param tv thread vars
+ * \param ctx flow queue handler ctx
  * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
+static inline int32_t TmqhFlowGetQidRoundRobin(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -245,29 +751,40 @@ void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
         if (ctx->last == ctx->size)
             ctx->last = 0;
     }
-    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+    TmqhFlowCountPacket(ctx, qid);
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
+    return qid;
+}
 
-    return;
+/**
+ * \internal
+ * \brief get the no of packets waiting in an output queue
+ *
+ * \param ctx flow queue handler ctx
+ * \param i queue index
+ */
+static inline uint32_t TmqhFlowQueueLen(TmqhFlowCtx *ctx, uint16_t i)
+{
+    PacketQueue *q = ctx->queues[i].q;
+
+    if (ctx->lockfree)
+        return q->len + TmqhFlowRingsLen(q - trans_q);
+    return q->len;
 }
 
 /**
+ * \internal
  * \brief select the queue to output to based on queue lengths.
  *
- * \param tv thread vars
+ * \param ctx flow queue handler ctx
  * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
+static inline int32_t TmqhFlowGetQidActivePackets(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -275,11 +792,11 @@ void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
         if (qid == -1) {
             uint16_t i = 0;
             int lowest_id = 0;
-            TmqhFlowMode *queues = ctx->queues;
-            uint32_t lowest = queues[i].q->len;
+            uint32_t lowest = TmqhFlowQueueLen(ctx, i);
             for (i = 1; i < ctx->size; i++) {
-                if (queues[i].q->len < lowest) {
-                    lowest = queues[i].q->len;
+                uint32_t len = TmqhFlowQueueLen(ctx, i);
+                if (len < lowest) {
+                    lowest = len;
                     lowest_id = i;
                 }
             }
@@ -293,29 +810,24 @@ void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
         if (ctx->last == ctx->size)
             ctx->last = 0;
     }
-    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+    TmqhFlowCountPacket(ctx, qid);
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
-
-    return;
+    return qid;
 }
 
 /**
+ * \internal
  * \brief select the queue to output based on address hash.
  *
- * \param tv thread vars.
- * \param p packet.
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+static inline int32_t TmqhFlowGetQidHash(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -340,15 +852,165 @@ void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
         if (ctx->last == ctx->size)
             ctx->last = 0;
     }
-    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+    TmqhFlowCountPacket(ctx, qid);
+
+    return qid;
+}
+
+/**
+ * \internal
+ * \brief select the queue to output to based on the flow's tuple hash.
+ *
+ * The hash is the one of the flow table, so it is the same for both
+ * directions and doesn't depend on where the flow lives in memory.
+ *
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
+ */
+static inline int32_t TmqhFlowGetQidTupleHash(TmqhFlowCtx *ctx, Packet *p)
+{
+    int32_t qid = 0;
+
+    /* if no flow we use the first queue,
+     * should be rare */
+    if (p->flow != NULL) {
+        qid = SC_ATOMIC_GET(p->flow->autofp_tmqh_flow_qid);
+        if (qid == -1) {
+            qid = p->flow->flow_hash % ctx->size;
+            (void) SC_ATOMIC_SET(p->flow->autofp_tmqh_flow_qid, qid);
+            (void) SC_ATOMIC_ADD(ctx->queues[qid].total_flows, 1);
+        }
+    } else {
+        qid = ctx->last++;
 
+        if (ctx->last == ctx->size)
+            ctx->last = 0;
+    }
+    TmqhFlowCountPacket(ctx, qid);
+
+    return qid;
+}
+
+static inline void TmqhFlowEnqueue(TmqhFlowCtx *ctx, int32_t qid, Packet *p)
+{
     PacketQueue *q = ctx->queues[qid].q;
     SCMutexLock(&q->mutex_q);
     PacketEnqueue(q, p);
     SCCondSignal(&q->cond_q);
     SCMutexUnlock(&q->mutex_q);
+}
 
-    return;
+/**
+ * \brief select the queue to output in a round robin fashion.
+ *
+ * \param tv thread vars
+ * \param p packet
+ */
+void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    TmqhFlowEnqueue(ctx, TmqhFlowGetQidRoundRobin(ctx, p), p);
+}
+
+/**
+ * \brief select the queue to output to based on queue lengths.
+ *
+ * \param tv thread vars
+ * \param p packet
+ */
+void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    TmqhFlowEnqueue(ctx, TmqhFlowGetQidActivePackets(ctx, p), p);
+}
+
+/**
+ * \brief select the queue to output based on address hash.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    TmqhFlowEnqueue(ctx, TmqhFlowGetQidHash(ctx, p), p);
+}
+
+/**
+ * \brief select the queue to output based on the flow's tuple hash.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+void TmqhOutputFlowTupleHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    TmqhFlowEnqueue(ctx, TmqhFlowGetQidTupleHash(ctx, p), p);
+}
+
+/**
+ * \brief output a batch of packets to the queues of the configured
+ *        scheduler. Consecutive packets for the same queue are enqueued
+ *        under a single lock.
+ *
+ * \param tv thread vars
+ * \param pkts packets
+ * \param cnt number of packets in pkts
+ */
+void TmqhOutputFlowBatch(ThreadVars *tv, Packet **pkts, uint16_t cnt)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    uint16_t i = 0;
+
+    if (cnt == 0)
+        return;
+
+    int32_t qid = TmqhFlowGetQid(ctx, pkts[0]);
+    while (i < cnt) {
+        PacketQueue *q = ctx->queues[qid].q;
+        int32_t next_qid = qid;
+
+        SCMutexLock(&q->mutex_q);
+        do {
+            PacketEnqueue(q, pkts[i++]);
+            if (i < cnt)
+                next_qid = TmqhFlowGetQid(ctx, pkts[i]);
+        } while (i < cnt && next_qid == qid);
+        SCCondSignal(&q->cond_q);
+        SCMutexUnlock(&q->mutex_q);
+
+        qid = next_qid;
+    }
+}
+
+void TmqhOutputFlowLockFreeRoundRobin(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidRoundRobin(ctx, p);
+    TmqhFlowRingPut(ctx->queues[qid].q, ctx->queues[qid].ring, p);
+}
+
+void TmqhOutputFlowLockFreeActivePackets(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidActivePackets(ctx, p);
+    TmqhFlowRingPut(ctx->queues[qid].q, ctx->queues[qid].ring, p);
+}
+
+void TmqhOutputFlowLockFreeHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidHash(ctx, p);
+    TmqhFlowRingPut(ctx->queues[qid].q, ctx->queues[qid].ring, p);
+}
+
+void TmqhOutputFlowLockFreeTupleHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidTupleHash(ctx, p);
+    TmqhFlowRingPut(ctx->queues[qid].q, ctx->queues[qid].ring, p);
 }
 
 #ifdef UNITTESTS
@@ -489,6 +1151,245 @@ end:
     return retval;
 }
 
+/**
+ * \test pass packets through the "flow-lockfree" rings
+ */
+static int TmqhFlowLockFreeTest01(void)
+{
+    int retval = 0;
+    TmqhFlowCtx *fctx = NULL;
+    Packet *p = NULL;
+    ThreadVars tv_out, tv_in;
+    int i;
+
+    memset(&tv_out, 0, sizeof(tv_out));
+    memset(&tv_in, 0, sizeof(tv_in));
+
+    TmqResetQueues();
+
+    p = SCCalloc(4, sizeof(Packet));
+    if (p == NULL)
+        goto end;
+
+    fctx = TmqhOutputFlowLockFreeSetupCtx("queue1,queue2");
+    if (fctx == NULL)
+        goto end;
+    if (fctx->size != 2 || fctx->queues[0].ring == NULL ||
+        fctx->queues[1].ring == NULL)
+        goto end;
+
+    tv_out.outctx = fctx;
+    tv_in.inq = TmqGetQueueByName("queue1");
+    if (tv_in.inq == NULL)
+        goto end;
+    uint16_t id = tv_in.inq->id;
+    uint32_t len = TmqhFlowRingsLen(id);
+
+    /* no flow, so the packets alternate between the queues */
+    for (i = 0; i < 4; i++) {
+        TmqhOutputFlowLockFreeRoundRobin(&tv_out, &p[i]);
+    }
+
+    if (TmqhFlowRingsLen(id) != len + 2) {
+        printf("rings len %u, expected %u: ", TmqhFlowRingsLen(id), len + 2);
+        goto end;
+    }
+
+    if (TmqhInputFlowLockFree(&tv_in) != &p[0]) {
+        printf("expected first packet: ");
+        goto end;
+    }
+    if (TmqhInputFlowLockFree(&tv_in) != &p[2]) {
+        printf("expected third packet: ");
+        goto end;
+    }
+    /* queue1 is empty now */
+    if (TmqhInputFlowLockFree(&tv_in) != NULL) {
+        printf("expected no packet: ");
+        goto end;
+    }
+    if (TmqhFlowRingsLen(id) != len) {
+        printf("rings len %u, expected %u: ", TmqhFlowRingsLen(id), len);
+        goto end;
+    }
+
+    /* drain queue2 */
+    tv_in.inq = TmqGetQueueByName("queue2");
+    if (tv_in.inq == NULL)
+        goto end;
+    if (TmqhInputFlowLockFree(&tv_in) != &p[1] ||
+        TmqhInputFlowLockFree(&tv_in) != &p[3] ||
+        TmqhInputFlowLockFree(&tv_in) != NULL) {
+        printf("unexpected packets from queue2: ");
+        goto end;
+    }
+
+    /* a packet put in the queue itself, like a rule reload does */
+    PacketQueue *q = &trans_q[tv_in.inq->id];
+    SCMutexLock(&q->mutex_q);
+    PacketEnqueue(q, &p[0]);
+    SCMutexUnlock(&q->mutex_q);
+    if (TmqhInputFlowLockFree(&tv_in) != &p[0]) {
+        printf("expected injected packet: ");
+        goto end;
+    }
+    if (q->len != 0 || TmqhFlowRingsLen(tv_in.inq->id) != 0) {
+        printf("queue len %u, rings len %u, expected 0: ", q->len,
+                TmqhFlowRingsLen(tv_in.inq->id));
+        goto end;
+    }
+
+    retval = 1;
+end:
+    if (fctx != NULL) {
+        TmqhOutputFlowFreeCtx(fctx);
+        SCFree(fctx);
+    }
+    if (p != NULL)
+        SCFree(p);
+    TmqResetQueues();
+    return retval;
+}
+
+static int TmqhFlowBatchTest01(void)
+{
+    int retval = 0;
+    TmqhFlowCtx *fctx = NULL;
+    Packet *p = NULL;
+    Packet *pkts[8];
+    ThreadVars tv_out, tv_in;
+    int i;
+
+    memset(&tv_out, 0, sizeof(tv_out));
+    memset(&tv_in, 0, sizeof(tv_in));
+
+    TmqResetQueues();
+
+    p = SCCalloc(4, sizeof(Packet));
+    if (p == NULL)
+        goto end;
+
+    fctx = TmqhOutputFlowSetupCtx("queue1,queue2");
+    if (fctx == NULL || fctx->size != 2)
+        goto end;
+
+    tv_out.outctx = fctx;
+    for (i = 0; i < 4; i++)
+        pkts[i] = &p[i];
+
+    /* no flow, so the packets alternate between the queues */
+    TmqhOutputFlowBatch(&tv_out, pkts, 4);
+
+    tv_in.inq = TmqGetQueueByName("queue1");
+    if (tv_in.inq == NULL)
+        goto end;
+    if (TmqhInputFlowBatch(&tv_in, pkts, 8) != 2 ||
+        pkts[0] != &p[0] || pkts[1] != &p[2]) {
+        printf("unexpected packets from queue1: ");
+        goto end;
+    }
+
+    /* max is respected */
+    tv_in.inq = TmqGetQueueByName("queue2");
+    if (tv_in.inq == NULL)
+        goto end;
+    if (TmqhInputFlowBatch(&tv_in, pkts, 1) != 1 || pkts[0] != &p[1] ||
+        TmqhInputFlowBatch(&tv_in, pkts, 1) != 1 || pkts[0] != &p[3]) {
+        printf("unexpected packets from queue2: ");
+        goto end;
+    }
+    if (trans_q[tv_in.inq->id].len != 0) {
+        printf("queue2 not empty: ");
+        goto end;
+    }
+
+    retval = 1;
+end:
+    if (fctx != NULL) {
+        TmqhOutputFlowFreeCtx(fctx);
+        SCFree(fctx);
+    }
+    if (p != NULL)
+        SCFree(p);
+    TmqResetQueues();
+    return retval;
+}
+
+/**
+ * \test "flow-hash" picks the queue from the flow's hash and the
+ *       imbalance counters follow the packet distribution
+ */
+static int TmqhFlowTupleHashTest01(void)
+{
+    int retval = 0;
+    TmqhFlowCtx *fctx = NULL;
+    ThreadVars tv_out;
+    Packet p;
+    Flow f[2];
+    int i;
+
+    memset(&tv_out, 0, sizeof(tv_out));
+    memset(&p, 0, sizeof(p));
+    memset(&f, 0, sizeof(f));
+
+    TmqResetQueues();
+
+    for (i = 0; i < 2; i++) {
+        SC_ATOMIC_INIT(f[i].autofp_tmqh_flow_qid);
+        (void) SC_ATOMIC_SET(f[i].autofp_tmqh_flow_qid, -1);
+    }
+    f[0].flow_hash = 0x10;
+    f[1].flow_hash = 0x21;
+
+    fctx = TmqhOutputFlowSetupCtx("queue1,queue2");
+    if (fctx == NULL || fctx->size != 2)
+        goto end;
+
+    tv_out.name = "TmqhFlowTest";
+    tv_out.outctx = fctx;
+    TmqhOutputFlowRegisterCounters(&tv_out);
+    tv_out.sc_perf_pca = SCPerfGetAllCountersArray(&tv_out.sc_perf_pctx);
+    if (tv_out.sc_perf_pca == NULL)
+        goto end;
+
+    /* 3 packets of the first flow for every packet of the second */
+    for (i = 0; i < TMQH_FLOW_IMBALANCE_INTERVAL; i++) {
+        p.flow = (i % 4 == 3) ? &f[1] : &f[0];
+        int32_t qid = TmqhFlowGetQidTupleHash(fctx, &p);
+        if (qid != (int32_t)(p.flow->flow_hash % 2)) {
+            printf("packet %d to queue %d: ", i, qid);
+            goto end;
+        }
+    }
+
+    if (SC_ATOMIC_GET(fctx->queues[0].total_flows) != 1 ||
+        SC_ATOMIC_GET(fctx->queues[1].total_flows) != 1) {
+        printf("expected a flow per queue: ");
+        goto end;
+    }
+
+    double q0 = SCPerfGetLocalCounterValue(fctx->queues[0].imbalance_id,
+                                           tv_out.sc_perf_pca);
+    double q1 = SCPerfGetLocalCounterValue(fctx->queues[1].imbalance_id,
+                                           tv_out.sc_perf_pca);
+    if (q0 != 50.0 || q1 != -50.0) {
+        printf("imbalance %f %f, expected 50 -50: ", q0, q1);
+        goto end;
+    }
+
+    retval = 1;
+end:
+    if (tv_out.sc_perf_pca != NULL)
+        SCPerfReleasePCA(tv_out.sc_perf_pca);
+    SCPerfReleasePerfCounterS(tv_out.sc_perf_pctx.head);
+    if (fctx != NULL) {
+        TmqhOutputFlowFreeCtx(fctx);
+        SCFree(fctx);
+    }
+    TmqResetQueues();
+    return retval;
+}
+
 #endif /* UNITTESTS */
 
 void TmqhFlowRegisterTests(void)
@@ -497,6 +1398,9 @@ void TmqhFlowRegisterTests(void)
     UtRegisterTest("TmqhOutputFlowSetupCtxTest01", TmqhOutputFlowSetupCtxTest01, 1);
     UtRegisterTest("TmqhOutputFlowSetupCtxTest02", TmqhOutputFlowSetupCtxTest02, 1);
     UtRegisterTest("TmqhOutputFlowSetupCtxTest03", TmqhOutputFlowSetupCtxTest03, 1);
+    UtRegisterTest("TmqhFlowLockFreeTest01", TmqhFlowLockFreeTest01, 1);
+    UtRegisterTest("TmqhFlowBatchTest01", TmqhFlowBatchTest01, 1);
+    UtRegisterTest("TmqhFlowTupleHashTest01", TmqhFlowTupleHashTest01, 1);
 #endif
 
     return;
@@ -24,11 +24,18 @@
 #ifndef __TMQH_FLOW_H__
 #define __TMQH_FLOW_H__
 
+struct TmqhFlowRing_;
+
 typedef struct TmqhFlowMode_ {
     PacketQueue *q;
+    /** our ring into the queue, "flow-lockfree" only */
+    struct TmqhFlowRing_ *ring;
 
     SC_ATOMIC_DECLARE(uint64_t, total_packets);
     SC_ATOMIC_DECLARE(uint64_t, total_flows);
+
+    /** id of the "autofp.queueN.imbalance" counter */
+    uint16_t imbalance_id;
 } TmqhFlowMode;
 
 /** \brief Ctx for the flow queue handler
@@ -37,13 +44,22 @@ typedef struct TmqhFlowMode_ {
 typedef struct TmqhFlowCtx_ {
     uint16_t size;
     uint16_t last;
+    /** ctx is used by "flow-lockfree" */
+    uint8_t lockfree;
 
     TmqhFlowMode *queues;
 
     SC_ATOMIC_DECLARE(uint16_t, round_robin_idx);
+
+    /** writer thread, set once the imbalance counters are registered */
+    ThreadVars *tv;
+    /** packets since the imbalance counters were last updated */
+    uint32_t imbalance_pkts;
 } TmqhFlowCtx;
 
 void TmqhFlowRegister (void);
 void TmqhFlowRegisterTests(void);
+uint32_t TmqhFlowRingsLen(uint16_t);
+void TmqhFlowDestroy(void);
 
 #endif /* __TMQH_FLOW_H__ */
@@ -26,6 +26,12 @@
  * because every thread can return packets to the pool and multiple parts
  * of the code retrieve packets (Decode, Defrag) and these can run in their
  * own threads as well.
+ *
+ * To keep threads from hitting the ringbuffer for every packet, each thread
+ * has a packet cache in front of it. The cache is refilled from and
+ * overflows into the ringbuffer in bulk. Packets returned by a thread other
+ * than the one that got them from the pool are pushed on the owner's
+ * return stack, which the owner takes over when its cache runs empty.
  */
 
 #include "suricata.h"
@@ -52,8 +58,56 @@
 #include "util-debug.h"
 #include "util-error.h"
 #include "util-profiling.h"
+#include "util-atomic.h"
+#include "util-unittest.h"
+
+#include "counters.h"
+
+/** max number of packets moved between a cache and the ringbuffer at once */
+#define PKT_POOL_CACHE_BULK_MAX 32
+
+/** per thread packet cache */
+typedef struct PktPoolCache_ {
+    /** free packets, linked through Packet::next. Only touched by
+     *  the owning thread. */
+    Packet *head;
+    uint32_t cnt;
+
+    /** set when the owning thread is gone */
+    SC_ATOMIC_DECLARE(int, dead);
+
+    /** packets returned by other threads, linked through Packet::next */
+    SC_ATOMIC_DECLARE(Packet *, return_stack);
+
+    /** perf counters, only registered for threads that register them */
+    ThreadVars *tv;
+    uint16_t counter_hit;
+    uint16_t counter_miss;
+
+    /** list of all caches */
+    struct PktPoolCache_ *next;
+} PktPoolCache;
 
 static RingBuffer16 *ringbuffer = NULL;
+
+/** number of packets moved between a cache and the ringbuffer at once,
+ *  and the number of packets a cache holds before it overflows */
+static uint16_t pkt_pool_cache_bulk = PKT_POOL_CACHE_BULK_MAX;
+static uint32_t pkt_pool_cache_max = 2 * PKT_POOL_CACHE_BULK_MAX;
+
+/** all caches, so we can clean them up at shutdown */
+static PktPoolCache *pkt_pool_caches = NULL;
+static SCMutex pkt_pool_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** key used to flush a cache when its thread exits */
+static pthread_key_t pkt_pool_cache_key;
+
+#ifdef TLS
+static __thread PktPoolCache *pkt_pool_cache = NULL;
+#endif
+
+static void PktPoolCacheThreadExit(void *data);
+
 /**
  * \brief TmqhPacketpoolRegister
  * \initonly
@@ -68,6 +122,212 @@ void TmqhPacketpoolRegister (void) {
         SCLogError(SC_ERR_FATAL, "Error registering Packet pool handler (at ring buffer init)");
         exit(EXIT_FAILURE);
     }
+
+    if (pthread_key_create(&pkt_pool_cache_key, PktPoolCacheThreadExit) != 0) {
+        SCLogError(SC_ERR_FATAL, "Error registering Packet pool handler (at cache key init)");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * \internal
+ * \brief put a list of packets linked through Packet::next in the
+ *        ringbuffer.
+ */
+static void PktPoolPutList(Packet *p)
+{
+    Packet *pkts[PKT_POOL_CACHE_BULK_MAX];
+    uint16_t cnt = 0;
+
+    while (p != NULL) {
+        pkts[cnt++] = p;
+        p = p->next;
+        pkts[cnt - 1]->next = NULL;
+
+        if (cnt == PKT_POOL_CACHE_BULK_MAX || p == NULL) {
+            RingBufferMrMwPutBulk(ringbuffer, (void **)pkts, cnt);
+            cnt = 0;
+        }
+    }
+}
+
+/**
+ * \internal
+ * \brief atomically take all packets from a cache's return stack
+ *
+ * \retval head list of packets, NULL if the stack was empty
+ */
+static inline Packet *PktPoolCacheTakeReturnStack(PktPoolCache *c)
+{
+    Packet *head;
+
+    do {
+        head = SC_ATOMIC_GET(c->return_stack);
+        if (head == NULL)
+            return NULL;
+    } while (!(SC_ATOMIC_CAS(&c->return_stack, head, NULL)));
+
+    return head;
+}
+
+/**
+ * \internal
+ * \brief called by pthread on thread exit: hand the cached packets
+ *        back to the ringbuffer and mark the cache dead, so that packets
+ *        returned to it later go to the ringbuffer as well.
+ */
+static void PktPoolCacheThreadExit(void *data)
+{
+    PktPoolCache *c = (PktPoolCache *)data;
+    if (c == NULL)
+        return;
+
+    (void)SC_ATOMIC_SET(c->dead, 1);
+
+    PktPoolPutList(c->head);
+    c->head = NULL;
+    c->cnt = 0;
+    c->tv = NULL;
+
+    PktPoolPutList(PktPoolCacheTakeReturnStack(c));
+}
+
+/**
+ * \internal
+ * \brief get the calling thread's cache, setting it up on first use
+ *
+ * \retval c cache or NULL if we're out of memory
+ */
+static inline PktPoolCache *PktPoolCacheGet(void)
+{
+#ifdef TLS
+    PktPoolCache *c = pkt_pool_cache;
+#else
+    PktPoolCache *c = (PktPoolCache *)pthread_getspecific(pkt_pool_cache_key);
+#endif
+    if (likely(c != NULL))
+        return c;
+
+    c = SCMalloc(sizeof(PktPoolCache));
+    if (unlikely(c == NULL))
+        return NULL;
+    memset(c, 0, sizeof(PktPoolCache));
+    SC_ATOMIC_INIT(c->dead);
+    SC_ATOMIC_INIT(c->return_stack);
+
+    if (pthread_setspecific(pkt_pool_cache_key, c) != 0) {
+        SCFree(c);
+        return NULL;
+    }
+#ifdef TLS
+    pkt_pool_cache = c;
+#endif
+
+    SCMutexLock(&pkt_pool_caches_lock);
+    c->next = pkt_pool_caches;
+    pkt_pool_caches = c;
+    SCMutexUnlock(&pkt_pool_caches_lock);
+    return c;
+}
+
+/**
+ * \internal
+ * \brief refill an empty cache from the return stack or, if that is
+ *        empty too, from the ringbuffer.
+ */
+static void PktPoolCacheRefill(PktPoolCache *c)
+{
+    Packet *head = PktPoolCacheTakeReturnStack(c);
+    if (head != NULL) {
+        Packet *p;
+        for (p = head; p->next != NULL; p = p->next)
+            c->cnt++;
+        c->cnt++;
+        p->next = c->head;
+        c->head = head;
+        return;
+    }
+
+    Packet *pkts[PKT_POOL_CACHE_BULK_MAX];
+    uint16_t cnt = RingBufferMrMwGetBulkNoWait(ringbuffer, (void **)pkts,
+                                               pkt_pool_cache_bulk);
+    uint16_t i;
+    for (i = 0; i < cnt; i++) {
+        pkts[i]->next = c->head;
+        c->head = pkts[i];
+    }
+    c->cnt += cnt;
+}
+
+/**
+ * \internal
+ * \brief return a packet to the pool
+ *
+ * Packets go back to the cache of the thread that got them from the pool.
+ * If that is us, they're simply added to our cache, otherwise they're
+ * pushed on the owner's return stack.
+ */
+static void PacketPoolReturnPacket(Packet *p)
+{
+    PktPoolCache *owner = p->pool;
+    PktPoolCache *c = PktPoolCacheGet();
+
+    p->pool = NULL;
+
+    if (owner == NULL || owner == c) {
+        if (unlikely(c == NULL)) {
+            RingBufferMrMwPut(ringbuffer, (void *)p);
+            return;
+        }
+
+        p->next = c->head;
+        c->head = p;
+        c->cnt++;
+
+        /* overflow: hand a bulk of packets back to the ringbuffer */
+        if (c->cnt > pkt_pool_cache_max) {
+            Packet *pkts[PKT_POOL_CACHE_BULK_MAX];
+            uint16_t i;
+            for (i = 0; i < pkt_pool_cache_bulk; i++) {
+                pkts[i] = c->head;
+                c->head = c->head->next;
+                pkts[i]->next = NULL;
+            }
+            c->cnt -= pkt_pool_cache_bulk;
+            RingBufferMrMwPutBulk(ringbuffer, (void **)pkts, pkt_pool_cache_bulk);
+        }
+        return;
+    }
+
+    Packet *head;
+    do {
+        head = SC_ATOMIC_GET(owner->return_stack);
+        p->next = head;
+    } while (!(SC_ATOMIC_CAS(&owner->return_stack, head, p)));
+
+    /* the owner may have exited before or while we pushed: it won't take
+     * the stack anymore, so we have to. */
+    if (unlikely(SC_ATOMIC_GET(owner->dead) != 0)) {
+        PktPoolPutList(PktPoolCacheTakeReturnStack(owner));
+    }
+}
+
+/**
+ * \brief register the cache hit/miss counters for the calling thread
+ *
+ * \param tv thread vars of the calling thread
+ */
+void PacketPoolRegisterPerfCounters(ThreadVars *tv)
+{
+    PktPoolCache *c = PktPoolCacheGet();
+    if (c == NULL)
+        return;
+
+    c->counter_hit = SCPerfTVRegisterCounter("packetpool.cache_hit", tv,
+                                             SC_PERF_TYPE_UINT64, "NULL");
+    c->counter_miss = SCPerfTVRegisterCounter("packetpool.cache_miss", tv,
+                                              SC_PERF_TYPE_UINT64, "NULL");
+    c->tv = tv;
 }
 
 void TmqhPacketpoolDestroy (void) {
@@ -76,14 +336,29 @@ void TmqhPacketpoolDestroy (void) {
 }
 
 int PacketPoolIsEmpty(void) {
-    return RingBufferIsEmpty(ringbuffer);
+    return (PacketPoolSize() == 0);
 }
 
+/** \brief number of packets available to the calling thread: its own
+ *         cache plus the shared ringbuffer */
 uint16_t PacketPoolSize(void) {
-    return RingBufferSize(ringbuffer);
+    uint32_t size = RingBufferSize(ringbuffer);
+
+    PktPoolCache *c = PktPoolCacheGet();
+    if (c != NULL) {
+        if (c->head == NULL && SC_ATOMIC_GET(c->return_stack) != NULL)
+            PktPoolCacheRefill(c);
+        size += c->cnt;
+    }
+
+    return (size > UINT16_MAX) ? UINT16_MAX : (uint16_t)size;
 }
 
 void PacketPoolWait(void) {
+    PktPoolCache *c = PktPoolCacheGet();
+    if (c != NULL && (c->head != NULL || SC_ATOMIC_GET(c->return_stack) != NULL))
+        return;
+
     RingBufferWait(ringbuffer);
 }
 
@@ -104,10 +379,31 @@ void PacketPoolStorePacket(Packet *p) {
  *         pool is empty, don't wait, just return NULL
  */
 Packet *PacketPoolGetPacket(void) {
-    if (RingBufferIsEmpty(ringbuffer))
-        return NULL;
+    PktPoolCache *c = PktPoolCacheGet();
+    if (unlikely(c == NULL)) {
+        if (RingBufferIsEmpty(ringbuffer))
+            return NULL;
+        return RingBufferMrMwGetNoWait(ringbuffer);
+    }
+
+    if (likely(c->head != NULL)) {
+        if (c->tv != NULL)
+            SCPerfCounterIncr(c->counter_hit, c->tv->sc_perf_pca);
+    } else {
+        if (c->tv != NULL)
+            SCPerfCounterIncr(c->counter_miss, c->tv->sc_perf_pca);
 
-    Packet *p = RingBufferMrMwGetNoWait(ringbuffer);
+        PktPoolCacheRefill(c);
+        if (c->head == NULL)
+            return NULL;
+    }
+
+    Packet *p = c->head;
+    c->head = p->next;
+    c->cnt--;
+
+    p->next = NULL;
+    p->pool = c;
     return p;
 }
 
@@ -128,6 +424,33 @@ void PacketPoolInit(intmax_t max_pending_packets) {
     }
     SCLogInfo("preallocated %"PRIiMAX" packets. Total memory %"PRIuMAX"",
             max_pending_packets, (uintmax_t)(max_pending_packets*SIZE_OF_PACKET));
+
+    /* keep the per thread caches small compared to the pool, so that
+     * packets sitting in the caches of idle threads don't starve the
+     * others */
+    if (max_pending_packets / 64 > PKT_POOL_CACHE_BULK_MAX)
+        pkt_pool_cache_bulk = PKT_POOL_CACHE_BULK_MAX;
+    else if (max_pending_packets / 64 > 0)
+        pkt_pool_cache_bulk = (uint16_t)(max_pending_packets / 64);
+    else
+        pkt_pool_cache_bulk = 1;
+    pkt_pool_cache_max = 2 * pkt_pool_cache_bulk;
+    SCLogDebug("packet pool cache bulk %"PRIu16", max %"PRIu32,
+            pkt_pool_cache_bulk, pkt_pool_cache_max);
+}
+
+/**
+ * \internal
+ * \brief free a list of packets linked through Packet::next
+ */
+static void PktPoolFreeList(Packet *p)
+{
+    while (p != NULL) {
+        Packet *next = p->next;
+        PACKET_CLEANUP(p);
+        SCFree(p);
+        p = next;
+    }
 }
 
 void PacketPoolDestroy(void) {
@@ -135,8 +458,25 @@ void PacketPoolDestroy(void) {
         return;
     }
 
+    SCMutexLock(&pkt_pool_caches_lock);
+    while (pkt_pool_caches != NULL) {
+        PktPoolCache *c = pkt_pool_caches;
+        pkt_pool_caches = c->next;
+
+        PktPoolFreeList(c->head);
+        PktPoolFreeList(PktPoolCacheTakeReturnStack(c));
+        SCFree(c);
+    }
+    SCMutexUnlock(&pkt_pool_caches_lock);
+
+    /* our own cache was freed above */
+    (void)pthread_setspecific(pkt_pool_cache_key, NULL);
+#ifdef TLS
+    pkt_pool_cache = NULL;
+#endif
+
     Packet *p = NULL;
-    while ((p = PacketPoolGetPacket()) != NULL) {
+    while ((p = RingBufferMrMwGetNoWait(ringbuffer)) != NULL) {
         PACKET_CLEANUP(p);
         SCFree(p);
     }
@@ -150,7 +490,9 @@ Packet *TmqhInputPacketpool(ThreadVars *t)
     Packet *p = NULL;
 
     while (p == NULL && ringbuffer->shutdown == FALSE) {
-        p = RingBufferMrMwGet(ringbuffer);
+        p = PacketPoolGetPacket();
+        if (p == NULL)
+            RingBufferWait(ringbuffer);
     }
 
     /* packet is clean */
@@ -270,7 +612,7 @@ void TmqhOutputPacketpool(ThreadVars *t, Packet *p)
             p->root = NULL;
         } else {
             PACKET_RECYCLE(p->root);
-            RingBufferMrMwPut(ringbuffer, (void *)p->root);
+            PacketPoolReturnPacket(p->root);
         }
 
     }
@@ -297,7 +639,7 @@ void TmqhOutputPacketpool(ThreadVars *t, Packet *p)
         SCFree(p);
     } else {
         PACKET_RECYCLE(p);
-        RingBufferMrMwPut(ringbuffer, (void *)p);
+        PacketPoolReturnPacket(p);
     }
 
     SCReturn;
@@ -325,3 +667,50 @@ void TmqhReleasePacketsToPacketPool(PacketQueue *pq)
 
     return;
 }
+
+#ifdef UNITTESTS
+/** \test packets returned by another thread go on the owner's return
+ *        stack and are picked up by the owner when its cache is empty */
+static int PacketPoolCacheTest01(void)
+{
+    int result = 0;
+    PktPoolCache owner;
+    Packet *p = SCMalloc(SIZE_OF_PACKET);
+    if (unlikely(p == NULL))
+        return 0;
+    PACKET_INITIALIZE(p);
+
+    memset(&owner, 0, sizeof(owner));
+    SC_ATOMIC_INIT(owner.dead);
+    SC_ATOMIC_INIT(owner.return_stack);
+
+    /* we're not the owner */
+    p->pool = &owner;
+    PacketPoolReturnPacket(p);
+
+    if (SC_ATOMIC_GET(owner.return_stack) != p || p->pool != NULL) {
+        printf("packet not on the owner's return stack: ");
+        goto end;
+    }
+
+    PktPoolCacheRefill(&owner);
+    if (owner.head != p || owner.cnt != 1 ||
+        SC_ATOMIC_GET(owner.return_stack) != NULL) {
+        printf("owner didn't take over the return stack: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    PACKET_CLEANUP(p);
+    SCFree(p);
+    return result;
+}
+#endif /* UNITTESTS */
+
+void TmqhPacketpoolRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PacketPoolCacheTest01", PacketPoolCacheTest01, 1);
+#endif /* UNITTESTS */
+}
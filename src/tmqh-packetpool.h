@@ -33,6 +33,8 @@ Packet *PacketPoolGetPacket(void);
 uint16_t PacketPoolSize(void);
 void PacketPoolStorePacket(Packet *);
 void PacketPoolWait(void);
+void PacketPoolRegisterPerfCounters(ThreadVars *);
+void TmqhPacketpoolRegisterTests(void);
 
 void PacketPoolInit(intmax_t max_pending_packets);
 void PacketPoolDestroy(void);
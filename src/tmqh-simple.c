@@ -32,14 +32,18 @@
 #include "tm-queuehandlers.h"
 
 Packet *TmqhInputSimple(ThreadVars *t);
+uint16_t TmqhInputSimpleBatch(ThreadVars *t, Packet **pkts, uint16_t max);
 void TmqhOutputSimple(ThreadVars *t, Packet *p);
+void TmqhOutputSimpleBatch(ThreadVars *t, Packet **pkts, uint16_t cnt);
 void TmqhInputSimpleShutdownHandler(ThreadVars *);
 
 void TmqhSimpleRegister (void) {
     tmqh_table[TMQH_SIMPLE].name = "simple";
     tmqh_table[TMQH_SIMPLE].InHandler = TmqhInputSimple;
+    tmqh_table[TMQH_SIMPLE].InHandlerBatch = TmqhInputSimpleBatch;
     tmqh_table[TMQH_SIMPLE].InShutdownHandler = TmqhInputSimpleShutdownHandler;
     tmqh_table[TMQH_SIMPLE].OutHandler = TmqhOutputSimple;
+    tmqh_table[TMQH_SIMPLE].OutHandlerBatch = TmqhOutputSimpleBatch;
 }
 
 Packet *TmqhInputSimple(ThreadVars *t)
@@ -66,6 +70,33 @@ Packet *TmqhInputSimple(ThreadVars *t)
     }
 }
 
+/**
+ * \brief get up to max packets from the queue, taking the lock only once.
+ *
+ * \retval cnt number of packets in pkts, 0 if the queue was empty
+ */
+uint16_t TmqhInputSimpleBatch(ThreadVars *t, Packet **pkts, uint16_t max)
+{
+    PacketQueue *q = &trans_q[t->inq->id];
+    uint16_t cnt = 0;
+
+    SCPerfSyncCountersIfSignalled(t, 0);
+
+    SCMutexLock(&q->mutex_q);
+
+    if (q->len == 0) {
+        /* if we have no packets in queue, wait... */
+        SCCondWait(&q->cond_q, &q->mutex_q);
+    }
+
+    while (cnt < max && q->len > 0) {
+        pkts[cnt++] = PacketDequeue(q);
+    }
+
+    SCMutexUnlock(&q->mutex_q);
+    return cnt;
+}
+
 void TmqhInputSimpleShutdownHandler(ThreadVars *tv) {
     int i;
 
@@ -89,6 +120,22 @@ void TmqhOutputSimple(ThreadVars *t, Packet *p)
     SCMutexUnlock(&q->mutex_q);
 }
 
+/**
+ * \brief enqueue cnt packets, taking the lock only once.
+ */
+void TmqhOutputSimpleBatch(ThreadVars *t, Packet **pkts, uint16_t cnt)
+{
+    PacketQueue *q = &trans_q[t->outq->id];
+    uint16_t i;
+
+    SCMutexLock(&q->mutex_q);
+    for (i = 0; i < cnt; i++) {
+        PacketEnqueue(q, pkts[i]);
+    }
+    SCCondSignal(&q->cond_q);
+    SCMutexUnlock(&q->mutex_q);
+}
+
 /*******************************Generic-Q-Handlers*****************************/
 
 /**
@@ -811,6 +811,23 @@ TmEcode UnixManagerRegisterBackgroundTask(
 
 
 
+/**
+ * \brief Close the command socket and the client connections
+ *
+ * Used by forked processes that must not keep the sockets of the
+ * unix manager open.
+ */
+void UnixManagerCloseSockets(void)
+{
+    UnixClient *item;
+
+    TAILQ_FOREACH(item, &(&command)->clients, next) {
+        close(item->fd);
+    }
+    if (command.socket != -1)
+        close(command.socket);
+}
+
 void *UnixManagerThread(void *td)
 {
     ThreadVars *th_v = (ThreadVars *)td;
@@ -44,6 +44,7 @@ TmEcode UnixManagerRegisterCommand(const char * keyword,
 TmEcode UnixManagerRegisterBackgroundTask(
         TmEcode (*Func)(void *),
         void *data);
+void UnixManagerCloseSockets(void);
 #endif
 
 #endif /* UNIX_MANAGER_H */
@@ -0,0 +1,70 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Newline scanners.
+ */
+
+#include "suricata-common.h"
+
+#include "util-line.h"
+#include "util-unittest.h"
+
+/* code is implemented in util-line.h as it's all inlined */
+
+/* UNITTESTS */
+#ifdef UNITTESTS
+
+static int LineTest01 (void) {
+    uint8_t buf[] = "abc\ndef\r\n";
+
+    if (SCLineFindLF(buf, sizeof(buf) - 1) != buf + 3)
+        return 0;
+    if (SCLineFindLF(buf, 3) != NULL)
+        return 0;
+
+    return 1;
+}
+
+/** \test CRLF search skips bare LFs and doesn't look before the buffer */
+static int LineTest02 (void) {
+    uint8_t buf[] = "\nabc\ndef\r\n";
+
+    if (SCLineFindCRLF(buf, sizeof(buf) - 1) != buf + 8)
+        return 0;
+    /* CR as the last byte, the LF isn't in the buffer */
+    if (SCLineFindCRLF(buf, sizeof(buf) - 2) != NULL)
+        return 0;
+    /* LF as the first byte, the CR isn't in the buffer */
+    if (SCLineFindCRLF(buf + 9, 1) != NULL)
+        return 0;
+    if (SCLineFindCRLF(buf + 8, 2) != buf + 8)
+        return 0;
+
+    return 1;
+}
+
+#endif /* UNITTESTS */
+
+void LineRegisterTests(void) {
+#ifdef UNITTESTS
+    UtRegisterTest("LineTest01", LineTest01, 1);
+    UtRegisterTest("LineTest02", LineTest02, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Newline scanners for the line based app layer parsers.
+ *
+ * Both are built on memchr, which the libc implements with vector
+ * instructions, so the scan looks at a word or vector at a time instead
+ * of comparing every byte like the generic spm search does.
+ */
+
+#ifndef __UTIL_LINE_H__
+#define __UTIL_LINE_H__
+
+/**
+ * \brief Find the first LF in a buffer.
+ *
+ * \retval ptr pointer to the LF
+ * \retval NULL no LF in the buffer
+ */
+static inline uint8_t *SCLineFindLF(const uint8_t *buf, uint32_t buf_len)
+{
+    return (uint8_t *)memchr(buf, 0x0a, buf_len);
+}
+
+/**
+ * \brief Find the first CRLF in a buffer.
+ *
+ * \retval ptr pointer to the CR of the CRLF
+ * \retval NULL no CRLF in the buffer
+ */
+static inline uint8_t *SCLineFindCRLF(const uint8_t *buf, uint32_t buf_len)
+{
+    const uint8_t *end = buf + buf_len;
+    const uint8_t *p = buf;
+
+    if (buf_len < 2)
+        return NULL;
+
+    /* a LF at the start of the buffer can't end a CRLF */
+    p++;
+    while (p < end) {
+        const uint8_t *lf = memchr(p, 0x0a, end - p);
+        if (lf == NULL)
+            return NULL;
+        if (*(lf - 1) == 0x0d)
+            return (uint8_t *)(lf - 1);
+        p = lf + 1;
+    }
+    return NULL;
+}
+
+void LineRegisterTests(void);
+
+#endif /* __UTIL_LINE_H__ */
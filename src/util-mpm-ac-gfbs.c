@@ -61,6 +61,8 @@ int SCACGfbsAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
 int SCACGfbsPreparePatterns(MpmCtx *mpm_ctx);
 uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                         PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+uint32_t SCACGfbsSearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                             PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen);
 void SCACGfbsPrintInfo(MpmCtx *mpm_ctx);
 void SCACGfbsPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
 void SCACGfbsRegisterTests(void);
@@ -98,6 +100,7 @@ void MpmACGfbsRegister(void)
     mpm_table[MPM_AC_GFBS].AddPatternNocase = SCACGfbsAddPatternCI;
     mpm_table[MPM_AC_GFBS].Prepare = SCACGfbsPreparePatterns;
     mpm_table[MPM_AC_GFBS].Search = SCACGfbsSearch;
+    mpm_table[MPM_AC_GFBS].SearchLarge = SCACGfbsSearchLarge;
     mpm_table[MPM_AC_GFBS].Cleanup = NULL;
     mpm_table[MPM_AC_GFBS].PrintCtx = SCACGfbsPrintInfo;
     mpm_table[MPM_AC_GFBS].PrintThreadCtx = SCACGfbsPrintSearchStats;
@@ -1287,7 +1290,7 @@ void SCACGfbsDestroyCtx(MpmCtx *mpm_ctx)
 }
 
 /**
- * \brief The aho corasick search function.
+ * \brief The aho corasick search function, for buffers of any size.
  *
  * \param mpm_ctx        Pointer to the mpm context.
  * \param mpm_thread_ctx Pointer to the mpm thread context.
@@ -1298,11 +1301,11 @@ void SCACGfbsDestroyCtx(MpmCtx *mpm_ctx)
  *
  * \retval matches Match count.
  */
-uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
-                        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+uint32_t SCACGfbsSearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                             PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen)
 {
     SCACGfbsCtx *ctx = (SCACGfbsCtx *)mpm_ctx->ctx;
-    int matches = 0;
+    uint32_t matches = 0;
     uint8_t buf_local;
 
     SCACGfbsPatternList *pid_pat_list = ctx->pid_pat_list;
@@ -1316,7 +1319,7 @@ uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
         uint16_t **goto_table_mod_pointers = (uint16_t **)ctx->goto_table_mod_pointers;
 
         //int32_t *failure_table = ctx->failure_table;
-        int i;
+        uint32_t i;
         /* \todo tried loop unrolling with register var, with no perf increase.  Need
          * to dig deeper */
         /* with so many var declarations the register declaration here is useless */
@@ -1445,7 +1448,7 @@ uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
         uint8_t *ascii_codes = NULL;
         uint32_t **goto_table_mod_pointers = (uint32_t **)ctx->goto_table_mod_pointers;
         //int32_t *failure_table = ctx->failure_table;
-        int i = 0;
+        uint32_t i = 0;
         /* \todo tried loop unrolling with register var, with no perf increase.  Need
          * to dig deeper */
         register int32_t state = 0;
@@ -1572,6 +1575,24 @@ uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
     return matches;
 }
 
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACGfbsSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    return SCACGfbsSearchLarge(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+}
+
 /**
  * \brief Add a case insensitive pattern.  Although we have different calls for
  *        adding case sensitive and insensitive patterns, we make a single call
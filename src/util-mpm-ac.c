@@ -67,6 +67,11 @@ int SCACAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
 int SCACPreparePatterns(MpmCtx *mpm_ctx);
 uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                     PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+uint32_t SCACSearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                         PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen);
+uint32_t SCACSearchStream(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                          PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen,
+                          uint32_t *stream_state, PatternMatcherQueue *span_pmq);
 void SCACPrintInfo(MpmCtx *mpm_ctx);
 void SCACPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
 void SCACRegisterTests(void);
@@ -78,6 +83,27 @@ void SCACRegisterTests(void);
 
 #define STATE_QUEUE_CONTAINER_SIZE 65536
 
+/* above this size of a full 4 byte state table the banded table is used */
+#define SC_AC_MAX_FULL_TABLE_SIZE (16 * 1024 * 1024)
+
+#ifdef UNITTESTS
+/* lets the unittests use the big table types for small pattern sets */
+static int sc_ac_test_table_type = -1;
+#endif
+
+static const char *SCACTableTypeToString(uint8_t table_type)
+{
+    switch (table_type) {
+        case SC_AC_TABLE_U16:
+            return "u16";
+        case SC_AC_TABLE_U32:
+            return "u32";
+        case SC_AC_TABLE_BANDED:
+            return "banded";
+    }
+    return "unknown";
+}
+
 /**
  * \brief Helper structure used by AC during state table creation
  */
@@ -104,6 +130,8 @@ void MpmACRegister(void)
     mpm_table[MPM_AC].AddPatternNocase = SCACAddPatternCI;
     mpm_table[MPM_AC].Prepare = SCACPreparePatterns;
     mpm_table[MPM_AC].Search = SCACSearch;
+    mpm_table[MPM_AC].SearchLarge = SCACSearchLarge;
+    mpm_table[MPM_AC].SearchStream = SCACSearchStream;
     mpm_table[MPM_AC].Cleanup = NULL;
     mpm_table[MPM_AC].PrintCtx = SCACPrintInfo;
     mpm_table[MPM_AC].PrintThreadCtx = SCACPrintSearchStats;
@@ -432,7 +460,7 @@ error:
 static inline int SCACInitNewState(MpmCtx *mpm_ctx)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int ascii_code = 0;
+    int symbol = 0;
     int size = 0;
 
     /* reallocate space in the goto table to include a new state */
@@ -443,8 +471,9 @@ static inline int SCACInitNewState(MpmCtx *mpm_ctx)
         exit(EXIT_FAILURE);
     }
     /* set all transitions for the newly assigned state as FAIL transitions */
-    for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-        ctx->goto_table[ctx->state_count][ascii_code] = SC_AC_FAIL;
+    int32_t *row = ctx->goto_table + ctx->state_count * ctx->alphabet_size;
+    for (symbol = 0; symbol < ctx->alphabet_size; symbol++) {
+        row[symbol] = SC_AC_FAIL;
     }
 
     /* reallocate space in the output table for the new state */
@@ -519,8 +548,9 @@ static inline void SCACEnter(uint8_t *pattern, uint16_t pattern_len, uint32_t pi
     /* walk down the trie till we have a match for the pattern prefix */
     state = 0;
     for (i = 0; i < pattern_len; i++) {
-        if (ctx->goto_table[state][pattern[i]] != SC_AC_FAIL) {
-            state = ctx->goto_table[state][pattern[i]];
+        uint8_t symbol = ctx->translate_table[pattern[i]];
+        if (ctx->goto_table[state * ctx->alphabet_size + symbol] != SC_AC_FAIL) {
+            state = ctx->goto_table[state * ctx->alphabet_size + symbol];
         } else {
             break;
         }
@@ -530,7 +560,8 @@ static inline void SCACEnter(uint8_t *pattern, uint16_t pattern_len, uint32_t pi
      * we left off */
     for (p = i; p < pattern_len; p++) {
         newstate = SCACInitNewState(mpm_ctx);
-        ctx->goto_table[state][pattern[p]] = newstate;
+        uint8_t symbol = ctx->translate_table[pattern[p]];
+        ctx->goto_table[state * ctx->alphabet_size + symbol] = newstate;
         state = newstate;
     }
 
@@ -558,10 +589,10 @@ static inline void SCACCreateGotoTable(MpmCtx *mpm_ctx)
                   ctx->parray[i]->id, mpm_ctx);
     }
 
-    int ascii_code = 0;
-    for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-        if (ctx->goto_table[0][ascii_code] == SC_AC_FAIL) {
-            ctx->goto_table[0][ascii_code] = 0;
+    int symbol = 0;
+    for (symbol = 0; symbol < ctx->alphabet_size; symbol++) {
+        if (ctx->goto_table[symbol] == SC_AC_FAIL) {
+            ctx->goto_table[symbol] = 0;
         }
     }
 
@@ -699,7 +730,8 @@ static inline void SCACClubOutputStates(int32_t dst_state, int32_t src_state,
 static inline void SCACCreateFailureTable(MpmCtx *mpm_ctx)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int ascii_code = 0;
+    uint16_t alpha = ctx->alphabet_size;
+    int symbol = 0;
     int32_t state = 0;
     int32_t r_state = 0;
 
@@ -718,8 +750,8 @@ static inline void SCACCreateFailureTable(MpmCtx *mpm_ctx)
     /* add the failure transitions for the 0th state, and add every non-fail
      * transition from the 0th state to the queue for further processing
      * of failure states */
-    for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-        int32_t temp_state = ctx->goto_table[0][ascii_code];
+    for (symbol = 0; symbol < alpha; symbol++) {
+        int32_t temp_state = ctx->goto_table[symbol];
         if (temp_state != 0) {
             SCACEnqueue(&q, temp_state);
             ctx->failure_table[temp_state] = 0;
@@ -729,16 +761,16 @@ static inline void SCACCreateFailureTable(MpmCtx *mpm_ctx)
     while (!SCACStateQueueIsEmpty(&q)) {
         /* pick up every state from the queue and add failure transitions */
         r_state = SCACDequeue(&q);
-        for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-            int32_t temp_state = ctx->goto_table[r_state][ascii_code];
+        for (symbol = 0; symbol < alpha; symbol++) {
+            int32_t temp_state = ctx->goto_table[r_state * alpha + symbol];
             if (temp_state == SC_AC_FAIL)
                 continue;
             SCACEnqueue(&q, temp_state);
             state = ctx->failure_table[r_state];
 
-            while(ctx->goto_table[state][ascii_code] == SC_AC_FAIL)
+            while(ctx->goto_table[state * alpha + symbol] == SC_AC_FAIL)
                 state = ctx->failure_table[state];
-            ctx->failure_table[temp_state] = ctx->goto_table[state][ascii_code];
+            ctx->failure_table[temp_state] = ctx->goto_table[state * alpha + symbol];
             SCACClubOutputStates(temp_state, ctx->failure_table[temp_state],
                                  mpm_ctx);
         }
@@ -749,36 +781,81 @@ static inline void SCACCreateFailureTable(MpmCtx *mpm_ctx)
 
 /**
  * \internal
- * \brief Create the delta table.
+ * \brief Create the compressed alphabet: each byte that is in a pattern
+ *        gets its own symbol, the bytes that aren't share symbol 0.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static inline void SCACInitAlphabet(MpmCtx *mpm_ctx)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    uint8_t used[256];
+    uint8_t symbol_of[256];
+    uint32_t i = 0;
+    int c = 0;
+
+    memset(used, 0, sizeof(used));
+    memset(symbol_of, 0, sizeof(symbol_of));
+
+    /* the patterns are added lowercased */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        uint16_t u;
+        for (u = 0; u < ctx->parray[i]->len; u++)
+            used[ctx->parray[i]->ci[u]] = 1;
+    }
+
+    ctx->alphabet_size = 1;
+    for (c = 0; c < 256; c++) {
+        if (used[c])
+            symbol_of[c] = ctx->alphabet_size++;
+    }
+
+    /* uppercase bytes are never used, so there are at most 231 symbols */
+    for (c = 0; c < 256; c++) {
+        ctx->translate_table[c] = symbol_of[u8_tolower(c)];
+    }
+
+    ctx->row_shift = 0;
+    while ((1 << ctx->row_shift) < ctx->alphabet_size)
+        ctx->row_shift++;
+
+    return;
+}
+
+/**
+ * \internal
+ * \brief Create the delta table, as full rows of the compressed alphabet.
  *
  * \param mpm_ctx Pointer to the mpm context.
  */
 static inline void SCACCreateDeltaTable(MpmCtx *mpm_ctx)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int ascii_code = 0;
+    uint16_t alpha = ctx->alphabet_size;
+    uint16_t shift = ctx->row_shift;
+    int symbol = 0;
     int32_t r_state = 0;
 
-    if (ctx->state_count < 32767) {
-        ctx->state_table_u16 = SCMalloc(ctx->state_count *
-                                        sizeof(SC_AC_STATE_TYPE_U16) * 256);
+    if (ctx->table_type == SC_AC_TABLE_U16) {
+        ctx->state_table_u16 = SCMalloc((ctx->state_count << shift) *
+                                        sizeof(SC_AC_STATE_TYPE_U16));
         if (ctx->state_table_u16 == NULL) {
             SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
             exit(EXIT_FAILURE);
         }
         memset(ctx->state_table_u16, 0,
-               ctx->state_count * sizeof(SC_AC_STATE_TYPE_U16) * 256);
+               (ctx->state_count << shift) * sizeof(SC_AC_STATE_TYPE_U16));
 
         mpm_ctx->memory_cnt++;
-        mpm_ctx->memory_size += (ctx->state_count *
-                                 sizeof(SC_AC_STATE_TYPE_U16) * 256);
+        mpm_ctx->memory_size += ((ctx->state_count << shift) *
+                                 sizeof(SC_AC_STATE_TYPE_U16));
 
         StateQueue q;
         memset(&q, 0, sizeof(StateQueue));
 
-        for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-            SC_AC_STATE_TYPE_U16 temp_state = ctx->goto_table[0][ascii_code];
-            ctx->state_table_u16[0][ascii_code] = temp_state;
+        for (symbol = 0; symbol < alpha; symbol++) {
+            SC_AC_STATE_TYPE_U16 temp_state = ctx->goto_table[symbol];
+            ctx->state_table_u16[symbol] = temp_state;
             if (temp_state != 0)
                 SCACEnqueue(&q, temp_state);
         }
@@ -786,40 +863,39 @@ static inline void SCACCreateDeltaTable(MpmCtx *mpm_ctx)
         while (!SCACStateQueueIsEmpty(&q)) {
             r_state = SCACDequeue(&q);
 
-            for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-                int32_t temp_state = ctx->goto_table[r_state][ascii_code];
+            for (symbol = 0; symbol < alpha; symbol++) {
+                int32_t temp_state = ctx->goto_table[r_state * alpha + symbol];
                 if (temp_state != SC_AC_FAIL) {
                     SCACEnqueue(&q, temp_state);
-                    ctx->state_table_u16[r_state][ascii_code] = temp_state;
+                    ctx->state_table_u16[(r_state << shift) + symbol] = temp_state;
                 } else {
-                    ctx->state_table_u16[r_state][ascii_code] =
-                        ctx->state_table_u16[ctx->failure_table[r_state]][ascii_code];
+                    ctx->state_table_u16[(r_state << shift) + symbol] =
+                        ctx->state_table_u16[(ctx->failure_table[r_state] << shift) + symbol];
                 }
             }
         }
     } else {
         /* create space for the state table.  We could have used the existing goto
-         * table, but since we have it set to hold 32 bit state values, we will create
-         * a new state table here of type SC_AC_STATE_TYPE(current set to uint16_t) */
-        ctx->state_table_u32 = SCMalloc(ctx->state_count *
-                                        sizeof(SC_AC_STATE_TYPE_U32) * 256);
+         * table, but it holds FAIL transitions */
+        ctx->state_table_u32 = SCMalloc((ctx->state_count << shift) *
+                                        sizeof(SC_AC_STATE_TYPE_U32));
         if (ctx->state_table_u32 == NULL) {
             SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
             exit(EXIT_FAILURE);
         }
         memset(ctx->state_table_u32, 0,
-               ctx->state_count * sizeof(SC_AC_STATE_TYPE_U32) * 256);
+               (ctx->state_count << shift) * sizeof(SC_AC_STATE_TYPE_U32));
 
         mpm_ctx->memory_cnt++;
-        mpm_ctx->memory_size += (ctx->state_count *
-                                 sizeof(SC_AC_STATE_TYPE_U32) * 256);
+        mpm_ctx->memory_size += ((ctx->state_count << shift) *
+                                 sizeof(SC_AC_STATE_TYPE_U32));
 
         StateQueue q;
         memset(&q, 0, sizeof(StateQueue));
 
-        for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-            SC_AC_STATE_TYPE_U32 temp_state = ctx->goto_table[0][ascii_code];
-            ctx->state_table_u32[0][ascii_code] = temp_state;
+        for (symbol = 0; symbol < alpha; symbol++) {
+            SC_AC_STATE_TYPE_U32 temp_state = ctx->goto_table[symbol];
+            ctx->state_table_u32[symbol] = temp_state;
             if (temp_state != 0)
                 SCACEnqueue(&q, temp_state);
         }
@@ -827,14 +903,14 @@ static inline void SCACCreateDeltaTable(MpmCtx *mpm_ctx)
         while (!SCACStateQueueIsEmpty(&q)) {
             r_state = SCACDequeue(&q);
 
-            for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-                int32_t temp_state = ctx->goto_table[r_state][ascii_code];
+            for (symbol = 0; symbol < alpha; symbol++) {
+                int32_t temp_state = ctx->goto_table[r_state * alpha + symbol];
                 if (temp_state != SC_AC_FAIL) {
                     SCACEnqueue(&q, temp_state);
-                    ctx->state_table_u32[r_state][ascii_code] = temp_state;
+                    ctx->state_table_u32[(r_state << shift) + symbol] = temp_state;
                 } else {
-                    ctx->state_table_u32[r_state][ascii_code] =
-                        ctx->state_table_u32[ctx->failure_table[r_state]][ascii_code];
+                    ctx->state_table_u32[(r_state << shift) + symbol] =
+                        ctx->state_table_u32[(ctx->failure_table[r_state] << shift) + symbol];
                 }
             }
         }
@@ -843,29 +919,113 @@ static inline void SCACCreateDeltaTable(MpmCtx *mpm_ctx)
     return;
 }
 
+/**
+ * \internal
+ * \brief Create the banded table: for each state only the range of
+ *        symbols from its first to its last goto transition is kept, the
+ *        other symbols take the failure transition. The row of state 0 is
+ *        complete, so the search always ends up with a transition.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static inline void SCACCreateBandedTable(MpmCtx *mpm_ctx)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    uint16_t alpha = ctx->alphabet_size;
+    uint32_t state = 0;
+    int symbol = 0;
+
+    ctx->bands = SCMalloc(ctx->state_count * sizeof(SCACBand));
+    if (ctx->bands == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->bands, 0, ctx->state_count * sizeof(SCACBand));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (ctx->state_count * sizeof(SCACBand));
+
+    /* first pass: the bands and the size of the table */
+    ctx->band_table_size = 0;
+    for (state = 0; state < ctx->state_count; state++) {
+        int32_t *row = ctx->goto_table + state * alpha;
+        int lo = -1, hi = -1;
+
+        for (symbol = 0; symbol < alpha; symbol++) {
+            if (state == 0 || row[symbol] != SC_AC_FAIL) {
+                if (lo == -1)
+                    lo = symbol;
+                hi = symbol;
+            }
+        }
+
+        ctx->bands[state].failure = (state == 0) ? 0 : ctx->failure_table[state];
+        ctx->bands[state].offset = ctx->band_table_size;
+        if (lo == -1) {
+            ctx->bands[state].lo = 1;
+            ctx->bands[state].hi = 0;
+        } else {
+            ctx->bands[state].lo = lo;
+            ctx->bands[state].hi = hi;
+            ctx->band_table_size += (hi - lo + 1);
+        }
+    }
+
+    ctx->band_table = SCMalloc(ctx->band_table_size * sizeof(SC_AC_STATE_TYPE_U32));
+    if (ctx->band_table == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (ctx->band_table_size * sizeof(SC_AC_STATE_TYPE_U32));
+
+    /* second pass: fill the bands */
+    for (state = 0; state < ctx->state_count; state++) {
+        int32_t *row = ctx->goto_table + state * alpha;
+        SCACBand *band = &ctx->bands[state];
+
+        for (symbol = band->lo; symbol <= band->hi; symbol++) {
+            if (row[symbol] == SC_AC_FAIL)
+                ctx->band_table[band->offset + symbol - band->lo] = SC_AC_BANDED_FAIL;
+            else
+                ctx->band_table[band->offset + symbol - band->lo] = row[symbol];
+        }
+    }
+
+    return;
+}
+
 static inline void SCACClubOutputStatePresenceWithDeltaTable(MpmCtx *mpm_ctx)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int ascii_code = 0;
+    uint16_t shift = ctx->row_shift;
+    int symbol = 0;
     uint32_t state = 0;
     uint32_t temp_state = 0;
 
-    if (ctx->state_count < 32767) {
+    if (ctx->table_type == SC_AC_TABLE_U16) {
         for (state = 0; state < ctx->state_count; state++) {
-            for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-                temp_state = ctx->state_table_u16[state & 0x7FFF][ascii_code];
+            for (symbol = 0; symbol < ctx->alphabet_size; symbol++) {
+                temp_state = ctx->state_table_u16[(state << shift) + symbol];
                 if (ctx->output_table[temp_state & 0x7FFF].no_of_entries != 0)
-                    ctx->state_table_u16[state & 0x7FFF][ascii_code] |= (1 << 15);
+                    ctx->state_table_u16[(state << shift) + symbol] |= (1 << 15);
             }
         }
-    } else {
+    } else if (ctx->table_type == SC_AC_TABLE_U32) {
         for (state = 0; state < ctx->state_count; state++) {
-            for (ascii_code = 0; ascii_code < 256; ascii_code++) {
-                temp_state = ctx->state_table_u32[state & 0x00FFFFFF][ascii_code];
+            for (symbol = 0; symbol < ctx->alphabet_size; symbol++) {
+                temp_state = ctx->state_table_u32[(state << shift) + symbol];
                 if (ctx->output_table[temp_state & 0x00FFFFFF].no_of_entries != 0)
-                    ctx->state_table_u32[state & 0x00FFFFFF][ascii_code] |= (1 << 24);
+                    ctx->state_table_u32[(state << shift) + symbol] |= (1 << 24);
             }
         }
+    } else {
+        for (state = 0; state < ctx->band_table_size; state++) {
+            temp_state = ctx->band_table[state];
+            if (temp_state == SC_AC_BANDED_FAIL)
+                continue;
+            if (ctx->output_table[temp_state & 0x00FFFFFF].no_of_entries != 0)
+                ctx->band_table[state] |= (1 << 24);
+        }
     }
 
     return;
@@ -901,7 +1061,7 @@ static void SCACPrintDeltaTable(MpmCtx *mpm_ctx)
     printf("##############Delta Table##############\n");
     for (i = 0; i < ctx->state_count; i++) {
         printf("%d: \n", i);
-        for (j = 0; j < 256; j++) {
+        for (j = 0; j < ctx->alphabet_size; j++) {
             if (SCACGetDelta(i, j, mpm_ctx) != 0) {
                 printf("  %c -> %d\n", j, SCACGetDelta(i, j, mpm_ctx));
             }
@@ -921,6 +1081,11 @@ static inline void SCACPrepareStateTable(MpmCtx *mpm_ctx)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
 
+    /* map the bytes to the symbols of the compressed alphabet */
+    SCACInitAlphabet(mpm_ctx);
+    /* the memory consumed by a single state in our goto table */
+    ctx->single_state_size = sizeof(int32_t) * ctx->alphabet_size;
+
     /* create the 0th state in the goto table and output_table */
     SCACInitNewState(mpm_ctx);
 
@@ -928,8 +1093,27 @@ static inline void SCACPrepareStateTable(MpmCtx *mpm_ctx)
     SCACCreateGotoTable(mpm_ctx);
     /* create the failure table */
     SCACCreateFailureTable(mpm_ctx);
+
+    /* full rows for small state counts, bands when full rows would take
+     * too much memory */
+    if (ctx->state_count < 32767) {
+        ctx->table_type = SC_AC_TABLE_U16;
+    } else if (((uint64_t)ctx->state_count << ctx->row_shift) *
+               sizeof(SC_AC_STATE_TYPE_U32) <= SC_AC_MAX_FULL_TABLE_SIZE) {
+        ctx->table_type = SC_AC_TABLE_U32;
+    } else {
+        ctx->table_type = SC_AC_TABLE_BANDED;
+    }
+#ifdef UNITTESTS
+    if (sc_ac_test_table_type != -1)
+        ctx->table_type = sc_ac_test_table_type;
+#endif
+
     /* create the final state(delta) table */
-    SCACCreateDeltaTable(mpm_ctx);
+    if (ctx->table_type == SC_AC_TABLE_BANDED)
+        SCACCreateBandedTable(mpm_ctx);
+    else
+        SCACCreateDeltaTable(mpm_ctx);
     /* club the output state presence with delta transition entries */
     SCACClubOutputStatePresenceWithDeltaTable(mpm_ctx);
 
@@ -988,9 +1172,6 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     SCFree(ctx->init_hash);
     ctx->init_hash = NULL;
 
-    /* the memory consumed by a single state in our goto table */
-    ctx->single_state_size = sizeof(int32_t) * 256;
-
     /* handle no case patterns */
     ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1)* sizeof(SCACPatternList));
     if (ctx->pid_pat_list == NULL) {
@@ -1000,6 +1181,8 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     memset(ctx->pid_pat_list, 0, (ctx->max_pat_id + 1) * sizeof(SCACPatternList));
 
     for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        ctx->pid_pat_list[ctx->parray[i]->id].patlen = ctx->parray[i]->len;
+
         if (ctx->parray[i]->flags & MPM_PATTERN_FLAG_NOCASE) {
             if (ctx->pid_pat_list[ctx->parray[i]->id].case_state == 0)
                 ctx->pid_pat_list[ctx->parray[i]->id].case_state = 1;
@@ -1017,7 +1200,6 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
                 }
                 memcpy(ctx->pid_pat_list[ctx->parray[i]->id].cs,
                        ctx->parray[i]->original_pat, ctx->parray[i]->len);
-                ctx->pid_pat_list[ctx->parray[i]->id].patlen = ctx->parray[i]->len;
 
                 if (ctx->pid_pat_list[ctx->parray[i]->id].case_state == 0)
                     ctx->pid_pat_list[ctx->parray[i]->id].case_state = 2;
@@ -1043,6 +1225,18 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     mpm_ctx->memory_cnt--;
     mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACPattern *));
 
+    if (mpm_ctx->global) {
+        SCLogInfo("ac ctx %p: %" PRIu32 " patterns, %" PRIu32 " states, "
+                  "alphabet %" PRIu32 ", %s table, %" PRIu32 " bytes", mpm_ctx,
+                  mpm_ctx->pattern_cnt, ctx->state_count, ctx->alphabet_size,
+                  SCACTableTypeToString(ctx->table_type), mpm_ctx->memory_size);
+    } else {
+        SCLogDebug("ac ctx %p: %" PRIu32 " patterns, %" PRIu32 " states, "
+                   "alphabet %" PRIu32 ", %s table, %" PRIu32 " bytes", mpm_ctx,
+                   mpm_ctx->pattern_cnt, ctx->state_count, ctx->alphabet_size,
+                   SCACTableTypeToString(ctx->table_type), mpm_ctx->memory_size);
+    }
+
     return 0;
 
 error:
@@ -1164,15 +1358,32 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
         ctx->state_table_u16 = NULL;
 
         mpm_ctx->memory_cnt++;
-        mpm_ctx->memory_size -= (ctx->state_count *
-                                 sizeof(SC_AC_STATE_TYPE_U16) * 256);
+        mpm_ctx->memory_size -= ((ctx->state_count << ctx->row_shift) *
+                                 sizeof(SC_AC_STATE_TYPE_U16));
     } else if (ctx->state_table_u32 != NULL) {
         SCFree(ctx->state_table_u32);
         ctx->state_table_u32 = NULL;
 
         mpm_ctx->memory_cnt++;
-        mpm_ctx->memory_size -= (ctx->state_count *
-                                 sizeof(SC_AC_STATE_TYPE_U32) * 256);
+        mpm_ctx->memory_size -= ((ctx->state_count << ctx->row_shift) *
+                                 sizeof(SC_AC_STATE_TYPE_U32));
+    }
+
+    if (ctx->bands != NULL) {
+        SCFree(ctx->bands);
+        ctx->bands = NULL;
+
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (ctx->state_count * sizeof(SCACBand));
+    }
+
+    if (ctx->band_table != NULL) {
+        SCFree(ctx->band_table);
+        ctx->band_table = NULL;
+
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (ctx->band_table_size *
+                                 sizeof(SC_AC_STATE_TYPE_U32));
     }
 
     if (ctx->output_table != NULL) {
@@ -1202,7 +1413,71 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
 }
 
 /**
- * \brief The aho corasick search function.
+ * \internal
+ * \brief Add the patterns ending in a matching state to the pmq.
+ *
+ * \param ctx   Pointer to the AC context.
+ * \param pmq   Pointer to the Pattern Matcher Queue.
+ * \param span_pmq Pattern Matcher Queue for the matches that started in a
+ *                 previous buffer of a stream, or NULL.
+ * \param state The matching state, without the output flag.
+ * \param buf   Buffer being searched.
+ * \param i     Offset in buf of the last byte of the match.
+ *
+ * A case sensitive pattern that started in a previous buffer of a stream
+ * can't be verified here, so it's added as a match. The payload inspection
+ * checks it against the stream.
+ *
+ * \retval matches Match count.
+ */
+static inline uint32_t SCACOutput(SCACCtx *ctx, PatternMatcherQueue *pmq,
+                                  PatternMatcherQueue *span_pmq,
+                                  uint32_t state, uint8_t *buf, uint32_t i)
+{
+    SCACPatternList *pid_pat_list = ctx->pid_pat_list;
+    uint32_t no_of_entries = ctx->output_table[state].no_of_entries;
+    uint32_t *pids = ctx->output_table[state].pids;
+    uint32_t matches = 0;
+    uint32_t k;
+
+    for (k = 0; k < no_of_entries; k++) {
+        uint32_t pid = pids[k] & 0x0000FFFF;
+
+        if (pids[k] & 0xFFFF0000) {
+            if (i + 1 >= pid_pat_list[pid].patlen &&
+                SCMemcmp(pid_pat_list[pid].cs,
+                         buf + i - pid_pat_list[pid].patlen + 1,
+                         pid_pat_list[pid].patlen) != 0) {
+                /* inside loop */
+                if (pid_pat_list[pid].case_state != 3) {
+                    continue;
+                }
+            }
+        }
+
+        if (pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8))) {
+            ;
+        } else {
+            pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pid;
+        }
+        matches++;
+
+        if (span_pmq != NULL && i + 1 < pid_pat_list[pid].patlen &&
+            !(span_pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8))))
+        {
+            span_pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+            span_pmq->pattern_id_array[span_pmq->pattern_id_array_cnt++] = pid;
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \brief The aho corasick search function for the buffers of a stream.
+ *        The search starts in the state the previous buffer ended in, so
+ *        patterns spanning buffers are found.
  *
  * \param mpm_ctx        Pointer to the mpm context.
  * \param mpm_thread_ctx Pointer to the mpm thread context.
@@ -1210,107 +1485,121 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
  *                       search matches.
  * \param buf            Buffer to be searched.
  * \param buflen         Buffer length.
+ * \param stream_state   State to start in, 0 for the start of the stream.
+ *                       Set to the state the search ended in.
+ * \param span_pmq       Pattern Matcher Queue to hold the matches that
+ *                       started in a previous buffer as well, or NULL.
  *
  * \retval matches Match count.
  */
-uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
-                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+uint32_t SCACSearchStream(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                          PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen,
+                          uint32_t *stream_state, PatternMatcherQueue *span_pmq)
 {
     SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int i = 0;
-    int matches = 0;
+    uint8_t *translate_table = ctx->translate_table;
+    uint32_t i = 0;
+    uint32_t matches = 0;
 
     /* \todo tried loop unrolling with register var, with no perf increase.  Need
      * to dig deeper */
-    /* \todo Change it for stateful MPM.  Supply the state using mpm_thread_ctx */
-    SCACPatternList *pid_pat_list = ctx->pid_pat_list;
 
-    if (ctx->state_count < 32767) {
-        register SC_AC_STATE_TYPE_U16 state = 0;
-        SC_AC_STATE_TYPE_U16 (*state_table_u16)[256] = ctx->state_table_u16;
+    if (ctx->table_type == SC_AC_TABLE_U16) {
+        register SC_AC_STATE_TYPE_U16 state = *stream_state;
+        SC_AC_STATE_TYPE_U16 *state_table_u16 = ctx->state_table_u16;
+        uint16_t row_shift = ctx->row_shift;
         for (i = 0; i < buflen; i++) {
-            state = state_table_u16[state & 0x7FFF][u8_tolower(buf[i])];
+            state = state_table_u16[((state & 0x7FFF) << row_shift) +
+                                    translate_table[buf[i]]];
             if (state & 0x8000) {
-                uint32_t no_of_entries = ctx->output_table[state & 0x7FFF].no_of_entries;
-                uint32_t *pids = ctx->output_table[state & 0x7FFF].pids;
-                uint32_t k;
-                for (k = 0; k < no_of_entries; k++) {
-                    if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
-                            /* inside loop */
-                            if (pid_pat_list[pids[k] & 0x0000FFFF].case_state != 3) {
-                                continue;
-                            }
-                        }
-                        if (pmq->pattern_id_bitarray[(pids[k] & 0x0000FFFF) / 8] & (1 << ((pids[k] & 0x0000FFFF) % 8))) {
-                            ;
-                        } else {
-                            pmq->pattern_id_bitarray[(pids[k] & 0x0000FFFF) / 8] |= (1 << ((pids[k] & 0x0000FFFF) % 8));
-                            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k] & 0x0000FFFF;
-                        }
-                        matches++;
-                    } else {
-                        if (pmq->pattern_id_bitarray[pids[k] / 8] & (1 << (pids[k] % 8))) {
-                            ;
-                        } else {
-                            pmq->pattern_id_bitarray[pids[k] / 8] |= (1 << (pids[k] % 8));
-                            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k];
-                        }
-                        matches++;
-                    }
-                    //loop1:
-                    //;
-                }
+                matches += SCACOutput(ctx, pmq, span_pmq, state & 0x7FFF, buf, i);
             }
         } /* for (i = 0; i < buflen; i++) */
+        *stream_state = state & 0x7FFF;
 
-    } else {
-        register SC_AC_STATE_TYPE_U32 state = 0;
-        SC_AC_STATE_TYPE_U32 (*state_table_u32)[256] = ctx->state_table_u32;
+    } else if (ctx->table_type == SC_AC_TABLE_U32) {
+        register SC_AC_STATE_TYPE_U32 state = *stream_state;
+        SC_AC_STATE_TYPE_U32 *state_table_u32 = ctx->state_table_u32;
+        uint16_t row_shift = ctx->row_shift;
         for (i = 0; i < buflen; i++) {
-            state = state_table_u32[state & 0x00FFFFFF][u8_tolower(buf[i])];
+            state = state_table_u32[((state & 0x00FFFFFF) << row_shift) +
+                                    translate_table[buf[i]]];
             if (state & 0xFF000000) {
-                uint32_t no_of_entries = ctx->output_table[state & 0x00FFFFFF].no_of_entries;
-                uint32_t *pids = ctx->output_table[state & 0x00FFFFFF].pids;
-                uint32_t k;
-                for (k = 0; k < no_of_entries; k++) {
-                    if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
-                            /* inside loop */
-                            if (pid_pat_list[pids[k] & 0x0000FFFF].case_state != 3) {
-                                continue;
-                            }
-                        }
-                        if (pmq->pattern_id_bitarray[(pids[k] & 0x0000FFFF) / 8] & (1 << ((pids[k] & 0x0000FFFF) % 8))) {
-                            ;
-                        } else {
-                            pmq->pattern_id_bitarray[(pids[k] & 0x0000FFFF) / 8] |= (1 << ((pids[k] & 0x0000FFFF) % 8));
-                            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k] & 0x0000FFFF;
-                        }
-                        matches++;
-                    } else {
-                        if (pmq->pattern_id_bitarray[pids[k] / 8] & (1 << (pids[k] % 8))) {
-                            ;
-                        } else {
-                            pmq->pattern_id_bitarray[pids[k] / 8] |= (1 << (pids[k] % 8));
-                            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k];
-                        }
-                        matches++;
-                    }
-                    //loop1:
-                    //;
+                matches += SCACOutput(ctx, pmq, span_pmq, state & 0x00FFFFFF, buf, i);
+            }
+        } /* for (i = 0; i < buflen; i++) */
+        *stream_state = state & 0x00FFFFFF;
+
+    } else {
+        register SC_AC_STATE_TYPE_U32 state = *stream_state;
+        SCACBand *bands = ctx->bands;
+        SC_AC_STATE_TYPE_U32 *band_table = ctx->band_table;
+        for (i = 0; i < buflen; i++) {
+            uint8_t symbol = translate_table[buf[i]];
+            SC_AC_STATE_TYPE_U32 next = SC_AC_BANDED_FAIL;
+
+            /* follow the failure transitions until a state has a goto
+             * for the symbol. The band of state 0 is complete. */
+            state &= 0x00FFFFFF;
+            while (1) {
+                SCACBand *band = &bands[state];
+                if (symbol >= band->lo && symbol <= band->hi) {
+                    next = band_table[band->offset + symbol - band->lo];
+                    if (next != SC_AC_BANDED_FAIL)
+                        break;
                 }
+                state = band->failure;
+            }
+
+            state = next;
+            if (state & 0xFF000000) {
+                matches += SCACOutput(ctx, pmq, span_pmq, state & 0x00FFFFFF, buf, i);
             }
         } /* for (i = 0; i < buflen; i++) */
+        *stream_state = state & 0x00FFFFFF;
     }
 
     return matches;
 }
 
+/**
+ * \brief The aho corasick search function, for buffers of any size.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACSearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                         PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen)
+{
+    uint32_t state = 0;
+
+    return SCACSearchStream(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen, &state, NULL);
+}
+
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    return SCACSearchLarge(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+}
+
 /**
  * \brief Add a case insensitive pattern.  Although we have different calls for
  *        adding case sensitive and insensitive patterns, we make a single call
@@ -1389,6 +1678,8 @@ void SCACPrintInfo(MpmCtx *mpm_ctx)
     printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
     printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
     printf("Total states in the state table:    %" PRIu32 "\n", ctx->state_count);
+    printf("Alphabet size:   %" PRIu32 "\n", ctx->alphabet_size);
+    printf("State table:     %s\n", SCACTableTypeToString(ctx->table_type));
     printf("\n");
 
     return;
@@ -2366,6 +2657,288 @@ static int SCACTest28(void)
     return result;
 }
 
+/** \test the compressed alphabet */
+static int SCACTest29(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"BCD", 3, 0, 0, 1, 0, 0);
+
+    SCACPreparePatterns(&mpm_ctx);
+
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx.ctx;
+    /* a, b, c, d and the symbol for all other bytes */
+    if (ctx->alphabet_size != 5) {
+        printf("alphabet_size %u != 5: ", ctx->alphabet_size);
+        goto end;
+    }
+    if (ctx->row_shift != 3) {
+        printf("row_shift %u != 3: ", ctx->row_shift);
+        goto end;
+    }
+    if (ctx->translate_table['a'] == 0 ||
+        ctx->translate_table['a'] != ctx->translate_table['A'] ||
+        ctx->translate_table['a'] == ctx->translate_table['b']) {
+        printf("bad symbol for a: ");
+        goto end;
+    }
+    if (ctx->translate_table['e'] != 0 || ctx->translate_table[0xff] != 0) {
+        printf("bad symbol for unused byte: ");
+        goto end;
+    }
+    if (ctx->table_type != SC_AC_TABLE_U16) {
+        printf("table type %u != u16: ", ctx->table_type);
+        goto end;
+    }
+
+    result = 1;
+ end:
+    SCACDestroyCtx(&mpm_ctx);
+    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    return result;
+}
+
+/**
+ * \internal
+ * \brief Search a buffer with a set of overlapping patterns using the
+ *        given table type.
+ */
+static int SCACTestTableType(int table_type)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    /* 1 match */
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"he", 2, 0, 0, 0, 0, 0);
+    /* 1 match */
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"SHE", 3, 0, 0, 1, 0, 0);
+    /* 0 match, only in the wrong case */
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"HIS", 3, 0, 0, 2, 0, 0);
+    /* 1 match */
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"hers", 4, 0, 0, 3, 0, 0);
+    /* 0 match */
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"usher", 5, 0, 0, 4, 0, 0);
+    /* 1 match */
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"\x00\xff", 2, 0, 0, 5, 0, 0);
+    PmqSetup(&pmq, 0, 6);
+
+    sc_ac_test_table_type = table_type;
+    SCACPreparePatterns(&mpm_ctx);
+    sc_ac_test_table_type = -1;
+
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx.ctx;
+    if (ctx->table_type != table_type) {
+        printf("table type %u != %d: ", ctx->table_type, table_type);
+        goto end;
+    }
+
+    uint8_t buf[] = "xushEhis\x00\xffshers";
+    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                              buf, sizeof(buf) - 1);
+
+    if (cnt != 5) {
+        printf("5 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+    if (pmq.pattern_id_array_cnt != 4) {
+        printf("4 != %" PRIu32 " ", pmq.pattern_id_array_cnt);
+        goto end;
+    }
+
+    result = 1;
+ end:
+    SCACDestroyCtx(&mpm_ctx);
+    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test the u32 state table */
+static int SCACTest30(void)
+{
+    return SCACTestTableType(SC_AC_TABLE_U32);
+}
+
+/** \test the banded state table */
+static int SCACTest31(void)
+{
+    return SCACTestTableType(SC_AC_TABLE_BANDED);
+}
+
+/** \test the memory of the banded table is released */
+static int SCACTest32(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"bcdx", 4, 0, 0, 1, 0, 0);
+
+    sc_ac_test_table_type = SC_AC_TABLE_BANDED;
+    SCACPreparePatterns(&mpm_ctx);
+    sc_ac_test_table_type = -1;
+
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx.ctx;
+    /* the root band is complete, the other states have a single goto
+     * transition, except for the final states */
+    if (ctx->band_table_size != (uint32_t)ctx->alphabet_size + 6) {
+        printf("band_table_size %" PRIu32 " != %" PRIu32 ": ",
+               ctx->band_table_size, (uint32_t)ctx->alphabet_size + 6);
+        goto end;
+    }
+
+    result = 1;
+ end:
+    SCACDestroyCtx(&mpm_ctx);
+    return result;
+}
+
+/** \test a buffer larger than 64k in a single search */
+static int SCACTest33(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    uint32_t buflen = 200000;
+    uint8_t *buf = NULL;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+    PmqSetup(&pmq, 0, 2);
+
+    SCACPreparePatterns(&mpm_ctx);
+
+    buf = SCMalloc(buflen);
+    if (buf == NULL)
+        goto end;
+    memset(buf, 'x', buflen);
+    memcpy(buf + 65534, "abcd", 4);
+    memcpy(buf + buflen - 4, "EFGH", 4);
+
+    uint32_t cnt = SCACSearchLarge(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                   buf, buflen);
+    if (cnt != 2) {
+        printf("2 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+
+    result = 1;
+ end:
+    if (buf != NULL)
+        SCFree(buf);
+    SCACDestroyCtx(&mpm_ctx);
+    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/**
+ * \internal
+ * \brief Search a stream split in three buffers, carrying the state from
+ *        one buffer to the next. "klm" doesn't span buffers.
+ */
+static int SCACTestStream(int table_type)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    PatternMatcherQueue span_pmq;
+    char *bufs[] = { "xxxxabc", "defxxXy", "Zxklm" };
+    uint32_t state = 0;
+    uint32_t cnt = 0;
+    int i;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC, -1);
+    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    SCACAddPatternCS(&mpm_ctx, (uint8_t *)"abcdef", 6, 0, 0, 0, 0, 0);
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"xyz", 3, 0, 0, 1, 0, 0);
+    SCACAddPatternCI(&mpm_ctx, (uint8_t *)"klm", 3, 0, 0, 2, 0, 0);
+    PmqSetup(&pmq, 0, 3);
+    PmqSetup(&span_pmq, 0, 3);
+
+    sc_ac_test_table_type = table_type;
+    SCACPreparePatterns(&mpm_ctx);
+    sc_ac_test_table_type = -1;
+
+    /* without the state only "klm" matches */
+    for (i = 0; i < 3; i++) {
+        cnt += SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                          (uint8_t *)bufs[i], strlen(bufs[i]));
+    }
+    if (cnt != 1) {
+        printf("1 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+    PmqReset(&pmq);
+    cnt = 0;
+
+    for (i = 0; i < 3; i++) {
+        cnt += SCACSearchStream(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                (uint8_t *)bufs[i], strlen(bufs[i]), &state,
+                                &span_pmq);
+    }
+    if (cnt != 3) {
+        printf("3 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+    if (pmq.pattern_id_array_cnt != 3) {
+        printf("3 != %" PRIu32 " ", pmq.pattern_id_array_cnt);
+        goto end;
+    }
+    if (span_pmq.pattern_id_array_cnt != 2 || (span_pmq.pattern_id_bitarray[0] & 0x04)) {
+        printf("expected the spanning \"abcdef\" and \"xyz\" only: ");
+        goto end;
+    }
+
+    result = 1;
+ end:
+    SCACDestroyCtx(&mpm_ctx);
+    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    PmqFree(&span_pmq);
+    return result;
+}
+
+/** \test stream search with the u16 state table */
+static int SCACTest34(void)
+{
+    return SCACTestStream(SC_AC_TABLE_U16);
+}
+
+/** \test stream search with the banded state table */
+static int SCACTest35(void)
+{
+    return SCACTestStream(SC_AC_TABLE_BANDED);
+}
+
 #endif /* UNITTESTS */
 
 void SCACRegisterTests(void)
@@ -2400,6 +2973,13 @@ void SCACRegisterTests(void)
     UtRegisterTest("SCACTest26", SCACTest26, 1);
     UtRegisterTest("SCACTest27", SCACTest27, 1);
     UtRegisterTest("SCACTest28", SCACTest28, 1);
+    UtRegisterTest("SCACTest29", SCACTest29, 1);
+    UtRegisterTest("SCACTest30", SCACTest30, 1);
+    UtRegisterTest("SCACTest31", SCACTest31, 1);
+    UtRegisterTest("SCACTest32", SCACTest32, 1);
+    UtRegisterTest("SCACTest33", SCACTest33, 1);
+    UtRegisterTest("SCACTest34", SCACTest34, 1);
+    UtRegisterTest("SCACTest35", SCACTest35, 1);
 #endif
 
     return;
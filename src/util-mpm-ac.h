@@ -55,6 +55,30 @@ typedef struct SCACOutputTable_ {
     uint32_t no_of_entries;
 } SCACOutputTable;
 
+/* state table representations, picked on the state count */
+enum {
+    /* full rows of the compressed alphabet, 2 byte states */
+    SC_AC_TABLE_U16 = 0,
+    /* full rows of the compressed alphabet, 4 byte states */
+    SC_AC_TABLE_U32,
+    /* banded goto rows, with failure transitions */
+    SC_AC_TABLE_BANDED,
+};
+
+/* in the band_table, no goto transition for this symbol */
+#define SC_AC_BANDED_FAIL 0xFFFFFFFF
+
+/* band of a state: the goto transitions for the symbols lo to hi */
+typedef struct SCACBand_ {
+    /* offset of the transition for lo in the band_table */
+    uint32_t offset;
+    /* state to continue from if there is no goto transition */
+    uint32_t failure;
+    /* lo > hi for a state without goto transitions */
+    uint8_t lo;
+    uint8_t hi;
+} SCACBand;
+
 typedef struct SCACCtx_ {
     /* hash used during ctx initialization */
     SCACPattern **init_hash;
@@ -64,14 +88,30 @@ typedef struct SCACCtx_ {
 
     /* no of states used by ac */
     uint32_t state_count;
+
+    /* byte to symbol of the compressed alphabet. Each byte that is in a
+     * pattern is a symbol, all other bytes share symbol 0. Lowercases. */
+    uint8_t translate_table[256];
+    /* no of symbols in the alphabet */
+    uint16_t alphabet_size;
+    /* the rows of the full state tables are 1 << row_shift long */
+    uint16_t row_shift;
+    /* SC_AC_TABLE_* */
+    uint8_t table_type;
+
     /* the all important memory hungry state_table */
-    SC_AC_STATE_TYPE_U16 (*state_table_u16)[256];
+    SC_AC_STATE_TYPE_U16 *state_table_u16;
     /* the all important memory hungry state_table */
-    SC_AC_STATE_TYPE_U32 (*state_table_u32)[256];
+    SC_AC_STATE_TYPE_U32 *state_table_u32;
+    /* for SC_AC_TABLE_BANDED, a band per state and the transitions of the
+     * bands */
+    SCACBand *bands;
+    SC_AC_STATE_TYPE_U32 *band_table;
+    uint32_t band_table_size;
 
     /* goto_table, failure table and output table.  Needed to create state_table.
      * Will be freed, once we have created the state_table */
-    int32_t (*goto_table)[256];
+    int32_t *goto_table;
     int32_t *failure_table;
     SCACOutputTable *output_table;
     SCACPatternList *pid_pat_list;
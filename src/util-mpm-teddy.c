@@ -0,0 +1,1053 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Teddy style bucketed literal matcher.
+ *
+ * The short patterns are spread over 8 buckets. For each of the first
+ * (up to) 3 bytes of the patterns two 16 byte tables map the low and the
+ * high nibble of an input byte to the buckets that have a pattern with a
+ * byte with that nibble at that position. Looking up both nibbles of 16
+ * (SSSE3) or 32 (AVX2) input bytes at once with pshufb and and'ing the
+ * results of the 3 positions leaves, per input offset, the buckets that
+ * may have a pattern starting there. Only those patterns are verified.
+ *
+ * - Without SSSE3 the same tables are used a byte at a time.
+ * - Patterns longer than SC_TEDDY_MAX_PATTERN_LEN are handed to an
+ *   internal ac ctx, as is the whole set if it has more short patterns
+ *   than the buckets can reasonably filter.
+ * - Offset and depth are ignored, like with ac.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "detect.h"
+#include "util-mpm-teddy.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-memcmp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+void SCTeddyInitCtx(MpmCtx *, int);
+void SCTeddyInitThreadCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+void SCTeddyDestroyCtx(MpmCtx *);
+void SCTeddyDestroyThreadCtx(MpmCtx *, MpmThreadCtx *);
+int SCTeddyAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, uint32_t, uint8_t);
+int SCTeddyAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, uint32_t, uint8_t);
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx);
+uint32_t SCTeddySearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+uint32_t SCTeddySearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                            PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen);
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx);
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
+void SCTeddyRegisterTests(void);
+
+/**
+ * \brief Register the teddy mpm.
+ */
+void MpmTeddyRegister(void)
+{
+    mpm_table[MPM_TEDDY].name = "teddy";
+    mpm_table[MPM_TEDDY].max_pattern_length = 0;
+
+    mpm_table[MPM_TEDDY].InitCtx = SCTeddyInitCtx;
+    mpm_table[MPM_TEDDY].InitThreadCtx = SCTeddyInitThreadCtx;
+    mpm_table[MPM_TEDDY].DestroyCtx = SCTeddyDestroyCtx;
+    mpm_table[MPM_TEDDY].DestroyThreadCtx = SCTeddyDestroyThreadCtx;
+    mpm_table[MPM_TEDDY].AddPattern = SCTeddyAddPatternCS;
+    mpm_table[MPM_TEDDY].AddPatternNocase = SCTeddyAddPatternCI;
+    mpm_table[MPM_TEDDY].Prepare = SCTeddyPreparePatterns;
+    mpm_table[MPM_TEDDY].Search = SCTeddySearch;
+    mpm_table[MPM_TEDDY].SearchLarge = SCTeddySearchLarge;
+    mpm_table[MPM_TEDDY].Cleanup = NULL;
+    mpm_table[MPM_TEDDY].PrintCtx = SCTeddyPrintInfo;
+    mpm_table[MPM_TEDDY].PrintThreadCtx = SCTeddyPrintSearchStats;
+    mpm_table[MPM_TEDDY].RegisterUnittests = SCTeddyRegisterTests;
+
+    return;
+}
+
+/**
+ * \internal
+ * \brief Free a pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param p       Pattern to free.
+ */
+static void SCTeddyFreePattern(MpmCtx *mpm_ctx, SCTeddyPattern *p)
+{
+    if (p == NULL)
+        return;
+
+    if (p->cs != NULL && p->cs != p->ci) {
+        SCFree(p->cs);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p->ci != NULL) {
+        SCFree(p->ci);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    SCFree(p);
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCTeddyPattern);
+}
+
+/**
+ * \internal
+ * \brief Add a pattern to the teddy context.
+ *
+ * \param mpm_ctx Mpm context.
+ * \param pat     Pointer to the pattern.
+ * \param patlen  Length of the pattern.
+ * \param pid     Pattern id
+ * \param sid     Signature id (internal id).
+ * \param flags   Pattern's MPM_PATTERN_* flags.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SCTeddyAddPattern(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                             uint16_t offset, uint16_t depth, uint32_t pid,
+                             uint32_t sid, uint8_t flags)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    SCLogDebug("Adding pattern for ctx %p, patlen %"PRIu16" and pid %" PRIu32,
+               ctx, patlen, pid);
+
+    if (patlen == 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "pattern length 0");
+        return 0;
+    }
+
+    if (ctx->init_hash == NULL) {
+        SCLogDebug("ctx already prepared");
+        return -1;
+    }
+
+    /* check if we have already inserted this pattern */
+    uint32_t hash = pid % SC_TEDDY_INIT_HASH_SIZE;
+    SCTeddyPattern *p = ctx->init_hash[hash];
+    for ( ; p != NULL; p = p->next) {
+        if (p->flags == flags && p->id == pid)
+            return 0;
+    }
+
+    p = SCMalloc(sizeof(SCTeddyPattern));
+    if (unlikely(p == NULL))
+        return -1;
+    memset(p, 0, sizeof(SCTeddyPattern));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCTeddyPattern);
+
+    p->len = patlen;
+    p->flags = flags;
+    p->id = pid;
+
+    p->ci = SCMalloc(patlen);
+    if (p->ci == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += patlen;
+
+    uint16_t u;
+    for (u = 0; u < patlen; u++)
+        p->ci[u] = u8_tolower(pat[u]);
+
+    if ((flags & MPM_PATTERN_FLAG_NOCASE) || memcmp(p->ci, pat, patlen) == 0) {
+        p->cs = p->ci;
+    } else {
+        p->cs = SCMalloc(patlen);
+        if (p->cs == NULL)
+            goto error;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += patlen;
+        memcpy(p->cs, pat, patlen);
+    }
+
+    p->next = ctx->init_hash[hash];
+    ctx->init_hash[hash] = p;
+
+    mpm_ctx->pattern_cnt++;
+
+    if (mpm_ctx->maxlen < patlen)
+        mpm_ctx->maxlen = patlen;
+    if (mpm_ctx->minlen == 0 || mpm_ctx->minlen > patlen)
+        mpm_ctx->minlen = patlen;
+
+    return 0;
+
+error:
+    SCTeddyFreePattern(mpm_ctx, p);
+    return -1;
+}
+
+/**
+ * \internal
+ * \brief qsort helper, orders patterns on their leading bytes so that
+ *        patterns sharing a bucket have similar filter bytes.
+ */
+static int SCTeddyPatternCmp(const void *a, const void *b)
+{
+    const SCTeddyPattern *pa = *(const SCTeddyPattern **)a;
+    const SCTeddyPattern *pb = *(const SCTeddyPattern **)b;
+
+    uint16_t len = (pa->len < pb->len) ? pa->len : pb->len;
+    if (len > SC_TEDDY_MAX_FILTER_LEN)
+        len = SC_TEDDY_MAX_FILTER_LEN;
+
+    int r = memcmp(pa->ci, pb->ci, len);
+    if (r != 0)
+        return r;
+    return (int)pa->len - (int)pb->len;
+}
+
+/**
+ * \internal
+ * \brief Set the bucket bit for a filter byte in the nibble masks.
+ */
+static inline void SCTeddySetMask(SCTeddyCtx *ctx, uint16_t pos, uint8_t c,
+                                  uint8_t bucket)
+{
+    ctx->lo_mask[pos][c & 0x0f] |= (1 << bucket);
+    ctx->hi_mask[pos][c >> 4] |= (1 << bucket);
+}
+
+/**
+ * \internal
+ * \brief Hand a pattern to the ac ctx, setting it up if needed.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SCTeddyAddPatternAC(MpmCtx *mpm_ctx, SCTeddyPattern *p)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    if (ctx->ac_ctx == NULL) {
+        ctx->ac_ctx = SCMalloc(sizeof(MpmCtx));
+        if (ctx->ac_ctx == NULL)
+            return -1;
+        memset(ctx->ac_ctx, 0, sizeof(MpmCtx));
+        MpmInitCtx(ctx->ac_ctx, MPM_AC, -1);
+    }
+
+    if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+        return mpm_table[MPM_AC].AddPatternNocase(ctx->ac_ctx, p->ci, p->len,
+                0, 0, p->id, 0, p->flags);
+    }
+    return mpm_table[MPM_AC].AddPattern(ctx->ac_ctx, p->cs, p->len,
+            0, 0, p->id, 0, p->flags);
+}
+
+/**
+ * \brief Process the patterns added to the mpm, and create the buckets and
+ *        nibble masks, and the ac ctx if needed.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    SCTeddyPattern *p, *np;
+    uint32_t short_cnt = 0;
+    uint32_t i;
+
+    if (mpm_ctx->pattern_cnt == 0 || ctx->init_hash == NULL) {
+        SCLogDebug("no patterns supplied to this mpm_ctx");
+        return 0;
+    }
+
+    for (i = 0; i < SC_TEDDY_INIT_HASH_SIZE; i++) {
+        for (p = ctx->init_hash[i]; p != NULL; p = p->next) {
+            if (p->len <= SC_TEDDY_MAX_PATTERN_LEN)
+                short_cnt++;
+        }
+    }
+    /* too many to filter with 8 buckets, let ac do them all */
+    if (short_cnt > SC_TEDDY_MAX_PATTERNS)
+        short_cnt = 0;
+
+    if (short_cnt > 0) {
+        ctx->parray = SCMalloc(short_cnt * sizeof(SCTeddyPattern *));
+        if (ctx->parray == NULL)
+            goto error;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += (short_cnt * sizeof(SCTeddyPattern *));
+    }
+
+    /* move the short patterns to the pattern array, the rest to ac */
+    for (i = 0; i < SC_TEDDY_INIT_HASH_SIZE; i++) {
+        for (p = ctx->init_hash[i]; p != NULL; p = np) {
+            np = p->next;
+            p->next = NULL;
+            ctx->init_hash[i] = np;
+
+            if (short_cnt > 0 && p->len <= SC_TEDDY_MAX_PATTERN_LEN) {
+                ctx->parray[ctx->pattern_cnt++] = p;
+            } else {
+                int r = SCTeddyAddPatternAC(mpm_ctx, p);
+                SCTeddyFreePattern(mpm_ctx, p);
+                if (r != 0)
+                    goto error;
+            }
+        }
+    }
+
+    /* we no longer need the hash, so free it's memory */
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= (SC_TEDDY_INIT_HASH_SIZE * sizeof(SCTeddyPattern *));
+
+    if (ctx->ac_ctx != NULL) {
+        if (mpm_table[MPM_AC].Prepare(ctx->ac_ctx) != 0)
+            goto error;
+        SCLogDebug("%"PRIu32" patterns handed to ac",
+                ctx->ac_ctx->pattern_cnt);
+    }
+
+    if (ctx->pattern_cnt == 0)
+        return 0;
+
+    qsort(ctx->parray, ctx->pattern_cnt, sizeof(SCTeddyPattern *),
+          SCTeddyPatternCmp);
+
+    ctx->filter_len = SC_TEDDY_MAX_FILTER_LEN;
+    for (i = 0; i < ctx->pattern_cnt; i++) {
+        if (ctx->parray[i]->len < ctx->filter_len)
+            ctx->filter_len = ctx->parray[i]->len;
+    }
+
+    /* spread the patterns evenly over the buckets, keeping neighbours in
+     * the sort order together */
+    uint8_t b;
+    for (b = 0; b <= SC_TEDDY_BUCKETS; b++) {
+        ctx->bucket_start[b] = (b * ctx->pattern_cnt) / SC_TEDDY_BUCKETS;
+    }
+
+    for (b = 0; b < SC_TEDDY_BUCKETS; b++) {
+        for (i = ctx->bucket_start[b]; i < ctx->bucket_start[b + 1]; i++) {
+            p = ctx->parray[i];
+
+            uint16_t pos;
+            for (pos = 0; pos < ctx->filter_len; pos++) {
+                if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                    SCTeddySetMask(ctx, pos, p->ci[pos], b);
+                    SCTeddySetMask(ctx, pos, toupper(p->ci[pos]), b);
+                } else {
+                    SCTeddySetMask(ctx, pos, p->cs[pos], b);
+                }
+            }
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+/**
+ * \brief Init the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param matchsize      We don't need this.
+ */
+void SCTeddyInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, uint32_t matchsize)
+{
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+
+    mpm_thread_ctx->ctx = SCMalloc(sizeof(SCTeddyThreadCtx));
+    if (mpm_thread_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_thread_ctx->ctx, 0, sizeof(SCTeddyThreadCtx));
+    mpm_thread_ctx->memory_cnt++;
+    mpm_thread_ctx->memory_size += sizeof(SCTeddyThreadCtx);
+
+    SCTeddyThreadCtx *tctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+    mpm_table[MPM_AC].InitThreadCtx(NULL, &tctx->ac_thread_ctx, matchsize);
+
+    return;
+}
+
+/**
+ * \brief Initialize the teddy context.
+ *
+ * \param mpm_ctx       Mpm context.
+ * \param module_handle Cuda module handle from the cuda handler API.  We don't
+ *                      have to worry about this here.
+ */
+void SCTeddyInitCtx(MpmCtx *mpm_ctx, int module_handle)
+{
+    if (mpm_ctx->ctx != NULL)
+        return;
+
+    mpm_ctx->ctx = SCMalloc(sizeof(SCTeddyCtx));
+    if (mpm_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->ctx, 0, sizeof(SCTeddyCtx));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCTeddyCtx);
+
+    /* initialize the hash we use to cull duplicate patterns */
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    ctx->init_hash = SCMalloc(sizeof(SCTeddyPattern *) * SC_TEDDY_INIT_HASH_SIZE);
+    if (ctx->init_hash == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->init_hash, 0, sizeof(SCTeddyPattern *) * SC_TEDDY_INIT_HASH_SIZE);
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (SC_TEDDY_INIT_HASH_SIZE * sizeof(SCTeddyPattern *));
+
+    SCReturn;
+}
+
+/**
+ * \brief Destroy the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCTeddyDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+    SCTeddyPrintSearchStats(mpm_thread_ctx);
+
+    if (mpm_thread_ctx->ctx != NULL) {
+        SCTeddyThreadCtx *tctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+        mpm_table[MPM_AC].DestroyThreadCtx(NULL, &tctx->ac_thread_ctx);
+
+        SCFree(mpm_thread_ctx->ctx);
+        mpm_thread_ctx->ctx = NULL;
+        mpm_thread_ctx->memory_cnt--;
+        mpm_thread_ctx->memory_size -= sizeof(SCTeddyThreadCtx);
+    }
+
+    return;
+}
+
+/**
+ * \brief Destroy the mpm context.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+void SCTeddyDestroyCtx(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    if (ctx == NULL)
+        return;
+
+    if (ctx->init_hash != NULL) {
+        uint32_t i;
+        for (i = 0; i < SC_TEDDY_INIT_HASH_SIZE; i++) {
+            SCTeddyPattern *p, *np;
+            for (p = ctx->init_hash[i]; p != NULL; p = np) {
+                np = p->next;
+                SCTeddyFreePattern(mpm_ctx, p);
+            }
+        }
+        SCFree(ctx->init_hash);
+        ctx->init_hash = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (SC_TEDDY_INIT_HASH_SIZE * sizeof(SCTeddyPattern *));
+    }
+
+    if (ctx->parray != NULL) {
+        uint32_t i;
+        for (i = 0; i < ctx->pattern_cnt; i++) {
+            SCTeddyFreePattern(mpm_ctx, ctx->parray[i]);
+        }
+        SCFree(ctx->parray);
+        ctx->parray = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    }
+
+    if (ctx->ac_ctx != NULL) {
+        mpm_table[MPM_AC].DestroyCtx(ctx->ac_ctx);
+        SCFree(ctx->ac_ctx);
+        ctx->ac_ctx = NULL;
+    }
+
+    SCFree(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCTeddyCtx);
+
+    return;
+}
+
+/**
+ * \internal
+ * \brief Verify the patterns of the buckets the filter passed for an
+ *        offset in the buffer.
+ *
+ * \param ctx     Teddy ctx.
+ * \param pmq     Pattern matcher queue to add the matches to.
+ * \param buf     Buffer being searched.
+ * \param buflen  Buffer length.
+ * \param offset  Offset in buf where the patterns would start.
+ * \param buckets Bucket bits the filter passed.
+ *
+ * \retval matches Match count.
+ */
+static inline uint32_t SCTeddyVerify(SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+                                     uint8_t *buf, uint32_t buflen,
+                                     uint32_t offset, uint8_t buckets)
+{
+    uint32_t matches = 0;
+
+    while (buckets != 0) {
+        int b = __builtin_ctz(buckets);
+        buckets &= buckets - 1;
+
+        uint32_t i;
+        for (i = ctx->bucket_start[b]; i < ctx->bucket_start[b + 1]; i++) {
+            SCTeddyPattern *p = ctx->parray[i];
+
+            if (offset + p->len > buflen)
+                continue;
+
+            if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                /* SCMemcmpLowercase may skip the first byte */
+                if (u8_tolower(buf[offset]) != p->ci[0] ||
+                    SCMemcmpLowercase(p->ci, buf + offset, p->len) != 0)
+                    continue;
+            } else {
+                if (SCMemcmp(p->cs, buf + offset, p->len) != 0)
+                    continue;
+            }
+
+            if (!(pmq->pattern_id_bitarray[p->id / 8] & (1 << (p->id % 8)))) {
+                pmq->pattern_id_bitarray[p->id / 8] |= (1 << (p->id % 8));
+                pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = p->id;
+            }
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \brief The teddy search function, for buffers of any size.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCTeddySearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                            PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    SCTeddyThreadCtx *tctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+    uint32_t matches = 0;
+
+#ifdef SC_TEDDY_COUNTERS
+    tctx->total_calls++;
+#endif
+
+    if (ctx->ac_ctx != NULL) {
+        matches += mpm_table[MPM_AC].SearchLarge(ctx->ac_ctx,
+                &tctx->ac_thread_ctx, pmq, buf, buflen);
+    }
+
+    if (ctx->pattern_cnt == 0 || buflen < ctx->filter_len)
+        goto end;
+
+    uint16_t flen = ctx->filter_len;
+    uint32_t i = 0;
+    uint16_t pos;
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+    const __m128i nibble128 = _mm_set1_epi8(0x0f);
+    __m128i lo128[SC_TEDDY_MAX_FILTER_LEN];
+    __m128i hi128[SC_TEDDY_MAX_FILTER_LEN];
+    for (pos = 0; pos < flen; pos++) {
+        lo128[pos] = _mm_loadu_si128((const __m128i *)ctx->lo_mask[pos]);
+        hi128[pos] = _mm_loadu_si128((const __m128i *)ctx->hi_mask[pos]);
+    }
+#endif
+
+#if defined(__AVX2__)
+    /* pshufb works per 128 bit lane, so both lanes get the tables */
+    const __m256i nibble256 = _mm256_set1_epi8(0x0f);
+    __m256i lo256[SC_TEDDY_MAX_FILTER_LEN];
+    __m256i hi256[SC_TEDDY_MAX_FILTER_LEN];
+    for (pos = 0; pos < flen; pos++) {
+        lo256[pos] = _mm256_broadcastsi128_si256(lo128[pos]);
+        hi256[pos] = _mm256_broadcastsi128_si256(hi128[pos]);
+    }
+
+    for ( ; i + 32 + flen - 1 <= buflen; i += 32) {
+        __m256i r = _mm256_set1_epi8((char)0xff);
+        for (pos = 0; pos < flen; pos++) {
+            __m256i in = _mm256_loadu_si256((const __m256i *)(buf + i + pos));
+            __m256i l = _mm256_shuffle_epi8(lo256[pos],
+                    _mm256_and_si256(in, nibble256));
+            __m256i h = _mm256_shuffle_epi8(hi256[pos],
+                    _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble256));
+            r = _mm256_and_si256(r, _mm256_and_si256(l, h));
+        }
+
+        uint32_t m = ~(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(r, _mm256_setzero_si256()));
+        if (m == 0)
+            continue;
+
+        uint8_t res[32];
+        _mm256_storeu_si256((__m256i *)res, r);
+        while (m != 0) {
+            int k = __builtin_ctz(m);
+            m &= m - 1;
+            matches += SCTeddyVerify(ctx, pmq, buf, buflen, i + k, res[k]);
+        }
+    }
+#endif /* __AVX2__ */
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+    for ( ; i + 16 + flen - 1 <= buflen; i += 16) {
+        __m128i r = _mm_set1_epi8((char)0xff);
+        for (pos = 0; pos < flen; pos++) {
+            __m128i in = _mm_loadu_si128((const __m128i *)(buf + i + pos));
+            __m128i l = _mm_shuffle_epi8(lo128[pos],
+                    _mm_and_si128(in, nibble128));
+            __m128i h = _mm_shuffle_epi8(hi128[pos],
+                    _mm_and_si128(_mm_srli_epi16(in, 4), nibble128));
+            r = _mm_and_si128(r, _mm_and_si128(l, h));
+        }
+
+        uint32_t m = (~(uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(r, _mm_setzero_si128()))) & 0xffff;
+        if (m == 0)
+            continue;
+
+        uint8_t res[16];
+        _mm_storeu_si128((__m128i *)res, r);
+        while (m != 0) {
+            int k = __builtin_ctz(m);
+            m &= m - 1;
+            matches += SCTeddyVerify(ctx, pmq, buf, buflen, i + k, res[k]);
+        }
+    }
+#endif /* __SSSE3__ || __AVX2__ */
+
+    /* the tail, or all of the buffer without SSSE3 */
+    for ( ; i + flen <= buflen; i++) {
+        uint8_t r = 0xff;
+        for (pos = 0; pos < flen; pos++) {
+            uint8_t c = buf[i + pos];
+            r &= ctx->lo_mask[pos][c & 0x0f] & ctx->hi_mask[pos][c >> 4];
+        }
+        if (r != 0)
+            matches += SCTeddyVerify(ctx, pmq, buf, buflen, i, r);
+    }
+
+end:
+#ifdef SC_TEDDY_COUNTERS
+    tctx->total_matches += matches;
+#endif
+    return matches;
+}
+
+/**
+ * \brief The teddy search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCTeddySearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    return SCTeddySearchLarge(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+}
+
+/**
+ * \brief Add a case insensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        uint32_t sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return SCTeddyAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/**
+ * \brief Add a case sensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        uint32_t sid, uint8_t flags)
+{
+    return SCTeddyAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx)
+{
+
+#ifdef SC_TEDDY_COUNTERS
+    SCTeddyThreadCtx *ctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+    printf("Teddy Thread Search stats (ctx %p)\n", ctx);
+    printf("Total calls: %" PRIu32 "\n", ctx->total_calls);
+    printf("Total matches: %" PRIu64 "\n", ctx->total_matches);
+#endif /* SC_TEDDY_COUNTERS */
+
+    return;
+}
+
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    printf("MPM Teddy Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf(" Sizeof:\n");
+    printf("  MpmCtx         %" PRIuMAX "\n", (uintmax_t)sizeof(MpmCtx));
+    printf("  SCTeddyCtx:    %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyCtx));
+    printf("  SCTeddyPattern %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyPattern));
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Bucket patterns: %" PRIu32 "\n", ctx->pattern_cnt);
+    printf("Filter length:   %" PRIu32 "\n", ctx->filter_len);
+    if (ctx->ac_ctx != NULL) {
+        printf("AC patterns:     %" PRIu32 "\n", ctx->ac_ctx->pattern_cnt);
+        mpm_table[MPM_AC].PrintCtx(ctx->ac_ctx);
+    }
+    printf("\n");
+
+    return;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/**
+ * \internal
+ * \brief Search buf with a teddy ctx of the patterns, nocase if the
+ *        pattern starts with a '~'.
+ *
+ * \retval cnt match count, -1 on setup failure
+ */
+static int SCTeddyTestSearch(char **pats, int pats_cnt, char *buf,
+                             uint16_t buflen, SCTeddyCtx *out)
+{
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    int i;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_TEDDY, -1);
+    SCTeddyInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    for (i = 0; i < pats_cnt; i++) {
+        if (pats[i][0] == '~') {
+            SCTeddyAddPatternCI(&mpm_ctx, (uint8_t *)pats[i] + 1,
+                                strlen(pats[i]) - 1, 0, 0, i, 0, 0);
+        } else {
+            SCTeddyAddPatternCS(&mpm_ctx, (uint8_t *)pats[i],
+                                strlen(pats[i]), 0, 0, i, 0, 0);
+        }
+    }
+    PmqSetup(&pmq, 0, pats_cnt);
+
+    SCTeddyPreparePatterns(&mpm_ctx);
+
+    int cnt = (int)SCTeddySearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                 (uint8_t *)buf, buflen);
+
+    /* each pattern only once in the queue */
+    for (i = 0; i < (int)pmq.pattern_id_array_cnt; i++) {
+        uint32_t j;
+        for (j = i + 1; j < pmq.pattern_id_array_cnt; j++) {
+            if (pmq.pattern_id_array[i] == pmq.pattern_id_array[j])
+                cnt = -1;
+        }
+    }
+
+    if (out != NULL) {
+        SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx.ctx;
+        out->pattern_cnt = ctx->pattern_cnt;
+        out->filter_len = ctx->filter_len;
+        out->ac_ctx = ctx->ac_ctx;
+    }
+
+    SCTeddyDestroyCtx(&mpm_ctx);
+    SCTeddyDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return cnt;
+}
+
+static int SCTeddyTest01(void)
+{
+    char *pats[] = { "abcd" };
+    char *buf = "abcdefghjiklmnopqrstuvwxyz";
+
+    int cnt = SCTeddyTestSearch(pats, 1, buf, strlen(buf), NULL);
+    if (cnt != 1) {
+        printf("1 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+static int SCTeddyTest02(void)
+{
+    char *pats[] = { "abce" };
+    char *buf = "abcdefghjiklmnopqrstuvwxyz";
+
+    int cnt = SCTeddyTestSearch(pats, 1, buf, strlen(buf), NULL);
+    if (cnt != 0) {
+        printf("0 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+static int SCTeddyTest03(void)
+{
+    char *pats[] = { "abcd", "bcde", "fghj" };
+    char *buf = "abcdefghjiklmnopqrstuvwxyz";
+
+    int cnt = SCTeddyTestSearch(pats, 3, buf, strlen(buf), NULL);
+    if (cnt != 3) {
+        printf("3 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+/** \test nocase and case sensitive patterns */
+static int SCTeddyTest04(void)
+{
+    char *pats[] = { "~ABCD", "BCDE", "~fGhJ", "Fghj" };
+    char *buf = "abcdEFGHJiklmnopqrstuvwxyz";
+
+    int cnt = SCTeddyTestSearch(pats, 4, buf, strlen(buf), NULL);
+    if (cnt != 2) {
+        printf("2 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+/** \test matches across the simd blocks and in the tail */
+static int SCTeddyTest05(void)
+{
+    char *pats[] = { "opqr", "wxyz", "ABCD", "z0" };
+    char *buf = "abcdefghjiklmnopqrstuvwxyz0123456789ABCDEFGHJIKLMNOPQRSTUVWXYZ";
+
+    int cnt = SCTeddyTestSearch(pats, 4, buf, strlen(buf), NULL);
+    if (cnt != 4) {
+        printf("4 != %d ", cnt);
+        return 0;
+    }
+
+    /* pattern ending at the last byte of the buffer */
+    char *pats2[] = { "XYZ" };
+    cnt = SCTeddyTestSearch(pats2, 1, buf, strlen(buf), NULL);
+    if (cnt != 1) {
+        printf("1 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+/** \test every occurrence is counted, the pmq gets the pattern once */
+static int SCTeddyTest06(void)
+{
+    char *pats[] = { "aa" };
+    char *buf = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+
+    int cnt = SCTeddyTestSearch(pats, 1, buf, strlen(buf), NULL);
+    if (cnt != 39) {
+        printf("39 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+/** \test one byte pattern */
+static int SCTeddyTest07(void)
+{
+    char *pats[] = { "a", "bc" };
+    char *buf = "aXa bc a";
+    SCTeddyCtx ctx;
+
+    int cnt = SCTeddyTestSearch(pats, 2, buf, strlen(buf), &ctx);
+    if (cnt != 4) {
+        printf("4 != %d ", cnt);
+        return 0;
+    }
+    if (ctx.filter_len != 1) {
+        printf("filter_len %u != 1 ", ctx.filter_len);
+        return 0;
+    }
+    return 1;
+}
+
+/** \test long patterns are handed to ac */
+static int SCTeddyTest08(void)
+{
+    char *pats[] = { "abcdefghjiklmnopqrstuvwxyz", "mnop", "~0123456789ABCDEFGHJ" };
+    char *buf = "abcdefghjiklmnopqrstuvwxyz0123456789abcdefghj";
+    SCTeddyCtx ctx;
+
+    int cnt = SCTeddyTestSearch(pats, 3, buf, strlen(buf), &ctx);
+    if (cnt != 3) {
+        printf("3 != %d ", cnt);
+        return 0;
+    }
+    if (ctx.pattern_cnt != 1 || ctx.ac_ctx == NULL) {
+        printf("long patterns not in ac: ");
+        return 0;
+    }
+    return 1;
+}
+
+/** \test too many patterns for the buckets are all handed to ac */
+static int SCTeddyTest09(void)
+{
+    char pat_buf[SC_TEDDY_MAX_PATTERNS + 1][8];
+    char *pats[SC_TEDDY_MAX_PATTERNS + 1];
+    char buf[(SC_TEDDY_MAX_PATTERNS + 1) * 8];
+    SCTeddyCtx ctx;
+    int i;
+
+    buf[0] = '\0';
+    for (i = 0; i <= SC_TEDDY_MAX_PATTERNS; i++) {
+        snprintf(pat_buf[i], sizeof(pat_buf[i]), "p%03d", i);
+        pats[i] = pat_buf[i];
+        strlcat(buf, pat_buf[i], sizeof(buf));
+        strlcat(buf, " ", sizeof(buf));
+    }
+
+    int cnt = SCTeddyTestSearch(pats, SC_TEDDY_MAX_PATTERNS + 1, buf,
+                                strlen(buf), &ctx);
+    if (cnt != SC_TEDDY_MAX_PATTERNS + 1) {
+        printf("%d != %d ", SC_TEDDY_MAX_PATTERNS + 1, cnt);
+        return 0;
+    }
+    if (ctx.pattern_cnt != 0 || ctx.ac_ctx == NULL) {
+        printf("patterns not in ac: ");
+        return 0;
+    }
+    return 1;
+}
+
+/** \test buffer shorter than the filter, and an empty ctx */
+static int SCTeddyTest10(void)
+{
+    char *pats[] = { "abcd" };
+
+    int cnt = SCTeddyTestSearch(pats, 1, "ab", 2, NULL);
+    if (cnt != 0) {
+        printf("0 != %d ", cnt);
+        return 0;
+    }
+
+    cnt = SCTeddyTestSearch(NULL, 0, "abcd", 4, NULL);
+    if (cnt != 0) {
+        printf("0 != %d ", cnt);
+        return 0;
+    }
+    return 1;
+}
+
+#endif /* UNITTESTS */
+
+void SCTeddyRegisterTests(void)
+{
+
+#ifdef UNITTESTS
+    UtRegisterTest("SCTeddyTest01", SCTeddyTest01, 1);
+    UtRegisterTest("SCTeddyTest02", SCTeddyTest02, 1);
+    UtRegisterTest("SCTeddyTest03", SCTeddyTest03, 1);
+    UtRegisterTest("SCTeddyTest04", SCTeddyTest04, 1);
+    UtRegisterTest("SCTeddyTest05", SCTeddyTest05, 1);
+    UtRegisterTest("SCTeddyTest06", SCTeddyTest06, 1);
+    UtRegisterTest("SCTeddyTest07", SCTeddyTest07, 1);
+    UtRegisterTest("SCTeddyTest08", SCTeddyTest08, 1);
+    UtRegisterTest("SCTeddyTest09", SCTeddyTest09, 1);
+    UtRegisterTest("SCTeddyTest10", SCTeddyTest10, 1);
+#endif /* UNITTESTS */
+
+    return;
+}
@@ -0,0 +1,95 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Teddy style bucketed literal matcher.
+ */
+
+#ifndef __UTIL_MPM_TEDDY_H__
+#define __UTIL_MPM_TEDDY_H__
+
+#include "util-mpm.h"
+
+/** no of buckets, one bit per bucket in the nibble masks */
+#define SC_TEDDY_BUCKETS            8
+/** max no of leading pattern bytes the filter looks at */
+#define SC_TEDDY_MAX_FILTER_LEN     3
+/** patterns longer than this are handed to ac */
+#define SC_TEDDY_MAX_PATTERN_LEN    16
+/** with more short patterns than this the buckets get too crowded, so
+ *  the whole ctx is handed to ac */
+#define SC_TEDDY_MAX_PATTERNS       64
+/** size of the hash used to cull duplicate patterns on insertion */
+#define SC_TEDDY_INIT_HASH_SIZE     4096
+
+typedef struct SCTeddyPattern_ {
+    /* length of the pattern */
+    uint16_t len;
+    /* flags decribing the pattern */
+    uint8_t flags;
+    /* case sensitive, same as ci for nocase patterns */
+    uint8_t *cs;
+    /* case INsensitive */
+    uint8_t *ci;
+    /* pattern id */
+    uint32_t id;
+
+    struct SCTeddyPattern_ *next;
+} SCTeddyPattern;
+
+typedef struct SCTeddyCtx_ {
+    /* nibble masks per filter byte: bit b is set if a pattern of bucket b
+     * can have a byte with that low/high nibble at that position */
+    uint8_t lo_mask[SC_TEDDY_MAX_FILTER_LEN][16];
+    uint8_t hi_mask[SC_TEDDY_MAX_FILTER_LEN][16];
+
+    /* no of leading bytes the filter looks at */
+    uint16_t filter_len;
+
+    /* patterns, sorted on their bucket */
+    SCTeddyPattern **parray;
+    uint32_t pattern_cnt;
+    /* patterns of bucket b are parray[bucket_start[b]] up to
+     * parray[bucket_start[b + 1]] */
+    uint32_t bucket_start[SC_TEDDY_BUCKETS + 1];
+
+    /* hash of the added patterns on their id, used until the ctx is
+     * prepared */
+    SCTeddyPattern **init_hash;
+
+    /* ac ctx for the long patterns, or for all patterns if there are too
+     * many for the buckets. NULL if not needed. */
+    MpmCtx *ac_ctx;
+} SCTeddyCtx;
+
+typedef struct SCTeddyThreadCtx_ {
+    /* thread ctx of the ac ctx */
+    MpmThreadCtx ac_thread_ctx;
+
+    /* the total calls we make to the search function */
+    uint32_t total_calls;
+    /* the no of candidates the filter passed to verification */
+    uint64_t total_candidates;
+    /* the total patterns that we ended up matching against */
+    uint64_t total_matches;
+} SCTeddyThreadCtx;
+
+void MpmTeddyRegister(void);
+
+#endif /* __UTIL_MPM_TEDDY_H__ */
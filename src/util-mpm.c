@@ -37,6 +37,7 @@
 #include "util-mpm-ac.h"
 #include "util-mpm-ac-gfbs.h"
 #include "util-mpm-ac-bs.h"
+#include "util-mpm-teddy.h"
 #include "util-hashlist.h"
 
 #include "detect-engine.h"
@@ -440,6 +441,54 @@ void MpmInitCtx (MpmCtx *mpm_ctx, uint16_t matcher, int module_handle) {
     mpm_table[matcher].InitCtx(mpm_ctx, module_handle);
 }
 
+/**
+ * \brief Search a buffer that can be larger than 64k.
+ *
+ * Matchers with a SearchLarge function scan the buffer in one pass. For
+ * the others the buffer is searched in 64k chunks, each overlapping the
+ * previous one by maxlen - 1 bytes so that no match is lost at a chunk
+ * boundary. A pattern inside the overlap is reported twice to the pmq,
+ * which keeps the pattern id only once.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pattern Matcher Queue to hold the matches.
+ * \param buf            Buffer to search.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t MpmSearchLarge(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                        PatternMatcherQueue *pmq, uint8_t *buf, uint32_t buflen)
+{
+    MpmTableElmt *m = &mpm_table[mpm_ctx->mpm_type];
+
+    if (m->SearchLarge != NULL)
+        return m->SearchLarge(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+
+    if (buflen <= UINT16_MAX)
+        return m->Search(mpm_ctx, mpm_thread_ctx, pmq, buf, (uint16_t)buflen);
+
+    uint32_t overlap = (mpm_ctx->maxlen > 1) ? (mpm_ctx->maxlen - 1) : 0;
+    uint32_t matches = 0;
+    uint32_t offset = 0;
+
+    while (1) {
+        uint32_t len = buflen - offset;
+        if (len > UINT16_MAX)
+            len = UINT16_MAX;
+
+        matches += m->Search(mpm_ctx, mpm_thread_ctx, pmq, buf + offset,
+                             (uint16_t)len);
+
+        if (offset + len >= buflen)
+            break;
+        offset += (len - overlap);
+    }
+
+    return matches;
+}
+
 void MpmTableSetup(void) {
     memset(mpm_table, 0, sizeof(mpm_table));
 
@@ -454,6 +503,7 @@ void MpmTableSetup(void) {
     MpmACRegister();
     MpmACBSRegister();
     MpmACGfbsRegister();
+    MpmTeddyRegister();
 }
 
 /** \brief  Function to return the default hash size for the mpm algorithm,
@@ -1271,6 +1321,64 @@ static int MpmTest11(void)
 }
 
 #endif /* __SC_CUDA_SUPPORT__ */
+
+/**
+ * \test MpmSearchLarge on a matcher without SearchLarge, with the matches
+ *       at the chunk boundary and past 64k.
+ */
+static int MpmSearchLargeTest01(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    uint32_t buflen = 3 * 65536;
+    uint8_t *buf = NULL;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    memset(&pmq, 0, sizeof(PatternMatcherQueue));
+    MpmInitCtx(&mpm_ctx, MPM_B2G, -1);
+    MpmInitThreadCtx(&mpm_thread_ctx, MPM_B2G, 3);
+
+    if (mpm_table[MPM_B2G].SearchLarge != NULL) {
+        printf("b2g has a SearchLarge function: ");
+        goto end;
+    }
+
+    mpm_table[MPM_B2G].AddPattern(&mpm_ctx, (uint8_t *)"abcdef", 6, 0, 0, 0, 0, 0);
+    mpm_table[MPM_B2G].AddPattern(&mpm_ctx, (uint8_t *)"ghijkl", 6, 0, 0, 1, 0, 0);
+    mpm_table[MPM_B2G].AddPattern(&mpm_ctx, (uint8_t *)"mnopqr", 6, 0, 0, 2, 0, 0);
+    mpm_table[MPM_B2G].Prepare(&mpm_ctx);
+    PmqSetup(&pmq, 0, 3);
+
+    buf = SCMalloc(buflen);
+    if (buf == NULL)
+        goto end;
+    memset(buf, 'x', buflen);
+    /* across the end of the first 64k chunk */
+    memcpy(buf + 65532, "abcdef", 6);
+    /* in the middle of the buffer */
+    memcpy(buf + 100000, "ghijkl", 6);
+    /* at the very end */
+    memcpy(buf + buflen - 6, "mnopqr", 6);
+
+    (void)MpmSearchLarge(&mpm_ctx, &mpm_thread_ctx, &pmq, buf, buflen);
+
+    if (pmq.pattern_id_array_cnt != 3) {
+        printf("3 != %" PRIu32 ": ", pmq.pattern_id_array_cnt);
+        goto end;
+    }
+
+    result = 1;
+ end:
+    if (buf != NULL)
+        SCFree(buf);
+    mpm_table[MPM_B2G].DestroyCtx(&mpm_ctx);
+    mpm_table[MPM_B2G].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
 #endif /* UNITTESTS */
 
 void MpmRegisterTests(void) {
@@ -1288,6 +1396,8 @@ void MpmRegisterTests(void) {
         }
     }
 
+    UtRegisterTest("MpmSearchLargeTest01", MpmSearchLargeTest01, 1);
+
 #ifdef __SC_CUDA_SUPPORT__
     UtRegisterTest("MpmTest01", MpmTest01, 1);
     UtRegisterTest("MpmTest02", MpmTest02, 1);
@@ -78,6 +78,8 @@ enum {
     /* aho-corasick-goto-failure state based */
     MPM_AC_GFBS,
     MPM_AC_BS,
+    /* teddy style simd literal filter */
+    MPM_TEDDY,
     /* table size */
     MPM_TABLE_SIZE,
 };
@@ -177,6 +179,16 @@ typedef struct MpmTableElmt_ {
     int  (*AddPatternNocase)(struct MpmCtx_ *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
     int  (*Prepare)(struct MpmCtx_ *);
     uint32_t (*Search)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint16_t);
+    /** search a buffer of up to 4GB in a single pass. Optional, for the
+     *  matchers that don't have it MpmSearchLarge() calls Search on
+     *  overlapping 64k chunks */
+    uint32_t (*SearchLarge)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint32_t);
+    /** search the next buffer of a stream, starting in the matcher state
+     *  the previous buffer ended in (0 at the start of the stream). The
+     *  end state is stored in the state argument. Matches that started in
+     *  a previous buffer are added to the last pmq as well, if not NULL.
+     *  Optional. */
+    uint32_t (*SearchStream)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint32_t, uint32_t *, PatternMatcherQueue *);
     void (*Cleanup)(struct MpmThreadCtx_ *);
     void (*PrintCtx)(struct MpmCtx_ *);
     void (*PrintThreadCtx)(struct MpmThreadCtx_ *);
@@ -231,6 +243,8 @@ void MpmRegisterTests(void);
 int32_t MpmMatcherGetMaxPatternLength(uint16_t);
 
 int MpmVerifyMatch(MpmThreadCtx *, PatternMatcherQueue *, uint32_t);
+uint32_t MpmSearchLarge(MpmCtx *, MpmThreadCtx *, PatternMatcherQueue *,
+                        uint8_t *, uint32_t);
 void MpmInitCtx (MpmCtx *mpm_ctx, uint16_t matcher, int module_handle);
 void MpmInitThreadCtx(MpmThreadCtx *mpm_thread_ctx, uint16_t, uint32_t);
 uint32_t MpmGetHashSize(const char *);
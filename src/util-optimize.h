@@ -43,5 +43,10 @@
  */
 #define hw_barrier() __sync_synchronize()
 
+/** hint the cpu to pull the cache line of addr in for reading */
+#ifndef prefetch
+#define prefetch(addr) __builtin_prefetch((addr), 0, 3)
+#endif
+
 #endif /* __UTIL_OPTIMIZE_H__ */
 
@@ -0,0 +1,689 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Memory mapped pcap and pcapng file reader.
+ *
+ * The whole file is mapped and the packets returned by
+ * PcapMmapNext() point into the mapping, so nothing is copied. The mapping
+ * is reference counted: it stays around until the reader and every packet
+ * using it have dropped their reference.
+ *
+ * The kernel is told we read the file sequentially and we ask for the
+ * next PCAP_MMAP_READAHEAD bytes ahead of time with MADV_WILLNEED.
+ */
+
+#include "suricata-common.h"
+#include "util-pcap-mmap.h"
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-error.h"
+#include "util-unittest.h"
+
+#include <sys/mman.h>
+
+#define PCAP_MAGIC              0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED      0xd4c3b2a1
+#define PCAP_MAGIC_NSEC         0xa1b23c4d
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+
+#define PCAP_FILE_HDR_LEN       24
+#define PCAP_REC_HDR_LEN        16
+
+#define PCAPNG_BLOCK_SHB        0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB        0x00000001
+#define PCAPNG_BLOCK_SPB        0x00000003
+#define PCAPNG_BLOCK_EPB        0x00000006
+#define PCAPNG_BOM              0x1a2b3c4d
+#define PCAPNG_BOM_SWAPPED      0x4d3c2b1a
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_IF_TSRESOL   9
+
+static inline uint16_t PcapMmapGet16(PcapMmapFile *f, uint8_t *ptr)
+{
+    uint16_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return f->swapped ? SCByteSwap16(v) : v;
+}
+
+static inline uint32_t PcapMmapGet32(PcapMmapFile *f, uint8_t *ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return f->swapped ? SCByteSwap32(v) : v;
+}
+
+/**
+ * \brief ask the kernel for the next window once we get close to the end
+ *        of the current one
+ */
+static inline void PcapMmapReadAhead(PcapMmapFile *f)
+{
+    if (f->advised >= f->size ||
+            f->offset + PCAP_MMAP_READAHEAD / 2 < f->advised)
+        return;
+
+    uint64_t len = PCAP_MMAP_READAHEAD;
+    if (f->advised + len > f->size)
+        len = f->size - f->advised;
+
+    (void)madvise(f->map + f->advised, len, MADV_WILLNEED);
+    f->advised += len;
+}
+
+static void PcapMmapTsConvert(uint64_t ts, uint64_t units, struct timeval *tv)
+{
+    uint64_t frac = ts % units;
+
+    tv->tv_sec = ts / units;
+    if (units >= 1000000)
+        tv->tv_usec = frac / (units / 1000000);
+    else
+        tv->tv_usec = frac * (1000000 / units);
+}
+
+static int PcapMmapParseIdb(PcapMmapFile *f, uint8_t *body, uint32_t body_len)
+{
+    if (body_len < 8) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "pcapng interface block too short");
+        return -1;
+    }
+    if (f->iface_cnt >= PCAP_MMAP_MAX_IFACES) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "pcapng file has more than %d "
+                   "interfaces", PCAP_MMAP_MAX_IFACES);
+        return -1;
+    }
+
+    PcapMmapIface *iface = &f->ifaces[f->iface_cnt];
+    iface->datalink = PcapMmapGet16(f, body);
+    iface->ts_units = 1000000;
+
+    /* look for the timestamp resolution option */
+    uint32_t o = 8;
+    while (o + 4 <= body_len) {
+        uint16_t code = PcapMmapGet16(f, body + o);
+        uint16_t len = PcapMmapGet16(f, body + o + 2);
+
+        if (code == PCAPNG_OPT_ENDOFOPT || o + 4 + len > body_len)
+            break;
+
+        if (code == PCAPNG_OPT_IF_TSRESOL && len >= 1) {
+            uint8_t res = body[o + 4];
+            uint64_t units = 1;
+            uint8_t i;
+
+            if (res & 0x80) {
+                res &= 0x7f;
+                units = 1ULL << (res > 63 ? 63 : res);
+            } else {
+                for (i = 0; i < res && i < 19; i++)
+                    units *= 10;
+            }
+            iface->ts_units = units;
+        }
+        o += 4 + ((len + 3) & ~3);
+    }
+
+    if (f->iface_cnt == 0 && f->datalink == -1) {
+        f->datalink = iface->datalink;
+    } else if (iface->datalink != f->datalink) {
+        SCLogError(SC_ERR_UNIMPLEMENTED, "pcapng interfaces with different "
+                   "datalink types (%d and %d) are not supported",
+                   f->datalink, iface->datalink);
+        return -1;
+    }
+
+    f->iface_cnt++;
+    return 0;
+}
+
+/**
+ * \brief get the next packet from a pcapng file, skipping the blocks
+ *        that don't hold packets
+ */
+static int PcapMmapNextPcapng(PcapMmapFile *f, PcapMmapPacket *pkt)
+{
+    while (f->offset < f->size) {
+        uint8_t *block = f->map + f->offset;
+
+        if (f->size - f->offset < 12) {
+            SCLogError(SC_ERR_PCAP_DISPATCH, "truncated pcapng block at "
+                       "offset %"PRIu64, f->offset);
+            return -1;
+        }
+
+        uint32_t type = PcapMmapGet32(f, block);
+        if (type == PCAPNG_BLOCK_SHB) {
+            /* a new section may come with a new byte order and
+             * new interfaces */
+            uint32_t bom;
+            memcpy(&bom, block + 8, sizeof(bom));
+            if (bom == PCAPNG_BOM) {
+                f->swapped = 0;
+            } else if (bom == PCAPNG_BOM_SWAPPED) {
+                f->swapped = 1;
+            } else {
+                SCLogError(SC_ERR_PCAP_DISPATCH, "invalid pcapng byte order "
+                           "magic at offset %"PRIu64, f->offset);
+                return -1;
+            }
+            f->iface_cnt = 0;
+        }
+
+        uint32_t block_len = PcapMmapGet32(f, block + 4);
+        if (block_len < 12 || (block_len & 3) || block_len > f->size - f->offset) {
+            SCLogError(SC_ERR_PCAP_DISPATCH, "invalid pcapng block length %"PRIu32
+                       " at offset %"PRIu64, block_len, f->offset);
+            return -1;
+        }
+
+        uint8_t *body = block + 8;
+        uint32_t body_len = block_len - 12;
+        PcapMmapIface *iface;
+        uint64_t ts;
+
+        f->offset += block_len;
+
+        switch (type) {
+            case PCAPNG_BLOCK_IDB:
+                if (PcapMmapParseIdb(f, body, body_len) < 0)
+                    return -1;
+                break;
+            case PCAPNG_BLOCK_EPB:
+                if (body_len < 20 || PcapMmapGet32(f, body) >= f->iface_cnt) {
+                    SCLogError(SC_ERR_PCAP_DISPATCH, "invalid pcapng packet "
+                               "block before offset %"PRIu64, f->offset);
+                    return -1;
+                }
+                iface = &f->ifaces[PcapMmapGet32(f, body)];
+                ts = ((uint64_t)PcapMmapGet32(f, body + 4) << 32) |
+                    PcapMmapGet32(f, body + 8);
+                PcapMmapTsConvert(ts, iface->ts_units, &pkt->ts);
+                f->last_ts = pkt->ts;
+
+                pkt->caplen = PcapMmapGet32(f, body + 12);
+                pkt->len = PcapMmapGet32(f, body + 16);
+                pkt->data = body + 20;
+                if (pkt->caplen > body_len - 20) {
+                    SCLogError(SC_ERR_PCAP_DISPATCH, "truncated pcapng packet "
+                               "block before offset %"PRIu64, f->offset);
+                    return -1;
+                }
+                return 1;
+            case PCAPNG_BLOCK_SPB:
+                if (body_len < 4 || f->iface_cnt == 0) {
+                    SCLogError(SC_ERR_PCAP_DISPATCH, "invalid pcapng simple "
+                               "packet block before offset %"PRIu64, f->offset);
+                    return -1;
+                }
+                /* no timestamp in simple packet blocks */
+                pkt->ts = f->last_ts;
+                pkt->len = PcapMmapGet32(f, body);
+                pkt->caplen = pkt->len < body_len - 4 ? pkt->len : body_len - 4;
+                pkt->data = body + 4;
+                return 1;
+            default:
+                break;
+        }
+    }
+
+    return 0;
+}
+
+static int PcapMmapNextPcap(PcapMmapFile *f, PcapMmapPacket *pkt)
+{
+    if (f->offset == f->size)
+        return 0;
+
+    uint8_t *rec = f->map + f->offset;
+    if (f->size - f->offset < PCAP_REC_HDR_LEN) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "truncated pcap record header at "
+                   "offset %"PRIu64, f->offset);
+        return -1;
+    }
+
+    pkt->ts.tv_sec = PcapMmapGet32(f, rec);
+    pkt->ts.tv_usec = PcapMmapGet32(f, rec + 4);
+    if (f->nsec)
+        pkt->ts.tv_usec /= 1000;
+    pkt->caplen = PcapMmapGet32(f, rec + 8);
+    pkt->len = PcapMmapGet32(f, rec + 12);
+    pkt->data = rec + PCAP_REC_HDR_LEN;
+
+    if (pkt->caplen > f->size - f->offset - PCAP_REC_HDR_LEN) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "truncated pcap record at "
+                   "offset %"PRIu64, f->offset);
+        return -1;
+    }
+
+    f->offset += PCAP_REC_HDR_LEN + pkt->caplen;
+    return 1;
+}
+
+/**
+ * \brief get the next packet of the file
+ *
+ * \param pkt filled with the packet, its data points into the mapping
+ *
+ * \retval 1 packet returned
+ * \retval 0 end of file
+ * \retval -1 invalid or truncated file
+ */
+int PcapMmapNext(PcapMmapFile *f, PcapMmapPacket *pkt)
+{
+    int r;
+
+    if (f->format == PCAP_MMAP_FORMAT_PCAPNG)
+        r = PcapMmapNextPcapng(f, pkt);
+    else
+        r = PcapMmapNextPcap(f, pkt);
+
+    if (r == 1) {
+        if (unlikely(pkt->caplen > PCAP_MMAP_MAX_CAPLEN)) {
+            /* like libpcap, keep reading and hand over what fits */
+            if (f->truncated++ == 0) {
+                SCLogWarning(SC_WARN_UNCOMMON, "packet of %"PRIu32" bytes is "
+                             "too large, truncating it and the other packets "
+                             "over %u bytes", pkt->caplen, PCAP_MMAP_MAX_CAPLEN);
+            }
+            pkt->caplen = PCAP_MMAP_MAX_CAPLEN;
+        }
+        PcapMmapReadAhead(f);
+    }
+    return r;
+}
+
+/**
+ * \brief set up the reader for a file in memory and parse its header
+ *
+ * \retval 0 ok, -1 not a pcap or pcapng file
+ */
+static int PcapMmapInit(PcapMmapFile *f, uint8_t *buf, uint64_t size, int mapped)
+{
+    uint32_t magic;
+
+    memset(f, 0x00, sizeof(*f));
+    f->map = buf;
+    f->size = size;
+    f->mapped = mapped;
+    /* only a mapping can be read ahead */
+    f->advised = mapped ? 0 : size;
+    f->datalink = -1;
+    SC_ATOMIC_INIT(f->ref);
+
+    if (size < 4) {
+        SCLogError(SC_ERR_PCAP_DISPATCH, "file too short for a pcap header");
+        return -1;
+    }
+    memcpy(&magic, buf, sizeof(magic));
+
+    switch (magic) {
+        case PCAP_MAGIC_NSEC_SWAPPED:
+            f->swapped = 1;
+            /* fall through */
+        case PCAP_MAGIC_NSEC:
+            f->nsec = 1;
+            break;
+        case PCAP_MAGIC_SWAPPED:
+            f->swapped = 1;
+            break;
+        case PCAP_MAGIC:
+            break;
+        case PCAPNG_BLOCK_SHB:
+            f->format = PCAP_MMAP_FORMAT_PCAPNG;
+            break;
+        default:
+            SCLogError(SC_ERR_PCAP_DISPATCH, "unknown file format, magic %08x",
+                       magic);
+            return -1;
+    }
+
+    if (f->format == PCAP_MMAP_FORMAT_PCAP) {
+        if (size < PCAP_FILE_HDR_LEN) {
+            SCLogError(SC_ERR_PCAP_DISPATCH, "file too short for a pcap header");
+            return -1;
+        }
+        /* upper bits may hold FCS information */
+        f->datalink = PcapMmapGet32(f, buf + 20) & 0x03ffffff;
+        f->offset = PCAP_FILE_HDR_LEN;
+        return 0;
+    }
+
+    /* pcapng: the datalink is in the first interface block, go through the
+     * blocks up to there and then start over */
+    PcapMmapPacket pkt;
+    while (f->iface_cnt == 0) {
+        int r = PcapMmapNextPcapng(f, &pkt);
+        if (r < 0)
+            return -1;
+        if (r == 0 && f->iface_cnt == 0) {
+            SCLogError(SC_ERR_PCAP_DISPATCH, "no interface block before the "
+                       "first packet of pcapng file");
+            return -1;
+        }
+    }
+    f->offset = 0;
+    f->iface_cnt = 0;
+    return 0;
+}
+
+/**
+ * \brief map a pcap or pcapng file
+ *
+ * \retval f file with one reference held by the caller, NULL on error
+ */
+PcapMmapFile *PcapMmapOpen(const char *path)
+{
+    struct stat st;
+    uint8_t *map;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1) {
+        SCLogError(SC_ERR_FOPEN, "failed to stat %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        SCLogError(SC_ERR_FOPEN, "can't map %s of %"PRIuMAX" bytes", path,
+                   (uintmax_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    /* read only, so the mapping isn't counted against the memory commit
+     * limit and files larger than ram and swap can be mapped. The packet
+     * data is never written to: only the IPS runmodes modify packets. */
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* the mapping keeps the file open */
+    close(fd);
+    if (map == MAP_FAILED) {
+        SCLogError(SC_ERR_MEM_ALLOC, "failed to mmap %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    (void)madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    PcapMmapFile *f = SCMalloc(sizeof(PcapMmapFile));
+    if (unlikely(f == NULL)) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    if (PcapMmapInit(f, map, (uint64_t)st.st_size, 1) < 0) {
+        munmap(map, (size_t)st.st_size);
+        SCFree(f);
+        return NULL;
+    }
+    PcapMmapReadAhead(f);
+
+    (void)SC_ATOMIC_ADD(f->ref, 1);
+    return f;
+}
+
+void PcapMmapRef(PcapMmapFile *f)
+{
+    (void)SC_ATOMIC_ADD(f->ref, 1);
+}
+
+/**
+ * \brief drop a reference, the last one unmaps the file
+ */
+void PcapMmapDeref(PcapMmapFile *f)
+{
+    if (SC_ATOMIC_SUB(f->ref, 1) == 0) {
+        if (f->mapped)
+            munmap(f->map, (size_t)f->size);
+        SC_ATOMIC_DESTROY(f->ref);
+        SCFree(f);
+    }
+}
+
+#ifdef UNITTESTS
+
+/* pcap file, little endian, usec, ethernet, two packets */
+static uint8_t pcap_le[] = {
+    0xd4, 0xc3, 0xb2, 0xa1, 0x02, 0x00, 0x04, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xff, 0xff, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+    /* record 1: 100.000002, 4 of 60 bytes */
+    0x64, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x04, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00,
+    0x01, 0x02, 0x03, 0x04,
+    /* record 2: 101.000003, 2 of 2 bytes */
+    0x65, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x05, 0x06,
+};
+
+static int PcapMmapTest01(void)
+{
+    PcapMmapFile f;
+    PcapMmapPacket pkt;
+    int result = 0;
+
+    if (PcapMmapInit(&f, pcap_le, sizeof(pcap_le), 0) != 0)
+        goto end;
+    if (f.format != PCAP_MMAP_FORMAT_PCAP || f.datalink != 1)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 100 || pkt.ts.tv_usec != 2 || pkt.caplen != 4 ||
+            pkt.len != 60 || pkt.data != pcap_le + 40 || pkt.data[3] != 0x04)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 101 || pkt.ts.tv_usec != 3 || pkt.caplen != 2 ||
+            pkt.data[1] != 0x06)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    return result;
+}
+
+/* pcap file, big endian, nsec, raw, one packet */
+static uint8_t pcap_be_nsec[] = {
+    0xa1, 0xb2, 0x3c, 0x4d, 0x00, 0x02, 0x00, 0x04,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x65,
+    /* 200.123456789 */
+    0x00, 0x00, 0x00, 0xc8, 0x07, 0x5b, 0xcd, 0x15,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x45,
+};
+
+static int PcapMmapTest02(void)
+{
+    PcapMmapFile f;
+    PcapMmapPacket pkt;
+    int result = 0;
+
+    if (PcapMmapInit(&f, pcap_be_nsec, sizeof(pcap_be_nsec), 0) != 0)
+        goto end;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (f.swapped != 1)
+        goto end;
+#endif
+    if (f.nsec != 1 || f.datalink != 101)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 200 || pkt.ts.tv_usec != 123456 ||
+            pkt.caplen != 1 || pkt.data[0] != 0x45)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    return result;
+}
+
+/* pcapng, little endian: SHB, IDB with nsec resolution, EPB, unknown
+ * block, EPB */
+static uint8_t pcapng_le[] = {
+    /* SHB, 28 bytes */
+    0x0a, 0x0d, 0x0d, 0x0a, 0x1c, 0x00, 0x00, 0x00,
+    0x4d, 0x3c, 0x2b, 0x1a, 0x01, 0x00, 0x00, 0x00,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0x1c, 0x00, 0x00, 0x00,
+    /* IDB, 32 bytes, ethernet, if_tsresol 9 */
+    0x01, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x09, 0x00, 0x01, 0x00, 0x09, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00,
+    /* EPB, 36 bytes, ts 1000000001500 ns, 3 bytes */
+    0x06, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xe8, 0x00, 0x00, 0x00,
+    0xdc, 0x15, 0xa5, 0xd4, 0x03, 0x00, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x00, 0xaa, 0xbb, 0xcc, 0x00,
+    0x24, 0x00, 0x00, 0x00,
+    /* unknown block, 16 bytes */
+    0x0b, 0x0b, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00,
+    /* EPB, 36 bytes, ts 1000000002500 ns, 4 bytes */
+    0x06, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xe8, 0x00, 0x00, 0x00,
+    0xc4, 0x19, 0xa5, 0xd4, 0x04, 0x00, 0x00, 0x00,
+    0x04, 0x00, 0x00, 0x00, 0x11, 0x22, 0x33, 0x44,
+    0x24, 0x00, 0x00, 0x00,
+};
+
+static int PcapMmapTest03(void)
+{
+    PcapMmapFile f;
+    PcapMmapPacket pkt;
+    int result = 0;
+
+    if (PcapMmapInit(&f, pcapng_le, sizeof(pcapng_le), 0) != 0)
+        goto end;
+    if (f.format != PCAP_MMAP_FORMAT_PCAPNG || f.datalink != 1 || f.offset != 0)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 1000 || pkt.ts.tv_usec != 1 || pkt.caplen != 3 ||
+            pkt.data[0] != 0xaa || pkt.data[2] != 0xcc)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 1000 || pkt.ts.tv_usec != 2 || pkt.caplen != 4 ||
+            pkt.data[3] != 0x44)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    return result;
+}
+
+/** \test truncated record is an error, not end of file */
+static int PcapMmapTest04(void)
+{
+    PcapMmapFile f;
+    PcapMmapPacket pkt;
+    int result = 0;
+
+    if (PcapMmapInit(&f, pcap_le, sizeof(pcap_le) - 1, 0) != 0)
+        goto end;
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (PcapMmapNext(&f, &pkt) != -1)
+        goto end;
+
+    /* pcapng without interface block */
+    if (PcapMmapInit(&f, pcapng_le, 28, 0) != -1)
+        goto end;
+
+    result = 1;
+end:
+    return result;
+}
+
+/** \test a record too large for the decoders is cut and reading goes on */
+static int PcapMmapTest05(void)
+{
+    PcapMmapFile f;
+    PcapMmapPacket pkt;
+    int result = 0;
+    uint32_t big = PCAP_MMAP_MAX_CAPLEN + 100;
+    uint32_t size = PCAP_FILE_HDR_LEN + 2 * PCAP_REC_HDR_LEN + big + 2;
+
+    uint8_t *buf = SCMalloc(size);
+    if (buf == NULL)
+        return 0;
+    memset(buf, 0x00, size);
+
+    /* file header and the second record of pcap_le */
+    memcpy(buf, pcap_le, PCAP_FILE_HDR_LEN);
+    memcpy(buf + PCAP_FILE_HDR_LEN + PCAP_REC_HDR_LEN + big,
+           pcap_le + PCAP_FILE_HDR_LEN + PCAP_REC_HDR_LEN + 4,
+           PCAP_REC_HDR_LEN + 2);
+    /* first record: caplen and len of big */
+    uint8_t *rec = buf + PCAP_FILE_HDR_LEN;
+    memcpy(rec + 8, &big, sizeof(big));
+    memcpy(rec + 12, &big, sizeof(big));
+
+    if (PcapMmapInit(&f, buf, size, 0) != 0)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.caplen != PCAP_MMAP_MAX_CAPLEN || pkt.len != big ||
+            f.truncated != 1)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 1)
+        goto end;
+    if (pkt.ts.tv_sec != 101 || pkt.caplen != 2 || pkt.data[1] != 0x06)
+        goto end;
+
+    if (PcapMmapNext(&f, &pkt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    SCFree(buf);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void PcapMmapRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PcapMmapTest01", PcapMmapTest01, 1);
+    UtRegisterTest("PcapMmapTest02", PcapMmapTest02, 1);
+    UtRegisterTest("PcapMmapTest03", PcapMmapTest03, 1);
+    UtRegisterTest("PcapMmapTest04", PcapMmapTest04, 1);
+    UtRegisterTest("PcapMmapTest05", PcapMmapTest05, 1);
+#endif /* UNITTESTS */
+}
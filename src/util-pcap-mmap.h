@@ -0,0 +1,95 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Memory mapped pcap and pcapng file reader.
+ */
+
+#ifndef __UTIL_PCAP_MMAP_H__
+#define __UTIL_PCAP_MMAP_H__
+
+#include "util-atomic.h"
+
+/** size of the read-ahead window requested with madvise */
+#define PCAP_MMAP_READAHEAD (16 * 1024 * 1024)
+
+/** largest packet we can hand to the decoders, larger ones are cut */
+#define PCAP_MMAP_MAX_CAPLEN 65535
+
+/** max number of pcapng interfaces we keep track of */
+#define PCAP_MMAP_MAX_IFACES 32
+
+enum {
+    PCAP_MMAP_FORMAT_PCAP,
+    PCAP_MMAP_FORMAT_PCAPNG,
+};
+
+typedef struct PcapMmapIface_ {
+    int datalink;
+    /** timestamp units per second */
+    uint64_t ts_units;
+} PcapMmapIface;
+
+typedef struct PcapMmapFile_ {
+    uint8_t *map;
+    uint64_t size;
+    /** map is a mmap of the file, not a memory buffer */
+    int mapped;
+    /** offset of the next record */
+    uint64_t offset;
+    /** end of the region madvise'd for read-ahead */
+    uint64_t advised;
+
+    int format;
+    /** file is in the other byte order */
+    int swapped;
+    /** datalink of the file, for pcapng the one of the first interface */
+    int datalink;
+
+    /** pcap: nanosecond timestamps */
+    int nsec;
+
+    /** pcapng: interfaces of the current section */
+    PcapMmapIface ifaces[PCAP_MMAP_MAX_IFACES];
+    uint32_t iface_cnt;
+    /** pcapng: timestamp of the last packet, for simple packet blocks */
+    struct timeval last_ts;
+
+    /** no of packets cut to PCAP_MMAP_MAX_CAPLEN */
+    uint64_t truncated;
+
+    /** one reference for the reader and one per packet pointing into
+     *  the mapping */
+    SC_ATOMIC_DECLARE(unsigned int, ref);
+} PcapMmapFile;
+
+typedef struct PcapMmapPacket_ {
+    struct timeval ts;
+    uint8_t *data;      /**< read only, points into the mapping */
+    uint32_t caplen;
+    uint32_t len;
+} PcapMmapPacket;
+
+PcapMmapFile *PcapMmapOpen(const char *);
+int PcapMmapNext(PcapMmapFile *, PcapMmapPacket *);
+void PcapMmapRef(PcapMmapFile *);
+void PcapMmapDeref(PcapMmapFile *);
+void PcapMmapRegisterTests(void);
+
+#endif /* __UTIL_PCAP_MMAP_H__ */
@@ -742,6 +742,43 @@ retry:
     return ptr;
 }
 
+/**
+ *  \brief get up to cnt ptrs from the ring buffer with a single CAS
+ *
+ *  Like RingBufferMrMwGetNoWait, but takes a range of entries at once.
+ *  The entries are copied out before the read idx is moved past them, so
+ *  no writer can overwrite them while we copy.
+ *
+ *  \param rb the ringbuffer
+ *  \param ptrs array to store the ptrs in
+ *  \param cnt max number of ptrs to get
+ *
+ *  \retval n number of ptrs stored in ptrs, 0 if the buffer is empty
+ */
+uint16_t RingBufferMrMwGetBulkNoWait(RingBuffer16 *rb, void **ptrs, uint16_t cnt) {
+    unsigned short readp;
+    unsigned short avail;
+    uint16_t i;
+
+    do {
+        readp = SC_ATOMIC_GET(rb->read);
+        avail = (unsigned short)(SC_ATOMIC_GET(rb->write) - readp);
+        if (avail == 0)
+            return 0;
+        if (avail > cnt)
+            avail = cnt;
+
+        for (i = 0; i < avail; i++) {
+            ptrs[i] = rb->array[(unsigned short)(readp + i)];
+        }
+    } while (!(SC_ATOMIC_CAS(&rb->read, readp, (unsigned short)(readp + avail))));
+
+#ifdef RINGBUFFER_MUTEX_WAIT
+    SCCondSignal(&rb->wait_cond);
+#endif
+    return avail;
+}
+
 /**
  *  \brief put a ptr in the RingBuffer.
  *
@@ -795,6 +832,50 @@ retry:
     return 0;
 }
 
+/**
+ *  \brief put cnt ptrs in the RingBuffer, taking the write lock once.
+ *
+ *  \param rb the ringbuffer
+ *  \param ptrs ptrs to store
+ *  \param cnt number of ptrs in ptrs
+ *
+ *  \retval 0 ok
+ *  \retval -1 wait loop interrupted because of engine flags
+ */
+int RingBufferMrMwPutBulk(RingBuffer16 *rb, void **ptrs, uint16_t cnt) {
+    uint16_t i;
+
+    /* buffer is too full, wait... */
+retry:
+    while ((unsigned short)(SC_ATOMIC_GET(rb->read) - SC_ATOMIC_GET(rb->write) - 1) < cnt) {
+        /* break out if the engine wants to shutdown */
+        if (rb->shutdown != 0)
+            return -1;
+
+        RingBufferDoWait(rb);
+    }
+
+    /* get our lock */
+    SCSpinLock(&rb->spin);
+    /* if while we got our lock the buffer changed, we need to retry */
+    if ((unsigned short)(SC_ATOMIC_GET(rb->read) - SC_ATOMIC_GET(rb->write) - 1) < cnt) {
+        SCSpinUnlock(&rb->spin);
+        goto retry;
+    }
+
+    /* update the ring buffer */
+    for (i = 0; i < cnt; i++) {
+        rb->array[(unsigned short)(SC_ATOMIC_GET(rb->write) + i)] = ptrs[i];
+    }
+    (void) SC_ATOMIC_ADD(rb->write, cnt);
+    SCSpinUnlock(&rb->spin);
+
+#ifdef RINGBUFFER_MUTEX_WAIT
+    SCCondSignal(&rb->wait_cond);
+#endif
+    return 0;
+}
+
 #ifdef UNITTESTS
 static int RingBuffer8SrSwInit01 (void) {
     int result = 0;
@@ -1039,6 +1120,64 @@ end:
     return result;
 }
 
+/** \test bulk get and put, wrapping around the end of the array */
+static int RingBufferMrMwBulk01 (void) {
+    int result = 0;
+    void *ptrs[64];
+    void *out[64];
+    int array[64];
+    uint16_t cnt;
+
+    RingBuffer16 *rb = RingBufferInit();
+    if (rb == NULL) {
+        printf("rb == NULL: ");
+        goto end;
+    }
+
+    /* start close to the end of the array so the bulk ops wrap */
+    (void)SC_ATOMIC_SET(rb->write, 65530);
+    (void)SC_ATOMIC_SET(rb->read, 65530);
+
+    for (cnt = 0; cnt < 64; cnt++)
+        ptrs[cnt] = &array[cnt];
+
+    if (RingBufferMrMwPutBulk(rb, ptrs, 64) != 0) {
+        printf("put failed: ");
+        goto end;
+    }
+    if (RingBufferSize(rb) != 64) {
+        printf("size %u, expected 64: ", RingBufferSize(rb));
+        goto end;
+    }
+
+    if (RingBufferMrMwGetBulkNoWait(rb, out, 48) != 48) {
+        printf("expected 48 ptrs: ");
+        goto end;
+    }
+    /* only 16 left */
+    if (RingBufferMrMwGetBulkNoWait(rb, out + 48, 48) != 16) {
+        printf("expected 16 ptrs: ");
+        goto end;
+    }
+    for (cnt = 0; cnt < 64; cnt++) {
+        if (out[cnt] != ptrs[cnt]) {
+            printf("ptr %u is %p, expected %p: ", cnt, out[cnt], ptrs[cnt]);
+            goto end;
+        }
+    }
+    if (RingBufferMrMwGetBulkNoWait(rb, out, 48) != 0 || !(RingBufferIsEmpty(rb))) {
+        printf("ringbuffer should be empty, isn't: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (rb != NULL) {
+        RingBufferDestroy(rb);
+    }
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectRingBufferRegisterTests(void) {
@@ -1048,6 +1187,7 @@ void DetectRingBufferRegisterTests(void) {
     UtRegisterTest("RingBuffer8SrSwPut02", RingBuffer8SrSwPut02, 1);
     UtRegisterTest("RingBuffer8SrSwGet01", RingBuffer8SrSwGet01, 1);
     UtRegisterTest("RingBuffer8SrSwGet02", RingBuffer8SrSwGet02, 1);
+    UtRegisterTest("RingBufferMrMwBulk01", RingBufferMrMwBulk01, 1);
 #endif /* UNITTESTS */
 }
 
@@ -125,7 +125,9 @@ int RingBufferMrMw8Put(RingBuffer8 *, void *);
  *  wrap around */
 void *RingBufferMrMwGet(RingBuffer16 *);
 void *RingBufferMrMwGetNoWait(RingBuffer16 *);
+uint16_t RingBufferMrMwGetBulkNoWait(RingBuffer16 *, void **, uint16_t);
 int RingBufferMrMwPut(RingBuffer16 *, void *);
+int RingBufferMrMwPutBulk(RingBuffer16 *, void **, uint16_t);
 
 void *RingBufferSrMw8Get(RingBuffer8 *);
 int RingBufferSrMw8Put(RingBuffer8 *, void *);
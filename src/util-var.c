@@ -43,13 +43,6 @@ void GenericVarFree(GenericVar *gv) {
     GenericVar *next_gv = gv->next;
 
     switch (gv->type) {
-        case DETECT_FLOWBITS:
-        {
-            FlowBit *fb = (FlowBit *)gv;
-            //printf("GenericVarFree: fb %p, removing\n", fb);
-            FlowBitFree(fb);
-            break;
-        }
         case DETECT_FLOWALERTSID:
         {
             FlowAlertSid *fb = (FlowAlertSid *)gv;